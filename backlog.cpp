@@ -0,0 +1,410 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "backlog.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The flag in the length of a datagram that says it is packed,
+// and the rest, the number of bytes stored
+#define ENTRY_FLAG_PACKED 0x8000
+#define ENTRY_SIZE_MASK 0x7FFF
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// The fewest bits that hold all of the bytes of a chunk
+// as signed values, 0 if they are all zero
+static int chunkWidth(const char * pChunk, int size)
+{
+    int magnitudes = 0;
+    bool allZero = true;
+    int width = 0;
+    int8_t value;
+
+    for (int x = 0; x < size; x++) {
+        value = (int8_t) pChunk[x];
+        magnitudes |= (value < 0) ? ~value : value;
+        if (value != 0) {
+            allZero = false;
+        }
+    }
+    if (!allZero) {
+        // One bit for the sign
+        width = 1;
+        while (magnitudes > 0) {
+            width++;
+            magnitudes >>= 1;
+        }
+    }
+
+    return width;
+}
+
+// Pack a chunk into pOut: a byte giving the width and then each byte
+// cut down to that many bits, least significant first, returning the
+// number of bytes in pOut
+static int packChunk(const char * pChunk, int size, char * pOut)
+{
+    int width = chunkWidth(pChunk, size);
+    uint32_t mask = (1UL << width) - 1;
+    uint32_t bits = 0;
+    int numBits = 0;
+    int numBytes = 1;
+
+    pOut[0] = (char) width;
+    for (int x = 0; x < size; x++) {
+        bits |= ((uint8_t) pChunk[x] & mask) << numBits;
+        numBits += width;
+        while (numBits >= 8) {
+            pOut[numBytes] = (char) bits;
+            numBytes++;
+            bits >>= 8;
+            numBits -= 8;
+        }
+    }
+    if (numBits > 0) {
+        pOut[numBytes] = (char) bits;
+        numBytes++;
+    }
+
+    return numBytes;
+}
+
+// Unpack the bytes of a chunk, packed at width bits each, into pChunk
+static void unpackChunk(const char * pIn, int width, char * pChunk, int size)
+{
+    uint32_t mask = (1UL << width) - 1;
+    uint32_t bits = 0;
+    uint32_t value;
+    int numBits = 0;
+
+    for (int x = 0; x < size; x++) {
+        while (numBits < width) {
+            bits |= (uint32_t) (uint8_t) *pIn << numBits;
+            pIn++;
+            numBits += 8;
+        }
+        value = bits & mask;
+        bits >>= width;
+        numBits -= width;
+        // Put the sign back
+        if ((width > 0) && ((value & (1UL << (width - 1))) != 0)) {
+            value |= ~mask;
+        }
+        pChunk[x] = (char) value;
+    }
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Constructor
+Backlog::Backlog()
+{
+    _pStorage = NULL;
+    _storageSize = 0;
+    _datagramSize = 0;
+    _numCursors = 0;
+    _pack = false;
+    _writeIndex = 0;
+    _writeOffset = 0;
+    _numHeldMax = 0;
+    _numBytesFreeMin = 0;
+    _numBytesWritten = 0;
+    _numBytesStored = 0;
+    memset(_readIndex, 0, sizeof(_readIndex));
+    memset(_readOffset, 0, sizeof(_readOffset));
+    memset(_numOverruns, 0, sizeof(_numOverruns));
+}
+
+// Set up the backlog
+void Backlog::init(char * pStorage, int storageSize, int datagramSize, int numCursors, bool pack)
+{
+    _pStorage = pStorage;
+    _storageSize = storageSize;
+    _datagramSize = datagramSize;
+    _numCursors = numCursors;
+    if (_numCursors > BACKLOG_MAX_NUM_CURSORS) {
+        _numCursors = BACKLOG_MAX_NUM_CURSORS;
+    }
+    _pack = pack;
+    _writeIndex = 0;
+    _writeOffset = 0;
+    _numHeldMax = 0;
+    _numBytesFreeMin = storageSize;
+    _numBytesWritten = 0;
+    _numBytesStored = 0;
+    memset(_readIndex, 0, sizeof(_readIndex));
+    memset(_readOffset, 0, sizeof(_readOffset));
+    memset(_numOverruns, 0, sizeof(_numOverruns));
+}
+
+// Add a datagram
+void Backlog::write(const char * pDatagram)
+{
+    char chunk[BACKLOG_PACK_CHUNK_SIZE + 1];
+    char header[BACKLOG_ENTRY_HEADER_SIZE];
+    int size = _datagramSize;
+    int count;
+    bool packed = false;
+    int entrySize;
+    uint32_t oldestIndex;
+    int oldestOffset;
+    int offset;
+
+    if ((_pStorage == NULL) || (_datagramSize > ENTRY_SIZE_MASK)) {
+        return;
+    }
+
+    // Work out what it packs down to, without packing it yet
+    if (_pack) {
+        size = 0;
+        for (int x = 0; x < _datagramSize; x += count) {
+            count = (_datagramSize - x < BACKLOG_PACK_CHUNK_SIZE) ? _datagramSize - x : BACKLOG_PACK_CHUNK_SIZE;
+            size += 1 + (count * chunkWidth(pDatagram + x, count) + 7) / 8;
+        }
+        packed = (size < _datagramSize);
+        if (!packed) {
+            size = _datagramSize;
+        }
+    }
+    entrySize = BACKLOG_ENTRY_HEADER_SIZE + size;
+    if (entrySize > _storageSize) {
+        return;
+    }
+
+    // Anyone whose oldest datagram is in the way has to move on
+    while (_storageSize - getNumBytesUsed() < entrySize) {
+        oldestOffset = getOldestOffset();
+        oldestIndex = _writeIndex - getNumHeld();
+        offset = (oldestOffset + getEntrySize(oldestOffset)) % _storageSize;
+        for (int x = 0; x < _numCursors; x++) {
+            if (_readIndex[x] == oldestIndex) {
+                _readIndex[x]++;
+                _readOffset[x] = offset;
+                _numOverruns[x]++;
+            }
+        }
+    }
+
+    header[0] = (char) (((packed ? ENTRY_FLAG_PACKED : 0) | size) >> 8);
+    header[1] = (char) size;
+    offset = put(_writeOffset, header, sizeof(header));
+    if (packed) {
+        for (int x = 0; x < _datagramSize; x += count) {
+            count = (_datagramSize - x < BACKLOG_PACK_CHUNK_SIZE) ? _datagramSize - x : BACKLOG_PACK_CHUNK_SIZE;
+            offset = put(offset, chunk, packChunk(pDatagram + x, count, chunk));
+        }
+    } else {
+        offset = put(offset, pDatagram, _datagramSize);
+    }
+    _writeOffset = offset;
+    _writeIndex++;
+
+    _numBytesWritten += _datagramSize;
+    _numBytesStored += entrySize;
+    if (getNumHeld() > _numHeldMax) {
+        _numHeldMax = getNumHeld();
+    }
+    if (_storageSize - getNumBytesUsed() < _numBytesFreeMin) {
+        _numBytesFreeMin = _storageSize - getNumBytesUsed();
+    }
+}
+
+// Copy out the oldest datagram for a cursor
+bool Backlog::read(int cursor, char * pBuffer, uint32_t * pIndex)
+{
+    char chunk[BACKLOG_PACK_CHUNK_SIZE];
+    char header[BACKLOG_ENTRY_HEADER_SIZE];
+    int offset;
+    int width;
+    int count;
+    bool success = false;
+
+    if ((cursor < _numCursors) && (_readIndex[cursor] != _writeIndex)) {
+        offset = get(_readOffset[cursor], header, sizeof(header));
+        if ((((uint8_t) header[0] << 8) & ENTRY_FLAG_PACKED) != 0) {
+            for (int x = 0; x < _datagramSize; x += count) {
+                count = (_datagramSize - x < BACKLOG_PACK_CHUNK_SIZE) ? _datagramSize - x : BACKLOG_PACK_CHUNK_SIZE;
+                offset = get(offset, chunk, 1);
+                width = (uint8_t) chunk[0];
+                offset = get(offset, chunk, (count * width + 7) / 8);
+                unpackChunk(chunk, width, pBuffer + x, count);
+            }
+        } else {
+            get(offset, pBuffer, _datagramSize);
+        }
+        if (pIndex != NULL) {
+            *pIndex = _readIndex[cursor];
+        }
+        success = true;
+    }
+
+    return success;
+}
+
+// Move a cursor on
+void Backlog::advance(int cursor, uint32_t index)
+{
+    if ((cursor < _numCursors) && ((int32_t) (index - _readIndex[cursor]) >= 0) &&
+        ((int32_t) (_writeIndex - index) > 0)) {
+        // Step over each datagram on the way
+        while (_readIndex[cursor] != index + 1) {
+            _readOffset[cursor] = (_readOffset[cursor] + getEntrySize(_readOffset[cursor])) % _storageSize;
+            _readIndex[cursor]++;
+        }
+    }
+}
+
+// Get the number of datagrams waiting for a cursor
+int Backlog::getNumWaiting(int cursor)
+{
+    int numWaiting = 0;
+
+    if (cursor < _numCursors) {
+        numWaiting = _writeIndex - _readIndex[cursor];
+    }
+
+    return numWaiting;
+}
+
+// Get the number of datagrams a cursor has missed
+unsigned int Backlog::getNumOverruns(int cursor)
+{
+    unsigned int numOverruns = 0;
+
+    if (cursor < _numCursors) {
+        numOverruns = _numOverruns[cursor];
+    }
+
+    return numOverruns;
+}
+
+// Get the number of datagrams held: as many as the
+// cursor furthest behind is waiting for
+int Backlog::getNumHeld()
+{
+    int numHeld = 0;
+
+    for (int x = 0; x < _numCursors; x++) {
+        if (getNumWaiting(x) > numHeld) {
+            numHeld = getNumWaiting(x);
+        }
+    }
+
+    return numHeld;
+}
+
+// Get the high-water mark of datagrams held
+int Backlog::getNumHeldMax()
+{
+    return _numHeldMax;
+}
+
+// Get the number of bytes in use
+int Backlog::getNumBytesUsed()
+{
+    int numBytesUsed = 0;
+
+    if (getNumHeld() > 0) {
+        // Held datagrams can't fill the ring exactly, as the oldest
+        // would then start where the next is to be written
+        numBytesUsed = (_writeOffset - getOldestOffset() + _storageSize) % _storageSize;
+        if (numBytesUsed == 0) {
+            numBytesUsed = _storageSize;
+        }
+    }
+
+    return numBytesUsed;
+}
+
+// Get the low-water mark of free bytes
+int Backlog::getNumBytesFreeMin()
+{
+    return _numBytesFreeMin;
+}
+
+// Get how well datagrams have packed
+int Backlog::getStoredPercent()
+{
+    return (_numBytesWritten > 0) ? (int) (_numBytesStored * 100 / _numBytesWritten) : 0;
+}
+
+/* ----------------------------------------------------------------
+ * PROTECTED FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Get the offset of the oldest datagram held, that of the
+// cursor furthest behind
+int Backlog::getOldestOffset()
+{
+    int oldestOffset = _writeOffset;
+    int numWaiting = 0;
+
+    for (int x = 0; x < _numCursors; x++) {
+        if (getNumWaiting(x) > numWaiting) {
+            numWaiting = getNumWaiting(x);
+            oldestOffset = _readOffset[x];
+        }
+    }
+
+    return oldestOffset;
+}
+
+// Get the number of bytes stored for a datagram, length included
+int Backlog::getEntrySize(int offset)
+{
+    char header[BACKLOG_ENTRY_HEADER_SIZE];
+
+    get(offset, header, sizeof(header));
+
+    return BACKLOG_ENTRY_HEADER_SIZE + ((((uint8_t) header[0] << 8) | (uint8_t) header[1]) & ENTRY_SIZE_MASK);
+}
+
+// Copy into the ring, wrapping at the end
+int Backlog::put(int offset, const char * pBuf, int size)
+{
+    int count = _storageSize - offset;
+
+    if (count > size) {
+        count = size;
+    }
+    memcpy(_pStorage + offset, pBuf, count);
+    memcpy(_pStorage, pBuf + count, size - count);
+
+    return (offset + size) % _storageSize;
+}
+
+// Copy out of the ring, wrapping at the end
+int Backlog::get(int offset, char * pBuf, int size)
+{
+    int count = _storageSize - offset;
+
+    if (count > size) {
+        count = size;
+    }
+    memcpy(pBuf, _pStorage + offset, count);
+    memcpy(pBuf + count, _pStorage, size - count);
+
+    return (offset + size) % _storageSize;
+}
@@ -0,0 +1,142 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A store of fixed-size datagrams, written once and read by several
+ * readers, each with its own cursor, so that the same coded audio can
+ * be sent to more than one destination.
+ *
+ * The storage is a ring of bytes rather than of fixed-size slots: each
+ * datagram takes a two byte length and then only as many bytes as it
+ * packs down to, so audio that packs well (quiet passages, silence)
+ * lets the same storage hold more seconds.  A datagram is packed 16
+ * bytes at a time, each chunk stored as a byte giving the fewest bits
+ * that hold all of its bytes as signed values, followed by the bytes
+ * cut down to that many bits; a chunk of zeroes takes one byte.  A
+ * datagram that doesn't get any smaller is stored as it is.
+ *
+ * Every datagram written is given an index, one more than the last.
+ * Space is only reused once all cursors have moved past it, except
+ * that when the store is full the cursors furthest behind are pushed
+ * on so that a slow reader never holds up the writer or the other
+ * readers; the datagrams a cursor misses this way are counted as
+ * overruns.
+ *
+ * There is no locking in here: the caller must make sure that only one
+ * call is made at a time.  Datagrams are copied out, rather than
+ * pointed to, so that a slot may be reused while the copy is being sent.
+ * Nothing here depends on mbed so that the host tools can use it too.
+ */
+
+#ifndef _BACKLOG_H_
+#define _BACKLOG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The maximum number of cursors
+#ifndef BACKLOG_MAX_NUM_CURSORS
+# define BACKLOG_MAX_NUM_CURSORS 4
+#endif
+
+// The number of bytes of a datagram packed together
+#define BACKLOG_PACK_CHUNK_SIZE 16
+
+// The size of the length stored with each datagram
+#define BACKLOG_ENTRY_HEADER_SIZE 2
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+class Backlog {
+public:
+    Backlog();
+
+    // Set up the backlog in storageSize bytes at pStorage, packing
+    // datagrams of datagramSize bytes (no more than 32767) if pack is
+    // true.  All cursors start at the next datagram written.
+    void init(char * pStorage, int storageSize, int datagramSize, int numCursors, bool pack = true);
+
+    // Add a datagram, pushing on the cursors furthest behind
+    // until there is room for it
+    void write(const char * pDatagram);
+
+    // Copy the oldest datagram that a cursor has not yet passed into
+    // pBuffer, returning false if there is none; if pIndex is not
+    // NULL the index of the datagram is written there
+    bool read(int cursor, char * pBuffer, uint32_t * pIndex = NULL);
+
+    // Move a cursor past the datagram with the given index, unless
+    // it has already been pushed past it
+    void advance(int cursor, uint32_t index);
+
+    // Get the number of datagrams waiting for a cursor
+    int getNumWaiting(int cursor);
+
+    // Get the number of datagrams a cursor has missed
+    unsigned int getNumOverruns(int cursor);
+
+    // Get the number of datagrams held, those that any
+    // cursor has yet to pass
+    int getNumHeld();
+
+    // Get the most datagrams there have been held at once
+    int getNumHeldMax();
+
+    // Get the number of bytes in use
+    int getNumBytesUsed();
+
+    // Get the smallest number of free bytes there have been
+    int getNumBytesFreeMin();
+
+    // Get the bytes stored for all the datagrams written, lengths
+    // included, as a percentage of the bytes written
+    int getStoredPercent();
+
+protected:
+    // Get the offset of the oldest datagram held
+    int getOldestOffset();
+
+    // Get the number of bytes stored for the datagram at offset
+    int getEntrySize(int offset);
+
+    // Copy size bytes into the ring at offset, returning the offset after
+    int put(int offset, const char * pBuf, int size);
+
+    // Copy size bytes out of the ring at offset, returning the offset after
+    int get(int offset, char * pBuf, int size);
+
+    char * _pStorage;
+    int _storageSize;
+    int _datagramSize;
+    int _numCursors;
+    bool _pack;
+    uint32_t _writeIndex;
+    int _writeOffset;
+    uint32_t _readIndex[BACKLOG_MAX_NUM_CURSORS];
+    int _readOffset[BACKLOG_MAX_NUM_CURSORS];
+    unsigned int _numOverruns[BACKLOG_MAX_NUM_CURSORS];
+    int _numHeldMax;
+    int _numBytesFreeMin;
+    uint64_t _numBytesWritten;
+    uint64_t _numBytesStored;
+};
+
+#endif // _BACKLOG_H_
@@ -0,0 +1,263 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "datagram.h"
+#include "clocksync.h"
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Turn a time request into a response
+int timeRespond(char * pBuf, int size, uint64_t t2Us, uint64_t t3Us)
+{
+    if ((size < TIME_DATAGRAM_SIZE) || ((unsigned char) pBuf[0] != TIME_SYNC_BYTE) ||
+        (pBuf[TIME_TYPE_OFFSET] != TIME_REQUEST)) {
+        return -1;
+    }
+
+    pBuf[TIME_TYPE_OFFSET] = TIME_RESPONSE;
+    datagramSetUint64(pBuf + TIME_T2_OFFSET, t2Us);
+    datagramSetUint64(pBuf + TIME_T3_OFFSET, t3Us);
+
+    return TIME_DATAGRAM_SIZE;
+}
+
+// Get the offset from a time request
+bool timeGetOffset(const char * pBuf, int size, int64_t * pOffsetUs)
+{
+    if ((size < TIME_DATAGRAM_SIZE) || ((unsigned char) pBuf[0] != TIME_SYNC_BYTE) ||
+        ((pBuf[TIME_FLAGS_OFFSET] & TIME_FLAG_OFFSET_VALID) == 0)) {
+        return false;
+    }
+
+    *pOffsetUs = (int64_t) datagramGetUint64(pBuf + TIME_OFFSET_OFFSET);
+
+    return true;
+}
+
+// Add the drift to a time request
+void timeSetDrift(char * pBuf, int driftPpb)
+{
+    pBuf[TIME_FLAGS_OFFSET] |= TIME_FLAG_DRIFT_VALID;
+    datagramSetUint32(pBuf + TIME_DRIFT_OFFSET, (uint32_t) driftPpb);
+}
+
+// Get the drift from a time request
+bool timeGetDrift(const char * pBuf, int size, int * pDriftPpb)
+{
+    if ((size < TIME_DATAGRAM_SIZE) || ((unsigned char) pBuf[0] != TIME_SYNC_BYTE) ||
+        ((pBuf[TIME_FLAGS_OFFSET] & TIME_FLAG_DRIFT_VALID) == 0)) {
+        return false;
+    }
+
+    *pDriftPpb = (int) (int32_t) datagramGetUint32(pBuf + TIME_DRIFT_OFFSET);
+
+    return true;
+}
+
+// Constructor
+ClockSync::ClockSync()
+{
+    init();
+}
+
+// Forget everything
+void ClockSync::init()
+{
+    memset(_offsetUs, 0, sizeof(_offsetUs));
+    memset(_delayUs, 0, sizeof(_delayUs));
+    _next = 0;
+    _count = 0;
+    _best = -1;
+    _numExchanges = 0;
+}
+
+// Make a time request
+int ClockSync::makeRequest(char * pBuf, uint64_t nowUs)
+{
+    memset(pBuf, 0, TIME_DATAGRAM_SIZE);
+    pBuf[0] = TIME_SYNC_BYTE;
+    pBuf[TIME_TYPE_OFFSET] = TIME_REQUEST;
+    datagramSetUint64(pBuf + TIME_T1_OFFSET, nowUs);
+    if (_best >= 0) {
+        pBuf[TIME_FLAGS_OFFSET] = TIME_FLAG_OFFSET_VALID;
+        datagramSetUint64(pBuf + TIME_OFFSET_OFFSET, (uint64_t) _offsetUs[_best]);
+    }
+
+    return TIME_DATAGRAM_SIZE;
+}
+
+// Take in a time response
+bool ClockSync::handleResponse(const char * pBuf, int size, uint64_t t4Us)
+{
+    int64_t t1;
+    int64_t t2;
+    int64_t t3;
+    int64_t delay;
+
+    if ((size < TIME_DATAGRAM_SIZE) || ((unsigned char) pBuf[0] != TIME_SYNC_BYTE) ||
+        (pBuf[TIME_TYPE_OFFSET] != TIME_RESPONSE)) {
+        return false;
+    }
+
+    t1 = (int64_t) datagramGetUint64(pBuf + TIME_T1_OFFSET);
+    t2 = (int64_t) datagramGetUint64(pBuf + TIME_T2_OFFSET);
+    t3 = (int64_t) datagramGetUint64(pBuf + TIME_T3_OFFSET);
+    delay = ((int64_t) t4Us - t1) - (t3 - t2);
+    // A response from before we started, or one that has been
+    // mangled, is no use
+    if ((t1 > (int64_t) t4Us) || (t3 < t2) || (delay < 0) || (delay > 0x7FFFFFFF)) {
+        return false;
+    }
+
+    _offsetUs[_next] = ((t2 - t1) + (t3 - (int64_t) t4Us)) / 2;
+    _delayUs[_next] = (int) delay;
+    _next++;
+    if (_next >= CLOCK_SYNC_NUM_SAMPLES) {
+        _next = 0;
+    }
+    if (_count < CLOCK_SYNC_NUM_SAMPLES) {
+        _count++;
+    }
+    _numExchanges++;
+
+    // Believe the exchange with the shortest round trip
+    _best = 0;
+    for (int x = 1; x < _count; x++) {
+        if (_delayUs[x] < _delayUs[_best]) {
+            _best = x;
+        }
+    }
+
+    return true;
+}
+
+// True if there is an estimate
+bool ClockSync::isValid()
+{
+    return (_best >= 0);
+}
+
+// Get the offset
+int64_t ClockSync::getOffsetUs()
+{
+    return (_best >= 0) ? _offsetUs[_best] : 0;
+}
+
+// Get the round trip
+int ClockSync::getDelayUs()
+{
+    return (_best >= 0) ? _delayUs[_best] : -1;
+}
+
+// Get the number of exchanges
+unsigned int ClockSync::getNumExchanges()
+{
+    return _numExchanges;
+}
+
+// Constructor
+LatencyHistogram::LatencyHistogram()
+{
+    _pBins = NULL;
+    _numBins = 0;
+    _binWidthUs = 1;
+    _count = 0;
+    _maxUs = -1;
+}
+
+// Set up the histogram
+void LatencyHistogram::init(uint32_t * pBins, int numBins, int binWidthUs)
+{
+    _pBins = pBins;
+    _numBins = numBins;
+    _binWidthUs = (binWidthUs > 0) ? binWidthUs : 1;
+    reset();
+}
+
+// Empty the histogram
+void LatencyHistogram::reset()
+{
+    if (_pBins != NULL) {
+        memset(_pBins, 0, _numBins * sizeof(_pBins[0]));
+    }
+    _count = 0;
+    _maxUs = -1;
+}
+
+// Add a latency
+void LatencyHistogram::add(int latencyUs)
+{
+    int bin;
+
+    if (_numBins > 0) {
+        if (latencyUs < 0) {
+            latencyUs = 0;
+        }
+        bin = latencyUs / _binWidthUs;
+        if (bin >= _numBins) {
+            bin = _numBins - 1;
+        }
+        _pBins[bin]++;
+        _count++;
+        if (latencyUs > _maxUs) {
+            _maxUs = latencyUs;
+        }
+    }
+}
+
+// Get a percentile
+int LatencyHistogram::getPercentileUs(int percent)
+{
+    unsigned int target;
+    unsigned int sum = 0;
+    int latencyUs = -1;
+
+    if (_count > 0) {
+        target = (unsigned int) (((uint64_t) _count * percent + 99) / 100);
+        if (target < 1) {
+            target = 1;
+        }
+        for (int x = 0; (x < _numBins) && (latencyUs < 0); x++) {
+            sum += _pBins[x];
+            if (sum >= target) {
+                // The top of the bin, which is no better than the
+                // worst that was actually seen
+                latencyUs = (x + 1) * _binWidthUs;
+                if ((x == _numBins - 1) || (latencyUs > _maxUs)) {
+                    latencyUs = _maxUs;
+                }
+            }
+        }
+    }
+
+    return latencyUs;
+}
+
+// Get the worst latency
+int LatencyHistogram::getMaxUs()
+{
+    return _maxUs;
+}
+
+// Get the number added
+unsigned int LatencyHistogram::getCount()
+{
+    return _count;
+}
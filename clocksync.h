@@ -0,0 +1,149 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Lining up the board's clock with the server's so that the timestamp
+ * in each URTP datagram, the time the audio in it was captured, can be
+ * turned into an end-to-end latency at the server.
+ *
+ * The exchange is the one NTP uses: the board sends a time request at
+ * t1, the server stamps it on arrival (t2) and again as it sends it
+ * back (t3) and the board notes when the response arrives (t4).  Then
+ *
+ *   offset = ((t2 - t1) + (t3 - t4)) / 2
+ *   delay  = (t4 - t1) - (t3 - t2)
+ *
+ * where offset is the server's clock minus the board's and delay is
+ * the round trip spent in the network.  The offset is only as good as
+ * the two directions are symmetric, which they are most nearly when
+ * the delay is smallest, so of the last few exchanges the one with the
+ * smallest delay is believed.  The board passes its estimate to the
+ * server in each request so that the server can do the sums.
+ *
+ * Also here is a histogram for latencies that gives percentiles in
+ * fixed memory.  Times are supplied by the caller, which keeps this
+ * independent of mbed so that the host tools can use it too.
+ */
+
+#ifndef _CLOCKSYNC_H_
+#define _CLOCKSYNC_H_
+
+#include <stdint.h>
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The number of exchanges that the offset estimate is drawn from
+#ifndef CLOCK_SYNC_NUM_SAMPLES
+# define CLOCK_SYNC_NUM_SAMPLES 8
+#endif
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Turn a time request into a response in place, for the server,
+// returning the size of the response or -1 if pBuf does not
+// hold a time request
+int timeRespond(char * pBuf, int size, uint64_t t2Us, uint64_t t3Us);
+
+// Get the offset the board has passed on in a time request,
+// returning false if there is none
+bool timeGetOffset(const char * pBuf, int size, int64_t * pOffsetUs);
+
+// Add the drift of the board's sample clock to a time request
+void timeSetDrift(char * pBuf, int driftPpb);
+
+// Get the drift of the board's sample clock from a time request,
+// returning false if there is none
+bool timeGetDrift(const char * pBuf, int size, int * pDriftPpb);
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+// The board's side of the exchange
+class ClockSync {
+public:
+    ClockSync();
+
+    // Forget everything
+    void init();
+
+    // Write a time request into pBuf, which must be at least
+    // TIME_DATAGRAM_SIZE long, returning its size
+    int makeRequest(char * pBuf, uint64_t nowUs);
+
+    // Take in a time response that arrived at t4Us, returning
+    // true if it was a good one
+    bool handleResponse(const char * pBuf, int size, uint64_t t4Us);
+
+    // True once there is an estimate of the offset
+    bool isValid();
+
+    // Get the server's clock minus ours
+    int64_t getOffsetUs();
+
+    // Get the round trip of the exchange the offset came from
+    int getDelayUs();
+
+    // Get the number of good exchanges so far
+    unsigned int getNumExchanges();
+
+protected:
+    int64_t _offsetUs[CLOCK_SYNC_NUM_SAMPLES];
+    int _delayUs[CLOCK_SYNC_NUM_SAMPLES];
+    int _next;
+    int _count;
+    int _best;
+    unsigned int _numExchanges;
+};
+
+// Percentiles of a latency, kept in bins of a fixed width;
+// anything beyond the last bin is counted in it
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    // Set up with numBins bins of storage, each binWidthUs wide
+    void init(uint32_t * pBins, int numBins, int binWidthUs);
+
+    // Empty the histogram
+    void reset();
+
+    // Add a latency; a negative one (e.g. before the clocks
+    // have settled) counts as zero
+    void add(int latencyUs);
+
+    // Get the latency that percent of those added were no worse
+    // than, to the width of a bin, or -1 if there are none
+    int getPercentileUs(int percent);
+
+    // Get the worst latency added, or -1 if there are none
+    int getMaxUs();
+
+    // Get the number of latencies added
+    unsigned int getCount();
+
+protected:
+    uint32_t * _pBins;
+    int _numBins;
+    int _binWidthUs;
+    unsigned int _count;
+    int _maxUs;
+};
+
+#endif // _CLOCKSYNC_H_
@@ -0,0 +1,182 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The fields of the URTP header that the send path needs to read or
+ * write, and the layout of the control datagrams that are exchanged
+ * with the server alongside the URTP stream.
+ *
+ * The URTP header is:
+ *
+ *   byte  0:      sync byte (0x5A)
+ *   byte  1:      audio coding scheme
+ *   bytes 2-3:    sequence number, big-endian
+ *   bytes 4-11:   timestamp, big-endian
+ *   bytes 12-13:  number of bytes of audio, big-endian
+ *
+ * Control datagrams begin with a sync byte of their own so that the
+ * server can tell them apart from URTP datagrams.  Nothing here
+ * depends on mbed so that the host tools can use it too.
+ */
+
+#ifndef _DATAGRAM_H_
+#define _DATAGRAM_H_
+
+#include <stdint.h>
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The URTP sync byte
+#ifndef URTP_SYNC_BYTE
+# define URTP_SYNC_BYTE 0x5a
+#endif
+
+// The size of the URTP header
+#ifndef URTP_HEADER_SIZE
+# define URTP_HEADER_SIZE 14
+#endif
+
+// Offset of the sequence number in a URTP datagram
+#ifndef URTP_SEQUENCE_NUMBER_OFFSET
+# define URTP_SEQUENCE_NUMBER_OFFSET 2
+#endif
+
+// Offset of the timestamp in a URTP datagram
+#ifndef URTP_TIMESTAMP_OFFSET
+# define URTP_TIMESTAMP_OFFSET 4
+#endif
+
+// Sync byte of a NACK datagram, sent by the server to ask for
+// datagrams to be sent again.  The layout is:
+//
+//   byte  0:      NACK_SYNC_BYTE
+//   byte  1:      number of sequence numbers that follow, N
+//   bytes 2...:   N sequence numbers, each two bytes big-endian
+#define NACK_SYNC_BYTE 0x5b
+
+// The header size of a NACK datagram
+#define NACK_HEADER_SIZE 2
+
+// The maximum number of sequence numbers in one NACK datagram
+#define NACK_MAX_SEQUENCE_NUMBERS 32
+
+// The maximum size of a NACK datagram
+#define NACK_MAX_SIZE (NACK_HEADER_SIZE + NACK_MAX_SEQUENCE_NUMBERS * 2)
+
+// Sync byte of a time datagram, exchanged to line the board's clock
+// up with the server's (see clocksync.h).  All times are in
+// microseconds, big-endian, and the layout is:
+//
+//   byte  0:      TIME_SYNC_BYTE
+//   byte  1:      TIME_REQUEST (board to server) or TIME_RESPONSE
+//   byte  2:      flags, TIME_FLAG_OFFSET_VALID if bytes 12-19 hold
+//                 the board's current estimate of the offset and
+//                 TIME_FLAG_DRIFT_VALID if bytes 36-39 hold the drift
+//   byte  3:      reserved
+//   bytes 4-11:   t1, the board's time when the request was sent
+//   bytes 12-19:  the server's clock minus the board's, signed
+//   bytes 20-27:  t2, the server's time when the request arrived
+//   bytes 28-35:  t3, the server's time when the response was sent
+//   bytes 36-39:  how fast the board's sample clock runs against the
+//                 server's clock, in parts per billion, signed
+//
+// The server returns the request with byte 1, t2 and t3 filled in.
+#define TIME_SYNC_BYTE 0x5d
+
+// The types of time datagram
+#define TIME_REQUEST 0
+#define TIME_RESPONSE 1
+
+// The flags of a time datagram
+#define TIME_FLAG_OFFSET_VALID 0x01
+#define TIME_FLAG_DRIFT_VALID 0x02
+
+// Offsets of the fields of a time datagram
+#define TIME_TYPE_OFFSET 1
+#define TIME_FLAGS_OFFSET 2
+#define TIME_T1_OFFSET 4
+#define TIME_OFFSET_OFFSET 12
+#define TIME_T2_OFFSET 20
+#define TIME_T3_OFFSET 28
+#define TIME_DRIFT_OFFSET 36
+
+// The size of a time datagram
+#define TIME_DATAGRAM_SIZE 40
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Read a big-endian 16 bit value
+static inline int datagramGetUint16(const char * pBuf)
+{
+    return (((int) (unsigned char) pBuf[0]) << 8) | (unsigned char) pBuf[1];
+}
+
+// Write a big-endian 16 bit value
+static inline void datagramSetUint16(char * pBuf, int value)
+{
+    pBuf[0] = (char) (value >> 8);
+    pBuf[1] = (char) value;
+}
+
+// Read a big-endian 32 bit value
+static inline uint32_t datagramGetUint32(const char * pBuf)
+{
+    return (((uint32_t) datagramGetUint16(pBuf)) << 16) | (uint32_t) datagramGetUint16(pBuf + 2);
+}
+
+// Write a big-endian 32 bit value
+static inline void datagramSetUint32(char * pBuf, uint32_t value)
+{
+    datagramSetUint16(pBuf, (int) (value >> 16));
+    datagramSetUint16(pBuf + 2, (int) (value & 0xFFFF));
+}
+
+// Read a big-endian 64 bit value
+static inline uint64_t datagramGetUint64(const char * pBuf)
+{
+    return (((uint64_t) datagramGetUint32(pBuf)) << 32) | (uint64_t) datagramGetUint32(pBuf + 4);
+}
+
+// Write a big-endian 64 bit value
+static inline void datagramSetUint64(char * pBuf, uint64_t value)
+{
+    datagramSetUint32(pBuf, (uint32_t) (value >> 32));
+    datagramSetUint32(pBuf + 4, (uint32_t) value);
+}
+
+// Get the sequence number of a URTP datagram
+static inline int urtpGetSequenceNumber(const char * pDatagram)
+{
+    return datagramGetUint16(pDatagram + URTP_SEQUENCE_NUMBER_OFFSET);
+}
+
+// Get the timestamp of a URTP datagram
+static inline uint64_t urtpGetTimestamp(const char * pDatagram)
+{
+    return datagramGetUint64(pDatagram + URTP_TIMESTAMP_OFFSET);
+}
+
+// Return the difference a - b between two 16 bit sequence
+// numbers, allowing for wrap
+static inline int sequenceNumberDiff(int a, int b)
+{
+    return (int) (int16_t) (uint16_t) (a - b);
+}
+
+#endif // _DATAGRAM_H_
@@ -0,0 +1,160 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "dnscache.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Marker at the start of a saved cache file
+#define DNS_CACHE_FILE_MAGIC 0x444e5343UL
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Constructor
+DnsCache::DnsCache()
+{
+    init(0);
+}
+
+// Empty the cache
+void DnsCache::init(int ttlSeconds)
+{
+    _ttlSeconds = ttlSeconds;
+    memset(_entries, 0, sizeof(_entries));
+}
+
+// Get the address for a name
+bool DnsCache::get(const char * pName, char * pAddress, uint32_t nowSeconds,
+                   bool * pExpired)
+{
+    Entry * pEntry = find(pName);
+
+    if (pEntry != NULL) {
+        strcpy(pAddress, pEntry->address);
+        if (pExpired != NULL) {
+            // Compare the difference so that the time may wrap
+            *pExpired = ((int32_t) (pEntry->expirySeconds - nowSeconds) <= 0);
+        }
+    }
+
+    return (pEntry != NULL);
+}
+
+// Add or update the address for a name
+void DnsCache::put(const char * pName, const char * pAddress, uint32_t nowSeconds)
+{
+    Entry * pEntry = find(pName);
+    Entry * pOldest = &(_entries[0]);
+
+    if ((strlen(pName) < sizeof(pEntry->name)) &&
+        (strlen(pAddress) < sizeof(pEntry->address))) {
+        if (pEntry == NULL) {
+            // Use a free entry or, failing that, the one
+            // which expires soonest
+            for (int x = 0; (x < DNS_CACHE_MAX_NUM_ENTRIES) && (pEntry == NULL); x++) {
+                if (!_entries[x].valid) {
+                    pEntry = &(_entries[x]);
+                } else if ((int32_t) (_entries[x].expirySeconds - pOldest->expirySeconds) < 0) {
+                    pOldest = &(_entries[x]);
+                }
+            }
+            if (pEntry == NULL) {
+                pEntry = pOldest;
+            }
+            strcpy(pEntry->name, pName);
+        }
+        strcpy(pEntry->address, pAddress);
+        pEntry->expirySeconds = nowSeconds + _ttlSeconds;
+        pEntry->valid = true;
+    }
+}
+
+// Check if a name should be looked up again
+bool DnsCache::needsRefresh(const char * pName, uint32_t nowSeconds, int marginSeconds)
+{
+    Entry * pEntry = find(pName);
+
+    return (pEntry == NULL) ||
+           ((int32_t) (pEntry->expirySeconds - nowSeconds) <= marginSeconds);
+}
+
+// Save the cache to a file
+bool DnsCache::save(const char * pFileName)
+{
+    bool success = false;
+    uint32_t magic = DNS_CACHE_FILE_MAGIC;
+    FILE * pFile = fopen(pFileName, "wb");
+
+    if (pFile != NULL) {
+        success = (fwrite(&magic, sizeof(magic), 1, pFile) == 1) &&
+                  (fwrite(_entries, sizeof(_entries), 1, pFile) == 1);
+        fclose(pFile);
+    }
+
+    return success;
+}
+
+// Load the cache from a file
+bool DnsCache::load(const char * pFileName, uint32_t nowSeconds)
+{
+    bool success = false;
+    uint32_t magic = 0;
+    FILE * pFile = fopen(pFileName, "rb");
+
+    if (pFile != NULL) {
+        if ((fread(&magic, sizeof(magic), 1, pFile) == 1) &&
+            (magic == DNS_CACHE_FILE_MAGIC) &&
+            (fread(_entries, sizeof(_entries), 1, pFile) == 1)) {
+            for (int x = 0; x < DNS_CACHE_MAX_NUM_ENTRIES; x++) {
+                // Don't trust what came off the disk too far
+                _entries[x].name[sizeof(_entries[x].name) - 1] = 0;
+                _entries[x].address[sizeof(_entries[x].address) - 1] = 0;
+                _entries[x].expirySeconds = nowSeconds;
+            }
+            success = true;
+        } else {
+            memset(_entries, 0, sizeof(_entries));
+        }
+        fclose(pFile);
+    }
+
+    return success;
+}
+
+/* ----------------------------------------------------------------
+ * PROTECTED FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Find the entry for a name
+DnsCache::Entry * DnsCache::find(const char * pName)
+{
+    Entry * pEntry = NULL;
+
+    for (int x = 0; (x < DNS_CACHE_MAX_NUM_ENTRIES) && (pEntry == NULL); x++) {
+        if (_entries[x].valid && (strcmp(_entries[x].name, pName) == 0)) {
+            pEntry = &(_entries[x]);
+        }
+    }
+
+    return pEntry;
+}
@@ -0,0 +1,97 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A small cache of host name to IP address (as a string) mappings,
+ * so that a reconnect need not wait for a DNS round trip.
+ *
+ * An entry is fresh for a time-to-live after it was put in; after
+ * that it may still be used while a new look-up is made.  The cache
+ * can be saved to and loaded from a file so that it survives a reset;
+ * since the age of a loaded entry is not known it is loaded as
+ * expired.
+ *
+ * Times are in seconds, supplied by the caller, which keeps this
+ * independent of mbed.
+ */
+
+#ifndef _DNSCACHE_H_
+#define _DNSCACHE_H_
+
+#include <stdint.h>
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The number of names that can be cached
+#ifndef DNS_CACHE_MAX_NUM_ENTRIES
+# define DNS_CACHE_MAX_NUM_ENTRIES 4
+#endif
+
+// The longest host name that can be cached, including terminator
+#ifndef DNS_CACHE_MAX_NAME_SIZE
+# define DNS_CACHE_MAX_NAME_SIZE 64
+#endif
+
+// Room for an IPV6 address string, including terminator
+#define DNS_CACHE_MAX_ADDRESS_SIZE 40
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+class DnsCache {
+public:
+    DnsCache();
+
+    // Empty the cache and set the time-to-live of new entries
+    void init(int ttlSeconds);
+
+    // Get the address for a name into pAddress (which must be
+    // DNS_CACHE_MAX_ADDRESS_SIZE bytes long), returning false if
+    // there is none.  If pExpired is not NULL it is set to true
+    // when the entry is past its time-to-live.
+    bool get(const char * pName, char * pAddress, uint32_t nowSeconds,
+             bool * pExpired = NULL);
+
+    // Add or update the address for a name
+    void put(const char * pName, const char * pAddress, uint32_t nowSeconds);
+
+    // True if the name is missing or will expire within marginSeconds
+    bool needsRefresh(const char * pName, uint32_t nowSeconds, int marginSeconds);
+
+    // Save the cache to a file
+    bool save(const char * pFileName);
+
+    // Load the cache from a file, all entries being expired
+    bool load(const char * pFileName, uint32_t nowSeconds);
+
+protected:
+    typedef struct {
+        bool valid;
+        char name[DNS_CACHE_MAX_NAME_SIZE];
+        char address[DNS_CACHE_MAX_ADDRESS_SIZE];
+        uint32_t expirySeconds;
+    } Entry;
+
+    // Find the entry for a name, or NULL
+    Entry * find(const char * pName);
+
+    int _ttlSeconds;
+    Entry _entries[DNS_CACHE_MAX_NUM_ENTRIES];
+};
+
+#endif // _DNSCACHE_H_
@@ -0,0 +1,80 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include "drift.h"
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Constructor
+DriftEstimator::DriftEstimator()
+{
+    init(0);
+}
+
+// Forget everything
+void DriftEstimator::init(int64_t minSpanUs)
+{
+    _minSpanUs = minSpanUs;
+    _numPoints = 0;
+    _firstXUs = 0;
+    _lastXUs = 0;
+    _meanX = 0;
+    _meanY = 0;
+    _sumXX = 0;
+    _sumXY = 0;
+}
+
+// Add a point
+void DriftEstimator::add(int64_t xUs, int64_t yUs)
+{
+    double x;
+    double dx;
+
+    if (_numPoints == 0) {
+        _firstXUs = xUs;
+    }
+    _lastXUs = xUs;
+    _numPoints++;
+
+    // Relative to the first point, to keep the doubles small
+    x = (double) (xUs - _firstXUs);
+    dx = x - _meanX;
+    _meanX += dx / _numPoints;
+    _meanY += ((double) yUs - _meanY) / _numPoints;
+    _sumXX += dx * (x - _meanX);
+    _sumXY += dx * ((double) yUs - _meanY);
+}
+
+// True if the estimate can be believed
+bool DriftEstimator::isValid()
+{
+    return (_numPoints > 1) && (_lastXUs - _firstXUs >= _minSpanUs) && (_sumXX > 0);
+}
+
+// Get the drift
+int DriftEstimator::getPpb()
+{
+    return isValid() ? (int) (_sumXY / _sumXX * 1000000000.0) : 0;
+}
+
+// Get the number of points
+unsigned int DriftEstimator::getNumPoints()
+{
+    return _numPoints;
+}
@@ -0,0 +1,74 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* An estimate of how fast one clock runs against another.
+ *
+ * The caller supplies points where x is a time on one clock and y is
+ * how far the other clock is from it at that moment (e.g. x is when a
+ * DMA event should have happened at the nominal sample rate and y is
+ * how much later than that it did happen).  The drift is the slope of
+ * the least-squares line through the points, in parts per billion:
+ * how many nanoseconds y gains for each second of x.  Interrupt latency
+ * and network jitter make the individual points noisy but they don't
+ * accumulate, while drift does, so the estimate gets better the longer
+ * it runs.
+ *
+ * The sums are kept in the numerically stable form (Welford's) since
+ * x may run to hours in microseconds.  Nothing here depends on mbed so
+ * that the host tools can use it too.
+ */
+
+#ifndef _DRIFT_H_
+#define _DRIFT_H_
+
+#include <stdint.h>
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+class DriftEstimator {
+public:
+    DriftEstimator();
+
+    // Forget everything; the estimate is only believed once
+    // the points span minSpanUs of x
+    void init(int64_t minSpanUs);
+
+    // Add a point
+    void add(int64_t xUs, int64_t yUs);
+
+    // True once the points span enough of x
+    bool isValid();
+
+    // Get the drift in parts per billion, 0 if it isn't yet valid
+    int getPpb();
+
+    // Get the number of points added
+    unsigned int getNumPoints();
+
+protected:
+    int64_t _minSpanUs;
+    unsigned int _numPoints;
+    int64_t _firstXUs;
+    int64_t _lastXUs;
+    double _meanX;
+    double _meanY;
+    double _sumXX;
+    double _sumXY;
+};
+
+#endif // _DRIFT_H_
@@ -0,0 +1,161 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "fastppp.h"
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// Buffers for the loopback test
+static char gLoopbackSent[FAST_PPP_MAX_LOOPBACK_BYTES];
+static char gLoopbackReceived[FAST_PPP_MAX_LOOPBACK_BYTES];
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Constructor
+FastPPPCellularInterface::FastPPPCellularInterface(PinName tx, PinName rx,
+                                                   int baud, bool debug_on)
+                         :UbloxPPPCellularInterface(tx, rx, baud, debug_on)
+{
+    _initialBaud = baud;
+    _uartBaud = baud;
+    _hasFlowControl = false;
+}
+
+// Find the highest rate that works
+int FastPPPCellularInterface::negotiateBaud(const int * pRates, int numRates,
+                                            bool flowControl, int loopbackBytes)
+{
+    int lastGoodBaud;
+
+#if DEVICE_SERIAL_FC
+    if (flowControl && !_hasFlowControl && _at->send("AT&K3") && _at->recv("OK")) {
+        getUart()->set_flow_control(SerialBase::RTSCTS, MDMRTS, MDMCTS);
+        _hasFlowControl = true;
+    }
+#endif
+
+    for (int x = 0; x < numRates; x++) {
+        if (pRates[x] > _uartBaud) {
+            lastGoodBaud = _uartBaud;
+            if (!setBaud(pRates[x])) {
+                break;
+            }
+            if (!loopback(loopbackBytes)) {
+                // Back to the last one that worked and stop there
+                setBaud(lastGoodBaud);
+                break;
+            }
+        }
+    }
+
+    return _uartBaud;
+}
+
+// Send a line of known bytes with echo on and check
+// that they come back, followed by the modem's ERROR
+bool FastPPPCellularInterface::loopback(int numBytes)
+{
+    const char hex[] = "0123456789ABCDEF";
+    bool success = false;
+
+    if (numBytes > FAST_PPP_MAX_LOOPBACK_BYTES) {
+        numBytes = FAST_PPP_MAX_LOOPBACK_BYTES;
+    }
+    if (numBytes < 3) {
+        numBytes = 3;
+    }
+
+    gLoopbackSent[0] = 'A';
+    gLoopbackSent[1] = 'T';
+    for (int x = 2; x < numBytes; x++) {
+        gLoopbackSent[x] = hex[x & 0x0F];
+    }
+
+    _at->flush();
+    if (_at->send("ATE1") && _at->recv("OK")) {
+        _at->flush();
+        if ((_at->write(gLoopbackSent, numBytes) == numBytes) && (_at->write("\r", 1) == 1) &&
+            (_at->read(gLoopbackReceived, numBytes) == numBytes) &&
+            (memcmp(gLoopbackSent, gLoopbackReceived, numBytes) == 0)) {
+            success = _at->recv("ERROR");
+        }
+        _at->flush();
+        _at->send("ATE0") && _at->recv("OK");
+    }
+
+    return success;
+}
+
+// Get the rate in use
+int FastPPPCellularInterface::getBaud()
+{
+    return _uartBaud;
+}
+
+// Check for flow control
+bool FastPPPCellularInterface::hasFlowControl()
+{
+    return _hasFlowControl;
+}
+
+// Put things back as they were and deinit
+void FastPPPCellularInterface::deinit()
+{
+    if (_uartBaud != _initialBaud) {
+        setBaud(_initialBaud);
+    }
+#if DEVICE_SERIAL_FC
+    if (_hasFlowControl) {
+        _at->send("AT&K0") && _at->recv("OK");
+        getUart()->set_flow_control(SerialBase::Disabled);
+        _hasFlowControl = false;
+    }
+#endif
+    UbloxPPPCellularInterface::deinit();
+}
+
+/* ----------------------------------------------------------------
+ * PROTECTED FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Change the rate at both ends
+bool FastPPPCellularInterface::setBaud(int baud)
+{
+    bool success = _at->send("AT+IPR=%d", baud) && _at->recv("OK");
+
+    if (success) {
+        // The modem moves to the new rate once it has sent OK
+        wait_ms(FAST_PPP_SWITCH_DELAY_MS);
+        getUart()->set_baud(baud);
+        _uartBaud = baud;
+        _at->flush();
+    }
+
+    return success;
+}
+
+// The base class only keeps the UART as a FileHandle, but it is
+// always a UARTSerial, made by the base class in baseClassInit()
+// from the pins and rate given to the constructor
+UARTSerial * FastPPPCellularInterface::getUart()
+{
+    return static_cast<UARTSerial *>(_fh);
+}
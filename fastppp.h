@@ -0,0 +1,88 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The PPP cellular interface with the UART to the modem run faster.
+ *
+ * After init() and before connect(), negotiateBaud() switches on RTS/CTS
+ * flow control (AT&K3) and then steps the modem and the UART up through
+ * a list of baud rates (AT+IPR).  At each rate a loopback test is run:
+ * with echo on, a long line of known bytes is sent and must come back
+ * exactly, followed by the modem's ERROR for the nonsense command.  The
+ * first rate to fail is backed out of and the last good one is kept.
+ * deinit() puts the modem and the UART back to the rate they started
+ * at, so that the next init() can talk to the modem.
+ */
+
+#ifndef _FASTPPP_H_
+#define _FASTPPP_H_
+
+#include "mbed.h"
+#include "UbloxPPPCellularInterface.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The largest loopback test
+#define FAST_PPP_MAX_LOOPBACK_BYTES 512
+
+// How long the modem takes to switch rate after its OK to AT+IPR
+#define FAST_PPP_SWITCH_DELAY_MS 100
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+class FastPPPCellularInterface : public UbloxPPPCellularInterface {
+public:
+    FastPPPCellularInterface(PinName tx = MDMTXD, PinName rx = MDMRXD,
+                             int baud = 115200, bool debug_on = false);
+
+    // Switch on flow control, if asked for, and then try each of the
+    // numRates rates in pRates (lowest first), keeping the highest that
+    // passes a loopback test of loopbackBytes; returns the rate in use
+    int negotiateBaud(const int * pRates, int numRates, bool flowControl,
+                      int loopbackBytes);
+
+    // Run a loopback test of numBytes at the current rate
+    bool loopback(int numBytes);
+
+    // Get the rate in use
+    int getBaud();
+
+    // True if RTS/CTS flow control is on
+    bool hasFlowControl();
+
+    // Put the rate back to where it started and deinit the modem;
+    // the base class's deinit() isn't virtual, so this hides it
+    // rather than overriding it: call it through a pointer to this
+    // class (main.cpp's INTERFACE_CLASS), never through a pointer
+    // to a base class, or the rate won't be put back
+    void deinit();
+
+protected:
+    // Send AT+IPR and move the UART to the same rate
+    bool setBaud(int baud);
+
+    // Get the UART to the modem
+    UARTSerial * getUart();
+
+    int _initialBaud;
+    int _uartBaud;
+    bool _hasFlowControl;
+};
+
+#endif // _FASTPPP_H_
@@ -0,0 +1,319 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "datagram.h"
+#include "fec.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Flag in the history/parity info to show that a slot is in use;
+// the history info holds the sequence number in the lower 16 bits
+#define SLOT_VALID 0x80000000UL
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// XOR one buffer into another
+static void xorInto(char * pTo, const char * pFrom, int size)
+{
+    for (int x = 0; x < size; x++) {
+        *(pTo + x) ^= *(pFrom + x);
+    }
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS: FecEncoder
+ * -------------------------------------------------------------- */
+
+// Constructor
+FecEncoder::FecEncoder()
+{
+    _pStorage = NULL;
+    _groupSize = 0;
+    _numParity = 0;
+    _datagramSize = 0;
+    _count = 0;
+    _firstSequenceNumber = 0;
+    _finished = false;
+}
+
+// Set up the encoder
+void FecEncoder::init(char * pStorage, int groupSize, int numParity, int datagramSize)
+{
+    _pStorage = pStorage;
+    _groupSize = groupSize;
+    if (_groupSize > FEC_MAX_GROUP_SIZE) {
+        _groupSize = FEC_MAX_GROUP_SIZE;
+    }
+    _numParity = numParity;
+    if (_numParity > _groupSize) {
+        _numParity = _groupSize;
+    }
+    _datagramSize = datagramSize;
+    clear();
+}
+
+// Check that a datagram carries on from the group so far
+bool FecEncoder::follows(const char * pDatagram)
+{
+    return (_count == 0) ||
+           (sequenceNumberDiff(urtpGetSequenceNumber(pDatagram), _firstSequenceNumber) == _count);
+}
+
+// Add a datagram to the group
+void FecEncoder::add(const char * pDatagram)
+{
+    char * pParity;
+
+    if ((_pStorage != NULL) && !isReady()) {
+        if (_count == 0) {
+            _firstSequenceNumber = urtpGetSequenceNumber(pDatagram);
+        }
+        pParity = _pStorage + (_count % _numParity) * getParitySize();
+        xorInto(pParity + FEC_HEADER_SIZE, pDatagram, _datagramSize);
+        _count++;
+    }
+}
+
+// Check if there's parity to send
+bool FecEncoder::isReady()
+{
+    return (_count > 0) && (_finished || (_count >= _groupSize));
+}
+
+// Cut the group short
+void FecEncoder::finish()
+{
+    _finished = true;
+}
+
+// Get the number of parity datagrams that are ready
+int FecEncoder::getNumParity()
+{
+    int numParity = 0;
+
+    if (isReady()) {
+        // A short group may not reach all of the parity datagrams
+        numParity = _numParity;
+        if (numParity > _count) {
+            numParity = _count;
+        }
+    }
+
+    return numParity;
+}
+
+// Get a parity datagram, filling in its header
+const char * FecEncoder::getParity(int k)
+{
+    char * pParity = NULL;
+
+    if (k < getNumParity()) {
+        pParity = _pStorage + k * getParitySize();
+        *pParity = (char) FEC_SYNC_BYTE;
+        *(pParity + 1) = (char) _count;
+        datagramSetUint16(pParity + 2, _firstSequenceNumber);
+        *(pParity + 4) = (char) _numParity;
+        *(pParity + 5) = (char) k;
+    }
+
+    return pParity;
+}
+
+// Get the size of a parity datagram
+int FecEncoder::getParitySize()
+{
+    return FEC_PARITY_DATAGRAM_SIZE(_datagramSize);
+}
+
+// Start a new group
+void FecEncoder::clear()
+{
+    if (_pStorage != NULL) {
+        memset(_pStorage, 0, _numParity * getParitySize());
+    }
+    _count = 0;
+    _finished = false;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS: FecDecoder
+ * -------------------------------------------------------------- */
+
+// Constructor
+FecDecoder::FecDecoder()
+{
+    _pHistory = NULL;
+    _pHistoryInfo = NULL;
+    _numHistory = 0;
+    _pParity = NULL;
+    _pParityInfo = NULL;
+    _numParity = 0;
+    _nextParity = 0;
+    _datagramSize = 0;
+    _pRecovered = NULL;
+    _pContext = NULL;
+}
+
+// Set up the decoder
+void FecDecoder::init(char * pHistory, uint32_t * pHistoryInfo, int numHistory,
+                      char * pParity, uint32_t * pParityInfo, int numParity,
+                      int datagramSize,
+                      void (*pRecovered) (const char *, void *), void * pContext)
+{
+    _pHistory = pHistory;
+    _pHistoryInfo = pHistoryInfo;
+    _numHistory = numHistory;
+    _pParity = pParity;
+    _pParityInfo = pParityInfo;
+    _numParity = numParity;
+    _nextParity = 0;
+    _datagramSize = datagramSize;
+    _pRecovered = pRecovered;
+    _pContext = pContext;
+    memset(_pHistoryInfo, 0, _numHistory * sizeof (_pHistoryInfo[0]));
+    memset(_pParityInfo, 0, _numParity * sizeof (_pParityInfo[0]));
+}
+
+// A URTP datagram has arrived
+void FecDecoder::receivedDatagram(const char * pDatagram)
+{
+    int sequenceNumber = urtpGetSequenceNumber(pDatagram);
+
+    if (getDatagram(sequenceNumber) == NULL) {
+        store(pDatagram);
+        // See if this completes a set that some parity can now fix
+        for (int x = 0; x < _numParity; x++) {
+            if (covers(x, sequenceNumber)) {
+                tryRecover(x);
+            }
+        }
+    }
+}
+
+// A parity datagram has arrived
+void FecDecoder::receivedParity(const char * pParity, int size)
+{
+    int slot;
+
+    if ((size == FEC_PARITY_DATAGRAM_SIZE(_datagramSize)) &&
+        ((unsigned char) *pParity == FEC_SYNC_BYTE) &&
+        ((unsigned char) *(pParity + 4) > 0) &&
+        ((unsigned char) *(pParity + 5) < (unsigned char) *(pParity + 4))) {
+        // Oldest parity makes way for the new
+        slot = _nextParity;
+        _nextParity++;
+        if (_nextParity >= _numParity) {
+            _nextParity = 0;
+        }
+        memcpy(_pParity + slot * size, pParity, size);
+        _pParityInfo[slot] = SLOT_VALID;
+        tryRecover(slot);
+    }
+}
+
+/* ----------------------------------------------------------------
+ * PROTECTED FUNCTIONS: FecDecoder
+ * -------------------------------------------------------------- */
+
+// Store a datagram in the history
+void FecDecoder::store(const char * pDatagram)
+{
+    int sequenceNumber = urtpGetSequenceNumber(pDatagram);
+    int slot = sequenceNumber % _numHistory;
+
+    memcpy(_pHistory + slot * _datagramSize, pDatagram, _datagramSize);
+    _pHistoryInfo[slot] = SLOT_VALID | sequenceNumber;
+}
+
+// Get a datagram from the history
+const char * FecDecoder::getDatagram(int sequenceNumber)
+{
+    const char * pDatagram = NULL;
+    int slot = (sequenceNumber & 0xFFFF) % _numHistory;
+
+    if ((_pHistoryInfo[slot] & SLOT_VALID) &&
+        ((int) (_pHistoryInfo[slot] & 0xFFFF) == (sequenceNumber & 0xFFFF))) {
+        pDatagram = _pHistory + slot * _datagramSize;
+    }
+
+    return pDatagram;
+}
+
+// Check whether a parity slot covers a sequence number
+bool FecDecoder::covers(int slot, int sequenceNumber)
+{
+    const char * pParity = _pParity + slot * FEC_PARITY_DATAGRAM_SIZE(_datagramSize);
+    int index;
+
+    if (!(_pParityInfo[slot] & SLOT_VALID)) {
+        return false;
+    }
+
+    index = sequenceNumberDiff(sequenceNumber, datagramGetUint16(pParity + 2));
+
+    return (index >= 0) && (index < (unsigned char) *(pParity + 1)) &&
+           ((index % (unsigned char) *(pParity + 4)) == (unsigned char) *(pParity + 5));
+}
+
+// Try to rebuild the one missing datagram covered by a parity slot
+void FecDecoder::tryRecover(int slot)
+{
+    char * pParity = _pParity + slot * FEC_PARITY_DATAGRAM_SIZE(_datagramSize);
+    int groupSize = (unsigned char) *(pParity + 1);
+    int firstSequenceNumber = datagramGetUint16(pParity + 2);
+    int numParity = (unsigned char) *(pParity + 4);
+    int k = (unsigned char) *(pParity + 5);
+    int numMissing = 0;
+    int missingSequenceNumber = 0;
+    int sequenceNumber;
+    const char * pDatagram;
+
+    for (int index = k; index < groupSize; index += numParity) {
+        sequenceNumber = (firstSequenceNumber + index) & 0xFFFF;
+        if (getDatagram(sequenceNumber) == NULL) {
+            numMissing++;
+            missingSequenceNumber = sequenceNumber;
+        }
+    }
+
+    if (numMissing == 0) {
+        // Nothing to do, this parity is spent
+        _pParityInfo[slot] = 0;
+    } else if (numMissing == 1) {
+        // XOR everything else out of the parity to leave the lost one
+        for (int index = k; index < groupSize; index += numParity) {
+            pDatagram = getDatagram((firstSequenceNumber + index) & 0xFFFF);
+            if (pDatagram != NULL) {
+                xorInto(pParity + FEC_HEADER_SIZE, pDatagram, _datagramSize);
+            }
+        }
+        _pParityInfo[slot] = 0;
+        // Only believe the result if it looks like the datagram we lost
+        if (((unsigned char) *(pParity + FEC_HEADER_SIZE) == URTP_SYNC_BYTE) &&
+            (urtpGetSequenceNumber(pParity + FEC_HEADER_SIZE) == missingSequenceNumber)) {
+            store(pParity + FEC_HEADER_SIZE);
+            if (_pRecovered != NULL) {
+                _pRecovered(pParity + FEC_HEADER_SIZE, _pContext);
+            }
+        }
+    }
+}
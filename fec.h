@@ -0,0 +1,157 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Forward error correction for the URTP stream over UDP.
+ *
+ * The stream is split into groups of up to N datagrams with consecutive
+ * sequence numbers and, after each group, P parity datagrams are sent.
+ * Parity datagram k is the XOR of the datagrams in the group whose
+ * index i has i % P == k, so the receiver can rebuild any one lost
+ * datagram from each interleaved subset: with P = 1 that is one loss
+ * per group, with P > 1 a burst of up to P consecutive losses.  The
+ * extra bandwidth is P / N.
+ *
+ * The encoder runs on the board; the decoder is for the receiving end
+ * (see tools/urtp_receiver).  Nothing here depends on mbed.
+ */
+
+#ifndef _FEC_H_
+#define _FEC_H_
+
+#include <stdint.h>
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The sync byte of a parity datagram.  The layout is:
+//
+//   byte  0:      FEC_SYNC_BYTE
+//   byte  1:      number of datagrams in the group, N
+//   bytes 2-3:    sequence number of the first datagram in the group
+//   byte  4:      number of parity datagrams for the group, P
+//   byte  5:      index of this parity datagram, k
+//   bytes 6...:   XOR of the datagrams covered
+#define FEC_SYNC_BYTE 0x5c
+
+// The header size of a parity datagram
+#define FEC_HEADER_SIZE 6
+
+// The largest group
+#define FEC_MAX_GROUP_SIZE 255
+
+// The size of a parity datagram for a given URTP datagram size
+#define FEC_PARITY_DATAGRAM_SIZE(datagramSize) (FEC_HEADER_SIZE + (datagramSize))
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+// Generates the parity datagrams
+class FecEncoder {
+public:
+    FecEncoder();
+
+    // Set up the encoder: pStorage must be numParity *
+    // FEC_PARITY_DATAGRAM_SIZE(datagramSize) bytes long
+    void init(char * pStorage, int groupSize, int numParity, int datagramSize);
+
+    // Return true if pDatagram carries on from the group so far; if
+    // it doesn't, the group should be finished off (sending its parity
+    // if isReady() says so) before pDatagram is added
+    bool follows(const char * pDatagram);
+
+    // Add a datagram that has been sent to the current group
+    void add(const char * pDatagram);
+
+    // True if there is parity to send: the group is full, or it
+    // has been cut short with finish()
+    bool isReady();
+
+    // Close the current group early, if it has anything in it
+    void finish();
+
+    // Get the number of parity datagrams that are ready
+    int getNumParity();
+
+    // Get parity datagram k of the ready group
+    const char * getParity(int k);
+
+    // Get the size of a parity datagram
+    int getParitySize();
+
+    // Start a new group, once the parity has been sent
+    void clear();
+
+protected:
+    char * _pStorage;
+    int _groupSize;
+    int _numParity;
+    int _datagramSize;
+    int _count;
+    int _firstSequenceNumber;
+    bool _finished;
+};
+
+// Rebuilds lost datagrams from the ones that arrived and the parity
+class FecDecoder {
+public:
+    FecDecoder();
+
+    // Set up the decoder.  The history of received datagrams must be
+    // big enough to span at least two groups: pHistory must be
+    // numHistory * datagramSize bytes and pHistoryInfo numHistory
+    // entries.  pParity must be numParity *
+    // FEC_PARITY_DATAGRAM_SIZE(datagramSize) bytes and pParityInfo
+    // numParity entries.  pRecovered is called with each datagram
+    // that is rebuilt.
+    void init(char * pHistory, uint32_t * pHistoryInfo, int numHistory,
+              char * pParity, uint32_t * pParityInfo, int numParity,
+              int datagramSize,
+              void (*pRecovered) (const char *, void *), void * pContext);
+
+    // Give the decoder a URTP datagram that has arrived
+    void receivedDatagram(const char * pDatagram);
+
+    // Give the decoder a parity datagram that has arrived
+    void receivedParity(const char * pParity, int size);
+
+protected:
+    // Store a datagram in the history
+    void store(const char * pDatagram);
+
+    // Return a datagram from the history, or NULL
+    const char * getDatagram(int sequenceNumber);
+
+    // Try to rebuild the missing datagram covered by a parity slot
+    void tryRecover(int slot);
+
+    // Return true if a parity slot covers a sequence number
+    bool covers(int slot, int sequenceNumber);
+
+    char * _pHistory;
+    uint32_t * _pHistoryInfo;
+    int _numHistory;
+    char * _pParity;
+    uint32_t * _pParityInfo;
+    int _numParity;
+    int _nextParity;
+    int _datagramSize;
+    void (*_pRecovered) (const char *, void *);
+    void * _pContext;
+};
+
+#endif // _FEC_H_
@@ -0,0 +1,252 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "datagram.h"
+#include "journal.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Offsets of the fields of a record
+#define RECORD_MAGIC_OFFSET 0
+#define RECORD_VERSION_OFFSET 4
+#define RECORD_FLAGS_OFFSET 6
+#define RECORD_RUN_OFFSET 8
+#define RECORD_COMMIT_OFFSET 12
+#define RECORD_NUM_BYTES_OFFSET 16
+#define RECORD_OFFSET_OFFSET 24
+#define RECORD_SEQUENCE_NUMBER_OFFSET 32
+#define RECORD_BLOCK_SIZE_OFFSET 34
+#define RECORD_TIMESTAMP_OFFSET 36
+#define RECORD_CRC_OFFSET 44
+
+// The number of bytes of a record covered by the CRC;
+// the rest of the sector is zero
+#define RECORD_CRC_LENGTH RECORD_CRC_OFFSET
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// CRC-32 (as Ethernet) of a buffer, a bit at a time: it is
+// only worked out once per commit
+static uint32_t crc32(const char * pBuf, int size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (int x = 0; x < size; x++) {
+        crc ^= (uint8_t) pBuf[x];
+        for (int y = 0; y < 8; y++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+// Decode a record, returning false if it isn't a good one
+static bool decodeRecord(const char * pBuf, JournalCommit * pCommit)
+{
+    if ((datagramGetUint32(pBuf + RECORD_MAGIC_OFFSET) != JOURNAL_MAGIC) ||
+        (datagramGetUint16(pBuf + RECORD_VERSION_OFFSET) != JOURNAL_VERSION) ||
+        (datagramGetUint32(pBuf + RECORD_CRC_OFFSET) != crc32(pBuf, RECORD_CRC_LENGTH))) {
+        return false;
+    }
+
+    pCommit->closed = ((datagramGetUint16(pBuf + RECORD_FLAGS_OFFSET) & JOURNAL_FLAG_CLOSED) != 0);
+    pCommit->run = datagramGetUint32(pBuf + RECORD_RUN_OFFSET);
+    pCommit->commit = datagramGetUint32(pBuf + RECORD_COMMIT_OFFSET);
+    pCommit->numBytes = datagramGetUint64(pBuf + RECORD_NUM_BYTES_OFFSET);
+    pCommit->offset = datagramGetUint64(pBuf + RECORD_OFFSET_OFFSET);
+    pCommit->sequenceNumber = datagramGetUint16(pBuf + RECORD_SEQUENCE_NUMBER_OFFSET);
+    pCommit->blockSize = datagramGetUint16(pBuf + RECORD_BLOCK_SIZE_OFFSET);
+    pCommit->timestampUs = datagramGetUint64(pBuf + RECORD_TIMESTAMP_OFFSET);
+
+    return true;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Find the last commit
+bool journalRead(FILE * pFile, JournalCommit * pCommit)
+{
+    char buf[JOURNAL_RECORD_SIZE];
+    JournalCommit commit;
+    bool found = false;
+
+    if (fseek(pFile, 0, SEEK_SET) != 0) {
+        return false;
+    }
+    for (int x = 0; x < JOURNAL_NUM_SLOTS; x++) {
+        if (fread(buf, 1, sizeof(buf), pFile) != sizeof(buf)) {
+            break;
+        }
+        if (decodeRecord(buf, &commit) &&
+            (!found || (commit.run > pCommit->run) ||
+             ((commit.run == pCommit->run) && (commit.commit > pCommit->commit)))) {
+            *pCommit = commit;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+// Constructor
+Journal::Journal()
+{
+    _pFile = NULL;
+    memset(&_last, 0, sizeof(_last));
+    memset(_buf, 0, sizeof(_buf));
+}
+
+// Open the journal for a new recording
+bool Journal::open(const char * pFileName, int blockSize)
+{
+    JournalCommit previous;
+    bool success;
+
+    if (_pFile != NULL) {
+        fclose(_pFile);
+    }
+
+    _pFile = fopen(pFileName, "rb+");
+    if (_pFile == NULL) {
+        _pFile = fopen(pFileName, "wb+");
+    }
+    if (_pFile == NULL) {
+        return false;
+    }
+    // Each record must go to the card as it is written
+    setvbuf(_pFile, NULL, _IONBF, 0);
+
+    memset(&_last, 0, sizeof(_last));
+    if (journalRead(_pFile, &previous)) {
+        _last.run = previous.run + 1;
+    }
+    _last.blockSize = blockSize;
+
+    // Make the journal its full size at the outset, so that its
+    // size never changes again; then the first commit, of nothing
+    success = (fseek(_pFile, 0, SEEK_END) == 0) && (ftell(_pFile) >= 0);
+    if (success && (ftell(_pFile) < JOURNAL_SIZE)) {
+        memset(_buf, 0, sizeof(_buf));
+        for (int x = 0; success && (x < JOURNAL_NUM_SLOTS); x++) {
+            success = (fseek(_pFile, x * JOURNAL_RECORD_SIZE, SEEK_SET) == 0) &&
+                      (fwrite(_buf, 1, sizeof(_buf), _pFile) == sizeof(_buf));
+        }
+        success = success && (fflush(_pFile) == 0);
+    }
+    success = success && write();
+    if (!success) {
+        fclose(_pFile);
+        _pFile = NULL;
+    }
+
+    return success;
+}
+
+// Commit some of the recording
+bool Journal::commit(uint64_t numBytes, uint64_t offset, int sequenceNumber, uint64_t timestampUs)
+{
+    if (_pFile == NULL) {
+        return false;
+    }
+
+    _last.commit++;
+    _last.numBytes = numBytes - numBytes % JOURNAL_RECORD_SIZE;
+    _last.offset = offset;
+    _last.sequenceNumber = sequenceNumber;
+    _last.timestampUs = timestampUs;
+
+    return write();
+}
+
+// Commit the lot and close
+bool Journal::close(uint64_t numBytes)
+{
+    bool success;
+
+    if (_pFile == NULL) {
+        return false;
+    }
+
+    _last.commit++;
+    _last.numBytes = numBytes;
+    _last.closed = true;
+    success = write();
+    if (fclose(_pFile) != 0) {
+        success = false;
+    }
+    _pFile = NULL;
+
+    return success;
+}
+
+// True if open
+bool Journal::isOpen()
+{
+    return (_pFile != NULL);
+}
+
+// Get the run
+uint32_t Journal::getRun()
+{
+    return _last.run;
+}
+
+// Get the number of commits
+uint32_t Journal::getNumCommits()
+{
+    return _last.commit;
+}
+
+// Get the number of bytes last committed
+uint64_t Journal::getNumBytes()
+{
+    return _last.numBytes;
+}
+
+/* ----------------------------------------------------------------
+ * PROTECTED FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Write the last commit to its slot, the one after the previous
+// commit's; a whole sector, at a sector boundary, goes straight
+// to the card
+bool Journal::write()
+{
+    memset(_buf, 0, sizeof(_buf));
+    datagramSetUint32(_buf + RECORD_MAGIC_OFFSET, JOURNAL_MAGIC);
+    datagramSetUint16(_buf + RECORD_VERSION_OFFSET, JOURNAL_VERSION);
+    datagramSetUint16(_buf + RECORD_FLAGS_OFFSET, _last.closed ? JOURNAL_FLAG_CLOSED : 0);
+    datagramSetUint32(_buf + RECORD_RUN_OFFSET, _last.run);
+    datagramSetUint32(_buf + RECORD_COMMIT_OFFSET, _last.commit);
+    datagramSetUint64(_buf + RECORD_NUM_BYTES_OFFSET, _last.numBytes);
+    datagramSetUint64(_buf + RECORD_OFFSET_OFFSET, _last.offset);
+    datagramSetUint16(_buf + RECORD_SEQUENCE_NUMBER_OFFSET, _last.sequenceNumber);
+    datagramSetUint16(_buf + RECORD_BLOCK_SIZE_OFFSET, _last.blockSize);
+    datagramSetUint64(_buf + RECORD_TIMESTAMP_OFFSET, _last.timestampUs);
+    datagramSetUint32(_buf + RECORD_CRC_OFFSET, crc32(_buf, RECORD_CRC_LENGTH));
+
+    return (fseek(_pFile, (long) (_last.commit % JOURNAL_NUM_SLOTS) * JOURNAL_RECORD_SIZE, SEEK_SET) == 0) &&
+           (fwrite(_buf, 1, sizeof(_buf), _pFile) == sizeof(_buf)) && (fflush(_pFile) == 0);
+}
@@ -0,0 +1,138 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A journal of commit records for a recording written in place over a
+ * file that was allocated beforehand, so that if the power goes before
+ * the recording is closed everything up to the last commit can be got
+ * back.
+ *
+ * Writing over an allocated file changes neither its clusters nor its
+ * size, so the FAT and the directory entry on the card stay good
+ * without the recording file ever being flushed; all that is lost is
+ * how much of it is the new recording.  That is what a commit record
+ * says: how many bytes of audio are on the card, with the URTP
+ * sequence number and timestamp of the block at a known offset, so
+ * that blocks can be placed in time.  Only whole sectors are counted,
+ * since the file system holds back a part-filled one.
+ *
+ * The journal is a file of JOURNAL_NUM_SLOTS sectors, made once; each
+ * commit is written to the next sector round, so committing is the
+ * write of one whole sector, which goes straight to the card, and a
+ * write cut short by the power going spoils only that sector: the
+ * previous commit is still there.  Each record carries a run number,
+ * one per recording, a commit number within the run and a CRC, and
+ * the good record with the highest of these is the last commit.
+ * Opening a new recording starts with a commit of no bytes, so that
+ * what an earlier run left can't be mistaken for the new one.  Only
+ * stdio is used, so this works on any file system (or on a host).
+ */
+
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Marks a commit record
+#define JOURNAL_MAGIC 0x554a4e4c
+
+// The version of the layout
+#define JOURNAL_VERSION 1
+
+// The size of a record: a sector, the unit the card writes in
+#define JOURNAL_RECORD_SIZE 512
+
+// The number of records the journal goes round
+#define JOURNAL_NUM_SLOTS 8
+
+// The size of the journal file
+#define JOURNAL_SIZE (JOURNAL_RECORD_SIZE * JOURNAL_NUM_SLOTS)
+
+// A record flag: the recording was closed cleanly
+#define JOURNAL_FLAG_CLOSED 0x01
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// A commit
+typedef struct {
+    uint32_t run;
+    uint32_t commit;
+    uint64_t numBytes;      // of audio on the card, from the start of the file
+    int blockSize;
+    uint64_t offset;        // of a block written before the commit
+    int sequenceNumber;     // the URTP sequence number of that block
+    uint64_t timestampUs;   // and its timestamp
+    bool closed;
+} JournalCommit;
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Find the last commit in a journal file, returning false if
+// there is none
+bool journalRead(FILE * pFile, JournalCommit * pCommit);
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+class Journal {
+public:
+    Journal();
+
+    // Open the journal file of the given name, making it if need be,
+    // for a new recording of blocks of blockSize bytes; the run
+    // follows on from whatever is there already
+    bool open(const char * pFileName, int blockSize);
+
+    // Commit the first numBytes of the recording, given the offset,
+    // URTP sequence number and timestamp of a block in it; numBytes
+    // is rounded down to whole sectors
+    bool commit(uint64_t numBytes, uint64_t offset, int sequenceNumber, uint64_t timestampUs);
+
+    // Commit all numBytes of the recording, once the recording file
+    // has been closed, marking the run as closed, and close the journal
+    bool close(uint64_t numBytes);
+
+    // True if open
+    bool isOpen();
+
+    // Get the run
+    uint32_t getRun();
+
+    // Get the number of commits written in this run
+    uint32_t getNumCommits();
+
+    // Get the number of bytes last committed
+    uint64_t getNumBytes();
+
+protected:
+    // Write the record of _last to its slot
+    bool write();
+
+    FILE * _pFile;
+    JournalCommit _last;
+    char _buf[JOURNAL_RECORD_SIZE];
+};
+
+#endif // _JOURNAL_H_
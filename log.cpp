@@ -110,7 +110,59 @@ static const char * gLogStrings[] = {
     "  TCP_CWND",
     "  TCP_WND",
     "  TCP_EFFWND",
-    "  TCP_ACK"
+    "  TCP_ACK",
+    "  SEND_QUEUE_DELAY_MS",
+    "  PACER_WAIT_US",
+    "  NACK_RECEIVED",
+    "  RETRANSMIT",
+    "* RETRANSMIT_NOT_POSSIBLE",
+    "  FEC_PARITY_SENT",
+    "  SPOOL_OPEN",
+    "* SPOOL_OPEN_FAILURE",
+    "* SPOOL_WRITE_FAILURE",
+    "  SPOOL_BACKFILL_START",
+    "  SPOOL_BACKFILL_STOP",
+    "  SPOOL_BACKFILL_BITS_S",
+    "* TRANSPORT_LOST",
+    "  TRANSPORT_RECONNECTED",
+    "* TRANSPORT_RECONNECT_FAILURE",
+    "  TIME_TO_RESUME_MS",
+    "  CONN_STATE",
+    "  CONN_STATE_DURATION_MS",
+    "  CONN_BACKOFF_MS",
+    "  TIME_TO_STREAM_MS",
+    "  DNS_LOOKUP_MS",
+    "* DNS_LOOKUP_FAILURE",
+    "  DNS_CACHE_HIT",
+    "  FAN_OUT_DESTINATION",
+    "  FAN_OUT_THROUGHPUT_BITS_S",
+    "  FAN_OUT_LAG_MS",
+    "  FAN_OUT_CONNECTED",
+    "* FAN_OUT_CONNECT_FAILURE",
+    "* FAN_OUT_SEND_FAILURE",
+    "  SECONDARY_PATH_UP",
+    "* SECONDARY_PATH_FAILURE",
+    "  PATH_FAILOVER_US",
+    "  PATH_SWITCH",
+    "  TCP_DOWNSHIFT_LEVEL",
+    "  PPP_BAUD",
+    "  PPP_UART_LOAD_PERCENT",
+    "  CLOCK_SYNC_ROUND_TRIP_US",
+    "* CLOCK_SYNC_FAILURE",
+    "  LATENCY_P50_US",
+    "  LATENCY_P99_US",
+    "  SAMPLE_CLOCK_DRIFT_PPB",
+    "  RTCP_FRACTION_LOST_PERCENT",
+    "  RTCP_JITTER_US",
+    "  RTCP_ROUND_TRIP_US",
+    "* FILE_WRITE_OVERRUN",
+    "  FILE_COMMIT_US",
+    "* FILE_COMMIT_FAILURE",
+    "  TIER_HOT_TO_WARM_PER_S",
+    "  TIER_WARM_TO_COLD_PER_S",
+    "* TIER_COLD_WRITE_FAILURE",
+    "* TIER_OVERFLOW",
+    "* TCP_THINNED_SEQUENCE_NUMBER"
 };
 
 /* ----------------------------------------------------------------
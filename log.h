@@ -111,7 +111,59 @@ typedef enum {
     EVENT_TCP_CWND,
     EVENT_TCP_WND,
     EVENT_TCP_EFFWND,
-    EVENT_TCP_ACK
+    EVENT_TCP_ACK,
+    EVENT_SEND_QUEUE_DELAY_MS,
+    EVENT_PACER_WAIT_US,
+    EVENT_NACK_RECEIVED,
+    EVENT_RETRANSMIT,
+    EVENT_RETRANSMIT_NOT_POSSIBLE,
+    EVENT_FEC_PARITY_SENT,
+    EVENT_SPOOL_OPEN,
+    EVENT_SPOOL_OPEN_FAILURE,
+    EVENT_SPOOL_WRITE_FAILURE,
+    EVENT_SPOOL_BACKFILL_START,
+    EVENT_SPOOL_BACKFILL_STOP,
+    EVENT_SPOOL_BACKFILL_BITS_S,
+    EVENT_TRANSPORT_LOST,
+    EVENT_TRANSPORT_RECONNECTED,
+    EVENT_TRANSPORT_RECONNECT_FAILURE,
+    EVENT_TIME_TO_RESUME_MS,
+    EVENT_CONN_STATE,
+    EVENT_CONN_STATE_DURATION_MS,
+    EVENT_CONN_BACKOFF_MS,
+    EVENT_TIME_TO_STREAM_MS,
+    EVENT_DNS_LOOKUP_MS,
+    EVENT_DNS_LOOKUP_FAILURE,
+    EVENT_DNS_CACHE_HIT,
+    EVENT_FAN_OUT_DESTINATION,
+    EVENT_FAN_OUT_THROUGHPUT_BITS_S,
+    EVENT_FAN_OUT_LAG_MS,
+    EVENT_FAN_OUT_CONNECTED,
+    EVENT_FAN_OUT_CONNECT_FAILURE,
+    EVENT_FAN_OUT_SEND_FAILURE,
+    EVENT_SECONDARY_PATH_UP,
+    EVENT_SECONDARY_PATH_FAILURE,
+    EVENT_PATH_FAILOVER_US,
+    EVENT_PATH_SWITCH,
+    EVENT_TCP_DOWNSHIFT_LEVEL,
+    EVENT_PPP_BAUD,
+    EVENT_PPP_UART_LOAD_PERCENT,
+    EVENT_CLOCK_SYNC_ROUND_TRIP_US,
+    EVENT_CLOCK_SYNC_FAILURE,
+    EVENT_LATENCY_P50_US,
+    EVENT_LATENCY_P99_US,
+    EVENT_SAMPLE_CLOCK_DRIFT_PPB,
+    EVENT_RTCP_FRACTION_LOST_PERCENT,
+    EVENT_RTCP_JITTER_US,
+    EVENT_RTCP_ROUND_TRIP_US,
+    EVENT_FILE_WRITE_OVERRUN,
+    EVENT_FILE_COMMIT_US,
+    EVENT_FILE_COMMIT_FAILURE,
+    EVENT_TIER_HOT_TO_WARM_PER_S,
+    EVENT_TIER_WARM_TO_COLD_PER_S,
+    EVENT_TIER_COLD_WRITE_FAILURE,
+    EVENT_TIER_OVERFLOW,
+    EVENT_TCP_THINNED_SEQUENCE_NUMBER
 } LogEvent;
 
 // An entry in the RAM log
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <math.h>
 #include "mbed.h"
 #include "UbloxATCellularInterface.h"
 #include "UbloxPPPCellularInterface.h"
@@ -23,6 +24,25 @@
 #include "FATFileSystem.h"
 #include "urtp.h"
 #include "log.h"
+#include "pacer.h"
+#include "datagram.h"
+#include "retransmit.h"
+#include "fec.h"
+#include "spool.h"
+#include "dnscache.h"
+#include "backlog.h"
+#include "multipath.h"
+#include "tcpwindow.h"
+#include "fastppp.h"
+#include "clocksync.h"
+#include "drift.h"
+#include "rtp.h"
+#include "rawlog.h"
+#include "segment.h"
+#include "unicam.h"
+#include "wav.h"
+#include "sdbench.h"
+#include "journal.h"
 
 /* ----------------------------------------------------------------
  * COMPILE-TIME MACROS
@@ -37,23 +57,204 @@
 // Define this to use TCP instead of UDP
 #define USE_TCP
 
+// Define this, with USE_TCP, to watch lwIP's congestion state for
+// the connection to the server and steer the send path by it:
+// datagrams are handed to lwIP in batches no bigger than the free
+// window and, when the congestion window falls, the stream is paced
+// down in steps before the window collapses altogether
+//#define TCP_CONGESTION_AWARE
+
+#if defined(TCP_CONGESTION_AWARE) && !defined(USE_TCP)
+#  error TCP_CONGESTION_AWARE requires USE_TCP
+#endif
+
+// Define this, with TCP_CONGESTION_AWARE, to also thin the stream
+// at each downshift step, dropping one datagram in four per step
+// before it is sent; this is loss on a reliable transport that the
+// server can't otherwise explain, so each dropped datagram's
+// sequence number is logged as TCP_THINNED_SEQUENCE_NUMBER
+//#define TCP_CONGESTION_THINNING
+
+#if defined(TCP_CONGESTION_THINNING) && !defined(TCP_CONGESTION_AWARE)
+#  error TCP_CONGESTION_THINNING requires TCP_CONGESTION_AWARE
+#endif
+
 // If SERVER_NAME is defined then the URTP
 // stream will be sent to the named server
 // on SERVER_PORT
 #define SERVER_NAME "ciot.it-sgn.u-blox.com"
 #define SERVER_PORT 5065
 
-#ifdef USE_TCP
+#if defined(USE_TCP) && defined(TCP_CONGESTION_AWARE)
+#  define SOCKET TcpWindowSocket
+#elif defined(USE_TCP)
 #  define SOCKET TCPSocket
 #else
 #  define SOCKET UDPSocket
 #endif
 
+// Define this to stream to further servers as well as SERVER_NAME,
+// each entry being {name, port, true for TCP or false for UDP}; up to
+// BACKLOG_MAX_NUM_CURSORS - 1 may be given.  All destinations are fed
+// from one backlog, each with its own cursor, so that a slow one
+// doesn't hold up the rest.
+//#define FAN_OUT_DESTINATIONS {{"10.10.10.2", 5065, false}, {"ciot.it-sgn.u-blox.com", 5066, true}}
+
+#if defined(FAN_OUT_DESTINATIONS) && !defined(SERVER_NAME)
+#  error FAN_OUT_DESTINATIONS requires SERVER_NAME
+#endif
+
+// The size of the fan-out backlog (2 seconds' worth of datagrams as
+// they are); the codec's own store is emptied into this every block,
+// so with fan-out MAX_NUM_DATAGRAMS in mbed_app.json can be made small
+#define FAN_OUT_BACKLOG_SIZE (URTP_DATAGRAM_SIZE * (2000 / BLOCK_DURATION_MS))
+
+// Whether datagrams are packed into the fan-out backlog (see
+// backlog.h), so that the same RAM holds more seconds of quiet audio,
+// rather than stored as they are
+#define FAN_OUT_BACKLOG_PACK true
+
+// Define this, with USE_ETHERNET defined and USE_TCP undefined, to
+// bring up cellular alongside Ethernet and send over cellular whenever
+// a send over Ethernet fails.  Ethernet and PPP would share the one
+// lwIP stack and its single default route, so cellular uses the
+// modem's own IP stack (UbloxATCellularInterface) instead.  The server
+// must accept the stream from either source address.
+//#define USE_MULTIPATH
+
+#if defined(USE_MULTIPATH) && (!defined(USE_ETHERNET) || defined(USE_TCP))
+#  error USE_MULTIPATH requires USE_ETHERNET and UDP
+#endif
+
+// How long a path that has failed a send is avoided for
+#define MULTIPATH_HOLD_DOWN_MS 2000
+
+// Define this, with USE_TCP undefined, to keep a window of recently
+// sent datagrams and send again any that the server NACKs, giving
+// near-TCP delivery without TCP's head-of-line blocking
+//#define USE_RELIABLE_UDP
+
+#if defined(USE_RELIABLE_UDP) && defined(USE_TCP)
+#  error USE_RELIABLE_UDP requires USE_TCP to be undefined
+#endif
+
+// The number of sent datagrams kept for retransmission (1 second's worth)
+#define RETRANSMIT_WINDOW_NUM_DATAGRAMS (1000 / BLOCK_DURATION_MS)
+
+// The maximum number of times a datagram will be sent again
+#define RETRANSMIT_MAX_TRIES 3
+
+// Define this, with USE_TCP undefined, to follow each group of
+// FEC_GROUP_SIZE datagrams with FEC_NUM_PARITY parity datagrams,
+// from which the server can rebuild lost datagrams without a
+// round trip (see fec.h)
+//#define USE_FEC
+
+#if defined(USE_FEC) && defined(USE_TCP)
+#  error USE_FEC requires USE_TCP to be undefined
+#endif
+
+// The number of datagrams in an FEC group
+#define FEC_GROUP_SIZE 10
+
+// The number of parity datagrams sent after each FEC group;
+// with more than one, a burst of that many losses can be repaired
+#define FEC_NUM_PARITY 1
+
+// Define this, with USE_TCP and USE_FEC undefined, to send the coded
+// audio as standard RTP (RFC 3550, see rtp.h) rather than URTP, with
+// RTCP sender reports to SERVER_PORT + 1, so that standard tools can
+// receive and record the stream and measure its jitter and loss.  For
+// those tools the stream is described by an SDP file such as:
+//
+//   v=0
+//   o=- 0 0 IN IP4 0.0.0.0
+//   s=ioc
+//   c=IN IP4 0.0.0.0
+//   t=0 0
+//   m=audio 5065 RTP/AVP 96
+//   a=rtpmap:96 L16/16000/1
+//
+// (the payload is whatever the codec produces, so L16 only
+// describes it where the codec is set to 16 bit PCM)
+//#define RTP_OUTPUT
+
+#if defined(RTP_OUTPUT) && (defined(USE_TCP) || defined(USE_FEC))
+#  error RTP_OUTPUT requires USE_TCP and USE_FEC to be undefined
+#endif
+
+// The dynamic RTP payload type
+#define RTP_PAYLOAD_TYPE 96
+
+// The interval between RTCP sender reports
+#define RTCP_INTERVAL_MS 5000
+
+// The canonical name of the board in RTCP
+#define RTCP_CNAME "ioc@u-blox"
+
+// Define this to line the codec's clock up with the server's, NTP
+// style (see clocksync.h), so that the server can work out the one-way
+// latency of each datagram from its timestamp.  Time goes over UDP to
+// SERVER_NAME:SERVER_PORT whichever transport carries the stream.  The
+// board keeps percentiles of its own view of the latency: from capture
+// to the end of the send, plus half the round trip to the server.
+//#define CLOCK_SYNC
+
+#if defined(CLOCK_SYNC) && !defined(SERVER_NAME)
+#  error CLOCK_SYNC requires SERVER_NAME
+#endif
+
+// How often the time is exchanged with the server
+#define CLOCK_SYNC_INTERVAL_MS 1000
+
+// The histogram of latencies kept on the board: 5 ms bins, up to 2.5 seconds
+#define LATENCY_BIN_US 5000
+#define LATENCY_NUM_BINS 500
+
+// Define this to estimate how far the sample clock is from nominal by
+// timing the I2S DMA events against gUpTimer (see drift.h).  With
+// CLOCK_SYNC the drift of our clock against the server's is taken into
+// account and the result goes to the server in each time request, so
+// that it can adjust its play-out rate rather than have its jitter
+// buffer slowly fill or starve.
+//#define MEASURE_SAMPLE_CLOCK_DRIFT
+
+// The number of DMA events between points for the drift estimate
+#define DRIFT_SAMPLE_NUM_BLOCKS (1000 / BLOCK_DURATION_MS)
+
+// How long the estimates must run before they are believed; the
+// server's clock is seen through the network, which is far noisier
+// than the DMA events, so needs longer
+#define SAMPLE_CLOCK_DRIFT_MIN_SPAN_MS 10000
+#define SERVER_CLOCK_DRIFT_MIN_SPAN_MS 120000
+
 // The maximum amount of time allowed to send a datagram over TCP
 #define TCP_SEND_TIMEOUT_MS 1500
 
-// How long to wait between retries when establishing the link
-#define RETRY_WAIT_SECONDS 5
+// The timeout for blocking socket operations
+#define SOCKET_TIMEOUT_MS 1000
+
+// How long to wait before the first retry when establishing the
+// link; the wait doubles with each consecutive failure, up to the
+// maximum, and is jittered so that boards don't retry in step
+#define CONN_BACKOFF_INITIAL_MS 1000
+#define CONN_BACKOFF_MAX_MS 60000
+
+// How long a looked-up server address is kept for; mbed's
+// gethostbyname() doesn't pass on the TTL of the DNS answer
+// so this is used instead
+#define DNS_CACHE_TTL_SECONDS 3600
+
+// Look the server up again in the background this
+// long before the cached address expires
+#define DNS_CACHE_REFRESH_MARGIN_SECONDS 300
+
+// How often to check, while streaming, if a refresh is due
+#define DNS_CACHE_REFRESH_CHECK_MS 10000
+
+// Define this to keep the DNS cache on the SD card
+// so that it survives a reset
+//#define DNS_CACHE_FILE "/sd/dnscache.bin"
 
 // If we've had consecutive socket errors for this long, it's gone bad
 #define MAX_DURATION_SOCKET_ERRORS_MS 1000
@@ -62,9 +263,64 @@
 // necessary in order to terminate it in an orderly fashion
 #define SEND_DATA_RUN_ANYWAY_TIME_MS 1000
 
+// Define this to pace datagrams into the socket with a token
+// bucket, rather than emptying any backlog as fast as send()
+// will take it, which just bursts into the modem after a stall
+#define SEND_PACER
+
+// The rate at which the pacer lets datagrams through: a little
+// above the codec bit rate so that a backlog still drains
+#define SEND_PACER_RATE_BITS_S ((URTP_DATAGRAM_SIZE << 3) * (1000 / BLOCK_DURATION_MS) * 120 / 100)
+
+// The burst, in bytes, that the pacer allows through in one go
+#define SEND_PACER_BURST_BYTES (URTP_DATAGRAM_SIZE * 4)
+
+// How often the TCP window is written to the log and to the trace
+// printed at the end, and how many samples the trace holds (the
+// last minute's worth)
+#define TCP_WINDOW_SAMPLE_MS 200
+#define TCP_WINDOW_TRACE_NUM_SAMPLES (60000 / TCP_WINDOW_SAMPLE_MS)
+
+// How long to wait for the TCP window to open before looking again;
+// after TCP_SEND_TIMEOUT_MS of waiting the send goes ahead anyway so
+// that a dead connection is found out
+#define TCP_WINDOW_WAIT_MS 5
+
+// The stream is downshifted by one more step when the congestion window
+// halves (lwIP's response to loss) or falls to TCP_CWND_DOWNSHIFT_BYTES,
+// at most once every TCP_DOWNSHIFT_HOLD_MS; it is shifted up again by one
+// step once the congestion window has stayed at or above
+// TCP_CWND_UPSHIFT_BYTES for TCP_UPSHIFT_HOLD_MS
+#define TCP_CWND_DOWNSHIFT_BYTES (TCP_MSS * 2)
+#define TCP_CWND_UPSHIFT_BYTES (TCP_MSS * 4)
+#define TCP_DOWNSHIFT_HOLD_MS 500
+#define TCP_UPSHIFT_HOLD_MS 2000
+
+// At downshift level n the pacer slows by n quarters and, with
+// TCP_CONGESTION_THINNING, n of every four datagrams are dropped
+#define TCP_DOWNSHIFT_MAX_LEVEL 2
+
+// The baud rate the UART to the modem is opened at
+#define PPP_UART_INITIAL_BAUD 230400
+
+// Define this to run the PPP UART faster, with RTS/CTS flow control:
+// once the modem is up, each rate in PPP_UART_BAUD_RATES (lowest first)
+// is tried and the highest that passes a loopback test of
+// PPP_UART_LOOPBACK_BYTES is kept.  drivers.uart-serial-rxbuf-size in
+// mbed_app.json should hold a few milliseconds at the top rate.
+//#define PPP_UART_AUTO_BAUD
+#define PPP_UART_BAUD_RATES {460800, 921600}
+
+#if defined(PPP_UART_AUTO_BAUD) && defined(USE_ETHERNET)
+#  error PPP_UART_AUTO_BAUD is for cellular only
+#endif
+#define PPP_UART_LOOPBACK_BYTES 256
+
 // Network API
 #ifdef USE_ETHERNET
 #  define INTERFACE_CLASS  EthernetInterface
+#elif defined(PPP_UART_AUTO_BAUD)
+#  define INTERFACE_CLASS  FastPPPCellularInterface
 #else
 #  define INTERFACE_CLASS  UbloxPPPCellularInterface
 #endif
@@ -86,24 +342,325 @@
 
 // If this is defined then the audio part of the stream
 // (i.e. minus the header) will be written to the named file
-// on the SD card.
-// Note: don't define both this and SERVER_NAME, there's not
-// enough time to do both
+// on the SD card.  The send task only copies the audio into one
+// of a ring of file buffers; a task of its own writes each one to
+// SD as it fills, so that a slow write doesn't hold up sending and
+// both can be done at once.
 //#define LOCAL_FILE "/sd/audio.bin"
 
+// The number of file buffers and the number of datagrams'
+// worth of audio in each: writing to file is only fast enough
+// in large blocks, and while one buffer is being written the
+// others must be able to soak up the audio that arrives
+#define FILE_NUM_BUFFERS 2
+#define FILE_BUFFER_NUM_DATAGRAMS (MAX_NUM_DATAGRAMS / 4)
+
+// The histogram of the time that each file buffer write
+// takes: 2 ms bins, up to a second, which is as long as
+// a buffer takes to fill
+#define FILE_WRITE_LATENCY_BIN_US 2000
+#define FILE_WRITE_LATENCY_NUM_BINS 500
+
+// Define this, with LOCAL_FILE, to record to the last
+// RAW_LOG_REGION_SIZE bytes of the SD card directly (see rawlog.h),
+// rather than to the file: there is then no FAT cluster allocation to
+// make the odd write take far longer than the rest, as the file write
+// times in the stats of the two modes show.  The card must be
+// partitioned so that the FAT file system stops short of the region.
+// To get the recordings out, take an image of the card and use
+// tools/raw_extract on it.
+//#define LOCAL_FILE_RAW
+
+#if defined(LOCAL_FILE_RAW) && !defined(LOCAL_FILE)
+#  error LOCAL_FILE_RAW requires LOCAL_FILE
+#endif
+
+// The size of the region at the end of the SD card for LOCAL_FILE_RAW
+#define RAW_LOG_REGION_SIZE (1024ULL * 1024 * 1024)
+
+// Define this, with LOCAL_FILE, to keep LOCAL_FILE at least this many
+// seconds of audio long and write each recording over it from the
+// start, rather than removing it and letting it grow cluster by
+// cluster.  The clusters are allocated once, when the file is first
+// made (as contiguously as the free space allows), so no write has to
+// allocate and the write times stay flat; the file is reused from then
+// on, so there is no remove() to wait for at start-up.  The file
+// keeps its size, so the number of bytes of audio in it is written to
+// LOCAL_FILE_LENGTH when it is closed.
+//#define LOCAL_FILE_PREALLOCATE_SECONDS 3600
+
+#ifdef LOCAL_FILE_PREALLOCATE_SECONDS
+# if !defined(LOCAL_FILE) || defined(LOCAL_FILE_RAW)
+#  error LOCAL_FILE_PREALLOCATE_SECONDS requires LOCAL_FILE and not LOCAL_FILE_RAW
+# endif
+# define LOCAL_FILE_PREALLOCATE_BYTES ((long) LOCAL_FILE_PREALLOCATE_SECONDS * \
+                                      (1000 / BLOCK_DURATION_MS) * URTP_BODY_SIZE)
+# define LOCAL_FILE_LENGTH "/sd/audio.len"
+#endif
+
+// Define this, with LOCAL_FILE_PREALLOCATE_SECONDS, to commit the
+// recording to LOCAL_FILE_JOURNAL (see journal.h) every this many
+// seconds of audio, so that if the power goes before LOCAL_FILE is
+// closed the audio up to the last commit can be got back with
+// tools/journal_recover.  LOCAL_FILE is never flushed for this: a
+// commit is the write of a single sector to the journal, done by the
+// file write task while it has nothing to write, and what it costs
+// is in the stats.
+//#define LOCAL_FILE_JOURNAL_SECONDS 5
+
+#ifdef LOCAL_FILE_JOURNAL_SECONDS
+# ifndef LOCAL_FILE_PREALLOCATE_SECONDS
+#  error LOCAL_FILE_JOURNAL_SECONDS requires LOCAL_FILE_PREALLOCATE_SECONDS
+# endif
+# define LOCAL_FILE_JOURNAL "/sd/audio.jnl"
+# define LOCAL_FILE_JOURNAL_BYTES ((uint64_t) LOCAL_FILE_JOURNAL_SECONDS * \
+                                   (1000 / BLOCK_DURATION_MS) * URTP_BODY_SIZE)
+#endif
+
+// Define this, with LOCAL_FILE, to split the recording into segments
+// of this many seconds, each an audio file plus an index of sequence
+// numbers, timestamps and byte offsets (see segment.h), rather than
+// writing one ever-growing LOCAL_FILE.  The newest
+// LOCAL_FILE_NUM_SEGMENTS segments are kept, the oldest being written
+// over.  The file write task opens the next segment's files while it
+// has nothing to write, so moving on to them doesn't hold up the
+// audio.  tools/seg_seek finds a point in the recording from the
+// indexes alone.
+//#define LOCAL_FILE_SEGMENT_SECONDS 60
+
+#ifdef LOCAL_FILE_SEGMENT_SECONDS
+# if !defined(LOCAL_FILE) || defined(LOCAL_FILE_RAW) || defined(LOCAL_FILE_PREALLOCATE_SECONDS)
+#  error LOCAL_FILE_SEGMENT_SECONDS requires LOCAL_FILE and not LOCAL_FILE_RAW or LOCAL_FILE_PREALLOCATE_SECONDS
+# endif
+# define LOCAL_FILE_SEGMENT_PREFIX "/sd/audio"
+# define LOCAL_FILE_NUM_SEGMENTS 120
+#endif
+
+// Define this, with LOCAL_FILE, to write LOCAL_FILE as a Broadcast
+// WAV file (see wav.h) of 24 bit PCM, decoded from the datagrams,
+// rather than as the coded bodies, so that it can be played straight
+// off the card; the capture timestamp of the first sample goes in
+// the bext chunk.  The header, with the length of the audio, is
+// brought up to date in place only every LOCAL_FILE_WAV_UPDATE_SECONDS
+// and on close, so writing audio costs no I/O beyond the audio.
+// LOCAL_FILE should then end in .wav.
+//#define LOCAL_FILE_WAV
+
+#ifdef LOCAL_FILE_WAV
+# if !defined(LOCAL_FILE) || defined(LOCAL_FILE_RAW) || defined(LOCAL_FILE_PREALLOCATE_SECONDS) || \
+     defined(LOCAL_FILE_SEGMENT_SECONDS)
+#  error LOCAL_FILE_WAV requires LOCAL_FILE and none of the other LOCAL_FILE_ options
+# endif
+# if SAMPLES_PER_BLOCK != UNICAM_BODY_SAMPLES
+#  error LOCAL_FILE_WAV decodes UNICAM_BODY_SAMPLES samples from each datagram
+# endif
+# define LOCAL_FILE_WAV_UPDATE_SECONDS 10
+# define LOCAL_FILE_WAV_ORIGINATOR "ioc-test"
+#endif
+
+// What goes into the file buffers for each datagram and how many
+// datagrams' worth a buffer holds; a WAV buffer is kept a multiple of
+// 16 blocks (30 sectors of 24 bit PCM) so that, the audio starting on
+// a sector boundary, every write is of whole sectors
+#ifdef LOCAL_FILE_WAV
+# define FILE_RECORD_SIZE (SAMPLES_PER_BLOCK * 3)
+# define FILE_BUFFER_NUM_RECORDS ((URTP_BODY_SIZE * FILE_BUFFER_NUM_DATAGRAMS / FILE_RECORD_SIZE) & ~15)
+# if FILE_BUFFER_NUM_RECORDS == 0
+#  error MAX_NUM_DATAGRAMS is too small for LOCAL_FILE_WAV
+# endif
+#else
+# define FILE_RECORD_SIZE URTP_BODY_SIZE
+# define FILE_BUFFER_NUM_RECORDS FILE_BUFFER_NUM_DATAGRAMS
+#endif
+
+// If this is defined then, while the network is down, audio
+// capture carries on and the coded datagrams are spooled to the
+// named file on the SD card.  Once the network is back the spool
+// is sent, faster than real time, in the gaps in the live stream;
+// the server must put the datagrams back in sequence number order.
+//#define SPOOL_FILE "/sd/spool.bin"
+
+// The number of datagrams written to or read from
+// the spool file in one go
+#define SPOOL_BUFFER_NUM_DATAGRAMS 16
+
+// The pacer rate while there is spooled audio to send, which
+// must be well above the codec bit rate for the spool to drain
+#define SEND_PACER_BACKFILL_RATE_BITS_S (SEND_PACER_RATE_BITS_S * 3)
+
+// Define this to hold the datagrams waiting to be sent to SERVER_NAME
+// in tiers, so that a stalled network is ridden out for minutes rather
+// than seconds: the codec's own store is emptied every block into a
+// hot tier in SRAM; when that is full its oldest datagram moves on to a
+// warm tier in CCMRAM, packed (see backlog.h); when that is more than
+// half full the send task moves its oldest datagrams on to a cold tier
+// in TIERED_BACKLOG_COLD_FILE on the SD card (see spool.h).  Datagrams
+// are sent oldest first, cold then warm then hot, so they stay in
+// order.  Datagrams are only lost if the warm tier fills because the
+// SD card can't keep up or isn't there.  As with fan-out,
+// MAX_NUM_DATAGRAMS in mbed_app.json can then be made small.
+//#define TIERED_BACKLOG
+
+#ifdef TIERED_BACKLOG
+# if defined(FAN_OUT_DESTINATIONS) || defined(SPOOL_FILE)
+#  error TIERED_BACKLOG takes the place of FAN_OUT_DESTINATIONS and SPOOL_FILE
+# endif
+// One second in the hot tier, datagrams stored as they are
+# define TIERED_BACKLOG_HOT_NUM_DATAGRAMS (1000 / BLOCK_DURATION_MS)
+# define TIERED_BACKLOG_HOT_SIZE (TIERED_BACKLOG_HOT_NUM_DATAGRAMS * \
+                                  (URTP_DATAGRAM_SIZE + BACKLOG_ENTRY_HEADER_SIZE))
+// The spare CCMRAM given to the warm tier
+# define TIERED_BACKLOG_WARM_SIZE (24 * 1024)
+// The file for the cold tier and the number of datagrams
+// written to or read from it in one go
+# define TIERED_BACKLOG_COLD_FILE "/sd/backlog.bin"
+# define TIERED_BACKLOG_COLD_BUFFER_NUM_DATAGRAMS 16
+#endif
+
+// Define this to benchmark writing to the SD card (see sdbench.h)
+// instead of streaming, so that the size of the file buffers can be
+// chosen from measurements: every combination of the write sizes in
+// SD_BENCHMARK_BLOCK_SIZES, the starting offsets in
+// SD_BENCHMARK_OFFSETS and the SPI clocks in SD_BENCHMARK_SPI_KHZ is
+// timed, through FAT and raw to the region that LOCAL_FILE_RAW uses,
+// and printed as a table.  The raw cases write over any LOCAL_FILE_RAW
+// recordings.  tools/sd_bench runs the same cases on Linux.
+//#define SD_BENCHMARK
+
+#ifdef SD_BENCHMARK
+# define SD_BENCHMARK_FILE "/sd/bench.bin"
+# define SD_BENCHMARK_BLOCK_SIZES {512, 2048, 4096, 8192, URTP_BODY_SIZE * FILE_BUFFER_NUM_DATAGRAMS, \
+                                   16384, 32768}
+# define SD_BENCHMARK_MAX_BLOCK_SIZE 32768
+# define SD_BENCHMARK_OFFSETS {0, URTP_BODY_SIZE, 512}
+# define SD_BENCHMARK_SPI_KHZ {1000, 10000, 25000}
+// The number of bytes written in each case
+# define SD_BENCHMARK_BYTES (1024 * 1024)
+// The histogram of write times: 500 us bins, up to two seconds
+# define SD_BENCHMARK_LATENCY_BIN_US 500
+# define SD_BENCHMARK_LATENCY_NUM_BINS 4000
+#endif
+
 // A signal to indicate that a datagram is ready to send
 #define SIG_DATAGRAM_READY 0x01
 
+// A signal to the main thread that something has
+// happened to the connection (or the button was pressed)
+#define SIG_CONN_EVENT 0x02
+
+// A signal to the file write task that a buffer is full
+#define SIG_FILE_BUFFER_READY 0x04
+
 /* ----------------------------------------------------------------
  * TYPES
  * -------------------------------------------------------------- */
 
+// The states of the connection to the server
+typedef enum {
+    CONN_STATE_POWER_UP,
+    CONN_STATE_NETWORK_START,
+    CONN_STATE_SERVER_VERIFY,
+    CONN_STATE_TRANSPORT_CONNECT,
+    CONN_STATE_STREAM_START,
+    CONN_STATE_STREAMING,
+    CONN_STATE_TRANSPORT_RECONNECT,
+    CONN_STATE_BACKOFF,
+    CONN_STATE_STOPPING,
+    CONN_STATE_STOPPED,
+    MAX_NUM_CONN_STATES
+} ConnState;
+
 // A struct to pass data to the task that sends data to the network
 typedef struct {
     SOCKET * pSock;
     SocketAddress * pServer;
 } SendParams;
 
+#ifdef TCP_CONGESTION_AWARE
+// A sample of the TCP window, for the trace
+typedef struct {
+    uint32_t timeMs;
+    uint16_t cwnd;
+    uint16_t sndWnd;
+    uint16_t effWnd;
+    uint8_t queueLen;
+    uint8_t level;
+} TcpWindowSample;
+#endif
+
+#ifdef FAN_OUT_DESTINATIONS
+// A further destination, as given in FAN_OUT_DESTINATIONS
+typedef struct {
+    const char * pName;
+    int port;
+    bool useTcp;
+} DestinationConfig;
+
+// The state of a further destination and a record of how it has done
+typedef struct {
+    const DestinationConfig * pConfig;
+    int cursor;
+    TCPSocket tcpSock;
+    UDPSocket udpSock;
+    SocketAddress address;
+    bool connected;
+    Thread * pTask;
+    Timer retryTimer;
+    int retryWaitMs;
+    unsigned int numSent;
+    unsigned int numSendFailures;
+    unsigned int numConnects;
+    uint64_t bytesSent;
+    volatile unsigned int bytesThisSecond;
+    int maxLagMs;
+} Destination;
+#endif
+
+#if defined(LOCAL_FILE_RAW) || defined(SD_BENCHMARK)
+// The region at the end of a block device that raw recordings go to
+class RawLogRegion : public RawLogStore {
+public:
+    RawLogRegion() : _pBd(NULL), _start(0), _size(0) {}
+
+    // Set up as the last size bytes of pBd
+    bool init(BlockDevice * pBd, uint64_t size)
+    {
+        _pBd = pBd;
+        _size = size;
+        if (_pBd->size() < size) {
+            return false;
+        }
+        _start = _pBd->size() - size;
+        return true;
+    }
+
+    bool read(void * pBuf, uint64_t address, uint32_t size)
+    {
+        return _pBd->read(pBuf, _start + address, size) == 0;
+    }
+
+    bool program(const void * pBuf, uint64_t address, uint32_t size)
+    {
+        return _pBd->program(pBuf, _start + address, size) == 0;
+    }
+
+    bool erase(uint64_t address, uint64_t size)
+    {
+        return _pBd->erase(_start + address, size) == 0;
+    }
+
+    uint64_t getSize()
+    {
+        return _size;
+    }
+
+protected:
+    BlockDevice * _pBd;
+    uint64_t _start;
+    uint64_t _size;
+};
+#endif
+
 /* ----------------------------------------------------------------
  * VARIABLES
  * -------------------------------------------------------------- */
@@ -133,6 +690,25 @@ static SOCKET gSock;
 // Flag to indicate that the network connection is good
 static volatile bool gNetworkConnected = false;
 
+// Flag to indicate that the connection to the server
+// is up and datagrams may be sent
+static volatile bool gTransportConnected = false;
+
+// The send task carries on across a loss of the transport, so it
+// holds this while it is using the sockets; anything that closes
+// them or takes the interface down clears gTransportConnected and
+// then takes this, which parks the send task until it is done (an
+// mbed Mutex is robust, so terminating the send task releases it)
+static Mutex gSocketMutex;
+
+// Time from losing the transport to the first datagram
+// being sent again, and a record of it
+static Timer gResumeTimer;
+static volatile bool gResuming = false;
+static int gMaxResumeMs = 0;
+static uint64_t gResumeSumMs = 0;
+static unsigned int gNumResumes = 0;
+
 // A server address
 __attribute__ ((section ("CCMRAM")))
 static SocketAddress gServer;
@@ -148,18 +724,112 @@ static DigitalOut gLedBlue(LED3, 1);
 // The user button
 static volatile bool gButtonPressed = false;
 
-#ifdef LOCAL_FILE
-  static FILE *gpFile = NULL;
+// The main thread, which runs the connection state machine
+static osThreadId gMainThreadId = NULL;
+
+// The connection state, the state to go to after backing off
+// and how long to back off for
+static ConnState gConnState = CONN_STATE_POWER_UP;
+static ConnState gConnStateAfterBackoff = CONN_STATE_NETWORK_START;
+static int gBackoffMs = 0;
+static int gNumConsecutiveFailures = 0;
+
+// Timing of the connection states
+static Timer gUpTimer;
+static Timer gConnStateTimer;
+static uint64_t gConnStateTimeMs[MAX_NUM_CONN_STATES];
+static unsigned int gConnStateCount[MAX_NUM_CONN_STATES];
+static Timer gStreamTimer;
+static bool gHasStreamed = false;
+static int gTimeToFirstStreamMs = 0;
+static uint64_t gTimeToRestreamSumMs = 0;
+static unsigned int gNumRestreams = 0;
+
+// Names for the connection states, for the stats
+static const char * gConnStateNames[] = {"POWER_UP",
+                                         "NETWORK_START",
+                                         "SERVER_VERIFY",
+                                         "TRANSPORT_CONNECT",
+                                         "STREAM_START",
+                                         "STREAMING",
+                                         "TRANSPORT_RECONNECT",
+                                         "BACKOFF",
+                                         "STOPPING",
+                                         "STOPPED"};
+
+#ifdef SERVER_NAME
+// Task to look up the server in the background
+static Thread *gpResolveTask = NULL;
+static volatile bool gResolving = false;
+
+// Cache of the server address and a record of how it has done
+static DnsCache gDnsCache;
+static unsigned int gNumDnsLookups = 0;
+static uint64_t gDnsLookupSumMs = 0;
+static unsigned int gNumDnsCacheHits = 0;
+#endif
+
+#if defined(LOCAL_FILE) || defined(SPOOL_FILE) || defined(DNS_CACHE_FILE) || defined(SD_BENCHMARK) || \
+    defined(TIERED_BACKLOG)
   static SDBlockDevice gSd(D11, D12, D13, D10);
   static FATFileSystem gFs("sd");
+#endif
+
+#ifdef LOCAL_FILE
+  static volatile bool gFileOpen = false;
+# ifdef LOCAL_FILE_RAW
+  static RawLogRegion gRawLogRegion;
+  static RawLog gRawLog;
+# elif defined(LOCAL_FILE_SEGMENT_SECONDS)
+  static SegmentWriter gSegmentWriter;
+# elif defined(LOCAL_FILE_WAV)
+  static WavWriter gWavWriter;
+# else
+  static FILE *gpFile = NULL;
+# endif
   // Writing to file is only fast enough if we
-  // write a large block in one go, hence this
-  // buffer (which must be a multiple of
-  // URTP_BODY_SIZE in size).
-  __attribute__ ((section ("CCMRAM")))
-  static char gFileBuf[URTP_BODY_SIZE * (MAX_NUM_DATAGRAMS / 2)];
+  // write a large block in one go, hence these
+  // buffers (each a multiple of FILE_RECORD_SIZE
+  // in size).
   __attribute__ ((section ("CCMRAM")))
-  static char * gpFileBuf = gFileBuf;
+  static char gFileBuf[FILE_NUM_BUFFERS][FILE_RECORD_SIZE * FILE_BUFFER_NUM_RECORDS];
+  // The number of bytes in each buffer waiting to be
+  // written, 0 if the buffer is free to be filled
+  static volatile int gFileBufBytes[FILE_NUM_BUFFERS];
+  // The sequence number and timestamp of the first
+  // datagram whose audio is in each buffer
+  static int gFileBufFirstSequenceNumber[FILE_NUM_BUFFERS];
+  static uint64_t gFileBufFirstTimestamp[FILE_NUM_BUFFERS];
+  // The buffer being filled and how far it has got
+  static int gFileBufFill = 0;
+  static int gFileBufOffset = 0;
+  // The buffer to be written next
+  static int gFileBufWrite = 0;
+  static Mutex gFileBufMutex;
+  // The task that writes the buffers to file
+  static Thread *gpFileWriteTask = NULL;
+  static volatile bool gFileWriteRunning = false;
+  // How it has gone
+  static uint32_t gFileWriteLatencyBins[FILE_WRITE_LATENCY_NUM_BINS];
+  static LatencyHistogram gFileWriteLatency;
+  static unsigned int gNumFileWrites = 0;
+  static unsigned int gNumFileWriteFailures = 0;
+  static unsigned int gNumFileOverruns = 0;
+  static uint64_t gFileBytesWritten = 0;
+  static uint64_t gFileWriteUs = 0;
+# ifdef LOCAL_FILE_JOURNAL_SECONDS
+  static Journal gJournal;
+  static unsigned int gNumFileCommitFailures = 0;
+  static int gFileCommitMaxUs = 0;
+  static uint64_t gFileCommitUs = 0;
+# endif
+#endif
+
+#ifdef SD_BENCHMARK
+// What the SD benchmark writes from, with room for a sector
+// held back from the write before, and the write times
+static char gSdBenchBuf[SD_BENCHMARK_MAX_BLOCK_SIZE + RAW_LOG_SECTOR_SIZE];
+static uint32_t gSdBenchLatencyBins[SD_BENCHMARK_LATENCY_NUM_BINS];
 #endif
 
 // Record some timings so that we can see how we're doing
@@ -169,9 +839,213 @@ static uint64_t gNumTimes = 0;
 static unsigned int gNumSendFailures = 0;
 static unsigned int gNumSendTookTooLong = 0;
 static unsigned int gBytesSent = 0;
+static uint64_t gSumSquaresTime = 0;
+static uint64_t gThroughputSum = 0;
+static int gPeakThroughput = 0;
+static unsigned int gNumThroughputs = 0;
+static int gQueueDelayPeak = 0;
+static int gMaxQueueDelay = 0;
+static uint64_t gQueueDelaySum = 0;
+static uint64_t gNumQueueDelays = 0;
 __attribute__ ((section ("CCMRAM")))
 static Ticker gSecondTicker;
 
+#ifdef PPP_UART_AUTO_BAUD
+// The rates to try on the PPP UART and the one that stuck
+static const int gPppBaudRates[] = PPP_UART_BAUD_RATES;
+static int gPppBaud = PPP_UART_INITIAL_BAUD;
+#endif
+
+#ifdef SEND_PACER
+// The pacer for the send task and a record of how it has behaved
+static Pacer gPacer;
+static unsigned int gNumPacerWaits = 0;
+static uint64_t gPacerWaitTotalUs = 0;
+#endif
+
+#ifdef TCP_CONGESTION_AWARE
+// The trace of the TCP window and the state of
+// the downshifting that is steered by it
+static TcpWindowSample gTcpWindowTrace[TCP_WINDOW_TRACE_NUM_SAMPLES];
+static unsigned int gTcpWindowTraceNext = 0;
+static unsigned int gTcpWindowTraceCount = 0;
+static Timer gTcpWindowTimer;
+static int gLastTcpWindowSampleMs = 0;
+static int gLastCwnd = 0;
+static int gMinCwnd = -1;
+static int gDownshiftLevel = 0;
+static int gLastShiftMs = 0;
+static int gLastPressureMs = 0;
+static unsigned int gNumDownshifts = 0;
+static unsigned int gNumTcpWindowWaits = 0;
+# ifdef TCP_CONGESTION_THINNING
+static unsigned int gThinCount = 0;
+static unsigned int gNumThinned = 0;
+# endif
+#endif
+
+#ifdef USE_RELIABLE_UDP
+// Copies of the most recently sent datagrams, for retransmission
+static char gRetransmitStorage[URTP_DATAGRAM_SIZE * RETRANSMIT_WINDOW_NUM_DATAGRAMS];
+static uint32_t gRetransmitSlotInfo[RETRANSMIT_WINDOW_NUM_DATAGRAMS];
+static RetransmitWindow gRetransmitWindow;
+// Buffer for received NACKs
+static char gNackBuf[NACK_MAX_SIZE];
+static unsigned int gNumNacks = 0;
+static unsigned int gNumRetransmits = 0;
+static unsigned int gNumRetransmitsNotPossible = 0;
+static unsigned int gNumNacksIgnored = 0;
+// Set by the network stack when something has arrived on a
+// socket that NACKs come back over, so that they are only
+// looked for when there may be one
+static volatile bool gNackReadable = false;
+#endif
+
+#ifdef USE_FEC
+// The FEC encoder and the parity it is building
+static char gFecStorage[FEC_PARITY_DATAGRAM_SIZE(URTP_DATAGRAM_SIZE) * FEC_NUM_PARITY];
+static FecEncoder gFecEncoder;
+static unsigned int gNumDatagramsSent = 0;
+static unsigned int gNumParitySent = 0;
+#endif
+
+#ifdef FAN_OUT_DESTINATIONS
+// The further destinations and the interface they use
+static const DestinationConfig gDestinationConfigs[] = FAN_OUT_DESTINATIONS;
+#define NUM_FAN_OUT_DESTINATIONS ((int) (sizeof (gDestinationConfigs) / sizeof (gDestinationConfigs[0])))
+static Destination gDestinations[NUM_FAN_OUT_DESTINATIONS];
+static INTERFACE_CLASS * gpFanOutInterface = NULL;
+static volatile bool gFanOutRunning = false;
+
+// The backlog all destinations are fed from, cursor 0 being
+// SERVER_NAME, and the mutex that protects it.  The send task
+// copies its datagrams into gServerDatagram.
+static char gBacklogStorage[FAN_OUT_BACKLOG_SIZE];
+static Backlog gBacklog;
+static Mutex gBacklogMutex;
+static char gServerDatagram[URTP_DATAGRAM_SIZE];
+static uint32_t gServerDatagramIndex = 0;
+static int gServerMaxLagMs = 0;
+#endif
+
+#ifdef USE_MULTIPATH
+// The cellular path, which is brought up by its own task
+// alongside Ethernet, and the choice between the two paths
+// (path 0 being Ethernet)
+static UbloxATCellularInterface * gpSecondaryInterface = NULL;
+static UDPSocket gSecondarySock;
+static volatile bool gSecondaryUp = false;
+static Thread * gpSecondaryTask = NULL;
+static volatile bool gSecondaryRunning = false;
+static PathSelector gPathSelector;
+static Timer gPathTimer;
+static unsigned int gNumFailovers = 0;
+static int gMaxFailoverUs = 0;
+static unsigned int gNumSentSecondary = 0;
+#endif
+
+#if defined(CLOCK_SYNC) || defined(RTP_OUTPUT)
+// gUpTimer minus the codec's clock
+static volatile bool gUrtpClockKnown = false;
+static int64_t gUrtpClockOffsetUs = 0;
+#endif
+
+#ifdef RTP_OUTPUT
+// The RTP framing, the packet it is built in, the RTCP
+// socket and what the server has said over it
+static RtpSender gRtpSender;
+static char gRtpBuf[URTP_DATAGRAM_SIZE - URTP_HEADER_SIZE + RTP_HEADER_SIZE];
+static UDPSocket gRtcpSock;
+static char gRtcpBuf[RTCP_MAX_SIZE];
+static Timer gRtcpTimer;
+static unsigned int gNumRtcpReports = 0;
+static unsigned int gNumRtcpIgnored = 0;
+static RtpReportBlock gLastReportBlock;
+static int gLastRttUs = -1;
+static int gMaxRtcpJitterUs = 0;
+#endif
+
+#ifdef CLOCK_SYNC
+// The task that exchanges time with the server and what it has found
+static Thread * gpClockSyncTask = NULL;
+static volatile bool gClockSyncRunning = false;
+static UDPSocket gTimeSock;
+static char gTimeBuf[TIME_DATAGRAM_SIZE];
+static ClockSync gClockSync;
+static volatile int gRoundTripUs = -1;
+static unsigned int gNumClockSyncFailures = 0;
+// The latencies of the datagrams that have been sent
+static uint32_t gLatencyBins[LATENCY_NUM_BINS];
+static LatencyHistogram gLatency;
+static Timer gLatencyLogTimer;
+#endif
+
+#ifdef MEASURE_SAMPLE_CLOCK_DRIFT
+// The timing of the I2S DMA events and the drift of the sample clock
+// against gUpTimer that it gives (positive if the sample clock is fast)
+// and, with CLOCK_SYNC, how fast the server's clock runs against ours
+static unsigned int gNumBlocks = 0;
+static int64_t gFirstBlockUs = 0;
+static DriftEstimator gSampleClockDrift;
+static volatile bool gSampleClockDriftValid = false;
+static volatile int gSampleClockDriftPpb = 0;
+# ifdef CLOCK_SYNC
+static DriftEstimator gServerClockDrift;
+static volatile bool gServerClockDriftValid = false;
+static volatile int gServerClockDriftPpb = 0;
+# endif
+#endif
+
+#ifdef SPOOL_FILE
+// The spool for audio captured while the network is down,
+// the buffers it uses and a record of how it has behaved
+static Spool gSpool;
+static char gSpoolWriteBuf[URTP_DATAGRAM_SIZE * SPOOL_BUFFER_NUM_DATAGRAMS];
+static char gSpoolReadBuf[URTP_DATAGRAM_SIZE * SPOOL_BUFFER_NUM_DATAGRAMS];
+static bool gBackfilling = false;
+static Timer gBackfillTimer;
+static unsigned int gNumSpooled = 0;
+static unsigned int gNumSpoolWriteFailures = 0;
+static unsigned int gNumBackfilled = 0;
+static uint64_t gBackfillBytes = 0;
+static unsigned int gBackfillBytesThisSecond = 0;
+#endif
+
+#ifdef TIERED_BACKLOG
+// The tiers of datagrams waiting to be sent to SERVER_NAME, hottest
+// first, and the mutex that protects the hot and warm tiers; the cold
+// tier is only touched by the send task
+static char gHotTierStorage[TIERED_BACKLOG_HOT_SIZE];
+static Backlog gHotTier;
+__attribute__ ((section ("CCMRAM")))
+static char gWarmTierStorage[TIERED_BACKLOG_WARM_SIZE];
+static Backlog gWarmTier;
+static Mutex gTierMutex;
+static Spool gColdTier;
+static char gColdTierWriteBuf[URTP_DATAGRAM_SIZE * TIERED_BACKLOG_COLD_BUFFER_NUM_DATAGRAMS];
+static char gColdTierReadBuf[URTP_DATAGRAM_SIZE * TIERED_BACKLOG_COLD_BUFFER_NUM_DATAGRAMS];
+// A datagram on its way from one tier to the next
+static char gTierMoveDatagram[URTP_DATAGRAM_SIZE];
+static char gTierSpillDatagram[URTP_DATAGRAM_SIZE];
+// The datagram handed to the send task, already taken out of its
+// tier, and whether it is still waiting to be sent
+static char gTierDatagram[URTP_DATAGRAM_SIZE];
+static volatile bool gTierDatagramHeld = false;
+// The number of datagrams in the cold tier, kept by the send task
+// so that the other tasks needn't touch the spool
+static volatile int gNumColdTiered = 0;
+// How the tiers have been used
+static unsigned int gNumHotToWarm = 0;
+static unsigned int gNumWarmToCold = 0;
+static unsigned int gHotToWarmThisSecond = 0;
+static unsigned int gWarmToColdThisSecond = 0;
+static unsigned int gHotToWarmPeakPerSecond = 0;
+static unsigned int gWarmToColdPeakPerSecond = 0;
+static unsigned int gNumTierSent[3] = {0};
+static unsigned int gNumColdWriteFailures = 0;
+static int gNumTieredMax = 0;
+#endif
+
 /* ----------------------------------------------------------------
  * STATIC DEBUG FUNCTIONS
  * -------------------------------------------------------------- */
@@ -219,10 +1093,24 @@ static void ledOff() {
 // Callback for when a datagram is ready for sending
 static void datagramReadyCb(const char * datagram)
 {
+#if defined(CLOCK_SYNC) || defined(RTP_OUTPUT)
+    int64_t offsetUs;
+
+    // The datagram has only just been coded, so the smallest gap
+    // seen between gUpTimer and its timestamp relates the two clocks
+    // to within the time the codec takes
+    offsetUs = (int64_t) gUpTimer.read_high_resolution_us() - (int64_t) urtpGetTimestamp(datagram);
+    if (!gUrtpClockKnown || (offsetUs < gUrtpClockOffsetUs)) {
+        gUrtpClockOffsetUs = offsetUs;
+        gUrtpClockKnown = true;
+    }
+#endif
+#if !defined(FAN_OUT_DESTINATIONS) && !defined(TIERED_BACKLOG)
     if (gpSendTask != NULL) {
         // Send the signal to the sending task
         gpSendTask->signal_set(SIG_DATAGRAM_READY);
     }
+#endif
 }
 
 // Callback for when the datagram list starts to overflow
@@ -241,17 +1129,302 @@ static void datagramOverflowStopCb(int numOverflows)
 __attribute__ ((section ("CCMRAM")))
 static Urtp urtp(&datagramReadyCb, &datagramOverflowStartCb, &datagramOverflowStopCb);
 
+#ifdef FAN_OUT_DESTINATIONS
+// Move coded datagrams from the codec into the backlog
+// and let everyone that sends them know
+static void pumpDatagrams()
+{
+    const char * pDatagram;
+
+    while ((pDatagram = urtp.getUrtpDatagram()) != NULL) {
+        gBacklogMutex.lock();
+        gBacklog.write(pDatagram);
+        gBacklogMutex.unlock();
+        urtp.setUrtpDatagramAsRead(pDatagram);
+    }
+
+    if (gpSendTask != NULL) {
+        gpSendTask->signal_set(SIG_DATAGRAM_READY);
+    }
+    for (int x = 0; x < NUM_FAN_OUT_DESTINATIONS; x++) {
+        if (gDestinations[x].pTask != NULL) {
+            gDestinations[x].pTask->signal_set(SIG_DATAGRAM_READY);
+        }
+    }
+}
+#endif
+
+#ifdef TIERED_BACKLOG
+// Move coded datagrams from the codec into the hot tier, moving
+// the oldest there on to the warm tier if the hot tier is full,
+// and let the send task know
+static void pumpDatagrams()
+{
+    const char * pDatagram;
+    uint32_t index;
+    unsigned int numOverruns;
+    int numTiered;
+
+    while ((pDatagram = urtp.getUrtpDatagram()) != NULL) {
+        gTierMutex.lock();
+        if ((gHotTier.getNumWaiting(0) >= TIERED_BACKLOG_HOT_NUM_DATAGRAMS) &&
+            gHotTier.read(0, gTierMoveDatagram, &index)) {
+            numOverruns = gWarmTier.getNumOverruns(0);
+            gWarmTier.write(gTierMoveDatagram);
+            gHotTier.advance(0, index);
+            gNumHotToWarm++;
+            gHotToWarmThisSecond++;
+            if (gWarmTier.getNumOverruns(0) != numOverruns) {
+                LOG(EVENT_TIER_OVERFLOW, gWarmTier.getNumOverruns(0));
+            }
+        }
+        gHotTier.write(pDatagram);
+        numTiered = gHotTier.getNumWaiting(0) + gWarmTier.getNumWaiting(0);
+        gTierMutex.unlock();
+        urtp.setUrtpDatagramAsRead(pDatagram);
+        numTiered += gNumColdTiered + (gTierDatagramHeld ? 1 : 0);
+        if (numTiered > gNumTieredMax) {
+            gNumTieredMax = numTiered;
+        }
+    }
+
+    if (gpSendTask != NULL) {
+        gpSendTask->signal_set(SIG_DATAGRAM_READY);
+    }
+}
+
+// Move the oldest datagrams in the warm tier on to the cold tier
+// until the warm tier is no more than half full; called by the send
+// task, the SD card being written without the hot and warm tiers
+// locked so that the codec is never held up
+static void spillTiers()
+{
+    uint32_t index;
+    bool moving = gColdTier.isOpen();
+
+    while (moving) {
+        gTierMutex.lock();
+        moving = (gWarmTier.getNumBytesUsed() > TIERED_BACKLOG_WARM_SIZE / 2) &&
+                 gWarmTier.read(0, gTierSpillDatagram, &index);
+        gTierMutex.unlock();
+        if (moving) {
+            if (gColdTier.write(gTierSpillDatagram)) {
+                gTierMutex.lock();
+                // If the warm tier filled in the meantime this datagram
+                // will have gone already, and this does nothing
+                gWarmTier.advance(0, index);
+                gTierMutex.unlock();
+                gNumColdTiered = gColdTier.getNumDatagrams();
+                gNumWarmToCold++;
+                gWarmToColdThisSecond++;
+            } else {
+                LOG(EVENT_TIER_COLD_WRITE_FAILURE, gNumWarmToCold);
+                gNumColdWriteFailures++;
+                moving = false;
+            }
+        }
+    }
+}
+
+// Get the number of datagrams in the tiers, including any handed to
+// the send task but not yet sent; this is called from monitor(), an
+// ISR, so takes no lock and, like fan-out, may be a datagram out
+static int getNumTiered()
+{
+    return gHotTier.getNumWaiting(0) + gWarmTier.getNumWaiting(0) +
+           gNumColdTiered + (gTierDatagramHeld ? 1 : 0);
+}
+#endif
+
+// Get the oldest datagram waiting to be sent to SERVER_NAME, or NULL
+static const char * getDatagram()
+{
+#ifdef FAN_OUT_DESTINATIONS
+    const char * pDatagram = NULL;
+
+    gBacklogMutex.lock();
+    if (gBacklog.read(0, gServerDatagram, &gServerDatagramIndex)) {
+        pDatagram = gServerDatagram;
+    }
+    gBacklogMutex.unlock();
+
+    return pDatagram;
+#elif defined(TIERED_BACKLOG)
+    const char * pCold;
+    uint32_t index;
+    int tier = -1;
+
+    spillTiers();
+    // The datagram is taken out of its tier straight away, so that
+    // moving datagrams between tiers can't touch it; it is kept
+    // until sent, being the oldest of all
+    if (!gTierDatagramHeld) {
+        pCold = gColdTier.peek();
+        if (pCold != NULL) {
+            memcpy(gTierDatagram, pCold, URTP_DATAGRAM_SIZE);
+            gColdTier.consume();
+            gNumColdTiered = gColdTier.getNumDatagrams();
+            tier = 2;
+        } else {
+            gTierMutex.lock();
+            if (gWarmTier.read(0, gTierDatagram, &index)) {
+                gWarmTier.advance(0, index);
+                tier = 1;
+            } else if (gHotTier.read(0, gTierDatagram, &index)) {
+                gHotTier.advance(0, index);
+                tier = 0;
+            }
+            gTierMutex.unlock();
+        }
+        if (tier >= 0) {
+            gNumTierSent[tier]++;
+            gTierDatagramHeld = true;
+        }
+    }
+
+    return gTierDatagramHeld ? gTierDatagram : NULL;
+#else
+    return urtp.getUrtpDatagram();
+#endif
+}
+
+// Done with a datagram from getDatagram()
+static void setDatagramAsRead(const char * pDatagram)
+{
+#ifdef FAN_OUT_DESTINATIONS
+    gBacklogMutex.lock();
+    gBacklog.advance(0, gServerDatagramIndex);
+    gBacklogMutex.unlock();
+#elif defined(TIERED_BACKLOG)
+    (void) pDatagram;
+    gTierDatagramHeld = false;
+#else
+    urtp.setUrtpDatagramAsRead(pDatagram);
+#endif
+}
+
+// Get the number of datagrams waiting to be sent to SERVER_NAME
+static int getNumDatagramsQueued()
+{
+#ifdef FAN_OUT_DESTINATIONS
+    return gBacklog.getNumWaiting(0);
+#elif defined(TIERED_BACKLOG)
+    return getNumTiered();
+#else
+    return urtp.getUrtpDatagramsAvailable();
+#endif
+}
+
 /* ----------------------------------------------------------------
  * ALL OTHER STATIC FUNCTIONS
  * -------------------------------------------------------------- */
 
+// Tell the main thread that something has happened
+// to the connection; may be called from an interrupt
+static void signalConnEvent()
+{
+    if (gMainThreadId != NULL) {
+        osSignalSet(gMainThreadId, SIG_CONN_EVENT);
+    }
+}
+
 // Something to attach to the button
 static void buttonCallback()
 {
     gButtonPressed = true;
     LOG(EVENT_BUTTON_PRESSED, 0);
     event();
+    signalConnEvent();
+}
+
+// Seconds since power-up
+static uint32_t nowSeconds()
+{
+    return (uint32_t) (gUpTimer.read_high_resolution_us() / 1000000);
+}
+
+// Move the connection state machine to a new state,
+// keeping a record of the time spent in the old one
+static void setConnState(ConnState state)
+{
+    int duration = gConnStateTimer.read_ms();
+
+    gConnStateTimeMs[gConnState] += duration;
+    gConnStateCount[gConnState]++;
+    LOG(EVENT_CONN_STATE_DURATION_MS, duration);
+    LOG(EVENT_CONN_STATE, state);
+    gConnState = state;
+    gConnStateTimer.reset();
+    gConnStateTimer.start();
+}
+
+// Back off before moving to the given state
+static void backoff(ConnState nextState)
+{
+    int limitMs = CONN_BACKOFF_MAX_MS;
+
+    if (gNumConsecutiveFailures == 0) {
+        // How long it took to fail is as good a seed as any
+        srand(gUpTimer.read_us());
+    }
+    if ((gNumConsecutiveFailures < 16) &&
+        ((CONN_BACKOFF_INITIAL_MS << gNumConsecutiveFailures) < CONN_BACKOFF_MAX_MS)) {
+        limitMs = CONN_BACKOFF_INITIAL_MS << gNumConsecutiveFailures;
+    }
+    gNumConsecutiveFailures++;
+
+    // Half the limit plus a random part of the other half
+    gBackoffMs = (limitMs / 2) + (rand() % ((limitMs / 2) + 1));
+    LOG(EVENT_CONN_BACKOFF_MS, gBackoffMs);
+    printf("Trying again in %d ms...\n", gBackoffMs);
+
+    gConnStateAfterBackoff = nextState;
+    setConnState(CONN_STATE_BACKOFF);
+}
+
+#ifdef MEASURE_SAMPLE_CLOCK_DRIFT
+// Note the time of a DMA event, each of which should come
+// SAMPLES_PER_BLOCK samples after the last
+static void timeBlock()
+{
+    int64_t nowUs = (int64_t) gUpTimer.read_high_resolution_us();
+    int64_t nominalUs;
+
+    if (gNumBlocks == 0) {
+        gFirstBlockUs = nowUs;
+    } else if (gNumBlocks % DRIFT_SAMPLE_NUM_BLOCKS == 0) {
+        nominalUs = (int64_t) gNumBlocks * SAMPLES_PER_BLOCK * 1000000 / SAMPLING_FREQUENCY;
+        gSampleClockDrift.add(nominalUs, nowUs - gFirstBlockUs - nominalUs);
+        if (gSampleClockDrift.isValid()) {
+            // Events that come later and later mean a slow sample clock
+            gSampleClockDriftPpb = -gSampleClockDrift.getPpb();
+            gSampleClockDriftValid = true;
+        }
+    }
+    gNumBlocks++;
+}
+
+// Get the drift of the sample clock against the server's clock
+// if that is known, otherwise against ours
+static int getSampleClockDriftPpb()
+{
+    int driftPpb = gSampleClockDriftPpb;
+
+# ifdef CLOCK_SYNC
+    if (gServerClockDriftValid) {
+        driftPpb -= gServerClockDriftPpb;
+    }
+# endif
+
+    return driftPpb;
+}
+
+// Print a drift in parts per billion as parts per million
+static void printPpm(int ppb)
+{
+    printf("%s%d.%03d ppm", (ppb < 0) ? "-" : "", abs(ppb) / 1000, abs(ppb) % 1000);
 }
+#endif
 
 // Callback for I2S events.
 // We get here when the DMA has either half-filled
@@ -261,12 +1434,23 @@ static void buttonCallback()
 // of double buffer.
 static void i2sEventCallback (int arg)
 {
+#ifdef MEASURE_SAMPLE_CLOCK_DRIFT
+    if (arg & (I2S_EVENT_RX_HALF_COMPLETE | I2S_EVENT_RX_COMPLETE)) {
+        timeBlock();
+    }
+#endif
     if (arg & I2S_EVENT_RX_HALF_COMPLETE) {
         //LOG(EVENT_I2S_DMA_RX_HALF_FULL, 0);
         urtp.codeAudioBlock(gRawAudio);
+#if defined(FAN_OUT_DESTINATIONS) || defined(TIERED_BACKLOG)
+        pumpDatagrams();
+#endif
     } else if (arg & I2S_EVENT_RX_COMPLETE) {
         //LOG(EVENT_I2S_DMA_RX_FULL, 0);
         urtp.codeAudioBlock(gRawAudio + (sizeof (gRawAudio) / sizeof (gRawAudio[0])) / 2);
+#if defined(FAN_OUT_DESTINATIONS) || defined(TIERED_BACKLOG)
+        pumpDatagrams();
+#endif
     } else {
         LOG(EVENT_I2S_DMA_UNKNOWN, arg);
         bad();
@@ -298,6 +1482,11 @@ static bool startI2s(I2S * pI2s)
 {
     bool success = false;
 
+#ifdef MEASURE_SAMPLE_CLOCK_DRIFT
+    // The DMA events are only evenly spaced while they keep coming
+    gNumBlocks = 0;
+    gSampleClockDrift.init((int64_t) SAMPLE_CLOCK_DRIFT_MIN_SPAN_MS * 1000);
+#endif
     if ((pI2s->protocol(PHILIPS) == 0) &&
         (pI2s->mode(MASTER_RX, true) == 0) &&
         (pI2s->format(24, 32, 0) == 0) &&
@@ -333,57 +1522,340 @@ static void stopI2s(I2S * pI2s)
 }
 
 #ifdef SERVER_NAME
-// Connect to the network, returning a pointer to a socket or NULL
-static SOCKET * startNetwork(INTERFACE_CLASS * pInterface)
+// Look up the server over the network, putting
+// the answer in the DNS cache
+static bool lookUpServer(INTERFACE_CLASS * pInterface)
 {
-    SOCKET *pSock = NULL;
-
-#ifndef USE_ETHERNET
-    if (pInterface->init(PIN)) {
-        pInterface->set_credentials(APN, USERNAME, PASSWORD);
+    bool success = false;
+    SocketAddress address;
+    Timer lookUpTimer;
+
+    lookUpTimer.start();
+    if (pInterface->gethostbyname(SERVER_NAME, &address) == 0) {
+        lookUpTimer.stop();
+        gDnsCache.put(SERVER_NAME, address.get_ip_address(), nowSeconds());
+        LOG(EVENT_DNS_LOOKUP_MS, lookUpTimer.read_ms());
+        gDnsLookupSumMs += lookUpTimer.read_ms();
+        gNumDnsLookups++;
+#ifdef DNS_CACHE_FILE
+        gDnsCache.save(DNS_CACHE_FILE);
 #endif
-        if (pInterface->connect() == 0) {
-            if (gSock.open(pInterface) == 0) {
-                gSock.set_timeout(1000);
-                pSock = &gSock;
-                gNetworkConnected = true;
-                LOG(EVENT_NETWORK_START, 0);
-            }
-        }
-#ifndef USE_ETHERNET
+        success = true;
+    } else {
+        LOG(EVENT_DNS_LOOKUP_FAILURE, 0);
     }
-#endif
 
-    return pSock;
+    return success;
 }
 
-// Verify that the server is there
-static SocketAddress * verifyServer(INTERFACE_CLASS * pInterface)
+// Verify that the server is there, from the DNS cache
+static SocketAddress * verifyServer()
 {
     SocketAddress *pServer = NULL;
+    char address[DNS_CACHE_MAX_ADDRESS_SIZE];
 
-    if (pInterface != NULL) {
-        if (pInterface->gethostbyname(SERVER_NAME, &gServer) == 0) {
-            gServer.set_port(SERVER_PORT);
-            pServer = &gServer;
-        }
+    if (gDnsCache.get(SERVER_NAME, address, nowSeconds()) &&
+        gServer.set_ip_address(address)) {
+        gServer.set_port(SERVER_PORT);
+        pServer = &gServer;
     }
 
     return pServer;
 }
+
+// The body of the resolve task
+static void resolveTask(INTERFACE_CLASS * pInterface)
+{
+    lookUpServer(pInterface);
+    gResolving = false;
+}
+
+// Wait for the resolve task to finish
+static void stopResolve()
+{
+    if (gpResolveTask != NULL) {
+        gpResolveTask->join();
+        delete gpResolveTask;
+        gpResolveTask = NULL;
+    }
+}
+
+// Tidy up the resolve task if it has finished
+static void reapResolve()
+{
+    if (!gResolving) {
+        stopResolve();
+    }
+}
+
+// Start looking up the server in the background
+static void startResolve(INTERFACE_CLASS * pInterface)
+{
+    reapResolve();
+    if (gpResolveTask == NULL) {
+        gResolving = true;
+        gpResolveTask = new Thread();
+        if (gpResolveTask->start(callback(resolveTask, pInterface)) != osOK) {
+            delete gpResolveTask;
+            gpResolveTask = NULL;
+            gResolving = false;
+        }
+    }
+}
+
+// Look the server up again in the background if
+// its cached address is about to expire
+static void refreshResolve(INTERFACE_CLASS * pInterface)
+{
+    reapResolve();
+    if (gNetworkConnected && (gpResolveTask == NULL) &&
+        gDnsCache.needsRefresh(SERVER_NAME, nowSeconds(), DNS_CACHE_REFRESH_MARGIN_SECONDS)) {
+        startResolve(pInterface);
+    }
+}
+
+// Get the server address: a cached one, even if it has expired,
+// is used straight away, leaving any look-up to carry on in the
+// background, otherwise wait for (or do) the look-up
+static SocketAddress * finishResolve(INTERFACE_CLASS * pInterface)
+{
+    char address[DNS_CACHE_MAX_ADDRESS_SIZE];
+    bool expired = false;
+
+    reapResolve();
+    if (gDnsCache.get(SERVER_NAME, address, nowSeconds(), &expired)) {
+        LOG(EVENT_DNS_CACHE_HIT, expired);
+        gNumDnsCacheHits++;
+        if (expired) {
+            startResolve(pInterface);
+        }
+    } else if (gpResolveTask != NULL) {
+        stopResolve();
+    } else {
+        lookUpServer(pInterface);
+    }
+
+    return verifyServer();
+}
+
+#ifdef USE_RELIABLE_UDP
+// Called by the network stack when there is news of a socket that
+// NACKs come back over; for UDP that is only something arriving
+// (or an error), so this says when a NACK may be waiting
+static void nackSigioCb()
+{
+    gNackReadable = true;
+}
+#endif
+
+// Connect to the network, returning a pointer to a socket or NULL
+static SOCKET * startNetwork(INTERFACE_CLASS * pInterface)
+{
+    SOCKET *pSock = NULL;
+
+#ifndef USE_ETHERNET
+    if (pInterface->init(PIN)) {
+        pInterface->set_credentials(APN, USERNAME, PASSWORD);
+# ifdef PPP_UART_AUTO_BAUD
+        gPppBaud = pInterface->negotiateBaud(gPppBaudRates, sizeof (gPppBaudRates) / sizeof (gPppBaudRates[0]),
+                                             true, PPP_UART_LOOPBACK_BYTES);
+        LOG(EVENT_PPP_BAUD, gPppBaud);
+        printf("PPP UART at %d baud, %s flow control.\n", gPppBaud,
+               pInterface->hasFlowControl() ? "RTS/CTS" : "no");
+# endif
+#endif
+        if (pInterface->connect() == 0) {
+            // Look up the server, if it isn't cached,
+            // while the socket is set up
+            if (gDnsCache.needsRefresh(SERVER_NAME, nowSeconds(), DNS_CACHE_REFRESH_MARGIN_SECONDS)) {
+                startResolve(pInterface);
+            }
+            if ((gSock.open(pInterface) == 0)
+#ifdef RTP_OUTPUT
+                && (gRtcpSock.open(pInterface) == 0)
+#endif
+               ) {
+                gSock.set_timeout(SOCKET_TIMEOUT_MS);
+#ifdef USE_RELIABLE_UDP
+                // NACKs are read from the send task between datagrams
+                gSock.sigio(nackSigioCb);
+#endif
+#ifdef RTP_OUTPUT
+                // RTCP is serviced from the send task between datagrams
+                gRtcpSock.set_blocking(false);
+#endif
+                pSock = &gSock;
+                gNetworkConnected = true;
+                LOG(EVENT_NETWORK_START, 0);
+            }
+        }
+#ifndef USE_ETHERNET
+    }
+#endif
+
+    return pSock;
+}
+#endif
+
+#ifdef FAN_OUT_DESTINATIONS
+// Stop sending to the further destinations; what they
+// haven't sent stays in the backlog for next time
+static void stopFanOut()
+{
+    gFanOutRunning = false;
+    for (int x = 0; x < NUM_FAN_OUT_DESTINATIONS; x++) {
+        if (gDestinations[x].pTask != NULL) {
+            gDestinations[x].pTask->signal_set(SIG_DATAGRAM_READY);
+            gDestinations[x].pTask->join();
+            delete gDestinations[x].pTask;
+            gDestinations[x].pTask = NULL;
+        }
+        gDestinations[x].connected = false;
+    }
+}
+#endif
+
+#if defined(CLOCK_SYNC) || defined(RTP_OUTPUT)
+// Get the time now on the codec's clock
+static int64_t urtpNowUs()
+{
+    int64_t offsetUs;
+
+    // The offset is written from the I2S interrupt
+    core_util_critical_section_enter();
+    offsetUs = gUrtpClockOffsetUs;
+    core_util_critical_section_exit();
+
+    return (int64_t) gUpTimer.read_high_resolution_us() - offsetUs;
+}
+#endif
+
+#ifdef CLOCK_SYNC
+// The body of the task that exchanges time with the server
+static void clockSyncTask()
+{
+    int size;
+
+    while (gClockSyncRunning) {
+        if (gUrtpClockKnown) {
+            size = gClockSync.makeRequest(gTimeBuf, (uint64_t) urtpNowUs());
+#ifdef MEASURE_SAMPLE_CLOCK_DRIFT
+            if (gSampleClockDriftValid && gServerClockDriftValid) {
+                timeSetDrift(gTimeBuf, getSampleClockDriftPpb());
+            }
+#endif
+            if (gTimeSock.sendto(gServer, gTimeBuf, size) == size) {
+                // A response to an earlier request may turn up instead,
+                // its long round trip means that it won't be believed
+                size = gTimeSock.recvfrom(NULL, gTimeBuf, sizeof(gTimeBuf));
+                if ((size > 0) && gClockSync.handleResponse(gTimeBuf, size, (uint64_t) urtpNowUs())) {
+                    gRoundTripUs = gClockSync.getDelayUs();
+                    LOG(EVENT_CLOCK_SYNC_ROUND_TRIP_US, gRoundTripUs);
+#ifdef MEASURE_SAMPLE_CLOCK_DRIFT
+                    // The offset is the server's clock minus ours, so
+                    // its slope is how fast the server's clock runs
+                    gServerClockDrift.add(urtpNowUs(), gClockSync.getOffsetUs());
+                    if (gServerClockDrift.isValid()) {
+                        gServerClockDriftPpb = gServerClockDrift.getPpb();
+                        gServerClockDriftValid = true;
+                    }
+#endif
+                } else {
+                    LOG(EVENT_CLOCK_SYNC_FAILURE, size);
+                    gNumClockSyncFailures++;
+                }
+            }
+        }
+        Thread::signal_wait(SIG_CONN_EVENT, CLOCK_SYNC_INTERVAL_MS);
+    }
+
+    gTimeSock.close();
+}
+
+// Start exchanging time with the server, unless that is already going on
+static void startClockSync(INTERFACE_CLASS * pInterface)
+{
+    if (gpClockSyncTask == NULL) {
+        if (gTimeSock.open(pInterface) == 0) {
+            gTimeSock.set_timeout(CLOCK_SYNC_INTERVAL_MS);
+            gClockSyncRunning = true;
+            gpClockSyncTask = new Thread();
+            if (gpClockSyncTask->start(clockSyncTask) != osOK) {
+                delete gpClockSyncTask;
+                gpClockSyncTask = NULL;
+                gClockSyncRunning = false;
+                gTimeSock.close();
+            }
+        }
+        if (gpClockSyncTask == NULL) {
+            printf("Unable to start exchanging time with the server.\n");
+        }
+    }
+}
+
+// Stop exchanging time with the server; the offset
+// found so far is kept for next time
+static void stopClockSync()
+{
+    gClockSyncRunning = false;
+    if (gpClockSyncTask != NULL) {
+        gpClockSyncTask->signal_set(SIG_CONN_EVENT);
+        gpClockSyncTask->join();
+        delete gpClockSyncTask;
+        gpClockSyncTask = NULL;
+    }
+}
+
+// Note how long a datagram that has just been sent took from capture,
+// plus half the round trip to the server once that is known
+static void recordLatency(const char * pDatagram)
+{
+    int latencyUs;
+
+    if (gUrtpClockKnown) {
+        latencyUs = (int) (urtpNowUs() - (int64_t) urtpGetTimestamp(pDatagram));
+        if (gRoundTripUs >= 0) {
+            latencyUs += gRoundTripUs / 2;
+        }
+        gLatency.add(latencyUs);
+        if (gLatencyLogTimer.read_ms() >= 1000) {
+            gLatencyLogTimer.reset();
+            LOG(EVENT_LATENCY_P50_US, gLatency.getPercentileUs(50));
+            LOG(EVENT_LATENCY_P99_US, gLatency.getPercentileUs(99));
+        }
+    }
+}
 #endif
 
 // Disconnect from the network
 static void stopNetwork(INTERFACE_CLASS * pInterface)
 {
     if (pInterface != NULL) {
+        gTransportConnected = false;
+        gSocketMutex.lock();
+#ifdef FAN_OUT_DESTINATIONS
+        stopFanOut();
+#endif
+#ifdef CLOCK_SYNC
+        stopClockSync();
+#endif
+#ifdef RTP_OUTPUT
+        gRtcpSock.close();
+#endif
         // TODO This commented out as sometimes it never returns, needs more investigation
         //gSock.close();
         pInterface->disconnect();
+#ifdef SERVER_NAME
+        // Any look-up still underway fails now the network has gone
+        stopResolve();
+#endif
 #ifndef USE_ETHERNET
+        // Through INTERFACE_CLASS, so that with PPP_UART_AUTO_BAUD it is
+        // FastPPPCellularInterface's deinit(), which puts the rate back
         pInterface->deinit();
 #endif
         gNetworkConnected = false;
+        gSocketMutex.unlock();
         LOG(EVENT_NETWORK_STOP, 0);
     }
 }
@@ -411,34 +1883,1010 @@ static bool connectTcp(const SendParams * pSendParams)
         LOG(EVENT_TCP_CONNECTION_PROBLEM, retValue);
     }
 
-    return success;
+    return success;
+}
+#endif
+
+#if defined(USE_TCP) || defined(FAN_OUT_DESTINATIONS)
+// Send a buffer of data over a TCP socket
+static int tcpSend(TCPSocket * pSock, const char * pData, int size)
+{
+    int x = 0;
+    int count = 0;
+    Timer timer;
+
+    timer.start();
+    while ((count < size) && (timer.read_ms() < TCP_SEND_TIMEOUT_MS)) {
+        x = pSock->send(pData + count, size - count);
+        if (x > 0) {
+            count += x;
+        }
+    }
+    timer.stop();
+
+    if (count < size) {
+        LOG(EVENT_TCP_SEND_TIMEOUT, size - count);
+    }
+
+    if (x < 0) {
+        count = x;
+    }
+
+    return count;
+}
+#endif
+
+#ifdef TCP_CONGESTION_AWARE
+// Write a sample of the TCP window to the log and the trace
+static void recordTcpWindow(const TcpWindow * pWindow, int nowMs)
+{
+    TcpWindowSample * pSample = &(gTcpWindowTrace[gTcpWindowTraceNext]);
+
+    LOG(EVENT_TCP_CWND, pWindow->cwnd);
+    LOG(EVENT_TCP_SNDWND, pWindow->sndWnd);
+    LOG(EVENT_TCP_EFFWND, pWindow->effWnd);
+    LOG(EVENT_TCP_QUEUELEN, pWindow->queueLen);
+
+    pSample->timeMs = nowMs;
+    pSample->cwnd = pWindow->cwnd;
+    pSample->sndWnd = pWindow->sndWnd;
+    pSample->effWnd = pWindow->effWnd;
+    pSample->queueLen = pWindow->queueLen;
+    pSample->level = gDownshiftLevel;
+    gTcpWindowTraceNext++;
+    if (gTcpWindowTraceNext >= TCP_WINDOW_TRACE_NUM_SAMPLES) {
+        gTcpWindowTraceNext = 0;
+    }
+    if (gTcpWindowTraceCount < TCP_WINDOW_TRACE_NUM_SAMPLES) {
+        gTcpWindowTraceCount++;
+    }
+}
+
+// Look at the TCP window, move the downshift level if need
+// be and return how many datagrams lwIP can take right now
+static int checkTcpWindow(TcpWindowSocket * pSock, Timer * pPacerTimer)
+{
+    TcpWindow window;
+    int nowMs = gTcpWindowTimer.read_ms();
+    int level = gDownshiftLevel;
+    int batch = 1;
+
+    if (pSock->getWindow(&window)) {
+        batch = window.effWnd / URTP_DATAGRAM_SIZE;
+        if (window.sndBuf < URTP_DATAGRAM_SIZE) {
+            batch = 0;
+        }
+
+        if ((window.cwnd <= TCP_CWND_DOWNSHIFT_BYTES) || (window.cwnd <= gLastCwnd / 2)) {
+            gLastPressureMs = nowMs;
+            if ((level < TCP_DOWNSHIFT_MAX_LEVEL) && (nowMs - gLastShiftMs >= TCP_DOWNSHIFT_HOLD_MS)) {
+                level++;
+                gNumDownshifts++;
+            }
+        } else if (window.cwnd < TCP_CWND_UPSHIFT_BYTES) {
+            gLastPressureMs = nowMs;
+        } else if ((level > 0) && (nowMs - gLastPressureMs >= TCP_UPSHIFT_HOLD_MS) &&
+                   (nowMs - gLastShiftMs >= TCP_UPSHIFT_HOLD_MS)) {
+            level--;
+        }
+        gLastCwnd = window.cwnd;
+        if ((gMinCwnd < 0) || (window.cwnd < gMinCwnd)) {
+            gMinCwnd = window.cwnd;
+        }
+
+        if (level != gDownshiftLevel) {
+            gDownshiftLevel = level;
+            gLastShiftMs = nowMs;
+            LOG(EVENT_TCP_DOWNSHIFT_LEVEL, level);
+#ifdef SEND_PACER
+            gPacer.setRate(SEND_PACER_RATE_BITS_S * (4 - level) / 4,
+                           pPacerTimer->read_high_resolution_us());
+#endif
+        }
+
+        if (nowMs - gLastTcpWindowSampleMs >= TCP_WINDOW_SAMPLE_MS) {
+            gLastTcpWindowSampleMs = nowMs;
+            recordTcpWindow(&window, nowMs);
+        }
+    }
+
+    return batch;
+}
+
+// Print the TCP window trace as comma-separated values
+static void printTcpWindowTrace()
+{
+    unsigned int x = gTcpWindowTraceNext + TCP_WINDOW_TRACE_NUM_SAMPLES - gTcpWindowTraceCount;
+    const TcpWindowSample * pSample;
+
+    printf("TCP window every %d ms, the last %d sample(s):\n", TCP_WINDOW_SAMPLE_MS, gTcpWindowTraceCount);
+    printf("time_ms,cwnd,snd_wnd,eff_wnd,queue_len,downshift_level\n");
+    for (unsigned int y = 0; y < gTcpWindowTraceCount; y++) {
+        pSample = &(gTcpWindowTrace[(x + y) % TCP_WINDOW_TRACE_NUM_SAMPLES]);
+        printf("%d,%d,%d,%d,%d,%d\n", (int) pSample->timeMs, pSample->cwnd, pSample->sndWnd,
+               pSample->effWnd, pSample->queueLen, pSample->level);
+    }
+}
+#endif
+
+#ifdef SERVER_NAME
+// Bring back just the socket (and, for TCP, the connection)
+// over a network that is still up, which is much quicker
+// than starting the network again
+static bool reconnectTransport(INTERFACE_CLASS * pInterface, const SendParams * pSendParams)
+{
+    bool success = false;
+
+    gTransportConnected = false;
+    gSocketMutex.lock();
+    if (gNetworkConnected && (pInterface->get_ip_address() != NULL)) {
+        // A socket can't be reconnected, it has to be opened again;
+        // the send task is parked, so nothing is in a send or a
+        // receive on it while it is closed
+        gSock.close();
+        if (gSock.open(pInterface) == 0) {
+            gSock.set_timeout(SOCKET_TIMEOUT_MS);
+#ifdef USE_RELIABLE_UDP
+            gSock.sigio(nackSigioCb);
+#endif
+#ifdef USE_TCP
+            success = connectTcp(pSendParams);
+#else
+            success = true;
+#endif
+        }
+    }
+    gSocketMutex.unlock();
+
+    if (success) {
+        LOG(EVENT_TRANSPORT_RECONNECTED, 0);
+    } else {
+        LOG(EVENT_TRANSPORT_RECONNECT_FAILURE, 0);
+    }
+
+    return success;
+}
+#endif
+
+#ifdef FAN_OUT_DESTINATIONS
+// Open a socket to a further destination and, for TCP, connect
+static bool connectDestination(Destination * pDest)
+{
+    bool success = false;
+    const int setOption = 1;
+    Socket * pSock = &(pDest->udpSock);
+
+    if (pDest->pConfig->useTcp) {
+        pSock = &(pDest->tcpSock);
+    }
+
+    if (gpFanOutInterface->gethostbyname(pDest->pConfig->pName, &(pDest->address)) == 0) {
+        pDest->address.set_port(pDest->pConfig->port);
+        // A socket can't be reconnected, it has to be opened again
+        pSock->close();
+        if (pSock->open(gpFanOutInterface) == 0) {
+            pSock->set_timeout(SOCKET_TIMEOUT_MS);
+            if (pDest->pConfig->useTcp) {
+                // Set TCP_NODELAY (1) in level IPPROTO_TCP (6) to 1
+                success = (pDest->tcpSock.connect(pDest->address) == 0) &&
+                          (pDest->tcpSock.setsockopt(6, 1, &setOption, sizeof(setOption)) == 0);
+            } else {
+                success = true;
+            }
+        }
+    }
+
+    pDest->retryTimer.reset();
+    if (success) {
+        LOG(EVENT_FAN_OUT_CONNECTED, pDest->cursor);
+        pDest->connected = true;
+        pDest->numConnects++;
+        pDest->retryWaitMs = CONN_BACKOFF_INITIAL_MS;
+        pDest->retryTimer.stop();
+    } else {
+        LOG(EVENT_FAN_OUT_CONNECT_FAILURE, pDest->cursor);
+        pDest->retryTimer.start();
+    }
+
+    return success;
+}
+
+// The body of the task that sends to a further destination;
+// it works through the backlog at its own pace
+static void sendDestination(Destination * pDest)
+{
+    char datagram[URTP_DATAGRAM_SIZE];
+    uint32_t index;
+    bool gotDatagram;
+    int retValue;
+
+    while (gFanOutRunning) {
+        Thread::signal_wait(SIG_DATAGRAM_READY, SEND_DATA_RUN_ANYWAY_TIME_MS);
+
+        if (!pDest->connected && (pDest->retryTimer.read_ms() >= pDest->retryWaitMs)) {
+            if (!connectDestination(pDest)) {
+                pDest->retryWaitMs <<= 1;
+                if (pDest->retryWaitMs > CONN_BACKOFF_MAX_MS) {
+                    pDest->retryWaitMs = CONN_BACKOFF_MAX_MS;
+                }
+            }
+        }
+
+        while (pDest->connected && gFanOutRunning) {
+            gBacklogMutex.lock();
+            gotDatagram = gBacklog.read(pDest->cursor, datagram, &index);
+            gBacklogMutex.unlock();
+            if (!gotDatagram) {
+                break;
+            }
+            if (pDest->pConfig->useTcp) {
+                retValue = tcpSend(&(pDest->tcpSock), datagram, URTP_DATAGRAM_SIZE);
+            } else {
+                retValue = pDest->udpSock.sendto(pDest->address, datagram, URTP_DATAGRAM_SIZE);
+            }
+            if (retValue == URTP_DATAGRAM_SIZE) {
+                gBacklogMutex.lock();
+                gBacklog.advance(pDest->cursor, index);
+                gBacklogMutex.unlock();
+                pDest->numSent++;
+                pDest->bytesSent += retValue;
+                pDest->bytesThisSecond += retValue;
+            } else {
+                // Connect again; the datagram stays in the backlog
+                LOG(EVENT_FAN_OUT_SEND_FAILURE, pDest->cursor);
+                pDest->numSendFailures++;
+                pDest->connected = false;
+                pDest->retryTimer.reset();
+                pDest->retryTimer.start();
+            }
+        }
+    }
+}
+
+// Start sending to the further destinations
+static void startFanOut(INTERFACE_CLASS * pInterface)
+{
+    gpFanOutInterface = pInterface;
+    gFanOutRunning = true;
+    for (int x = 0; x < NUM_FAN_OUT_DESTINATIONS; x++) {
+        if ((gDestinations[x].pTask == NULL) && (gDestinations[x].cursor < BACKLOG_MAX_NUM_CURSORS)) {
+            gDestinations[x].pTask = new Thread();
+            if (gDestinations[x].pTask->start(callback(sendDestination, &(gDestinations[x]))) != osOK) {
+                delete gDestinations[x].pTask;
+                gDestinations[x].pTask = NULL;
+                printf("Unable to start sending to %s:%d.\n", gDestinations[x].pConfig->pName,
+                       gDestinations[x].pConfig->port);
+            }
+        }
+    }
+}
+#endif
+
+#ifdef USE_MULTIPATH
+// The body of the task that brings up the cellular path and
+// keeps it up, backing off between attempts
+static void secondaryPathTask()
+{
+    int waitMs = CONN_BACKOFF_INITIAL_MS;
+
+    while (gSecondaryRunning) {
+        if (!gSecondaryUp) {
+            if (gpSecondaryInterface->init(PIN)) {
+                gpSecondaryInterface->set_credentials(APN, USERNAME, PASSWORD);
+                if (gpSecondaryInterface->connect() == 0) {
+                    gSecondarySock.close();
+                    if (gSecondarySock.open(gpSecondaryInterface) == 0) {
+                        gSecondarySock.set_timeout(SOCKET_TIMEOUT_MS);
+# ifdef USE_RELIABLE_UDP
+                        gSecondarySock.sigio(nackSigioCb);
+# endif
+                        gSecondaryUp = true;
+                        waitMs = CONN_BACKOFF_INITIAL_MS;
+                        LOG(EVENT_SECONDARY_PATH_UP, 0);
+                    }
+                }
+            }
+            if (!gSecondaryUp) {
+                LOG(EVENT_SECONDARY_PATH_FAILURE, waitMs);
+                gpSecondaryInterface->disconnect();
+                gpSecondaryInterface->deinit();
+                Thread::signal_wait(SIG_CONN_EVENT, waitMs);
+                waitMs <<= 1;
+                if (waitMs > CONN_BACKOFF_MAX_MS) {
+                    waitMs = CONN_BACKOFF_MAX_MS;
+                }
+            }
+        } else {
+            Thread::signal_wait(SIG_CONN_EVENT, SEND_DATA_RUN_ANYWAY_TIME_MS);
+            if (gpSecondaryInterface->get_ip_address() == NULL) {
+                // The modem has lost its PDP context
+                gSecondaryUp = false;
+            }
+        }
+    }
+
+    gSecondaryUp = false;
+    gSecondarySock.close();
+    gpSecondaryInterface->disconnect();
+    gpSecondaryInterface->deinit();
+}
+
+// Start bringing up the cellular path
+static void startSecondaryPath()
+{
+    gPathSelector.init(2, MULTIPATH_HOLD_DOWN_MS);
+    gPathTimer.start();
+    gpSecondaryInterface = new UbloxATCellularInterface();
+    gSecondaryRunning = true;
+    gpSecondaryTask = new Thread();
+    if (gpSecondaryTask->start(secondaryPathTask) != osOK) {
+        delete gpSecondaryTask;
+        gpSecondaryTask = NULL;
+        gSecondaryRunning = false;
+        printf("Unable to start the cellular path.\n");
+    }
+}
+
+// Take down the cellular path
+static void stopSecondaryPath()
+{
+    gSecondaryRunning = false;
+    if (gpSecondaryTask != NULL) {
+        gpSecondaryTask->signal_set(SIG_CONN_EVENT);
+        gpSecondaryTask->join();
+        delete gpSecondaryTask;
+        gpSecondaryTask = NULL;
+    }
+    delete gpSecondaryInterface;
+    gpSecondaryInterface = NULL;
+}
+#endif
+
+#ifndef USE_TCP
+// Send a buffer of data to the server over UDP; with USE_MULTIPATH,
+// if the send fails on one path it is made again at once on the other
+static int udpSend(const SendParams * pSendParams, const char * pData, int size)
+{
+    int retValue = -1;
+#ifdef RTP_OUTPUT
+    int urtpSize = size;
+
+    // URTP datagrams go out as RTP
+    if ((unsigned char) pData[0] == URTP_SYNC_BYTE) {
+        size = gRtpSender.wrap(gRtpBuf, pData, size);
+        pData = gRtpBuf;
+    }
+#endif
+#ifdef USE_MULTIPATH
+    int path;
+    int failedPath = -1;
+    int failoverUs;
+    Timer failoverTimer;
+
+    gPathSelector.setUp(0, gNetworkConnected);
+    gPathSelector.setUp(1, gSecondaryUp);
+    while ((retValue != size) &&
+           ((path = gPathSelector.getPath(gPathTimer.read_ms(), failedPath)) >= 0)) {
+        if (path == 0) {
+            retValue = pSendParams->pSock->sendto(*(pSendParams->pServer), pData, size);
+        } else {
+            retValue = gSecondarySock.sendto(*(pSendParams->pServer), pData, size);
+        }
+        if (retValue == size) {
+            if (path != gPathSelector.getCurrentPath()) {
+                LOG(EVENT_PATH_SWITCH, path);
+            }
+            gPathSelector.sendSucceeded(path);
+            if (path != 0) {
+                gNumSentSecondary++;
+            }
+            if (failedPath >= 0) {
+                failoverUs = failoverTimer.read_us();
+                LOG(EVENT_PATH_FAILOVER_US, failoverUs);
+                gNumFailovers++;
+                if (failoverUs > gMaxFailoverUs) {
+                    gMaxFailoverUs = failoverUs;
+                }
+            }
+        } else {
+            gPathSelector.sendFailed(path, gPathTimer.read_ms());
+            if (failedPath >= 0) {
+                // Both have failed
+                break;
+            }
+            failedPath = path;
+            failoverTimer.start();
+        }
+    }
+#else
+    retValue = pSendParams->pSock->sendto(*(pSendParams->pServer), pData, size);
+#endif
+#ifdef RTP_OUTPUT
+    if ((pData == gRtpBuf) && (retValue == size)) {
+        // As far as the caller is concerned it is the URTP
+        // datagram that has been sent
+        gRtpSender.sent(size);
+        retValue = urtpSize;
+    }
+#endif
+
+    return retValue;
+}
+#endif
+
+#ifdef RTP_OUTPUT
+// Read what the server has said over RTCP and send
+// a sender report when one is due
+static void serviceRtcp(const SendParams * pSendParams)
+{
+    // RTCP goes to and comes from the port above the server's RTP port
+    SocketAddress address = *(pSendParams->pServer);
+    SocketAddress source;
+    RtpReportBlock block;
+    int rttUs;
+    int jitterUs;
+    int size;
+
+    address.set_port(address.get_port() + 1);
+    while ((size = gRtcpSock.recvfrom(&source, gRtcpBuf, sizeof(gRtcpBuf))) > 0) {
+        // Only the server's reports go into the stats
+        if (source != address) {
+            gNumRtcpIgnored++;
+            continue;
+        }
+        if (gRtpSender.handleReport(gRtcpBuf, size, gUpTimer.read_high_resolution_us(), &block, &rttUs)) {
+            gLastReportBlock = block;
+            gLastRttUs = rttUs;
+            gNumRtcpReports++;
+            jitterUs = (int) ((uint64_t) block.jitter * 1000000 / SAMPLING_FREQUENCY);
+            if (jitterUs > gMaxRtcpJitterUs) {
+                gMaxRtcpJitterUs = jitterUs;
+            }
+            LOG(EVENT_RTCP_FRACTION_LOST_PERCENT, block.fractionLost * 100 / 256);
+            LOG(EVENT_RTCP_JITTER_US, jitterUs);
+            if (rttUs >= 0) {
+                LOG(EVENT_RTCP_ROUND_TRIP_US, rttUs);
+            }
+        }
+    }
+
+    if (gRtcpTimer.read_ms() >= RTCP_INTERVAL_MS) {
+        // There is no wall clock, so the NTP time is the time since
+        // power-up, which RFC 3550 allows
+        size = gRtpSender.makeSenderReport(gRtcpBuf, gUpTimer.read_high_resolution_us(), urtpNowUs());
+        if (size > 0) {
+            gRtcpTimer.reset();
+            gRtcpSock.sendto(address, gRtcpBuf, size);
+        }
+    }
+}
+#endif
+
+#ifdef USE_RELIABLE_UDP
+// Read any NACKs the server has sent and send again the datagrams
+// they ask for, provided they are still in the retransmit window
+static void serviceNacks(const SendParams * pSendParams, Timer * pPacerTimer)
+{
+    SocketAddress source;
+    int sequenceNumbers[NACK_MAX_SEQUENCE_NUMBERS];
+    int numSequenceNumbers;
+    const char * pDatagram;
+    int retValue;
+    // NACKs come back over whichever path the server heard from
+    UDPSocket * pSocks[] = {pSendParams->pSock,
+#ifdef USE_MULTIPATH
+                            &gSecondarySock
+#endif
+                           };
+
+    if (!gNackReadable) {
+        return;
+    }
+    gNackReadable = false;
+
+    for (unsigned int s = 0; s < sizeof (pSocks) / sizeof (pSocks[0]); s++) {
+        // Don't hang around once there's nothing more there; only
+        // the send task uses the socket, so no send sees this
+        pSocks[s]->set_timeout(0);
+        while ((retValue = pSocks[s]->recvfrom(&source, gNackBuf, sizeof (gNackBuf))) > 0) {
+            // Only the server, over either path, may ask for datagrams
+            if (source != *(pSendParams->pServer)) {
+                gNumNacksIgnored++;
+                continue;
+            }
+            numSequenceNumbers = nackDecode(gNackBuf, retValue, sequenceNumbers);
+            if (numSequenceNumbers > 0) {
+                LOG(EVENT_NACK_RECEIVED, numSequenceNumbers);
+                gNumNacks++;
+                for (int x = 0; x < numSequenceNumbers; x++) {
+                    pDatagram = gRetransmitWindow.getForRetransmit(sequenceNumbers[x]);
+                    if (pDatagram != NULL) {
+                        retValue = udpSend(pSendParams, pDatagram, URTP_DATAGRAM_SIZE);
+                        if (retValue == URTP_DATAGRAM_SIZE) {
+                            LOG(EVENT_RETRANSMIT, sequenceNumbers[x]);
+                            gNumRetransmits++;
+                            gBytesSent += retValue;
+#ifdef SEND_PACER
+                            gPacer.consume(retValue, pPacerTimer->read_high_resolution_us());
+#endif
+                        } else {
+                            LOG(EVENT_SEND_FAILURE, retValue);
+                            gNumSendFailures++;
+                        }
+                    } else {
+                        LOG(EVENT_RETRANSMIT_NOT_POSSIBLE, sequenceNumbers[x]);
+                        gNumRetransmitsNotPossible++;
+                    }
+                }
+            }
+        }
+        pSocks[s]->set_timeout(SOCKET_TIMEOUT_MS);
+    }
+}
+#endif
+
+#ifdef USE_FEC
+// Send the parity datagrams for an FEC group and start a new group
+static void sendParity(const SendParams * pSendParams, Timer * pPacerTimer)
+{
+    int retValue;
+
+    for (int x = 0; x < gFecEncoder.getNumParity(); x++) {
+        retValue = udpSend(pSendParams, gFecEncoder.getParity(x), gFecEncoder.getParitySize());
+        if (retValue == gFecEncoder.getParitySize()) {
+            //LOG(EVENT_FEC_PARITY_SENT, x);
+            gNumParitySent++;
+            gBytesSent += retValue;
+#ifdef SEND_PACER
+            gPacer.consume(retValue, pPacerTimer->read_high_resolution_us());
+#endif
+        } else {
+            LOG(EVENT_SEND_FAILURE, retValue);
+            gNumSendFailures++;
+        }
+    }
+    gFecEncoder.clear();
+}
+#endif
+
+#ifdef SPOOL_FILE
+// Send datagrams from the spool for as long as no live
+// datagrams are waiting
+static void backfill(const SendParams * pSendParams, Timer * pPacerTimer)
+{
+    const char * pDatagram;
+    int retValue;
+#ifdef SEND_PACER
+    int waitUs;
+#endif
+
+    while (gTransportConnected && (getNumDatagramsQueued() == 0) &&
+           ((pDatagram = gSpool.peek()) != NULL)) {
+        if (!gBackfilling) {
+            gBackfilling = true;
+            gBackfillTimer.start();
+            LOG(EVENT_SPOOL_BACKFILL_START, gSpool.getNumDatagrams());
+#ifdef SEND_PACER
+            gPacer.setRate(SEND_PACER_BACKFILL_RATE_BITS_S, pPacerTimer->read_high_resolution_us());
+#endif
+        }
+#ifdef SEND_PACER
+        waitUs = gPacer.getWaitUs(URTP_DATAGRAM_SIZE, pPacerTimer->read_high_resolution_us());
+        if (waitUs > 0) {
+            // Check again for live datagrams after waiting
+            Thread::wait((waitUs + 999) / 1000);
+            continue;
+        }
+#endif
+#ifdef USE_TCP
+        retValue = tcpSend(pSendParams->pSock, pDatagram, URTP_DATAGRAM_SIZE);
+#else
+        retValue = udpSend(pSendParams, pDatagram, URTP_DATAGRAM_SIZE);
+#endif
+        if (retValue == URTP_DATAGRAM_SIZE) {
+            gSpool.consume();
+            gNumBackfilled++;
+            gBytesSent += retValue;
+            gBackfillBytes += retValue;
+            gBackfillBytesThisSecond += retValue;
+#ifdef SEND_PACER
+            gPacer.consume(retValue, pPacerTimer->read_high_resolution_us());
+#endif
+        } else {
+            // Leave it to the live stream to decide if
+            // the connection has gone
+            LOG(EVENT_SEND_FAILURE, retValue);
+            gNumSendFailures++;
+            break;
+        }
+    }
+
+    if (gBackfilling && (gSpool.getNumDatagrams() == 0)) {
+        gBackfilling = false;
+        gBackfillTimer.stop();
+        LOG(EVENT_SPOOL_BACKFILL_STOP, gNumBackfilled);
+#ifdef SEND_PACER
+        gPacer.setRate(SEND_PACER_RATE_BITS_S, pPacerTimer->read_high_resolution_us());
+#endif
+    }
+}
+#endif
+
+#ifdef SD_BENCHMARK
+// The clock for the SD benchmark
+static int64_t sdBenchNowUs()
+{
+    return (int64_t) gUpTimer.read_high_resolution_us();
+}
+
+// Run every case of the SD benchmark, printing a table of the results
+// and the smallest write size that kept up in each mode
+static void sdBenchmark()
+{
+    const int blockSizes[] = SD_BENCHMARK_BLOCK_SIZES;
+    const int offsets[] = SD_BENCHMARK_OFFSETS;
+    const int spiKhz[] = SD_BENCHMARK_SPI_KHZ;
+    const int neededBytesPerSecond = FILE_RECORD_SIZE * (1000 / BLOCK_DURATION_MS);
+    SdBench bench;
+    SdBenchResult result;
+    RawLogRegion region;
+    bool raw;
+    int smallest[2] = {-1, -1};
+
+    bench.init(sdBenchNowUs, gSdBenchLatencyBins, SD_BENCHMARK_LATENCY_NUM_BINS,
+               SD_BENCHMARK_LATENCY_BIN_US, gSdBenchBuf, sizeof(gSdBenchBuf), NULL);
+    raw = region.init(&gSd, RAW_LOG_REGION_SIZE);
+    if (!raw) {
+        printf("The SD card is too small for the raw region, only FAT will be benchmarked.\n");
+    }
+
+    printf("Writing %d byte(s) in each case, audio arriving at %d byte(s)/s:\n",
+           SD_BENCHMARK_BYTES, neededBytesPerSecond);
+    sdBenchPrintHeading();
+    for (unsigned int s = 0; s < sizeof(spiKhz) / sizeof(spiKhz[0]); s++) {
+        gSd.frequency((uint64_t) spiKhz[s] * 1000);
+        for (unsigned int b = 0; b < sizeof(blockSizes) / sizeof(blockSizes[0]); b++) {
+            for (unsigned int o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+                bench.runFat(SD_BENCHMARK_FILE, blockSizes[b], offsets[o], SD_BENCHMARK_BYTES, &result);
+                result.spiKhz = spiKhz[s];
+                sdBenchPrintResult(&result, neededBytesPerSecond);
+                if (sdBenchKeptUp(&result, neededBytesPerSecond) &&
+                    ((smallest[0] < 0) || (blockSizes[b] < smallest[0]))) {
+                    smallest[0] = blockSizes[b];
+                }
+                // Raw writes are only ever sector aligned
+                if (raw && (offsets[o] % RAW_LOG_SECTOR_SIZE == 0)) {
+                    bench.runRaw(&region, blockSizes[b], offsets[o], SD_BENCHMARK_BYTES, &result);
+                    result.spiKhz = spiKhz[s];
+                    sdBenchPrintResult(&result, neededBytesPerSecond);
+                    if (sdBenchKeptUp(&result, neededBytesPerSecond) &&
+                        ((smallest[1] < 0) || (blockSizes[b] < smallest[1]))) {
+                        smallest[1] = blockSizes[b];
+                    }
+                }
+            }
+        }
+    }
+    printf("Smallest write that kept up every time: FAT %d byte(s), raw %d byte(s) (-1 if none did);"
+           " the file buffers are %d byte(s).\n", smallest[0], smallest[1],
+           FILE_RECORD_SIZE * FILE_BUFFER_NUM_RECORDS);
+}
+#endif
+
+#ifdef LOCAL_FILE
+// The body of the task that writes full file buffers to SD,
+// in the order they were filled
+static void fileWriteTask()
+{
+    Timer writeTimer;
+    int size;
+    int duration;
+    int retValue;
+#ifdef LOCAL_FILE_JOURNAL_SECONDS
+    // Where the last buffer written went and what began it
+    uint64_t lastOffset = 0;
+    int lastSequenceNumber = 0;
+    uint64_t lastTimestamp = 0;
+#endif
+
+    writeTimer.start();
+    while (gFileWriteRunning || (gFileBufBytes[gFileBufWrite] > 0)) {
+        if (gFileBufBytes[gFileBufWrite] > 0) {
+            size = gFileBufBytes[gFileBufWrite];
+            LOG(EVENT_FILE_WRITE_START, size);
+            writeTimer.reset();
+#if defined(LOCAL_FILE_RAW)
+            retValue = gRawLog.write(gFileBuf[gFileBufWrite], size) ? size : -1;
+#elif defined(LOCAL_FILE_SEGMENT_SECONDS)
+            retValue = gSegmentWriter.write(gFileBuf[gFileBufWrite], size,
+                                            gFileBufFirstSequenceNumber[gFileBufWrite],
+                                            gFileBufFirstTimestamp[gFileBufWrite]) ? size : -1;
+#elif defined(LOCAL_FILE_WAV)
+            retValue = gWavWriter.write(gFileBuf[gFileBufWrite], size,
+                                        gFileBufFirstTimestamp[gFileBufWrite],
+                                        gFileBufFirstSequenceNumber[gFileBufWrite]) ? size : -1;
+#else
+            retValue = fwrite(gFileBuf[gFileBufWrite], 1, size, gpFile);
+#endif
+            duration = writeTimer.read_us();
+            LOG(EVENT_FILE_WRITE_STOP, duration);
+            gFileWriteLatency.add(duration);
+            gFileWriteUs += duration;
+            if (retValue != size) {
+                LOG(EVENT_FILE_WRITE_FAILURE, retValue);
+                bad();
+                gNumFileWriteFailures++;
+            } else {
+#ifdef LOCAL_FILE_JOURNAL_SECONDS
+                lastOffset = gFileBytesWritten;
+                lastSequenceNumber = gFileBufFirstSequenceNumber[gFileBufWrite];
+                lastTimestamp = gFileBufFirstTimestamp[gFileBufWrite];
+#endif
+                gFileBytesWritten += size;
+            }
+            gNumFileWrites++;
+            // Only now can the buffer be filled again
+            gFileBufBytes[gFileBufWrite] = 0;
+            gFileBufWrite++;
+            if (gFileBufWrite >= FILE_NUM_BUFFERS) {
+                gFileBufWrite = 0;
+            }
+        } else {
+            // Nothing to write, so get ready for the next one
+#if defined(LOCAL_FILE_RAW)
+            gRawLog.eraseAhead();
+#elif defined(LOCAL_FILE_SEGMENT_SECONDS)
+            gSegmentWriter.prepare();
+#elif defined(LOCAL_FILE_JOURNAL_SECONDS)
+            // Commit what has gone to the card, if it is time to,
+            // timed apart from the writes so that the cost shows
+            if (gFileBytesWritten - gJournal.getNumBytes() >= LOCAL_FILE_JOURNAL_BYTES) {
+                writeTimer.reset();
+                if (!gJournal.commit(gFileBytesWritten, lastOffset, lastSequenceNumber, lastTimestamp)) {
+                    LOG(EVENT_FILE_COMMIT_FAILURE, (int) gFileBytesWritten);
+                    bad();
+                    gNumFileCommitFailures++;
+                }
+                duration = writeTimer.read_us();
+                LOG(EVENT_FILE_COMMIT_US, duration);
+                gFileCommitUs += duration;
+                if (duration > gFileCommitMaxUs) {
+                    gFileCommitMaxUs = duration;
+                }
+            }
+#endif
+            Thread::signal_wait(SIG_FILE_BUFFER_READY);
+        }
+    }
+}
+
+// Hand the buffer being filled to the file write task,
+// moving on to the next; call with gFileBufMutex locked
+static void fileBufHandOver()
+{
+    if (gFileBufOffset > 0) {
+        gFileBufBytes[gFileBufFill] = gFileBufOffset;
+        gFileBufFill++;
+        if (gFileBufFill >= FILE_NUM_BUFFERS) {
+            gFileBufFill = 0;
+        }
+        gFileBufOffset = 0;
+        gpFileWriteTask->signal_set(SIG_FILE_BUFFER_READY);
+    }
+}
+
+// Copy the audio portion of a datagram into the file buffers
+// (decoding it first for LOCAL_FILE_WAV), returning false if there
+// was no room for it because writes to SD have fallen behind
+static bool fileWrite(const char * pDatagram)
+{
+    bool success = false;
+#ifdef LOCAL_FILE_WAV
+    int32_t samples[SAMPLES_PER_BLOCK];
+#endif
+
+    gFileBufMutex.lock();
+    if (gFileWriteRunning) {
+        if (gFileBufBytes[gFileBufFill] == 0) {
+            MBED_ASSERT (gFileBufOffset + FILE_RECORD_SIZE <= (int) sizeof(gFileBuf[0]));
+            if (gFileBufOffset == 0) {
+                gFileBufFirstSequenceNumber[gFileBufFill] = urtpGetSequenceNumber(pDatagram);
+                gFileBufFirstTimestamp[gFileBufFill] = urtpGetTimestamp(pDatagram);
+            }
+#ifdef LOCAL_FILE_WAV
+            unicamDecode(pDatagram + URTP_HEADER_SIZE, samples);
+            wavPack24(samples, SAMPLES_PER_BLOCK, gFileBuf[gFileBufFill] + gFileBufOffset);
+#else
+            memcpy (gFileBuf[gFileBufFill] + gFileBufOffset, pDatagram + URTP_HEADER_SIZE, URTP_BODY_SIZE);
+#endif
+            gFileBufOffset += FILE_RECORD_SIZE;
+            if (gFileBufOffset >= (int) sizeof(gFileBuf[0])) {
+                fileBufHandOver();
+            }
+            success = true;
+        } else {
+            LOG(EVENT_FILE_WRITE_OVERRUN, gFileBufFill);
+            gNumFileOverruns++;
+        }
+    }
+    gFileBufMutex.unlock();
+
+    return success;
+}
+
+// Start the task that writes to file
+static bool startFileWrite()
+{
+    for (int x = 0; x < FILE_NUM_BUFFERS; x++) {
+        gFileBufBytes[x] = 0;
+    }
+    gFileBufFill = 0;
+    gFileBufOffset = 0;
+    gFileBufWrite = 0;
+    gFileWriteLatency.init(gFileWriteLatencyBins, FILE_WRITE_LATENCY_NUM_BINS, FILE_WRITE_LATENCY_BIN_US);
+    gFileWriteRunning = true;
+    gpFileWriteTask = new Thread();
+    if (gpFileWriteTask->start(fileWriteTask) != osOK) {
+        delete gpFileWriteTask;
+        gpFileWriteTask = NULL;
+        gFileWriteRunning = false;
+    }
+
+    return (gpFileWriteTask != NULL);
+}
+
+#ifdef LOCAL_FILE_PREALLOCATE_SECONDS
+// Open a file for writing over from the start, first making it at
+// least size bytes long; seeking past the end of a FAT file and
+// writing there allocates all of the clusters in between in one go
+static FILE * openPreallocated(const char * pFileName, long size)
+{
+    FILE * pFile;
+    long length = -1;
+
+    pFile = fopen(pFileName, "rb+");
+    if (pFile == NULL) {
+        pFile = fopen(pFileName, "wb+");
+    }
+    if ((pFile != NULL) && (fseek(pFile, 0, SEEK_END) == 0)) {
+        length = ftell(pFile);
+        if ((length >= 0) && (length < size)) {
+            printf("Allocating %ld bytes...\n", size - length);
+            length = -1;
+            if ((fseek(pFile, size - 1, SEEK_SET) == 0) && (fputc(0, pFile) != EOF) &&
+                (fflush(pFile) == 0)) {
+                length = size;
+            }
+        }
+    }
+    if ((pFile != NULL) && ((length < 0) || (fseek(pFile, 0, SEEK_SET) != 0))) {
+        fclose(pFile);
+        pFile = NULL;
+    }
+
+    return pFile;
+}
+#endif
+
+// Close the file (or the raw recording), which must
+// have been opened
+static void closeFile()
+{
+#ifdef LOCAL_FILE_PREALLOCATE_SECONDS
+    FILE * pLength;
+#endif
+
+    gFileOpen = false;
+#ifdef LOCAL_FILE_RAW
+    if (!gRawLog.close()) {
+        LOG(EVENT_FILE_WRITE_FAILURE, gRawLog.getNumBytes());
+        bad();
+    }
+#elif defined(LOCAL_FILE_SEGMENT_SECONDS)
+    gSegmentWriter.close();
+#elif defined(LOCAL_FILE_WAV)
+    if (!gWavWriter.close()) {
+        LOG(EVENT_FILE_WRITE_FAILURE, (int) gWavWriter.getNumBytes());
+        bad();
+    }
+#else
+    fclose(gpFile);
+    gpFile = NULL;
+# ifdef LOCAL_FILE_PREALLOCATE_SECONDS
+    pLength = fopen(LOCAL_FILE_LENGTH, "w");
+    if ((pLength == NULL) || (fprintf(pLength, "%lu\n", (unsigned long) gFileBytesWritten) < 0)) {
+        LOG(EVENT_FILE_WRITE_FAILURE, (int) gFileBytesWritten);
+        bad();
+    }
+    if (pLength != NULL) {
+        fclose(pLength);
+    }
+    if ((long) gFileBytesWritten > LOCAL_FILE_PREALLOCATE_BYTES) {
+        printf("The recording outgrew the %ld bytes of %s made ready for it.\n",
+               LOCAL_FILE_PREALLOCATE_BYTES, LOCAL_FILE);
+    }
+# endif
+# ifdef LOCAL_FILE_JOURNAL_SECONDS
+    // Only now is all of the recording on the card
+    if (!gJournal.close(gFileBytesWritten)) {
+        LOG(EVENT_FILE_COMMIT_FAILURE, (int) gFileBytesWritten);
+        bad();
+        gNumFileCommitFailures++;
+    }
+# endif
+#endif
+}
+
+// Open the file (or the raw recording) and start the
+// task that writes to it
+static bool openFile()
+{
+#ifdef LOCAL_FILE_RAW
+    printf("Opening a recording in the last %d Mbyte(s) of the SD card...\n",
+           (int) (RAW_LOG_REGION_SIZE >> 20));
+    gFileOpen = gRawLogRegion.init(&gSd, RAW_LOG_REGION_SIZE) && gRawLog.open(&gRawLogRegion, URTP_BODY_SIZE);
+#elif defined(LOCAL_FILE_SEGMENT_SECONDS)
+    printf("Opening %d second segments %sNNNN.bin...\n", LOCAL_FILE_SEGMENT_SECONDS, LOCAL_FILE_SEGMENT_PREFIX);
+    gFileOpen = gSegmentWriter.open(LOCAL_FILE_SEGMENT_PREFIX, LOCAL_FILE_NUM_SEGMENTS,
+                                    LOCAL_FILE_SEGMENT_SECONDS, URTP_BODY_SIZE);
+#elif defined(LOCAL_FILE_WAV)
+    printf("Opening WAV file %s...\n", LOCAL_FILE);
+    gFileOpen = gWavWriter.open(LOCAL_FILE, SAMPLING_FREQUENCY, 24, 1,
+                                (uint32_t) LOCAL_FILE_WAV_UPDATE_SECONDS * SAMPLING_FREQUENCY * 3,
+                                LOCAL_FILE_WAV_ORIGINATOR);
+#elif defined(LOCAL_FILE_PREALLOCATE_SECONDS)
+    printf("Opening file %s, making it %d second(s) of audio long if it isn't already...\n",
+           LOCAL_FILE, LOCAL_FILE_PREALLOCATE_SECONDS);
+    gpFile = openPreallocated(LOCAL_FILE, LOCAL_FILE_PREALLOCATE_BYTES);
+    gFileOpen = (gpFile != NULL);
+# ifdef LOCAL_FILE_JOURNAL_SECONDS
+    if (gFileOpen) {
+        // Nothing may be held back in stdio, or a commit could
+        // count bytes that aren't on the card yet
+        setvbuf(gpFile, NULL, _IONBF, 0);
+        printf("Committing the recording to %s every %d second(s).\n", LOCAL_FILE_JOURNAL,
+               LOCAL_FILE_JOURNAL_SECONDS);
+        if (!gJournal.open(LOCAL_FILE_JOURNAL, URTP_BODY_SIZE)) {
+            printf("Unable to open %s.\n", LOCAL_FILE_JOURNAL);
+            fclose(gpFile);
+            gpFile = NULL;
+            gFileOpen = false;
+        }
+    }
+# endif
+#else
+    printf("Opening file %s...\n", LOCAL_FILE);
+    remove (LOCAL_FILE);
+    // Sometimes we fail to open the file unless there's a pause here
+    // after any existing file is removed
+    wait_ms(1000);
+    gpFile = fopen(LOCAL_FILE, "wb+");
+    gFileOpen = (gpFile != NULL);
+#endif
+    if (gFileOpen && !startFileWrite()) {
+        printf("Unable to start task to write to file.\n");
+        closeFile();
+    }
+
+    return gFileOpen;
 }
 
-// Send a buffer of data over a TCP socket
-static int tcpSend(SOCKET * pSock, const char * pData, int size)
+// Write whatever is in the file buffers and stop the
+// task that writes to file
+static void stopFileWrite()
 {
-    int x = 0;
-    int count = 0;
-    Timer timer;
-
-    timer.start();
-    while ((count < size) && (timer.read_ms() < TCP_SEND_TIMEOUT_MS)) {
-        x = pSock->send(pData + count, size - count);
-        if (x > 0) {
-            count += x;
-        }
-    }
-    timer.stop();
-
-    if (count < size) {
-        LOG(EVENT_TCP_SEND_TIMEOUT, size - count);
+    gFileBufMutex.lock();
+    if (gpFileWriteTask != NULL) {
+        fileBufHandOver();
     }
-
-    if (x < 0) {
-        count = x;
+    gFileWriteRunning = false;
+    gFileBufMutex.unlock();
+    if (gpFileWriteTask != NULL) {
+        gpFileWriteTask->signal_set(SIG_FILE_BUFFER_READY);
+        gpFileWriteTask->join();
+        delete gpFileWriteTask;
+        gpFileWriteTask = NULL;
     }
-
-    return count;
 }
 #endif
 
@@ -451,14 +2899,118 @@ static void sendData(const SendParams * pSendParams)
     Timer badSendDurationTimer;
     int duration;
     int retValue;
+    int queueDelay;
     bool okToDelete = false;
+    Timer pacerTimer;
+#ifdef SEND_PACER
+    int waitUs;
+#endif
+#ifdef TCP_CONGESTION_AWARE
+    int batch = 0;
+    bool windowWaiting = false;
+    Timer windowWaitTimer;
+#endif
+
+    pacerTimer.start();
+#ifdef SEND_PACER
+    gPacer.init(SEND_PACER_RATE_BITS_S, SEND_PACER_BURST_BYTES,
+                pacerTimer.read_high_resolution_us());
+#endif
+#ifdef USE_RELIABLE_UDP
+    gRetransmitWindow.init(gRetransmitStorage, RETRANSMIT_WINDOW_NUM_DATAGRAMS, URTP_DATAGRAM_SIZE,
+                           gRetransmitSlotInfo, RETRANSMIT_MAX_TRIES);
+#endif
+#ifdef USE_FEC
+    gFecEncoder.init(gFecStorage, FEC_GROUP_SIZE, FEC_NUM_PARITY, URTP_DATAGRAM_SIZE);
+#endif
+#ifdef TCP_CONGESTION_AWARE
+    gTcpWindowTimer.start();
+#endif
+#ifdef CLOCK_SYNC
+    gLatencyLogTimer.start();
+#endif
+#ifdef RTP_OUTPUT
+    gRtcpTimer.start();
+#endif
 
-    while (gNetworkConnected) {
+    // Keep going while the network is down, the task
+    // is only stopped when capture stops
+    while (true) {
         // Wait for at least one datagram to be ready to send
         Thread::signal_wait(SIG_DATAGRAM_READY, SEND_DATA_RUN_ANYWAY_TIME_MS);
+        gSocketMutex.lock();
+
+#ifdef USE_RELIABLE_UDP
+        if (gTransportConnected && (pSendParams->pSock != NULL) && (pSendParams->pServer != NULL)) {
+            serviceNacks(pSendParams, &pacerTimer);
+        }
+#endif
 
-        while ((urtpDatagram = urtp.getUrtpDatagram()) != NULL) {
+        while ((urtpDatagram = getDatagram()) != NULL) {
             okToDelete = false;
+            if (!gTransportConnected) {
+#ifdef SPOOL_FILE
+                if (gSpool.isOpen()) {
+                    if (gSpool.write(urtpDatagram)) {
+                        gNumSpooled++;
+                    } else {
+                        LOG(EVENT_SPOOL_WRITE_FAILURE, gNumSpooled);
+                        gNumSpoolWriteFailures++;
+                    }
+                    setDatagramAsRead(urtpDatagram);
+                    continue;
+                }
+#endif
+                // Leave the datagrams queued so that sending resumes
+                // from the oldest unsent one when we're back
+                break;
+            }
+#ifdef TCP_CONGESTION_AWARE
+            if ((pSendParams->pSock != NULL) && (batch <= 0)) {
+                // Only hand lwIP as much as the window will take
+                batch = checkTcpWindow(pSendParams->pSock, &pacerTimer);
+                if (batch <= 0) {
+                    if (!windowWaiting) {
+                        windowWaiting = true;
+                        windowWaitTimer.reset();
+                        windowWaitTimer.start();
+                        gNumTcpWindowWaits++;
+                    }
+                    if (windowWaitTimer.read_ms() < TCP_SEND_TIMEOUT_MS) {
+                        Thread::wait(TCP_WINDOW_WAIT_MS);
+                        continue;
+                    }
+                    batch = 1;
+                }
+                windowWaiting = false;
+                windowWaitTimer.stop();
+            }
+            batch--;
+#endif
+#ifdef TCP_CONGESTION_THINNING
+            // Thin the stream while the connection is congested
+            if ((int) (gThinCount++ % 4) < gDownshiftLevel) {
+                LOG(EVENT_TCP_THINNED_SEQUENCE_NUMBER, urtpGetSequenceNumber(urtpDatagram));
+                gNumThinned++;
+                setDatagramAsRead(urtpDatagram);
+                continue;
+            }
+#endif
+            // Datagrams are produced at a fixed rate, so the
+            // number queued says how long this one has waited
+            queueDelay = getNumDatagramsQueued() * BLOCK_DURATION_MS;
+#ifdef SEND_PACER
+            if (pSendParams->pSock != NULL) {
+                // Hold back until the bucket has room
+                waitUs = gPacer.getWaitUs(URTP_DATAGRAM_SIZE, pacerTimer.read_high_resolution_us());
+                if (waitUs > 0) {
+                    //LOG(EVENT_PACER_WAIT_US, waitUs);
+                    gNumPacerWaits++;
+                    gPacerWaitTotalUs += waitUs;
+                    Thread::wait((waitUs + 999) / 1000);
+                }
+            }
+#endif
             sendDurationTimer.reset();
             sendDurationTimer.start();
             // Send the datagram
@@ -467,7 +3019,7 @@ static void sendData(const SendParams * pSendParams)
 #ifdef USE_TCP
                 retValue = tcpSend(pSendParams->pSock, urtpDatagram, URTP_DATAGRAM_SIZE);
 #else
-                retValue = pSendParams->pSock->sendto(*(pSendParams->pServer), urtpDatagram, URTP_DATAGRAM_SIZE);
+                retValue = udpSend(pSendParams, urtpDatagram, URTP_DATAGRAM_SIZE);
 #endif
                 if (retValue != URTP_DATAGRAM_SIZE) {
                     badSendDurationTimer.start();
@@ -477,6 +3029,47 @@ static void sendData(const SendParams * pSendParams)
                 } else {
                     gBytesSent += retValue;
                     okToDelete = true;
+                    if (gResuming) {
+                        gResuming = false;
+                        gResumeTimer.stop();
+                        duration = gResumeTimer.read_ms();
+                        LOG(EVENT_TIME_TO_RESUME_MS, duration);
+                        if (duration > gMaxResumeMs) {
+                            gMaxResumeMs = duration;
+                        }
+                        gResumeSumMs += duration;
+                        gNumResumes++;
+                    }
+#ifdef SEND_PACER
+                    gPacer.consume(retValue, pacerTimer.read_high_resolution_us());
+#endif
+                    if (queueDelay > gQueueDelayPeak) {
+                        gQueueDelayPeak = queueDelay;
+                    }
+                    if (queueDelay > gMaxQueueDelay) {
+                        gMaxQueueDelay = queueDelay;
+                    }
+                    gQueueDelaySum += queueDelay;
+                    gNumQueueDelays++;
+#ifdef CLOCK_SYNC
+                    recordLatency(urtpDatagram);
+#endif
+#ifdef USE_RELIABLE_UDP
+                    gRetransmitWindow.store(urtpDatagram);
+#endif
+#ifdef USE_FEC
+                    gNumDatagramsSent++;
+                    // A gap in the sequence (e.g. from an overflow)
+                    // ends the group early
+                    if (!gFecEncoder.follows(urtpDatagram)) {
+                        gFecEncoder.finish();
+                        sendParity(pSendParams, &pacerTimer);
+                    }
+                    gFecEncoder.add(urtpDatagram);
+                    if (gFecEncoder.isReady()) {
+                        sendParity(pSendParams, &pacerTimer);
+                    }
+#endif
                     badSendDurationTimer.stop();
                     badSendDurationTimer.reset();
                     toggleGreen();
@@ -485,53 +3078,50 @@ static void sendData(const SendParams * pSendParams)
 
                 if (retValue < 0) {
                     // If the connection has gone, set a flag that will be picked up outside this function and
-                    // cause us to start again
+                    // cause the transport to be brought back; capture carries on meanwhile
                     if (badSendDurationTimer.read_ms() > MAX_DURATION_SOCKET_ERRORS_MS) {
                         LOG(EVENT_SOCKET_ERRORS_FOR_TOO_LONG, badSendDurationTimer.read_ms());
                         badSendDurationTimer.stop();
                         badSendDurationTimer.reset();
                         bad();
-                        gNetworkConnected = false;
+                        gTransportConnected = false;
+                        signalConnEvent();
                     }
                     if ((retValue == NSAPI_ERROR_NO_CONNECTION) ||
                         (retValue == NSAPI_ERROR_CONNECTION_LOST) ||
                         (retValue == NSAPI_ERROR_NO_SOCKET)) {
                         LOG(EVENT_SOCKET_BAD, retValue);
                         bad();
-                        gNetworkConnected = false;
+                        gTransportConnected = false;
+                        signalConnEvent();
                     }
                 }
+
+#ifdef USE_RELIABLE_UDP
+                if (gTransportConnected) {
+                    serviceNacks(pSendParams, &pacerTimer);
+                }
+#endif
             }
 
 #ifdef LOCAL_FILE
-            // Write the audio portion to file
-            if (gpFile != NULL) {
-                LOG(EVENT_FILE_WRITE_START, (int) urtpDatagram);
-                MBED_ASSERT (gpFileBuf + URTP_BODY_SIZE <= gFileBuf + sizeof(gFileBuf));
-                memcpy (gpFileBuf, (char *) urtpDatagram + URTP_HEADER_SIZE, URTP_BODY_SIZE);
-                gpFileBuf += URTP_BODY_SIZE;
-                if (gpFileBuf >= gFileBuf + sizeof(gFileBuf)) {
-                    gpFileBuf = gFileBuf;
-                    retValue = fwrite(gFileBuf, 1, sizeof(gFileBuf), gpFile);
-                    if (retValue != sizeof(gFileBuf)) {
-                        LOG(EVENT_FILE_WRITE_FAILURE, retValue);
-                        bad();
-                    } else {
-                        // If we aren't sending stuff over the socket then
-                        // just writing it to disk means that it can be
-                        // deleted
-                        if ((pSendParams->pSock == NULL) {
-                            okToDelete = true;
-                        }
-                    }
+            // Pass the audio portion on to be written to file, once
+            // only, when we're done with the datagram; if we aren't
+            // sending stuff over the socket then we're done with it now
+            if (gFileOpen) {
+                if (pSendParams->pSock == NULL) {
+                    okToDelete = true;
+                }
+                if (okToDelete) {
+                    fileWrite(urtpDatagram);
                 }
-                LOG(EVENT_FILE_WRITE_STOP, (int) urtpDatagram);
             }
 #endif
 
             sendDurationTimer.stop();
             duration = sendDurationTimer.read_us();
             gAverageTime += duration;
+            gSumSquaresTime += (uint64_t) duration * duration;
             gNumTimes++;
 
             if (duration > BLOCK_DURATION_MS * 1000) {
@@ -548,21 +3138,186 @@ static void sendData(const SendParams * pSendParams)
             }
 
             if (okToDelete) {
-                urtp.setUrtpDatagramAsRead(urtpDatagram);
+                setDatagramAsRead(urtpDatagram);
             }
         }
+
+#ifdef RTP_OUTPUT
+        if (gTransportConnected && (pSendParams->pSock != NULL) && (pSendParams->pServer != NULL)) {
+            serviceRtcp(pSendParams);
+        }
+#endif
+#ifdef SPOOL_FILE
+        // Use any gap in the live stream to catch up
+        if ((pSendParams->pSock != NULL) && (pSendParams->pServer != NULL)) {
+            backfill(pSendParams, &pacerTimer);
+        }
+#endif
+        gSocketMutex.unlock();
+    }
+}
+
+// Start the codec, the send task and I2S, unless they are
+// already running (e.g. because audio was being spooled)
+static bool startAudio(I2S * pI2s, SendParams * pSendParams)
+{
+    int retValue;
+
+    if (gpSendTask != NULL) {
+        printf("Audio already running, carrying on.\n");
+        return true;
+    }
+
+#ifdef FAN_OUT_DESTINATIONS
+    // Cursor 0 is for SERVER_NAME
+    gBacklog.init(gBacklogStorage, sizeof(gBacklogStorage), URTP_DATAGRAM_SIZE,
+                  NUM_FAN_OUT_DESTINATIONS + 1, FAN_OUT_BACKLOG_PACK);
+    for (int x = 0; x < NUM_FAN_OUT_DESTINATIONS; x++) {
+        gDestinations[x].pConfig = &(gDestinationConfigs[x]);
+        gDestinations[x].cursor = x + 1;
+        gDestinations[x].retryWaitMs = 0;
+        gDestinations[x].retryTimer.start();
+        if (gDestinations[x].cursor >= BACKLOG_MAX_NUM_CURSORS) {
+            printf("Too many fan-out destinations, %s:%d will be ignored.\n",
+                   gDestinationConfigs[x].pName, gDestinationConfigs[x].port);
+        }
+    }
+#endif
+#ifdef TIERED_BACKLOG
+    gHotTier.init(gHotTierStorage, sizeof(gHotTierStorage), URTP_DATAGRAM_SIZE, 1, false);
+    gWarmTier.init(gWarmTierStorage, sizeof(gWarmTierStorage), URTP_DATAGRAM_SIZE, 1, true);
+    gTierDatagramHeld = false;
+#endif
+#ifdef RTP_OUTPUT
+    // The SSRC and first timestamp should be random; how long it
+    // took to get here is the best source of randomness to hand
+    srand(gUpTimer.read_us());
+    gRtpSender.init(((uint32_t) rand() << 16) ^ (uint32_t) rand(), ((uint32_t) rand() << 16) ^ (uint32_t) rand(),
+                    RTP_PAYLOAD_TYPE, SAMPLING_FREQUENCY, RTCP_CNAME);
+#endif
+
+    printf ("Setting up audio codec...\n");
+    if (!urtp.init((void *) &datagramStorage)) {
+        bad();
+        printf("Unable to initialise audio codec.\n");
+        return false;
+    }
+
+    printf ("Starting task to send data...\n");
+    gpSendTask = new Thread();
+    retValue = gpSendTask->start(callback(sendData, pSendParams));
+    if (retValue != osOK) {
+        bad();
+        printf("Unable to start sending task (error %d).\n", retValue);
+        delete gpSendTask;
+        gpSendTask = NULL;
+        return false;
+    }
+    printf("Send data task started.\n");
+
+    printf("Starting I2S...\n");
+    if (!startI2s(pI2s)) {
+        bad();
+        printf("Unable to start reading from I2S.\n");
+        gpSendTask->terminate();
+        gpSendTask->join();
+        delete gpSendTask;
+        gpSendTask = NULL;
+        return false;
+    }
+    printf("I2S started.\n");
+
+    return true;
+}
+
+// Stop I2S and the send task
+static void stopAudio(I2S * pI2s, bool waitForSends)
+{
+    if (gpSendTask != NULL) {
+        stopI2s(pI2s);
+        if (waitForSends) {
+            // Wait for any on-going transmissions to complete
+            wait_ms(2000);
+        }
+        gpSendTask->terminate();
+        gpSendTask->join();
+        delete gpSendTask;
+        gpSendTask = NULL;
     }
 }
 
 // Monitoring operation on a 1 second tick
 static void monitor()
 {
+#ifdef FAN_OUT_DESTINATIONS
+    int lagMs;
+#endif
+
     // Monitor throughput
     if (gBytesSent > 0) {
         LOG(EVENT_THROUGHPUT_BITS_S, gBytesSent << 3);
+        gThroughputSum += gBytesSent << 3;
+        gNumThroughputs++;
+        if ((int) (gBytesSent << 3) > gPeakThroughput) {
+            gPeakThroughput = gBytesSent << 3;
+        }
+#ifdef PPP_UART_AUTO_BAUD
+        // How much of the UART's capacity (ten bits a byte) the payload used
+        LOG(EVENT_PPP_UART_LOAD_PERCENT, (int) (gBytesSent * 10 * 100 / gPppBaud));
+#endif
         gBytesSent = 0;
-        LOG(EVENT_NUM_DATAGRAMS_QUEUED, urtp.getUrtpDatagramsAvailable());
+        LOG(EVENT_NUM_DATAGRAMS_QUEUED, getNumDatagramsQueued());
+        LOG(EVENT_SEND_QUEUE_DELAY_MS, gQueueDelayPeak);
+        gQueueDelayPeak = 0;
+    }
+#ifdef FAN_OUT_DESTINATIONS
+    // Lag is how far behind the newest datagram each destination is
+    lagMs = gBacklog.getNumWaiting(0) * BLOCK_DURATION_MS;
+    if (lagMs > gServerMaxLagMs) {
+        gServerMaxLagMs = lagMs;
+    }
+    for (int x = 0; x < NUM_FAN_OUT_DESTINATIONS; x++) {
+        lagMs = gBacklog.getNumWaiting(gDestinations[x].cursor) * BLOCK_DURATION_MS;
+        if (lagMs > gDestinations[x].maxLagMs) {
+            gDestinations[x].maxLagMs = lagMs;
+        }
+        if (gDestinations[x].pTask != NULL) {
+            LOG(EVENT_FAN_OUT_DESTINATION, gDestinations[x].cursor);
+            LOG(EVENT_FAN_OUT_THROUGHPUT_BITS_S, gDestinations[x].bytesThisSecond << 3);
+            LOG(EVENT_FAN_OUT_LAG_MS, lagMs);
+        }
+        gDestinations[x].bytesThisSecond = 0;
+    }
+#endif
+#ifdef MEASURE_SAMPLE_CLOCK_DRIFT
+    if (gSampleClockDriftValid) {
+        LOG(EVENT_SAMPLE_CLOCK_DRIFT_PPB, getSampleClockDriftPpb());
+    }
+#endif
+#ifdef SPOOL_FILE
+    if (gBackfillBytesThisSecond > 0) {
+        LOG(EVENT_SPOOL_BACKFILL_BITS_S, gBackfillBytesThisSecond << 3);
+        gBackfillBytesThisSecond = 0;
+    }
+#endif
+#ifdef TIERED_BACKLOG
+    // The counts are written by other tasks, so may be a
+    // datagram out either way, which doesn't matter here
+    if (gHotToWarmThisSecond > 0) {
+        LOG(EVENT_TIER_HOT_TO_WARM_PER_S, gHotToWarmThisSecond);
+        if (gHotToWarmThisSecond > gHotToWarmPeakPerSecond) {
+            gHotToWarmPeakPerSecond = gHotToWarmThisSecond;
+        }
+        gHotToWarmThisSecond = 0;
     }
+    if (gWarmToColdThisSecond > 0) {
+        LOG(EVENT_TIER_WARM_TO_COLD_PER_S, gWarmToColdThisSecond);
+        if (gWarmToColdThisSecond > gWarmToColdPeakPerSecond) {
+            gWarmToColdPeakPerSecond = gWarmToColdThisSecond;
+        }
+        gWarmToColdThisSecond = 0;
+    }
+#endif
 }
 
 /* ----------------------------------------------------------------
@@ -576,9 +3331,26 @@ int main(void)
     I2S *pMic = new I2S(PB_15, PB_10, PB_9);
     SendParams sendParams;
     InterruptIn userButton(SW0);
-    int retValue;
+    int waitMs;
+    double variance;
 
     printf("\n");
+#ifdef LWIP_PROFILE
+    // Built with one of the per-link profiles from tools/lwip_sweep
+    printf("lwIP profile \"%s\": TCP_MSS %d, TCP_WND %d, TCP_SND_BUF %d, PBUF_POOL_SIZE %d,"
+           " MEMP_NUM_TCP_SEG %d.\n", LWIP_PROFILE, TCP_MSS, TCP_WND, TCP_SND_BUF,
+           PBUF_POOL_SIZE, MEMP_NUM_TCP_SEG);
+#endif
+
+    gUpTimer.start();
+    gConnStateTimer.start();
+    gMainThreadId = osThreadGetId();
+#ifdef CLOCK_SYNC
+    gLatency.init(gLatencyBins, LATENCY_NUM_BINS, LATENCY_BIN_US);
+#endif
+#if defined(MEASURE_SAMPLE_CLOCK_DRIFT) && defined(CLOCK_SYNC)
+    gServerClockDrift.init((int64_t) SERVER_CLOCK_DRIFT_MIN_SPAN_MS * 1000);
+#endif
 
     gSecondTicker.attach_us(callback(&monitor), 1000000);
     initLog();
@@ -592,150 +3364,230 @@ int main(void)
 
     good();
 
-#ifdef LOCAL_FILE
-    printf("Opening file %s...\n", LOCAL_FILE);
+#if defined(LOCAL_FILE) || defined(SPOOL_FILE) || defined(DNS_CACHE_FILE) || defined(SD_BENCHMARK) || \
+    defined(TIERED_BACKLOG)
     gSd.init();
     gFs.mount(&gSd);
-    remove (LOCAL_FILE);
-    // Sometimes we fail to open the file unless there's a pause here
-    // after any existing file is removed
-    wait_ms(1000);
-    gpFile = fopen(LOCAL_FILE, "wb+");
-    if (gpFile != NULL) {
+#endif
+
+#ifdef SD_BENCHMARK
+    sdBenchmark();
+    gFs.unmount();
+    gSd.deinit();
+    return 0;
+#endif
+
+#ifdef SPOOL_FILE
+    printf("Opening spool file %s...\n", SPOOL_FILE);
+    if (gSpool.open(SPOOL_FILE, URTP_DATAGRAM_SIZE, gSpoolWriteBuf,
+                    gSpoolReadBuf, SPOOL_BUFFER_NUM_DATAGRAMS)) {
+        LOG(EVENT_SPOOL_OPEN, 0);
+    } else {
+        bad();
+        LOG(EVENT_SPOOL_OPEN_FAILURE, 0);
+        printf("Unable to open spool file, audio will be held in RAM while the network is down.\n");
+    }
+#endif
+
+#ifdef TIERED_BACKLOG
+    printf("Opening cold tier file %s...\n", TIERED_BACKLOG_COLD_FILE);
+    if (!gColdTier.open(TIERED_BACKLOG_COLD_FILE, URTP_DATAGRAM_SIZE, gColdTierWriteBuf,
+                        gColdTierReadBuf, TIERED_BACKLOG_COLD_BUFFER_NUM_DATAGRAMS)) {
+        bad();
+        LOG(EVENT_TIER_COLD_WRITE_FAILURE, 0);
+        printf("Unable to open cold tier file, audio will only be held in RAM while the network is down.\n");
+    }
+#endif
+
+#ifdef LOCAL_FILE
+    if (openFile()) {
         LOG(EVENT_FILE_OPEN, 0);
 #endif
 
 #ifdef SERVER_NAME
+    gDnsCache.init(DNS_CACHE_TTL_SECONDS);
+# ifdef DNS_CACHE_FILE
+    if (gDnsCache.load(DNS_CACHE_FILE, nowSeconds())) {
+        printf("DNS cache loaded from %s.\n", DNS_CACHE_FILE);
+    }
+# endif
 # ifdef USE_ETHERNET
     printf("Connecting via Ethernet interface...\n");
     pInterface = new INTERFACE_CLASS();
+#  ifdef USE_MULTIPATH
+    printf("Bringing up cellular as a second path...\n");
+    startSecondaryPath();
+#  endif
 # else
     printf("Starting up, please wait up to 180 seconds to connect to the packet network...\n");
-    pInterface = new INTERFACE_CLASS(MDMTXD, MDMRXD, 230400);
+    pInterface = new INTERFACE_CLASS(MDMTXD, MDMRXD, PPP_UART_INITIAL_BAUD);
 # endif
-#ifndef STREAM_DURATION_MILLISECONDS
-        while (!gButtonPressed) {
+        setConnState(CONN_STATE_NETWORK_START);
 #else
-        {
+        setConnState(CONN_STATE_STREAM_START);
 #endif
-            sendParams.pSock = startNetwork(pInterface);
-            if (sendParams.pSock != NULL) {
-                good();
-
-                printf("Verifying that the server exists...\n");
-#ifndef STREAM_DURATION_MILLISECONDS
-                while (gNetworkConnected && !gButtonPressed) {
+        while (gConnState != CONN_STATE_STOPPED) {
+            if ((gConnState != CONN_STATE_STOPPING) &&
+#ifdef STREAM_DURATION_MILLISECONDS
+                (gButtonPressed || (gHasStreamed && (gStreamTimer.read_ms() >= STREAM_DURATION_MILLISECONDS)))) {
 #else
-                if (gNetworkConnected) {
+                gButtonPressed) {
 #endif
-                    sendParams.pServer = verifyServer(pInterface);
+                setConnState(CONN_STATE_STOPPING);
+            }
+
+            switch (gConnState) {
+#ifdef SERVER_NAME
+                case CONN_STATE_NETWORK_START:
+                    sendParams.pSock = startNetwork(pInterface);
+                    if (sendParams.pSock != NULL) {
+                        good();
+                        printf("Verifying that the server exists...\n");
+                        setConnState(CONN_STATE_SERVER_VERIFY);
+                    } else {
+                        bad();
+                        LOG(EVENT_NETWORK_START_FAILURE, 0);
+                        printf("Unable to connect to the network and open a socket.\n");
+                        stopNetwork(pInterface);
+                        backoff(CONN_STATE_NETWORK_START);
+                    }
+                break;
+                case CONN_STATE_SERVER_VERIFY:
+                    sendParams.pServer = finishResolve(pInterface);
                     if (sendParams.pServer != NULL) {
                         good();
+                        setConnState(CONN_STATE_TRANSPORT_CONNECT);
+                    } else {
+                        bad();
+                        printf("Unable to locate server.\n");
+                        backoff(CONN_STATE_SERVER_VERIFY);
+                    }
+                break;
+                case CONN_STATE_TRANSPORT_CONNECT:
 # ifdef USE_TCP
-                        printf("Connecting TCP...\n");
-#  ifndef STREAM_DURATION_MILLISECONDS
-                        while (gNetworkConnected && !gButtonPressed) {
-#  else
-                        if (gNetworkConnected) {
-#  endif
-                            if (connectTcp(&sendParams)) {
-                                good();
-                                printf("Connected.\n");
+                    printf("Connecting TCP...\n");
+                    if (connectTcp(&sendParams)) {
+                        good();
+                        printf("Connected.\n");
+                        setConnState(CONN_STATE_STREAM_START);
+                    } else {
+                        bad();
+                        stopNetwork(pInterface);
+                        printf("Unable to make TCP connection to %s:%d.\n",
+                               sendParams.pServer->get_ip_address(),
+                               sendParams.pServer->get_port());
+                        backoff(CONN_STATE_NETWORK_START);
+                    }
+# else
+                    setConnState(CONN_STATE_STREAM_START);
 # endif
+                break;
+                case CONN_STATE_TRANSPORT_RECONNECT:
+                    printf("Connection to server lost, reconnecting...\n");
+                    if (reconnectTransport(pInterface, &sendParams)) {
+                        setConnState(CONN_STATE_STREAM_START);
+                    } else {
+                        // Leave audio running: datagrams are queued
+                        // (or spooled) until we're back
+                        printf("Network connection lost, audio capture continues.\n");
+                        stopNetwork(pInterface);
+                        backoff(CONN_STATE_NETWORK_START);
+                    }
+                break;
+                case CONN_STATE_BACKOFF:
+                    // Wait, unless the button is pressed
+                    while (!gButtonPressed && (gConnStateTimer.read_ms() < gBackoffMs)) {
+                        Thread::signal_wait(SIG_CONN_EVENT, gBackoffMs - gConnStateTimer.read_ms());
+                    }
+                    if (!gButtonPressed) {
+                        setConnState(gConnStateAfterBackoff);
+                    }
+                break;
 #endif
-                                printf ("Setting up audio codec...\n");
-                                if (urtp.init((void *) &datagramStorage)) {
-                                    printf ("Starting task to send data...\n");
-                                    if (gpSendTask == NULL) {
-                                        gpSendTask = new Thread();
-                                    }
-                                    retValue = gpSendTask->start(callback(sendData, &sendParams));
-                                    if (retValue == osOK) {
-                                        printf("Send data task started.\n");
-                                        printf("Starting I2S...\n");
-                                        if (startI2s(pMic)) {
-                                            printf("I2S started.\n");
+                case CONN_STATE_STREAM_START:
+                    if (startAudio(pMic, &sendParams)) {
+                        gTransportConnected = true;
+                        gNumConsecutiveFailures = 0;
+                        if (!gHasStreamed) {
+                            gHasStreamed = true;
+                            gStreamTimer.start();
+                            gTimeToFirstStreamMs = gUpTimer.read_ms();
+                            LOG(EVENT_TIME_TO_STREAM_MS, gTimeToFirstStreamMs);
 #ifndef STREAM_DURATION_MILLISECONDS
-                                            printf("Streaming audio until the user button is pressed.\n");
-                                            while (gNetworkConnected && !gButtonPressed) {};
+                            printf("Streaming audio until the user button is pressed.\n");
 #else
-                                            printf("Streaming audio for %d milliseconds.\n", STREAM_DURATION_MILLISECONDS);
-                                            wait_ms(STREAM_DURATION_MILLISECONDS);
-#endif
-                                            if (gButtonPressed) {
-                                                printf("Stopping...\n");
-                                                stopI2s(pMic);
-                                                // Wait for any on-going transmissions to complete
-                                                wait_ms(2000);
-                                            } else {
-                                                printf("Network connection lost, stopping...\n");
-                                                stopI2s(pMic);
-                                            }
-
-                                            // Tidy up
-                                            gpSendTask->terminate();
-                                            gpSendTask->join();
-                                            delete gpSendTask;
-                                            gpSendTask = NULL;
-                                            stopNetwork(pInterface);
-
-                                            if (gButtonPressed) {
-                                                printf("Stopped.\n");
-                                                ledOff();
-                                            } else {
-#ifndef STREAM_DURATION_MILLISECONDS
-                                                printf("Trying again in %d second(s)...\n", RETRY_WAIT_SECONDS);
-                                                wait_ms(RETRY_WAIT_SECONDS * 1000);
-#endif
-                                            }
-                                        } else {
-                                            bad();
-                                            printf("Unable to start reading from I2S.\n");
-                                        }
-                                    } else {
-                                        bad();
-                                        printf("Unable to start sending task (error %d).\n", retValue);
-                                    }
-                                } else {
-                                    bad();
-                                    printf("Unable to initialise audio codec.\n");
-                                }
-#ifdef SERVER_NAME
-# ifdef USE_TCP
-                            } else {
-                                bad();
-                                stopNetwork(pInterface);
-                                printf("Unable to make TCP connection to %s:%d, trying again in %d second(s)...\n",
-                                       sendParams.pServer->get_ip_address(),
-                                       sendParams.pServer->get_port(),
-                                       RETRY_WAIT_SECONDS);
-                                wait_ms(RETRY_WAIT_SECONDS * 1000);
-                            }
-                        } // While (gNetworkConnected && !gButtonPressed)
-# endif
+                            printf("Streaming audio for %d milliseconds.\n", STREAM_DURATION_MILLISECONDS);
+#endif
+                        } else {
+                            LOG(EVENT_TIME_TO_STREAM_MS, gResumeTimer.read_ms());
+                            gTimeToRestreamSumMs += gResumeTimer.read_ms();
+                            gNumRestreams++;
+                            printf("Streaming again.\n");
+                        }
+#ifdef FAN_OUT_DESTINATIONS
+                        startFanOut(pInterface);
+#endif
+#ifdef CLOCK_SYNC
+                        startClockSync(pInterface);
+#endif
+                        setConnState(CONN_STATE_STREAMING);
                     } else {
-                        bad();
-                        printf("Unable to locate server, trying again in %d second(s)...\n", RETRY_WAIT_SECONDS);
-                        wait_ms(RETRY_WAIT_SECONDS * 1000);
+#ifdef SERVER_NAME
+                        stopNetwork(pInterface);
+                        backoff(CONN_STATE_NETWORK_START);
+#else
+                        setConnState(CONN_STATE_STOPPING);
+#endif
                     }
-                } // While (gNetworkConnected && !gButtonPressed)
-            } else {
-                bad();
-                LOG(EVENT_NETWORK_START_FAILURE, 0);
-                printf("Unable to connect to the network and open a socket, trying again in %d second(s)...\n", RETRY_WAIT_SECONDS);
-                stopNetwork(pInterface);
-                wait_ms(RETRY_WAIT_SECONDS * 1000);
-            }
-        } // While (!gButtonPressed)
+                break;
+                case CONN_STATE_STREAMING:
+                    // Wait for the send task or the button to tell us
+                    // something, waking up now and again to keep the
+                    // DNS cache fresh
+                    waitMs = DNS_CACHE_REFRESH_CHECK_MS;
+#ifdef STREAM_DURATION_MILLISECONDS
+                    if (STREAM_DURATION_MILLISECONDS - gStreamTimer.read_ms() < waitMs) {
+                        waitMs = STREAM_DURATION_MILLISECONDS - gStreamTimer.read_ms();
+                    }
+#endif
+                    if (waitMs > 0) {
+                        Thread::signal_wait(SIG_CONN_EVENT, waitMs);
+                    }
+#ifdef SERVER_NAME
+                    refreshResolve(pInterface);
+#endif
+                    if (!gTransportConnected) {
+                        LOG(EVENT_TRANSPORT_LOST, 0);
+                        gResumeTimer.reset();
+                        gResumeTimer.start();
+                        gResuming = true;
+#ifdef SERVER_NAME
+                        setConnState(CONN_STATE_TRANSPORT_RECONNECT);
 #endif
+                    }
+                break;
+                case CONN_STATE_STOPPING:
+                    printf("Stopping...\n");
+                    gTransportConnected = false;
+                    stopAudio(pMic, true);
+                    stopNetwork(pInterface);
+#ifdef USE_MULTIPATH
+                    stopSecondaryPath();
+#endif
+                    printf("Stopped.\n");
+                    ledOff();
+                    setConnState(CONN_STATE_STOPPED);
+                break;
+                default:
+                break;
+            }
+        }
 
 #ifdef LOCAL_FILE
         printf("Closing file %s on SD card...\n", LOCAL_FILE);
-        fclose(gpFile);
-        gpFile = NULL;
+        stopFileWrite();
+        closeFile();
         LOG(EVENT_FILE_CLOSE, 0);
-        gFs.unmount();
-        gSd.deinit();
         printf("File closed.\n");
     } else {
         bad();
@@ -744,13 +3596,257 @@ int main(void)
     }
 #endif
 
+    // Audio may still be running if it was being spooled
+    stopAudio(pMic, false);
+
+#ifdef SPOOL_FILE
+    if (gSpool.getNumDatagrams() > 0) {
+        printf("%d datagram(s) left unsent in the spool.\n", gSpool.getNumDatagrams());
+    }
+    gSpool.close();
+#endif
+
+#ifdef TIERED_BACKLOG
+    if (gColdTier.getNumDatagrams() > 0) {
+        printf("%d datagram(s) left unsent in the cold tier.\n", gColdTier.getNumDatagrams());
+    }
+    gColdTier.close();
+#endif
+
+#if defined(LOCAL_FILE) || defined(SPOOL_FILE) || defined(DNS_CACHE_FILE) || defined(TIERED_BACKLOG)
+    gFs.unmount();
+    gSd.deinit();
+#endif
+
     LOG(EVENT_LOG_STOP, 0);
     printLog();
 
+    printf("Connection states (time spent, number of times):\n");
+    for (int x = 0; x < MAX_NUM_CONN_STATES; x++) {
+        if (gConnStateCount[x] > 0) {
+            printf("  %s: %d ms, %d.\n", gConnStateNames[x], (int) gConnStateTimeMs[x], gConnStateCount[x]);
+        }
+    }
+    if (gHasStreamed) {
+        printf("Time to stream after power-up: %d ms.\n", gTimeToFirstStreamMs);
+    }
+    if (gNumRestreams > 0) {
+        printf("Average time to stream again after the connection was lost: %d ms.\n",
+               (int) (gTimeToRestreamSumMs / gNumRestreams));
+    }
+#ifdef SERVER_NAME
+    if (gNumDnsLookups > 0) {
+        // Each cache hit saved a look-up on the way to streaming
+        printf("%d DNS look-up(s), average %d ms; %d served from cache, saving about %d ms.\n",
+               gNumDnsLookups, (int) (gDnsLookupSumMs / gNumDnsLookups), gNumDnsCacheHits,
+               (int) (gDnsLookupSumMs * gNumDnsCacheHits / gNumDnsLookups));
+    }
+#endif
+
     if (gNumTimes > 0) {
         printf("Stats:\n");
         printf("Worst case time to perform a send: %d us.\n", gMaxTime);
         printf("Average time to perform a send: %d us.\n", (int) (gAverageTime / gNumTimes));
+        // The spread of send durations is our proxy for RTT variance
+        variance = ((double) gSumSquaresTime / gNumTimes) -
+                   ((double) gAverageTime / gNumTimes) * ((double) gAverageTime / gNumTimes);
+        if (variance < 0) {
+            variance = 0;
+        }
+        printf("Standard deviation of the time to perform a send: %d us.\n", (int) sqrt(variance));
+        if (gNumQueueDelays > 0) {
+            printf("Average queueing delay before a send: %d ms (worst case %d ms).\n",
+                   (int) (gQueueDelaySum / gNumQueueDelays), gMaxQueueDelay);
+        }
+        if (gNumThroughputs > 0) {
+            printf("Average throughput: %d bits/s.\n", (int) (gThroughputSum / gNumThroughputs));
+        }
+#ifdef PPP_UART_AUTO_BAUD
+        printf("PPP UART at %d baud, peak payload throughput %d bits/s (%d%% of the UART's capacity).\n",
+               gPppBaud, gPeakThroughput, (int) ((uint64_t) gPeakThroughput * 10 * 100 / 8 / gPppBaud));
+#endif
+#ifdef SEND_PACER
+        printf("Pacer (%d bits/s, burst %d bytes) held back %d send(s) for %d ms in total.\n",
+               SEND_PACER_RATE_BITS_S, SEND_PACER_BURST_BYTES, gNumPacerWaits,
+               (int) (gPacerWaitTotalUs / 1000));
+#endif
+#ifdef TCP_CONGESTION_AWARE
+        printf("TCP window: smallest congestion window %d byte(s), waited for the window to open %d time(s),"
+               " downshifted %d time(s).\n", gMinCwnd, gNumTcpWindowWaits, gNumDownshifts);
+# ifdef TCP_CONGESTION_THINNING
+        printf("%d datagram(s) dropped to thin the stream (sequence numbers logged).\n", gNumThinned);
+# endif
+        printTcpWindowTrace();
+#endif
+#ifdef USE_RELIABLE_UDP
+        printf("%d NACK(s) received, %d datagram(s) sent again, %d no longer in the retransmit window,"
+               " %d packet(s) ignored as not from the server.\n", gNumNacks, gNumRetransmits,
+               gNumRetransmitsNotPossible, gNumNacksIgnored);
+#endif
+#ifdef USE_FEC
+        if (gNumDatagramsSent > 0) {
+            printf("%d FEC parity datagram(s) sent, %d%% extra bandwidth.\n", gNumParitySent,
+                   (int) ((uint64_t) gNumParitySent * FEC_PARITY_DATAGRAM_SIZE(URTP_DATAGRAM_SIZE) * 100 /
+                          ((uint64_t) gNumDatagramsSent * URTP_DATAGRAM_SIZE)));
+        }
+#endif
+        if (gNumResumes > 0) {
+            printf("Sending resumed %d time(s) after losing the connection, on average after %d ms"
+                   " (worst case %d ms).\n", gNumResumes, (int) (gResumeSumMs / gNumResumes), gMaxResumeMs);
+        }
+#ifdef SPOOL_FILE
+        printf("%d datagram(s) spooled to SD card while the network was down (%d spool write failure(s)),"
+               " %d backfilled.\n", gNumSpooled, gNumSpoolWriteFailures, gNumBackfilled);
+        if (gBackfillTimer.read_ms() > 0) {
+            // Real time is one datagram per block
+            printf("Average backfill rate %d bits/s, %d%% of real time.\n",
+                   (int) ((gBackfillBytes << 3) * 1000 / gBackfillTimer.read_ms()),
+                   (int) ((uint64_t) gBackfillBytes * BLOCK_DURATION_MS * 100 /
+                          ((uint64_t) URTP_DATAGRAM_SIZE * gBackfillTimer.read_ms())));
+        }
+#endif
+#ifdef USE_MULTIPATH
+        printf("%d datagram(s) sent over cellular, %d failover(s) (worst case %d us, against a block"
+               " duration of %d ms), %d path switch(es).\n", gNumSentSecondary, gNumFailovers,
+               gMaxFailoverUs, BLOCK_DURATION_MS, gPathSelector.getNumSwitches());
+#endif
+#ifdef CLOCK_SYNC
+        if (gLatency.getCount() > 0) {
+            printf("Latency from capture to %s (%d datagram(s)): 50%% %d ms, 90%% %d ms, 99%% %d ms,"
+                   " worst %d ms.\n", gClockSync.isValid() ? "the server" : "the end of the send",
+                   gLatency.getCount(), gLatency.getPercentileUs(50) / 1000,
+                   gLatency.getPercentileUs(90) / 1000, gLatency.getPercentileUs(99) / 1000,
+                   gLatency.getMaxUs() / 1000);
+        }
+        printf("%d time exchange(s) with the server, best round trip %d us, %d failure(s).\n",
+               gClockSync.getNumExchanges(), gClockSync.getDelayUs(), gNumClockSyncFailures);
+#endif
+#ifdef RTP_OUTPUT
+        printf("%d RTP packet(s) sent, %d byte(s) of audio", (int) gRtpSender.getNumPackets(),
+               (int) gRtpSender.getNumOctets());
+        if (gNumRtcpReports > 0) {
+            printf("; %d RTCP report(s), the last saying %d%% lost recently, %d lost in all, jitter %d us"
+                   " (worst %d us), round trip %d us", gNumRtcpReports,
+                   gLastReportBlock.fractionLost * 100 / 256, gLastReportBlock.cumulativeLost,
+                   (int) ((uint64_t) gLastReportBlock.jitter * 1000000 / SAMPLING_FREQUENCY),
+                   gMaxRtcpJitterUs, gLastRttUs);
+        }
+        if (gNumRtcpIgnored > 0) {
+            printf("; %d RTCP packet(s) ignored as not from the server", gNumRtcpIgnored);
+        }
+        printf(".\n");
+#endif
+#ifdef LOCAL_FILE
+        if (gNumFileWrites > 0) {
+            printf("%d write(s) to file, %d byte(s) written, %d failure(s), %d datagram(s) missed because"
+                   " writes had fallen behind.\n", gNumFileWrites, (int) gFileBytesWritten,
+                   gNumFileWriteFailures, gNumFileOverruns);
+            // A full buffer must be written in less time than it takes to fill
+            printf("Time to write a %d byte file buffer (%d ms of audio) %s: 50%% %d ms, 99%% %d ms,"
+                   " worst %d ms.\n", (int) sizeof(gFileBuf[0]), FILE_BUFFER_NUM_RECORDS * BLOCK_DURATION_MS,
+# ifdef LOCAL_FILE_RAW
+                   "raw",
+# else
+                   "through FAT",
+# endif
+                   gFileWriteLatency.getPercentileUs(50) / 1000, gFileWriteLatency.getPercentileUs(99) / 1000,
+                   gFileWriteLatency.getMaxUs() / 1000);
+            // How fast SD takes the audio while writing against how fast
+            // it arrives: the headroom is what rides out a slow write
+            if (gFileWriteUs > 0) {
+                printf("Write throughput to SD %d kbyte(s)/s sustained, %d kbyte(s)/s needed.\n",
+                       (int) (gFileBytesWritten * 1000 / gFileWriteUs),
+                       FILE_RECORD_SIZE * (1000 / BLOCK_DURATION_MS) / 1000);
+            }
+# ifdef LOCAL_FILE_JOURNAL_SECONDS
+            // What committing costs: the throughput with the time
+            // spent on commits against that without
+            printf("Run %d committed %d time(s) to %s, %d failure(s), %d byte(s) last committed;"
+                   " a commit takes %d us on average, worst %d us.\n", (int) gJournal.getRun(),
+                   (int) gJournal.getNumCommits(), LOCAL_FILE_JOURNAL, gNumFileCommitFailures,
+                   (int) gJournal.getNumBytes(),
+                   (gJournal.getNumCommits() > 0) ? (int) (gFileCommitUs / gJournal.getNumCommits()) : 0,
+                   gFileCommitMaxUs);
+            if (gFileWriteUs + gFileCommitUs > 0) {
+                printf("Write throughput to SD with commits %d kbyte(s)/s sustained, %d.%d%% of the time"
+                       " spent committing.\n", (int) (gFileBytesWritten * 1000 / (gFileWriteUs + gFileCommitUs)),
+                       (int) (gFileCommitUs * 100 / (gFileWriteUs + gFileCommitUs)),
+                       (int) (gFileCommitUs * 1000 / (gFileWriteUs + gFileCommitUs) % 10));
+            }
+# endif
+# ifdef LOCAL_FILE_RAW
+            printf("Raw recording: %d byte(s), %d write(s) had to wait for an erase, %d found the region full.\n",
+                   (int) gRawLog.getNumBytes(), gRawLog.getNumEraseStalls(), gRawLog.getNumFullFailures());
+# endif
+# ifdef LOCAL_FILE_SEGMENT_SECONDS
+            printf("Recorded run %d, up to segment %d; %d move(s) to a new segment had to open its files.\n",
+                   (int) gSegmentWriter.getRun(), (int) gSegmentWriter.getSegment(),
+                   gSegmentWriter.getNumUnpreparedSwitches());
+# endif
+# ifdef LOCAL_FILE_WAV
+            printf("WAV file: %d byte(s) of audio, header written %d time(s).\n",
+                   (int) gWavWriter.getNumBytes(), gWavWriter.getNumHeaderWrites());
+# endif
+        }
+#endif
+#ifdef MEASURE_SAMPLE_CLOCK_DRIFT
+        if (gSampleClockDriftValid) {
+            printf("Sample clock drift ");
+            printPpm(gSampleClockDriftPpb);
+            printf(" against our clock, from %d DMA event(s)", gNumBlocks);
+# ifdef CLOCK_SYNC
+            if (gServerClockDriftValid) {
+                printf(", ");
+                printPpm(getSampleClockDriftPpb());
+                printf(" against the server's clock");
+            }
+# endif
+            printf(".\n");
+        }
+#endif
+#ifdef FAN_OUT_DESTINATIONS
+        // How much audio the backlog has had to hold against how
+        // much it could: packing makes the datagrams take less room
+        printf("Fan-out from a backlog of %d byte(s), datagrams stored in %d%% of their size; at most"
+               " %d datagram(s) (%d ms) held at once, minimum free %d byte(s):\n", FAN_OUT_BACKLOG_SIZE,
+               gBacklog.getStoredPercent(), gBacklog.getNumHeldMax(),
+               gBacklog.getNumHeldMax() * BLOCK_DURATION_MS, gBacklog.getNumBytesFreeMin());
+        printf("  %s:%d: worst lag %d ms, %d datagram(s) missed.\n", SERVER_NAME, SERVER_PORT,
+               gServerMaxLagMs, gBacklog.getNumOverruns(0));
+        for (int x = 0; x < NUM_FAN_OUT_DESTINATIONS; x++) {
+            printf("  %s:%d (%s): %d datagram(s) sent", gDestinations[x].pConfig->pName,
+                   gDestinations[x].pConfig->port, gDestinations[x].pConfig->useTcp ? "TCP" : "UDP",
+                   gDestinations[x].numSent);
+            if (gStreamTimer.read_ms() > 0) {
+                printf(", average %d bits/s", (int) ((gDestinations[x].bytesSent << 3) * 1000 /
+                                                     gStreamTimer.read_ms()));
+            }
+            printf(", worst lag %d ms, %d datagram(s) missed, %d send failure(s), %d connection(s).\n",
+                   gDestinations[x].maxLagMs, gBacklog.getNumOverruns(gDestinations[x].cursor),
+                   gDestinations[x].numSendFailures, gDestinations[x].numConnects);
+        }
+#endif
+#ifdef TIERED_BACKLOG
+        // Real time is one datagram per block
+        printf("Tiered backlog: at most %d datagram(s) (%d second(s)) waiting at once.\n",
+               gNumTieredMax, gNumTieredMax * BLOCK_DURATION_MS / 1000);
+        printf("  Hot, %d byte(s) SRAM: at most %d datagram(s) held, %d sent from here.\n",
+               TIERED_BACKLOG_HOT_SIZE, gHotTier.getNumHeldMax(), gNumTierSent[0]);
+        printf("  Warm, %d byte(s) CCMRAM, datagrams stored in %d%% of their size: at most %d"
+               " datagram(s) held, minimum free %d byte(s), %d sent from here, %d lost"
+               " as it filled.\n", TIERED_BACKLOG_WARM_SIZE, gWarmTier.getStoredPercent(),
+               gWarmTier.getNumHeldMax(), gWarmTier.getNumBytesFreeMin(), gNumTierSent[1],
+               gWarmTier.getNumOverruns(0));
+        printf("  Cold, %s: %d sent from here, %d write failure(s).\n", TIERED_BACKLOG_COLD_FILE,
+               gNumTierSent[2], gNumColdWriteFailures);
+        printf("  %d datagram(s) moved hot to warm, %d warm to cold", gNumHotToWarm, gNumWarmToCold);
+        if (gStreamTimer.read_ms() > 0) {
+            printf(", on average %d and %d per minute", (int) ((int64_t) gNumHotToWarm * 60000 /
+                                                                gStreamTimer.read_ms()),
+                   (int) ((int64_t) gNumWarmToCold * 60000 / gStreamTimer.read_ms()));
+        }
+        printf(", at most %d and %d in one second.\n", gHotToWarmPeakPerSecond, gWarmToColdPeakPerSecond);
+#endif
         printf("Minimum number of datagram(s) free %d.\n", urtp.getUrtpDatagramsFreeMin());
         printf("Number of send failure(s) %d,\n", gNumSendFailures);
         printf("%d send(s) took longer than %d ms (%d%% of the total).\n", gNumSendTookTooLong,
@@ -0,0 +1,112 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "multipath.h"
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Constructor
+PathSelector::PathSelector()
+{
+    init(0, 0);
+}
+
+// Set up the paths
+void PathSelector::init(int numPaths, int holdDownMs)
+{
+    _numPaths = numPaths;
+    if (_numPaths > MULTIPATH_MAX_NUM_PATHS) {
+        _numPaths = MULTIPATH_MAX_NUM_PATHS;
+    }
+    _holdDownMs = holdDownMs;
+    memset(_up, 0, sizeof(_up));
+    memset(_heldDown, 0, sizeof(_heldDown));
+    memset(_holdDownStartMs, 0, sizeof(_holdDownStartMs));
+    _currentPath = -1;
+    _numSwitches = 0;
+}
+
+// Set whether a path is up
+void PathSelector::setUp(int path, bool up)
+{
+    if ((path >= 0) && (path < _numPaths)) {
+        if (up && !_up[path]) {
+            // Newly up, give it a chance
+            _heldDown[path] = false;
+        }
+        _up[path] = up;
+    }
+}
+
+// Choose a path
+int PathSelector::getPath(uint32_t nowMs, int excludePath)
+{
+    int path = -1;
+
+    for (int x = 0; (x < _numPaths) && (path < 0); x++) {
+        if (_heldDown[x] && ((uint32_t) (nowMs - _holdDownStartMs[x]) >= (uint32_t) _holdDownMs)) {
+            _heldDown[x] = false;
+        }
+        if (_up[x] && !_heldDown[x] && (x != excludePath)) {
+            path = x;
+        }
+    }
+
+    // If everything is held down, try anything that's up
+    for (int x = 0; (x < _numPaths) && (path < 0); x++) {
+        if (_up[x] && (x != excludePath)) {
+            path = x;
+        }
+    }
+
+    return path;
+}
+
+// A send worked
+void PathSelector::sendSucceeded(int path)
+{
+    if ((path >= 0) && (path < _numPaths)) {
+        if ((_currentPath >= 0) && (path != _currentPath)) {
+            _numSwitches++;
+        }
+        _currentPath = path;
+    }
+}
+
+// A send failed
+void PathSelector::sendFailed(int path, uint32_t nowMs)
+{
+    if ((path >= 0) && (path < _numPaths)) {
+        _heldDown[path] = true;
+        _holdDownStartMs[path] = nowMs;
+    }
+}
+
+// Get the current path
+int PathSelector::getCurrentPath()
+{
+    return _currentPath;
+}
+
+// Get the number of switches
+unsigned int PathSelector::getNumSwitches()
+{
+    return _numSwitches;
+}
@@ -0,0 +1,85 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Choice of path when there is more than one way to reach the server
+ * (e.g. Ethernet and cellular), in order of preference.
+ *
+ * Datagrams go over the most preferred path that is up.  When a send on
+ * a path fails, the path is held down for a while and the caller sends
+ * the same datagram again straight away over the next path, so failover
+ * costs no more than the failed send and no sequence numbers are
+ * skipped.  Once the hold-down is over, the path is tried again with
+ * the next datagram; if it works, traffic moves back to it.
+ *
+ * Times are in milliseconds, supplied by the caller, which keeps this
+ * independent of mbed so that the host tools can use it too.
+ */
+
+#ifndef _MULTIPATH_H_
+#define _MULTIPATH_H_
+
+#include <stdint.h>
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The maximum number of paths
+#define MULTIPATH_MAX_NUM_PATHS 4
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+class PathSelector {
+public:
+    PathSelector();
+
+    // Set up for numPaths paths, path 0 being the most preferred;
+    // all start down
+    void init(int numPaths, int holdDownMs);
+
+    // Set whether a path is up at all (e.g. its interface is connected)
+    void setUp(int path, bool up);
+
+    // Get the path to send on, or -1 if there is none; a path that is
+    // held down is only chosen if all are.  excludePath (if not -1) is
+    // not considered, e.g. because it has just failed.
+    int getPath(uint32_t nowMs, int excludePath = -1);
+
+    // Report that a send over a path worked
+    void sendSucceeded(int path);
+
+    // Report that a send over a path failed
+    void sendFailed(int path, uint32_t nowMs);
+
+    // Get the path the last successful send went over, or -1
+    int getCurrentPath();
+
+    // Get the number of times traffic has moved from one path to another
+    unsigned int getNumSwitches();
+
+protected:
+    int _numPaths;
+    int _holdDownMs;
+    bool _up[MULTIPATH_MAX_NUM_PATHS];
+    bool _heldDown[MULTIPATH_MAX_NUM_PATHS];
+    uint32_t _holdDownStartMs[MULTIPATH_MAX_NUM_PATHS];
+    int _currentPath;
+    unsigned int _numSwitches;
+};
+
+#endif // _MULTIPATH_H_
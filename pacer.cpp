@@ -0,0 +1,114 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pacer.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The number of micro-bits in a byte
+#define MICRO_BITS_PER_BYTE 8000000LL
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Constructor
+Pacer::Pacer()
+{
+    _rateBitsPerSecond = 0;
+    _burstMicroBits = 0;
+    _tokensMicroBits = 0;
+    _lastUs = 0;
+}
+
+// Set the rate and burst size, filling the bucket
+void Pacer::init(int rateBitsPerSecond, int burstBytes, uint64_t nowUs)
+{
+    _rateBitsPerSecond = rateBitsPerSecond;
+    _burstMicroBits = (int64_t) burstBytes * MICRO_BITS_PER_BYTE;
+    _tokensMicroBits = _burstMicroBits;
+    _lastUs = nowUs;
+}
+
+// Change the rate
+void Pacer::setRate(int rateBitsPerSecond, uint64_t nowUs)
+{
+    // Bank what has accumulated at the old rate first
+    refill(nowUs);
+    _rateBitsPerSecond = rateBitsPerSecond;
+}
+
+// Get the rate
+int Pacer::getRate()
+{
+    return _rateBitsPerSecond;
+}
+
+// Return the time to wait before size bytes may be sent
+int Pacer::getWaitUs(int size, uint64_t nowUs)
+{
+    int64_t shortfall;
+    int waitUs = 0;
+
+    if (_rateBitsPerSecond > 0) {
+        refill(nowUs);
+        // A datagram bigger than the burst size would never fit,
+        // so a full bucket is always enough
+        shortfall = (int64_t) size * MICRO_BITS_PER_BYTE;
+        if (shortfall > _burstMicroBits) {
+            shortfall = _burstMicroBits;
+        }
+        shortfall -= _tokensMicroBits;
+        if (shortfall > 0) {
+            // Round up so that the caller doesn't wake too early
+            waitUs = (int) ((shortfall + _rateBitsPerSecond - 1) / _rateBitsPerSecond);
+        }
+    }
+
+    return waitUs;
+}
+
+// Take the tokens for a send
+void Pacer::consume(int size, uint64_t nowUs)
+{
+    if (_rateBitsPerSecond > 0) {
+        refill(nowUs);
+        _tokensMicroBits -= (int64_t) size * MICRO_BITS_PER_BYTE;
+        // Don't let debt build up beyond one burst, otherwise
+        // an over-sized send could hold things up for ages
+        if (_tokensMicroBits < -_burstMicroBits) {
+            _tokensMicroBits = -_burstMicroBits;
+        }
+    }
+}
+
+/* ----------------------------------------------------------------
+ * PROTECTED FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Add the tokens accumulated since the last call
+void Pacer::refill(uint64_t nowUs)
+{
+    if (nowUs > _lastUs) {
+        _tokensMicroBits += (int64_t) (nowUs - _lastUs) * _rateBitsPerSecond;
+        if (_tokensMicroBits > _burstMicroBits) {
+            _tokensMicroBits = _burstMicroBits;
+        }
+    }
+    _lastUs = nowUs;
+}
@@ -0,0 +1,71 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A token-bucket pacer for the send path.
+ *
+ * Tokens accumulate at the configured rate, up to the configured burst
+ * size, and sending a datagram costs its size in tokens.  After a stall
+ * this lets a backlog drain at a steady rate a little above the codec
+ * bit rate, rather than all at once into the modem.
+ *
+ * The pacer has no notion of time of its own: the caller passes in a
+ * microsecond time-stamp.  This keeps it independent of mbed so that
+ * it can also be used by the host tools.
+ */
+
+#ifndef _PACER_H_
+#define _PACER_H_
+
+#include <stdint.h>
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+class Pacer {
+public:
+    Pacer();
+
+    // Set the rate in bits/second and the burst size in bytes;
+    // the bucket starts full.  A rate of zero disables pacing.
+    void init(int rateBitsPerSecond, int burstBytes, uint64_t nowUs);
+
+    // Change the rate without emptying the bucket
+    void setRate(int rateBitsPerSecond, uint64_t nowUs);
+
+    // Get the current rate in bits/second
+    int getRate();
+
+    // Return how many microseconds the caller must wait before
+    // size bytes may be sent (zero if they may be sent now)
+    int getWaitUs(int size, uint64_t nowUs);
+
+    // Take the tokens for size bytes that have been sent
+    void consume(int size, uint64_t nowUs);
+
+protected:
+    // Add the tokens that have accumulated since last time
+    void refill(uint64_t nowUs);
+
+    int _rateBitsPerSecond;
+    int64_t _burstMicroBits;
+    // Tokens are held in micro-bits so that a microsecond
+    // of accumulation at any rate is an exact number
+    int64_t _tokensMicroBits;
+    uint64_t _lastUs;
+};
+
+#endif // _PACER_H_
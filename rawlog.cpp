@@ -0,0 +1,311 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "datagram.h"
+#include "rawlog.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Offsets of the fields of the index header
+#define INDEX_MAGIC_OFFSET 0
+#define INDEX_VERSION_OFFSET 4
+#define INDEX_NUM_RECORDINGS_OFFSET 6
+#define INDEX_SECTOR_SIZE_OFFSET 8
+
+// Offsets of the fields of an index entry
+#define ENTRY_START_SECTOR_OFFSET 0
+#define ENTRY_NUM_BYTES_OFFSET 4
+#define ENTRY_BLOCK_SIZE_OFFSET 8
+#define ENTRY_FLAGS_OFFSET 12
+
+// The number of sectors a number of bytes takes up
+#define NUM_SECTORS(numBytes) (((numBytes) + RAW_LOG_SECTOR_SIZE - 1) / RAW_LOG_SECTOR_SIZE)
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Read the index
+int rawLogReadIndex(RawLogStore * pStore, RawLogRecording * pRecordings, int maxNumRecordings)
+{
+    char sector[RAW_LOG_SECTOR_SIZE];
+    const char * pEntry;
+    int numRecordings;
+
+    if (!pStore->read(sector, 0, sizeof(sector)) ||
+        (datagramGetUint32(sector + INDEX_MAGIC_OFFSET) != RAW_LOG_MAGIC) ||
+        (datagramGetUint16(sector + INDEX_VERSION_OFFSET) != RAW_LOG_VERSION) ||
+        (datagramGetUint32(sector + INDEX_SECTOR_SIZE_OFFSET) != RAW_LOG_SECTOR_SIZE)) {
+        return -1;
+    }
+
+    numRecordings = datagramGetUint16(sector + INDEX_NUM_RECORDINGS_OFFSET);
+    if (numRecordings > RAW_LOG_MAX_NUM_RECORDINGS) {
+        return -1;
+    }
+    for (int x = 0; (x < numRecordings) && (x < maxNumRecordings); x++) {
+        pEntry = sector + RAW_LOG_INDEX_HEADER_SIZE + x * RAW_LOG_INDEX_ENTRY_SIZE;
+        pRecordings[x].startSector = datagramGetUint32(pEntry + ENTRY_START_SECTOR_OFFSET);
+        pRecordings[x].numBytes = datagramGetUint32(pEntry + ENTRY_NUM_BYTES_OFFSET);
+        pRecordings[x].blockSize = (int) datagramGetUint32(pEntry + ENTRY_BLOCK_SIZE_OFFSET);
+        pRecordings[x].closed = (datagramGetUint32(pEntry + ENTRY_FLAGS_OFFSET) & RAW_LOG_FLAG_CLOSED) != 0;
+    }
+
+    return numRecordings;
+}
+
+// Constructor
+RawLog::RawLog()
+{
+    _pStore = NULL;
+    _numSectors = 0;
+    _numRecordings = 0;
+    _index = -1;
+    _writeSector = 0;
+    _erasedToSector = 0;
+    _tailSize = 0;
+    _numBytes = 0;
+    _numEraseStalls = 0;
+    _numFullFailures = 0;
+}
+
+// Start a new recording
+bool RawLog::open(RawLogStore * pStore, int blockSize)
+{
+    RawLogRecording * pLast;
+
+    close();
+
+    _pStore = pStore;
+    _numSectors = (uint32_t) (pStore->getSize() / RAW_LOG_SECTOR_SIZE);
+    _numRecordings = rawLogReadIndex(pStore, _recordings, RAW_LOG_MAX_NUM_RECORDINGS);
+    if (_numRecordings < 0) {
+        // A fresh region
+        _numRecordings = 0;
+    }
+    if ((_numRecordings >= RAW_LOG_MAX_NUM_RECORDINGS) || (_numSectors < 2)) {
+        _pStore = NULL;
+        return false;
+    }
+
+    // Follow on from the last recording; one that wasn't closed
+    // has no length, so it is taken to have filled nothing
+    _writeSector = 1;
+    if (_numRecordings > 0) {
+        pLast = &_recordings[_numRecordings - 1];
+        _writeSector = pLast->startSector + NUM_SECTORS(pLast->numBytes);
+    }
+    _index = _numRecordings;
+    _numRecordings++;
+    _recordings[_index].startSector = _writeSector;
+    _recordings[_index].numBytes = 0;
+    _recordings[_index].blockSize = blockSize;
+    _recordings[_index].closed = false;
+    _erasedToSector = _writeSector;
+    _tailSize = 0;
+    _numBytes = 0;
+    _numEraseStalls = 0;
+    _numFullFailures = 0;
+
+    if (!writeIndex(false) || !eraseTo(_writeSector + RAW_LOG_ERASE_CHUNK_SECTORS)) {
+        _pStore = NULL;
+        _index = -1;
+    }
+
+    return (_pStore != NULL);
+}
+
+// Close the recording
+bool RawLog::close()
+{
+    bool success = true;
+
+    if (_pStore != NULL) {
+        if (_tailSize > 0) {
+            memset(_tail + _tailSize, 0, sizeof(_tail) - _tailSize);
+            success = (_writeSector < _numSectors) && eraseTo(_writeSector + 1) &&
+                      _pStore->program(_tail, (uint64_t) _writeSector * RAW_LOG_SECTOR_SIZE, sizeof(_tail));
+            if (success) {
+                _writeSector++;
+            } else {
+                // Whatever was held back is lost
+                _numBytes -= _tailSize;
+            }
+            _tailSize = 0;
+        }
+        _recordings[_index].numBytes = _numBytes;
+        if (!writeIndex(true)) {
+            success = false;
+        }
+        _pStore = NULL;
+        _index = -1;
+    }
+
+    return success;
+}
+
+// True if a recording is open
+bool RawLog::isOpen()
+{
+    return (_pStore != NULL);
+}
+
+// Add to the recording
+bool RawLog::write(const char * pData, int size)
+{
+    int count;
+    uint32_t numSectors;
+
+    if ((_pStore == NULL) || (size <= 0)) {
+        return false;
+    }
+    if ((uint64_t) _writeSector * RAW_LOG_SECTOR_SIZE + _tailSize + size >
+        (uint64_t) _numSectors * RAW_LOG_SECTOR_SIZE) {
+        _numFullFailures++;
+        return false;
+    }
+
+    // Top up what was held back last time
+    if (_tailSize > 0) {
+        count = RAW_LOG_SECTOR_SIZE - _tailSize;
+        if (count > size) {
+            count = size;
+        }
+        memcpy(_tail + _tailSize, pData, count);
+        _tailSize += count;
+        pData += count;
+        size -= count;
+        _numBytes += count;
+        if (_tailSize < RAW_LOG_SECTOR_SIZE) {
+            return true;
+        }
+        if (!makeRoom(_writeSector + 1) ||
+            !_pStore->program(_tail, (uint64_t) _writeSector * RAW_LOG_SECTOR_SIZE, RAW_LOG_SECTOR_SIZE)) {
+            return false;
+        }
+        _writeSector++;
+        _tailSize = 0;
+    }
+
+    // Whole sectors go straight from the caller's buffer
+    numSectors = (uint32_t) size / RAW_LOG_SECTOR_SIZE;
+    if (numSectors > 0) {
+        if (!makeRoom(_writeSector + numSectors) ||
+            !_pStore->program(pData, (uint64_t) _writeSector * RAW_LOG_SECTOR_SIZE,
+                              numSectors * RAW_LOG_SECTOR_SIZE)) {
+            return false;
+        }
+        _writeSector += numSectors;
+        pData += numSectors * RAW_LOG_SECTOR_SIZE;
+        size -= numSectors * RAW_LOG_SECTOR_SIZE;
+        _numBytes += numSectors * RAW_LOG_SECTOR_SIZE;
+    }
+
+    // Hold back the rest
+    memcpy(_tail, pData, size);
+    _tailSize = size;
+    _numBytes += size;
+
+    return true;
+}
+
+// Erase ahead of the write point
+void RawLog::eraseAhead()
+{
+    if ((_pStore != NULL) && (_erasedToSector < _numSectors) &&
+        (_erasedToSector - _writeSector < RAW_LOG_ERASE_CHUNK_SECTORS / 2)) {
+        eraseTo(_erasedToSector + RAW_LOG_ERASE_CHUNK_SECTORS);
+    }
+}
+
+// Get the number of bytes in the recording
+uint32_t RawLog::getNumBytes()
+{
+    return _numBytes;
+}
+
+// Get the number of erase stalls
+unsigned int RawLog::getNumEraseStalls()
+{
+    return _numEraseStalls;
+}
+
+// Get the number of writes that failed as the store was full
+unsigned int RawLog::getNumFullFailures()
+{
+    return _numFullFailures;
+}
+
+/* ----------------------------------------------------------------
+ * PROTECTED FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Write the index
+bool RawLog::writeIndex(bool closed)
+{
+    char sector[RAW_LOG_SECTOR_SIZE];
+    char * pEntry;
+
+    _recordings[_index].closed = closed;
+    memset(sector, 0, sizeof(sector));
+    datagramSetUint32(sector + INDEX_MAGIC_OFFSET, RAW_LOG_MAGIC);
+    datagramSetUint16(sector + INDEX_VERSION_OFFSET, RAW_LOG_VERSION);
+    datagramSetUint16(sector + INDEX_NUM_RECORDINGS_OFFSET, _numRecordings);
+    datagramSetUint32(sector + INDEX_SECTOR_SIZE_OFFSET, RAW_LOG_SECTOR_SIZE);
+    for (int x = 0; x < _numRecordings; x++) {
+        pEntry = sector + RAW_LOG_INDEX_HEADER_SIZE + x * RAW_LOG_INDEX_ENTRY_SIZE;
+        datagramSetUint32(pEntry + ENTRY_START_SECTOR_OFFSET, _recordings[x].startSector);
+        datagramSetUint32(pEntry + ENTRY_NUM_BYTES_OFFSET, _recordings[x].numBytes);
+        datagramSetUint32(pEntry + ENTRY_BLOCK_SIZE_OFFSET, (uint32_t) _recordings[x].blockSize);
+        datagramSetUint32(pEntry + ENTRY_FLAGS_OFFSET, _recordings[x].closed ? RAW_LOG_FLAG_CLOSED : 0);
+    }
+
+    return _pStore->erase(0, sizeof(sector)) && _pStore->program(sector, 0, sizeof(sector));
+}
+
+// Make sure that sectors are erased up to endSector before a write,
+// erasing a chunk beyond if eraseAhead() hasn't kept up
+bool RawLog::makeRoom(uint32_t endSector)
+{
+    if (endSector <= _erasedToSector) {
+        return true;
+    }
+    _numEraseStalls++;
+
+    return eraseTo(endSector + RAW_LOG_ERASE_CHUNK_SECTORS);
+}
+
+// Make sure that sectors are erased up to endSector
+bool RawLog::eraseTo(uint32_t endSector)
+{
+    if (endSector > _numSectors) {
+        endSector = _numSectors;
+    }
+    if (endSector <= _erasedToSector) {
+        return true;
+    }
+    if (!_pStore->erase((uint64_t) _erasedToSector * RAW_LOG_SECTOR_SIZE,
+                        (uint64_t) (endSector - _erasedToSector) * RAW_LOG_SECTOR_SIZE)) {
+        return false;
+    }
+    _erasedToSector = endSector;
+
+    return true;
+}
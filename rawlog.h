@@ -0,0 +1,169 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Recordings written straight to a reserved region of a block device
+ * (e.g. the end of the SD card), without a file system, so that there
+ * is no cluster allocation or FAT update to make a write take longer
+ * than the one before.
+ *
+ * The first sector of the region is an index: a header followed by an
+ * entry for each recording giving where it starts, how many bytes it
+ * holds, the size of the audio blocks in it and whether it was closed
+ * cleanly.  Each recording follows on from the last, sector-aligned,
+ * and is written strictly in order; whatever doesn't fill a sector is
+ * held back until it does, so every program is of whole sectors.
+ * Ahead of the write point the region is erased in chunks, outside the
+ * write itself, since an SD card programs erased sectors fastest.
+ *
+ * The index is written when a recording is opened and when it is
+ * closed.  The block device is reached through a RawLogStore so that
+ * nothing here depends on mbed and the host tools can use it too
+ * (on an image of the card).
+ */
+
+#ifndef _RAWLOG_H_
+#define _RAWLOG_H_
+
+#include <stdint.h>
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The sector size: the unit of programming
+#define RAW_LOG_SECTOR_SIZE 512
+
+// Marks the index sector
+#define RAW_LOG_MAGIC 0x55524157
+
+// The version of the layout
+#define RAW_LOG_VERSION 1
+
+// The size of the index header and of each entry
+#define RAW_LOG_INDEX_HEADER_SIZE 16
+#define RAW_LOG_INDEX_ENTRY_SIZE 16
+
+// The number of recordings the index has room for
+#define RAW_LOG_MAX_NUM_RECORDINGS ((RAW_LOG_SECTOR_SIZE - RAW_LOG_INDEX_HEADER_SIZE) / \
+                                    RAW_LOG_INDEX_ENTRY_SIZE)
+
+// An index entry flag: the recording was closed cleanly
+#define RAW_LOG_FLAG_CLOSED 0x01
+
+// The number of sectors erased in one go, ahead of the write point
+#ifndef RAW_LOG_ERASE_CHUNK_SECTORS
+# define RAW_LOG_ERASE_CHUNK_SECTORS 256
+#endif
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// A recording, as the index describes it
+typedef struct {
+    uint32_t startSector;
+    uint32_t numBytes;
+    int blockSize;
+    bool closed;
+} RawLogRecording;
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+// The region of a block device that the recordings go to;
+// addresses are in bytes from the start of the region
+class RawLogStore {
+public:
+    virtual ~RawLogStore() {}
+
+    // Read size bytes at address
+    virtual bool read(void * pBuf, uint64_t address, uint32_t size) = 0;
+
+    // Program size bytes, a multiple of the sector size, at address
+    virtual bool program(const void * pBuf, uint64_t address, uint32_t size) = 0;
+
+    // Erase size bytes at address, both a multiple of the sector size
+    virtual bool erase(uint64_t address, uint64_t size) = 0;
+
+    // Get the size of the region
+    virtual uint64_t getSize() = 0;
+};
+
+// Read the index of the recordings in a store into pRecordings,
+// which has room for maxNumRecordings of them, returning the
+// number of recordings or -1 if the store has no index
+int rawLogReadIndex(RawLogStore * pStore, RawLogRecording * pRecordings, int maxNumRecordings);
+
+class RawLog {
+public:
+    RawLog();
+
+    // Start a new recording of blocks of blockSize bytes after those
+    // already in the store, writing an index first if there is none
+    bool open(RawLogStore * pStore, int blockSize);
+
+    // Write out what is held back, note the length of the
+    // recording in the index and close it
+    bool close();
+
+    // True if a recording is open
+    bool isOpen();
+
+    // Add size bytes to the recording
+    bool write(const char * pData, int size);
+
+    // Erase the next chunk ahead of the write point if the write point
+    // is getting close to the end of what has been erased; call this
+    // between writes, it takes as long as an erase does
+    void eraseAhead();
+
+    // Get the number of bytes in the recording
+    uint32_t getNumBytes();
+
+    // Get the number of times a write had to erase first
+    // because eraseAhead() hadn't been called soon enough
+    unsigned int getNumEraseStalls();
+
+    // Get the number of writes that failed because
+    // the store was full
+    unsigned int getNumFullFailures();
+
+protected:
+    // Write the index, with our recording as entry _index
+    bool writeIndex(bool closed);
+
+    // Make sure that the sectors up to endSector are erased
+    bool eraseTo(uint32_t endSector);
+
+    // The same, before a write, counting a stall if it erases
+    bool makeRoom(uint32_t endSector);
+
+    RawLogStore * _pStore;
+    uint32_t _numSectors;
+    RawLogRecording _recordings[RAW_LOG_MAX_NUM_RECORDINGS];
+    int _numRecordings;
+    int _index;
+    uint32_t _writeSector;
+    uint32_t _erasedToSector;
+    char _tail[RAW_LOG_SECTOR_SIZE];
+    int _tailSize;
+    uint32_t _numBytes;
+    unsigned int _numEraseStalls;
+    unsigned int _numFullFailures;
+};
+
+#endif // _RAWLOG_H_
@@ -0,0 +1,146 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "datagram.h"
+#include "retransmit.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Flag in the slot info to show that the slot holds a datagram
+#define SLOT_VALID 0x80000000UL
+
+// Where the retransmit count lives in the slot info
+#define SLOT_RETRANSMITS_SHIFT 16
+#define SLOT_RETRANSMITS_MASK  0xFF
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS: RetransmitWindow
+ * -------------------------------------------------------------- */
+
+// Constructor
+RetransmitWindow::RetransmitWindow()
+{
+    _pStorage = NULL;
+    _pSlotInfo = NULL;
+    _numSlots = 0;
+    _datagramSize = 0;
+    _maxRetransmits = 0;
+}
+
+// Set up the window
+void RetransmitWindow::init(char * pStorage, int numSlots, int datagramSize,
+                            uint32_t * pSlotInfo, int maxRetransmits)
+{
+    _pStorage = pStorage;
+    _numSlots = numSlots;
+    _datagramSize = datagramSize;
+    _pSlotInfo = pSlotInfo;
+    _maxRetransmits = maxRetransmits;
+    if (_maxRetransmits > SLOT_RETRANSMITS_MASK) {
+        _maxRetransmits = SLOT_RETRANSMITS_MASK;
+    }
+    reset();
+}
+
+// Forget everything
+void RetransmitWindow::reset()
+{
+    if (_pSlotInfo != NULL) {
+        memset(_pSlotInfo, 0, _numSlots * sizeof(_pSlotInfo[0]));
+    }
+}
+
+// Keep a copy of a datagram
+void RetransmitWindow::store(const char * pDatagram)
+{
+    int sequenceNumber;
+    int slot;
+
+    if (_pStorage != NULL) {
+        sequenceNumber = urtpGetSequenceNumber(pDatagram);
+        slot = sequenceNumber % _numSlots;
+        memcpy(_pStorage + slot * _datagramSize, pDatagram, _datagramSize);
+        _pSlotInfo[slot] = SLOT_VALID | sequenceNumber;
+    }
+}
+
+// Get a datagram to send again
+const char * RetransmitWindow::getForRetransmit(int sequenceNumber)
+{
+    const char * pDatagram = NULL;
+    int slot;
+    int retransmits;
+
+    if (_pStorage != NULL) {
+        slot = (sequenceNumber & 0xFFFF) % _numSlots;
+        if ((_pSlotInfo[slot] & SLOT_VALID) &&
+            ((int) (_pSlotInfo[slot] & 0xFFFF) == (sequenceNumber & 0xFFFF))) {
+            retransmits = (_pSlotInfo[slot] >> SLOT_RETRANSMITS_SHIFT) & SLOT_RETRANSMITS_MASK;
+            if (retransmits < _maxRetransmits) {
+                retransmits++;
+                _pSlotInfo[slot] = (_pSlotInfo[slot] & ~(SLOT_RETRANSMITS_MASK << SLOT_RETRANSMITS_SHIFT)) |
+                                   (retransmits << SLOT_RETRANSMITS_SHIFT);
+                pDatagram = _pStorage + slot * _datagramSize;
+            }
+        }
+    }
+
+    return pDatagram;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS: NACK DATAGRAMS
+ * -------------------------------------------------------------- */
+
+// Encode a NACK datagram
+int nackEncode(char * pBuf, const int * pSequenceNumbers, int numSequenceNumbers)
+{
+    if (numSequenceNumbers > NACK_MAX_SEQUENCE_NUMBERS) {
+        numSequenceNumbers = NACK_MAX_SEQUENCE_NUMBERS;
+    }
+
+    pBuf[0] = (char) NACK_SYNC_BYTE;
+    pBuf[1] = (char) numSequenceNumbers;
+    for (int x = 0; x < numSequenceNumbers; x++) {
+        datagramSetUint16(pBuf + NACK_HEADER_SIZE + x * 2, *(pSequenceNumbers + x));
+    }
+
+    return NACK_HEADER_SIZE + numSequenceNumbers * 2;
+}
+
+// Decode a NACK datagram
+int nackDecode(const char * pBuf, int size, int * pSequenceNumbers)
+{
+    int numSequenceNumbers = -1;
+
+    if ((size >= NACK_HEADER_SIZE) && ((unsigned char) pBuf[0] == NACK_SYNC_BYTE)) {
+        numSequenceNumbers = (unsigned char) pBuf[1];
+        if ((numSequenceNumbers > NACK_MAX_SEQUENCE_NUMBERS) ||
+            (size < NACK_HEADER_SIZE + numSequenceNumbers * 2)) {
+            numSequenceNumbers = -1;
+        } else {
+            for (int x = 0; x < numSequenceNumbers; x++) {
+                *(pSequenceNumbers + x) = datagramGetUint16(pBuf + NACK_HEADER_SIZE + x * 2);
+            }
+        }
+    }
+
+    return numSequenceNumbers;
+}
@@ -0,0 +1,81 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A bounded window of recently sent URTP datagrams, indexed by
+ * sequence number, from which the ones the server NACKs can be sent
+ * again.  The URTP codec frees a slot in its datagram store as soon
+ * as the datagram has been sent, so a copy is kept here.
+ *
+ * Also here are the functions to encode and decode NACK datagrams
+ * (see datagram.h).  Nothing here depends on mbed so that the host
+ * tools can use it too.
+ */
+
+#ifndef _RETRANSMIT_H_
+#define _RETRANSMIT_H_
+
+#include <stdint.h>
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+class RetransmitWindow {
+public:
+    RetransmitWindow();
+
+    // Set up the window: pStorage must be numSlots * datagramSize
+    // bytes and pSlotInfo must be numSlots entries long; each
+    // datagram may be sent again at most maxRetransmits times
+    void init(char * pStorage, int numSlots, int datagramSize,
+              uint32_t * pSlotInfo, int maxRetransmits);
+
+    // Forget everything in the window
+    void reset();
+
+    // Keep a copy of a datagram that has just been sent
+    void store(const char * pDatagram);
+
+    // Return the datagram with the given sequence number, or NULL
+    // if it has dropped out of the window or been sent again too
+    // many times already; the retransmit count for it is bumped
+    const char * getForRetransmit(int sequenceNumber);
+
+protected:
+    char * _pStorage;
+    // For each slot, the sequence number it holds in the lower
+    // 16 bits, a valid flag and the number of retransmits so far
+    uint32_t * _pSlotInfo;
+    int _numSlots;
+    int _datagramSize;
+    int _maxRetransmits;
+};
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Encode a NACK datagram for up to NACK_MAX_SEQUENCE_NUMBERS
+// sequence numbers into pBuf, which must be at least NACK_MAX_SIZE
+// bytes long, returning the size of the datagram
+int nackEncode(char * pBuf, const int * pSequenceNumbers, int numSequenceNumbers);
+
+// Decode a NACK datagram into pSequenceNumbers, which must be
+// NACK_MAX_SEQUENCE_NUMBERS long, returning the number of sequence
+// numbers or -1 if this is not a valid NACK datagram
+int nackDecode(const char * pBuf, int size, int * pSequenceNumbers);
+
+#endif // _RETRANSMIT_H_
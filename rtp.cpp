@@ -0,0 +1,315 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "datagram.h"
+#include "rtp.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The size of an RTCP header plus the SSRC of the sender
+#define RTCP_HEADER_SIZE 8
+
+// The size of the sender info in a sender report
+#define RTCP_SENDER_INFO_SIZE 20
+
+// The size of a report block
+#define RTCP_REPORT_BLOCK_SIZE 24
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Write an RTCP header, count being the number of report blocks (or
+// SDES chunks) and size the size of the whole packet in bytes
+static void setRtcpHeader(char * pBuf, int count, int packetType, int size, uint32_t ssrc)
+{
+    pBuf[0] = (char) ((RTP_VERSION << 6) | (count & 0x1F));
+    pBuf[1] = (char) packetType;
+    datagramSetUint16(pBuf + 2, size / 4 - 1);
+    datagramSetUint32(pBuf + 4, ssrc);
+}
+
+// Add an SDES packet carrying a CNAME, returning its size
+static int addSdes(char * pBuf, uint32_t ssrc, const char * pCname)
+{
+    int length = strlen(pCname);
+    int size;
+
+    if (length > RTCP_MAX_CNAME_LENGTH) {
+        length = RTCP_MAX_CNAME_LENGTH;
+    }
+    // The item list ends with at least one zero byte,
+    // padded to a 32 bit boundary
+    size = (RTCP_HEADER_SIZE + 2 + length + 4) & ~3;
+    memset(pBuf, 0, size);
+    setRtcpHeader(pBuf, 1, RTCP_SDES, size, ssrc);
+    pBuf[RTCP_HEADER_SIZE] = RTCP_SDES_CNAME;
+    pBuf[RTCP_HEADER_SIZE + 1] = (char) length;
+    memcpy(pBuf + RTCP_HEADER_SIZE + 2, pCname, length);
+
+    return size;
+}
+
+// Write the NTP form of a time
+static void setNtp(char * pBuf, uint64_t ntpUs)
+{
+    datagramSetUint32(pBuf, (uint32_t) (ntpUs / 1000000));
+    datagramSetUint32(pBuf + 4, (uint32_t) (((ntpUs % 1000000) << 32) / 1000000));
+}
+
+// Read a report block
+static void getReportBlock(const char * pBuf, RtpReportBlock * pBlock)
+{
+    int32_t lost;
+
+    pBlock->ssrc = datagramGetUint32(pBuf);
+    pBlock->fractionLost = (unsigned char) pBuf[4];
+    // Cumulative loss is a signed 24 bit number
+    lost = (int32_t) (datagramGetUint32(pBuf + 4) << 8) >> 8;
+    pBlock->cumulativeLost = (int) lost;
+    pBlock->highestSeq = datagramGetUint32(pBuf + 8);
+    pBlock->jitter = datagramGetUint32(pBuf + 12);
+    pBlock->lsr = datagramGetUint32(pBuf + 16);
+    pBlock->dlsr = datagramGetUint32(pBuf + 20);
+}
+
+// Write a report block
+static void setReportBlock(char * pBuf, const RtpReportBlock * pBlock)
+{
+    datagramSetUint32(pBuf, pBlock->ssrc);
+    datagramSetUint32(pBuf + 4, ((uint32_t) pBlock->cumulativeLost) & 0xFFFFFF);
+    pBuf[4] = (char) pBlock->fractionLost;
+    datagramSetUint32(pBuf + 8, pBlock->highestSeq);
+    datagramSetUint32(pBuf + 12, pBlock->jitter);
+    datagramSetUint32(pBuf + 16, pBlock->lsr);
+    datagramSetUint32(pBuf + 20, pBlock->dlsr);
+}
+
+// Check that an RTCP packet within a compound packet is sound,
+// returning its size or -1
+static int checkRtcpPacket(const char * pBuf, int size)
+{
+    int packetSize;
+
+    if ((size < RTCP_HEADER_SIZE) || ((((unsigned char) pBuf[0]) >> 6) != RTP_VERSION)) {
+        return -1;
+    }
+    packetSize = (datagramGetUint16(pBuf + 2) + 1) * 4;
+
+    return (packetSize <= size) ? packetSize : -1;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Get the middle 32 bits of an NTP time
+uint32_t rtpNtpMiddle(uint64_t ntpUs)
+{
+    char ntp[8];
+
+    setNtp(ntp, ntpUs);
+
+    return datagramGetUint32(ntp + 2);
+}
+
+// Make an RTCP receiver report
+int rtcpMakeReceiverReport(char * pBuf, uint32_t ssrc, const char * pCname,
+                           const RtpReportBlock * pBlock)
+{
+    int size = RTCP_HEADER_SIZE + RTCP_REPORT_BLOCK_SIZE;
+
+    setRtcpHeader(pBuf, 1, RTCP_RR, size, ssrc);
+    setReportBlock(pBuf + RTCP_HEADER_SIZE, pBlock);
+
+    return size + addSdes(pBuf + size, ssrc, pCname);
+}
+
+// Find a sender report
+bool rtcpGetSenderReport(const char * pBuf, int size, uint32_t * pNtpMiddle, uint32_t * pSsrc)
+{
+    int packetSize;
+
+    while ((packetSize = checkRtcpPacket(pBuf, size)) > 0) {
+        if (((unsigned char) pBuf[1] == RTCP_SR) &&
+            (packetSize >= RTCP_HEADER_SIZE + RTCP_SENDER_INFO_SIZE)) {
+            *pSsrc = datagramGetUint32(pBuf + 4);
+            *pNtpMiddle = datagramGetUint32(pBuf + RTCP_HEADER_SIZE + 2);
+            return true;
+        }
+        pBuf += packetSize;
+        size -= packetSize;
+    }
+
+    return false;
+}
+
+// Constructor
+RtpSender::RtpSender()
+{
+    init(0, 0, 0, 1, "");
+}
+
+// Set up
+void RtpSender::init(uint32_t ssrc, uint32_t timestampBase, int payloadType,
+                     int clockRate, const char * pCname)
+{
+    _ssrc = ssrc;
+    _timestampBase = timestampBase;
+    _firstMediaUs = 0;
+    _payloadType = payloadType;
+    _clockRate = clockRate;
+    strncpy(_cname, pCname, sizeof(_cname) - 1);
+    _cname[sizeof(_cname) - 1] = 0;
+    _started = false;
+    _lastSeq = 0;
+    _numPackets = 0;
+    _numOctets = 0;
+}
+
+// Wrap a URTP datagram as RTP
+int RtpSender::wrap(char * pBuf, const char * pUrtp, int size)
+{
+    uint64_t mediaUs;
+    int seq;
+    bool marker;
+
+    if ((size < URTP_HEADER_SIZE) || ((unsigned char) pUrtp[0] != URTP_SYNC_BYTE)) {
+        return -1;
+    }
+
+    seq = urtpGetSequenceNumber(pUrtp);
+    mediaUs = urtpGetTimestamp(pUrtp);
+    if (!_started) {
+        _started = true;
+        _firstMediaUs = mediaUs;
+        _lastSeq = seq;
+        marker = true;
+    } else {
+        // A gap (e.g. from an overflow) is the start of a new talkspurt;
+        // something that has been sent again is not
+        marker = sequenceNumberDiff(seq, _lastSeq) > 1;
+        if (sequenceNumberDiff(seq, _lastSeq) > 0) {
+            _lastSeq = seq;
+        }
+    }
+
+    pBuf[0] = (char) (RTP_VERSION << 6);
+    pBuf[1] = (char) ((marker ? 0x80 : 0) | (_payloadType & 0x7F));
+    datagramSetUint16(pBuf + 2, seq);
+    datagramSetUint32(pBuf + 4, getTimestamp(mediaUs));
+    datagramSetUint32(pBuf + 8, _ssrc);
+    memcpy(pBuf + RTP_HEADER_SIZE, pUrtp + URTP_HEADER_SIZE, size - URTP_HEADER_SIZE);
+
+    return size - URTP_HEADER_SIZE + RTP_HEADER_SIZE;
+}
+
+// Count an RTP packet that has been sent
+void RtpSender::sent(int size)
+{
+    if (size > RTP_HEADER_SIZE) {
+        _numPackets++;
+        _numOctets += size - RTP_HEADER_SIZE;
+    }
+}
+
+// Make a sender report
+int RtpSender::makeSenderReport(char * pBuf, uint64_t ntpUs, uint64_t mediaUs)
+{
+    int size = RTCP_HEADER_SIZE + RTCP_SENDER_INFO_SIZE;
+
+    if (_numPackets == 0) {
+        return -1;
+    }
+
+    setRtcpHeader(pBuf, 0, RTCP_SR, size, _ssrc);
+    setNtp(pBuf + RTCP_HEADER_SIZE, ntpUs);
+    datagramSetUint32(pBuf + RTCP_HEADER_SIZE + 8, getTimestamp(mediaUs));
+    datagramSetUint32(pBuf + RTCP_HEADER_SIZE + 12, _numPackets);
+    datagramSetUint32(pBuf + RTCP_HEADER_SIZE + 16, _numOctets);
+
+    return size + addSdes(pBuf + size, _ssrc, _cname);
+}
+
+// Read what the receiver has to say
+bool RtpSender::handleReport(const char * pBuf, int size, uint64_t ntpUs,
+                             RtpReportBlock * pBlock, int * pRttUs)
+{
+    int packetSize;
+    int offset;
+    int32_t rtt;
+    bool found = false;
+
+    while (!found && ((packetSize = checkRtcpPacket(pBuf, size)) > 0)) {
+        offset = -1;
+        if ((unsigned char) pBuf[1] == RTCP_SR) {
+            offset = RTCP_HEADER_SIZE + RTCP_SENDER_INFO_SIZE;
+        } else if ((unsigned char) pBuf[1] == RTCP_RR) {
+            offset = RTCP_HEADER_SIZE;
+        }
+        for (int x = 0; (offset >= 0) && !found && (x < (pBuf[0] & 0x1F)) &&
+                        (offset + RTCP_REPORT_BLOCK_SIZE <= packetSize); x++) {
+            if (datagramGetUint32(pBuf + offset) == _ssrc) {
+                getReportBlock(pBuf + offset, pBlock);
+                found = true;
+            }
+            offset += RTCP_REPORT_BLOCK_SIZE;
+        }
+        pBuf += packetSize;
+        size -= packetSize;
+    }
+
+    if (found) {
+        *pRttUs = -1;
+        if (pBlock->lsr != 0) {
+            // All in units of 1/65536 seconds
+            rtt = (int32_t) (rtpNtpMiddle(ntpUs) - pBlock->lsr - pBlock->dlsr);
+            if (rtt >= 0) {
+                *pRttUs = (int) (((int64_t) rtt * 1000000) >> 16);
+            }
+        }
+    }
+
+    return found;
+}
+
+// Get the number of packets sent
+uint32_t RtpSender::getNumPackets()
+{
+    return _numPackets;
+}
+
+// Get the number of bytes of audio sent
+uint32_t RtpSender::getNumOctets()
+{
+    return _numOctets;
+}
+
+/* ----------------------------------------------------------------
+ * PROTECTED FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Work out an RTP timestamp
+uint32_t RtpSender::getTimestamp(uint64_t mediaUs)
+{
+    int64_t elapsedUs = (int64_t) (mediaUs - _firstMediaUs);
+
+    return _timestampBase + (uint32_t) (elapsedUs * _clockRate / 1000000);
+}
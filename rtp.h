@@ -0,0 +1,153 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Standard RTP (RFC 3550) framing for the coded audio, so that it can
+ * be received by tools that know nothing of URTP.
+ *
+ * Each URTP datagram becomes one RTP packet: the URTP header is replaced
+ * by a 12 byte RTP header with a dynamic payload type, the same sequence
+ * number and a timestamp in samples worked out from the URTP timestamp,
+ * and the audio follows unchanged.  The RTP packet is two bytes smaller
+ * than the URTP datagram, so the throughput is the same.
+ *
+ * RTCP goes to the next port up.  The sender sends sender reports (with
+ * an SDES CNAME, as RFC 3550 requires of a compound packet) and reads
+ * the report blocks that the receiver sends back, which give the loss
+ * and jitter the receiver sees and, from LSR and DLSR, the round trip.
+ * NTP times are in microseconds, supplied by the caller; a sender that
+ * has no wall clock may use the time since it started.
+ *
+ * Nothing here depends on mbed so that the host tools can use it too.
+ */
+
+#ifndef _RTP_H_
+#define _RTP_H_
+
+#include <stdint.h>
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The RTP version
+#define RTP_VERSION 2
+
+// The size of an RTP header with no contributing sources
+#define RTP_HEADER_SIZE 12
+
+// The RTCP packet types used here
+#define RTCP_SR 200
+#define RTCP_RR 201
+#define RTCP_SDES 202
+
+// The SDES item carrying the canonical name
+#define RTCP_SDES_CNAME 1
+
+// The largest RTCP compound packet made or read here
+#define RTCP_MAX_SIZE 256
+
+// The longest CNAME that will be sent
+#define RTCP_MAX_CNAME_LENGTH 64
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// A report block of an RTCP sender or receiver report
+typedef struct {
+    uint32_t ssrc;
+    int fractionLost;       // Since the last report, out of 256
+    int cumulativeLost;
+    uint32_t highestSeq;    // Extended highest sequence number
+    uint32_t jitter;        // In timestamp units
+    uint32_t lsr;           // Middle 32 bits of the last SR's NTP time
+    uint32_t dlsr;          // Delay since the last SR, 1/65536 seconds
+} RtpReportBlock;
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Get the middle 32 bits of the NTP form of a time
+uint32_t rtpNtpMiddle(uint64_t ntpUs);
+
+// Make an RTCP receiver report with one report block, plus the
+// receiver's CNAME, in pBuf, which must be at least RTCP_MAX_SIZE
+// long, returning its size
+int rtcpMakeReceiverReport(char * pBuf, uint32_t ssrc, const char * pCname,
+                           const RtpReportBlock * pBlock);
+
+// Find the NTP time (middle 32 bits) and SSRC of an RTCP sender
+// report, returning false if there is none in the compound packet
+bool rtcpGetSenderReport(const char * pBuf, int size, uint32_t * pNtpMiddle, uint32_t * pSsrc);
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+class RtpSender {
+public:
+    RtpSender();
+
+    // Set up with our SSRC, the (random) RTP timestamp of the first
+    // packet, the payload type, the RTP clock rate (the sample rate)
+    // and the CNAME to send in RTCP
+    void init(uint32_t ssrc, uint32_t timestampBase, int payloadType,
+              int clockRate, const char * pCname);
+
+    // Wrap a URTP datagram of size bytes as RTP in pBuf, which must be
+    // at least size - URTP_HEADER_SIZE + RTP_HEADER_SIZE long,
+    // returning the size of the RTP packet or -1 if it isn't URTP
+    int wrap(char * pBuf, const char * pUrtp, int size);
+
+    // Report that an RTP packet of size bytes has been sent
+    void sent(int size);
+
+    // Make an RTCP sender report with our CNAME in pBuf, which must be
+    // at least RTCP_MAX_SIZE long, returning its size or -1 if nothing
+    // has been sent yet; mediaUs is the time now on the clock of the
+    // URTP timestamps
+    int makeSenderReport(char * pBuf, uint64_t ntpUs, uint64_t mediaUs);
+
+    // Read an RTCP compound packet from the receiver, returning true
+    // if it held a report block about us; *pRttUs is set to the round
+    // trip, or -1 if that can't be worked out
+    bool handleReport(const char * pBuf, int size, uint64_t ntpUs,
+                      RtpReportBlock * pBlock, int * pRttUs);
+
+    // Get the number of RTP packets sent
+    uint32_t getNumPackets();
+
+    // Get the number of bytes of audio sent
+    uint32_t getNumOctets();
+
+protected:
+    // Work out the RTP timestamp for a time on the URTP clock
+    uint32_t getTimestamp(uint64_t mediaUs);
+
+    uint32_t _ssrc;
+    uint32_t _timestampBase;
+    uint64_t _firstMediaUs;
+    int _payloadType;
+    int _clockRate;
+    char _cname[RTCP_MAX_CNAME_LENGTH + 1];
+    bool _started;
+    int _lastSeq;
+    uint32_t _numPackets;
+    uint32_t _numOctets;
+};
+
+#endif // _RTP_H_
@@ -0,0 +1,218 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "sdbench.h"
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// The time in milliseconds that audio arriving at
+// neededBytesPerSecond takes to fill a block
+static int fillMs(int blockSize, int neededBytesPerSecond)
+{
+    return (neededBytesPerSecond > 0) ? (int) ((int64_t) blockSize * 1000 / neededBytesPerSecond) : 0;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Print the heading of the table
+void sdBenchPrintHeading()
+{
+    printf("mode  SPI kHz   block  offset  writes  kbyte/s  50%% us  99%% us  worst us  fill ms  kept up\n");
+}
+
+// Print a result as a row of the table
+void sdBenchPrintResult(const SdBenchResult * pResult, int neededBytesPerSecond)
+{
+    char spi[12];
+    const char * pKeptUp;
+
+    if (pResult->spiKhz > 0) {
+        snprintf(spi, sizeof(spi), "%d", pResult->spiKhz);
+    } else {
+        strcpy(spi, "-");
+    }
+    printf("%-4s  %7s  %6d  %6d  ", pResult->isRaw ? "raw" : "FAT", spi, pResult->blockSize, pResult->offset);
+    if (!pResult->success) {
+        printf("%6s  %7s  %6s  %6s  %8s  %7d  FAILED\n", "-", "-", "-", "-", "-",
+               fillMs(pResult->blockSize, neededBytesPerSecond));
+        return;
+    }
+    if (sdBenchKeptUp(pResult, neededBytesPerSecond)) {
+        pKeptUp = "yes";
+    } else if (pResult->p99Us < fillMs(pResult->blockSize, neededBytesPerSecond) * 1000) {
+        pKeptUp = "99%";
+    } else {
+        pKeptUp = "no";
+    }
+    printf("%6u  %7d  %6d  %6d  %8d  %7d  %s\n", pResult->numWrites, pResult->kBytesPerSecond,
+           pResult->p50Us, pResult->p99Us, pResult->maxUs,
+           fillMs(pResult->blockSize, neededBytesPerSecond), pKeptUp);
+}
+
+// True if every write kept up
+bool sdBenchKeptUp(const SdBenchResult * pResult, int neededBytesPerSecond)
+{
+    return pResult->success && (pResult->maxUs < fillMs(pResult->blockSize, neededBytesPerSecond) * 1000);
+}
+
+// Constructor
+SdBench::SdBench()
+{
+    _pNowUs = NULL;
+    _pBuf = NULL;
+    _bufSize = 0;
+    _pSync = NULL;
+}
+
+// Set up
+void SdBench::init(int64_t (*pNowUs)(), uint32_t * pBins, int numBins, int binWidthUs,
+                   char * pBuf, int bufSize, void (*pSync)(FILE * pFile))
+{
+    _pNowUs = pNowUs;
+    _latency.init(pBins, numBins, binWidthUs);
+    _pBuf = pBuf;
+    _bufSize = bufSize;
+    _pSync = pSync;
+
+    // Something other than all zeroes, in case that is quicker
+    for (int x = 0; x < _bufSize; x++) {
+        _pBuf[x] = (char) (x * 7);
+    }
+}
+
+// Write through a file system
+bool SdBench::runFat(const char * pFileName, int blockSize, int offset, uint32_t totalBytes,
+                     SdBenchResult * pResult)
+{
+    FILE * pFile;
+    int64_t startUs = 0;
+    int64_t writeStartUs;
+    uint32_t done = 0;
+    int count;
+    bool success;
+
+    success = start(false, blockSize, offset, pResult);
+    if (success) {
+        remove(pFileName);
+        pFile = fopen(pFileName, "wb");
+        success = (pFile != NULL);
+        // The offset goes in first, untimed
+        for (int x = 0; success && (x < offset); x += count) {
+            count = (offset - x < _bufSize) ? offset - x : _bufSize;
+            success = (fwrite(_pBuf, 1, count, pFile) == (size_t) count);
+        }
+        if (success) {
+            success = (fflush(pFile) == 0);
+        }
+        startUs = _pNowUs();
+        while (success && (done < totalBytes)) {
+            count = (totalBytes - done < (uint32_t) blockSize) ? (int) (totalBytes - done) : blockSize;
+            writeStartUs = _pNowUs();
+            success = (fwrite(_pBuf, 1, count, pFile) == (size_t) count);
+            if (_pSync != NULL) {
+                _pSync(pFile);
+            }
+            _latency.add((int) (_pNowUs() - writeStartUs));
+            done += count;
+        }
+        // Closing flushes whatever stdio held back, so is timed
+        if ((pFile != NULL) && (fclose(pFile) != 0)) {
+            success = false;
+        }
+        remove(pFileName);
+    }
+    finish(done, _pNowUs() - startUs, success, pResult);
+
+    return success;
+}
+
+// Write straight to a store
+bool SdBench::runRaw(RawLogStore * pStore, int blockSize, int offset, uint32_t totalBytes,
+                     SdBenchResult * pResult)
+{
+    uint64_t address = (uint64_t) offset;
+    uint64_t needed = (uint64_t) offset + totalBytes + RAW_LOG_SECTOR_SIZE;
+    int64_t startUs = 0;
+    int64_t writeStartUs;
+    uint32_t done = 0;
+    int pending = 0;
+    int count;
+    int size;
+    bool success;
+
+    success = start(true, blockSize, offset, pResult) && (offset % RAW_LOG_SECTOR_SIZE == 0) &&
+              (needed <= pStore->getSize()) && pStore->erase(0, needed - needed % RAW_LOG_SECTOR_SIZE);
+    if (success) {
+        startUs = _pNowUs();
+        while (success && (done < totalBytes)) {
+            count = (totalBytes - done < (uint32_t) blockSize) ? (int) (totalBytes - done) : blockSize;
+            writeStartUs = _pNowUs();
+            // Whatever doesn't fill a sector waits for the next write
+            pending += count;
+            size = pending - pending % RAW_LOG_SECTOR_SIZE;
+            if (size > 0) {
+                success = pStore->program(_pBuf, address, size);
+                address += size;
+                pending -= size;
+            }
+            _latency.add((int) (_pNowUs() - writeStartUs));
+            done += count;
+        }
+        if (success && (pending > 0)) {
+            success = pStore->program(_pBuf, address, RAW_LOG_SECTOR_SIZE);
+        }
+    }
+    finish(done, _pNowUs() - startUs, success, pResult);
+
+    return success;
+}
+
+/* ----------------------------------------------------------------
+ * PROTECTED FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Start a result; the buffer has to hold a block and the
+// sector that may be held back from the write before
+bool SdBench::start(bool isRaw, int blockSize, int offset, SdBenchResult * pResult)
+{
+    memset(pResult, 0, sizeof(*pResult));
+    pResult->isRaw = isRaw;
+    pResult->blockSize = blockSize;
+    pResult->offset = offset;
+    _latency.reset();
+
+    return (_pNowUs != NULL) && (blockSize > 0) && (offset >= 0) &&
+           (blockSize + RAW_LOG_SECTOR_SIZE <= _bufSize);
+}
+
+// Finish a result
+void SdBench::finish(uint32_t totalBytes, int64_t durationUs, bool success, SdBenchResult * pResult)
+{
+    pResult->success = success;
+    pResult->numWrites = _latency.getCount();
+    if (success) {
+        pResult->kBytesPerSecond = (durationUs > 0) ? (int) ((int64_t) totalBytes * 1000 / durationUs) : 0;
+        pResult->p50Us = _latency.getPercentileUs(50);
+        pResult->p99Us = _latency.getPercentileUs(99);
+        pResult->maxUs = _latency.getMaxUs();
+    }
+}
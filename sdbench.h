@@ -0,0 +1,118 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A benchmark of writing to SD, so that the size of the file buffers
+ * can be chosen from measurements rather than guessed.
+ *
+ * Each case writes a given number of bytes in blocks of one size,
+ * starting a given number of bytes into the file or region, and times
+ * every write: the result is the sustained throughput and percentiles
+ * of the write time.  A case goes either through a file system, with
+ * stdio, as LOCAL_FILE does, or straight to a RawLogStore, as
+ * LOCAL_FILE_RAW does; the raw cases are programmed whole sectors at a
+ * time with what doesn't fill a sector held back, as RawLog does, onto
+ * sectors erased beforehand.
+ *
+ * The results are printed as a table, a row per case, which says for
+ * each whether a write of that size always finished in the time that
+ * the audio takes to fill a buffer of that size: with two file buffers
+ * that is what keeps the writes up with the audio.
+ *
+ * Nothing here depends on mbed so that the host tools can use it too,
+ * against a file standing in for the card.
+ */
+
+#ifndef _SDBENCH_H_
+#define _SDBENCH_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "rawlog.h"
+#include "clocksync.h"
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// The result of a case
+typedef struct {
+    bool isRaw;
+    int spiKhz;             // 0 if not known
+    int blockSize;
+    int offset;
+    bool success;
+    unsigned int numWrites;
+    int kBytesPerSecond;
+    int p50Us;
+    int p99Us;
+    int maxUs;
+} SdBenchResult;
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Print the heading of the table of results
+void sdBenchPrintHeading();
+
+// Print a result as a row of the table, against audio arriving
+// at neededBytesPerSecond
+void sdBenchPrintResult(const SdBenchResult * pResult, int neededBytesPerSecond);
+
+// True if every write of a case finished in the time that the
+// audio takes to fill a block
+bool sdBenchKeptUp(const SdBenchResult * pResult, int neededBytesPerSecond);
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+class SdBench {
+public:
+    SdBench();
+
+    // Set up with a clock in microseconds, numBins bins of storage,
+    // each binWidthUs wide, for the write times, and a buffer of
+    // bufSize bytes to write from; if pSync isn't NULL it is called
+    // after each file write (e.g. to get past a host's page cache)
+    void init(int64_t (*pNowUs)(), uint32_t * pBins, int numBins, int binWidthUs,
+              char * pBuf, int bufSize, void (*pSync)(FILE * pFile));
+
+    // Write totalBytes to a new file of the given name in blocks of
+    // blockSize, starting offset bytes in; the file is removed after
+    bool runFat(const char * pFileName, int blockSize, int offset, uint32_t totalBytes,
+                SdBenchResult * pResult);
+
+    // Write totalBytes to a store in blocks of blockSize, starting
+    // offset bytes in, which must be a whole number of sectors
+    bool runRaw(RawLogStore * pStore, int blockSize, int offset, uint32_t totalBytes,
+                SdBenchResult * pResult);
+
+protected:
+    // Start a result
+    bool start(bool isRaw, int blockSize, int offset, SdBenchResult * pResult);
+
+    // Finish a result
+    void finish(uint32_t totalBytes, int64_t durationUs, bool success, SdBenchResult * pResult);
+
+    int64_t (*_pNowUs)();
+    LatencyHistogram _latency;
+    char * _pBuf;
+    int _bufSize;
+    void (*_pSync)(FILE * pFile);
+};
+
+#endif // _SDBENCH_H_
@@ -0,0 +1,280 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "datagram.h"
+#include "segment.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Offsets of the fields of the index header
+#define HEADER_MAGIC_OFFSET 0
+#define HEADER_VERSION_OFFSET 4
+#define HEADER_BLOCK_SIZE_OFFSET 6
+#define HEADER_RUN_OFFSET 8
+#define HEADER_SEGMENT_OFFSET 12
+
+// Offsets of the fields of an index entry
+#define ENTRY_OFFSET_OFFSET 0
+#define ENTRY_SEQUENCE_NUMBER_OFFSET 4
+#define ENTRY_NUM_BLOCKS_OFFSET 6
+#define ENTRY_TIMESTAMP_OFFSET 8
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Make the name of a segment file
+void segmentFileName(char * pName, const char * pPrefix, int slot, bool isIndex)
+{
+    sprintf(pName, "%s%04d.%s", pPrefix, slot % 10000, isIndex ? "idx" : "bin");
+}
+
+// Read the header of an index file
+bool segmentReadHeader(FILE * pFile, SegmentHeader * pHeader)
+{
+    char buf[SEGMENT_INDEX_HEADER_SIZE];
+
+    if ((fread(buf, 1, sizeof(buf), pFile) != sizeof(buf)) ||
+        (datagramGetUint32(buf + HEADER_MAGIC_OFFSET) != SEGMENT_INDEX_MAGIC) ||
+        (datagramGetUint16(buf + HEADER_VERSION_OFFSET) != SEGMENT_INDEX_VERSION)) {
+        return false;
+    }
+
+    pHeader->blockSize = datagramGetUint16(buf + HEADER_BLOCK_SIZE_OFFSET);
+    pHeader->run = datagramGetUint32(buf + HEADER_RUN_OFFSET);
+    pHeader->segment = datagramGetUint32(buf + HEADER_SEGMENT_OFFSET);
+
+    return true;
+}
+
+// Read an entry of an index file
+bool segmentReadEntry(FILE * pFile, SegmentEntry * pEntry)
+{
+    char buf[SEGMENT_INDEX_ENTRY_SIZE];
+
+    if (fread(buf, 1, sizeof(buf), pFile) != sizeof(buf)) {
+        return false;
+    }
+
+    pEntry->offset = datagramGetUint32(buf + ENTRY_OFFSET_OFFSET);
+    pEntry->sequenceNumber = datagramGetUint16(buf + ENTRY_SEQUENCE_NUMBER_OFFSET);
+    pEntry->numBlocks = datagramGetUint16(buf + ENTRY_NUM_BLOCKS_OFFSET);
+    pEntry->timestampUs = datagramGetUint64(buf + ENTRY_TIMESTAMP_OFFSET);
+
+    return true;
+}
+
+// Constructor
+SegmentWriter::SegmentWriter()
+{
+    _prefix[0] = 0;
+    _numSlots = 0;
+    _segmentUs = 0;
+    _blockSize = 0;
+    _run = 0;
+    _segment = 0;
+    _pData = NULL;
+    _pIndex = NULL;
+    _offset = 0;
+    _started = false;
+    _firstTimestampUs = 0;
+    _pNextData = NULL;
+    _pNextIndex = NULL;
+    _numUnpreparedSwitches = 0;
+}
+
+// Start recording
+bool SegmentWriter::open(const char * pPrefix, int numSlots, int segmentSeconds, int blockSize)
+{
+    char name[SEGMENT_FILE_NAME_SIZE];
+    FILE * pFile;
+    SegmentHeader header;
+    bool found = false;
+
+    close();
+
+    // The next segment is opened while the last is still
+    // being written, so they mustn't share a slot
+    if ((strlen(pPrefix) > SEGMENT_MAX_PREFIX_LENGTH) || (numSlots < 2) || (blockSize <= 0)) {
+        return false;
+    }
+    strcpy(_prefix, pPrefix);
+    _numSlots = numSlots;
+    _segmentUs = (uint64_t) segmentSeconds * 1000000;
+    _blockSize = blockSize;
+    _numUnpreparedSwitches = 0;
+
+    // Follow on from the newest segment and run already there
+    _run = 0;
+    _segment = 0;
+    for (int x = 0; x < _numSlots; x++) {
+        segmentFileName(name, _prefix, x, true);
+        pFile = fopen(name, "rb");
+        if (pFile != NULL) {
+            if (segmentReadHeader(pFile, &header)) {
+                if (!found || (header.segment >= _segment)) {
+                    _segment = header.segment + 1;
+                }
+                if (!found || (header.run >= _run)) {
+                    _run = header.run + 1;
+                }
+                found = true;
+            }
+            fclose(pFile);
+        }
+    }
+
+    _started = false;
+    if (!openSegment(_segment, &_pData, &_pIndex)) {
+        close();
+    }
+
+    return (_pData != NULL);
+}
+
+// Close the segment being written
+void SegmentWriter::close()
+{
+    FILE ** ppFiles[] = {&_pData, &_pIndex, &_pNextData, &_pNextIndex};
+
+    for (unsigned int x = 0; x < sizeof(ppFiles) / sizeof(ppFiles[0]); x++) {
+        if (*ppFiles[x] != NULL) {
+            fclose(*ppFiles[x]);
+            *ppFiles[x] = NULL;
+        }
+    }
+}
+
+// True if recording
+bool SegmentWriter::isOpen()
+{
+    return (_pData != NULL);
+}
+
+// Write some audio
+bool SegmentWriter::write(const char * pBuf, int size, int sequenceNumber, uint64_t timestampUs)
+{
+    char entry[SEGMENT_INDEX_ENTRY_SIZE];
+    bool success;
+
+    if (_pData == NULL) {
+        return false;
+    }
+
+    if (!_started) {
+        _started = true;
+        _firstTimestampUs = timestampUs;
+    } else if ((_segmentUs > 0) && (timestampUs - _firstTimestampUs >= _segmentUs)) {
+        // Move on to the next segment
+        if (_pNextData == NULL) {
+            _numUnpreparedSwitches++;
+            prepare();
+        }
+        if (_pNextData != NULL) {
+            fclose(_pData);
+            fclose(_pIndex);
+            _pData = _pNextData;
+            _pIndex = _pNextIndex;
+            _pNextData = NULL;
+            _pNextIndex = NULL;
+            _segment++;
+            _offset = 0;
+            _firstTimestampUs = timestampUs;
+        }
+    }
+
+    success = (fwrite(pBuf, 1, size, _pData) == (size_t) size);
+    if (success) {
+        datagramSetUint32(entry + ENTRY_OFFSET_OFFSET, _offset);
+        datagramSetUint16(entry + ENTRY_SEQUENCE_NUMBER_OFFSET, sequenceNumber);
+        datagramSetUint16(entry + ENTRY_NUM_BLOCKS_OFFSET, size / _blockSize);
+        datagramSetUint64(entry + ENTRY_TIMESTAMP_OFFSET, timestampUs);
+        success = (fwrite(entry, 1, sizeof(entry), _pIndex) == sizeof(entry));
+        _offset += size;
+    }
+
+    return success;
+}
+
+// Open the files of the next segment
+void SegmentWriter::prepare()
+{
+    if ((_pData != NULL) && (_pNextData == NULL)) {
+        openSegment(_segment + 1, &_pNextData, &_pNextIndex);
+    }
+}
+
+// Get the segment being written
+uint32_t SegmentWriter::getSegment()
+{
+    return _segment;
+}
+
+// Get the run
+uint32_t SegmentWriter::getRun()
+{
+    return _run;
+}
+
+// Get the number of unprepared switches
+unsigned int SegmentWriter::getNumUnpreparedSwitches()
+{
+    return _numUnpreparedSwitches;
+}
+
+/* ----------------------------------------------------------------
+ * PROTECTED FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Open the files of a segment, writing the index header
+bool SegmentWriter::openSegment(uint32_t segment, FILE ** ppData, FILE ** ppIndex)
+{
+    char name[SEGMENT_FILE_NAME_SIZE];
+    char header[SEGMENT_INDEX_HEADER_SIZE];
+    int slot = (int) (segment % _numSlots);
+
+    // Opening the files empties them, so the index goes first: an
+    // index left with no header is ignored, whatever its audio holds
+    segmentFileName(name, _prefix, slot, true);
+    *ppIndex = fopen(name, "wb");
+    segmentFileName(name, _prefix, slot, false);
+    *ppData = fopen(name, "wb");
+    if ((*ppIndex != NULL) && (*ppData != NULL)) {
+        datagramSetUint32(header + HEADER_MAGIC_OFFSET, SEGMENT_INDEX_MAGIC);
+        datagramSetUint16(header + HEADER_VERSION_OFFSET, SEGMENT_INDEX_VERSION);
+        datagramSetUint16(header + HEADER_BLOCK_SIZE_OFFSET, _blockSize);
+        datagramSetUint32(header + HEADER_RUN_OFFSET, _run);
+        datagramSetUint32(header + HEADER_SEGMENT_OFFSET, segment);
+        if (fwrite(header, 1, sizeof(header), *ppIndex) == sizeof(header)) {
+            return true;
+        }
+    }
+
+    if (*ppIndex != NULL) {
+        fclose(*ppIndex);
+        *ppIndex = NULL;
+    }
+    if (*ppData != NULL) {
+        fclose(*ppData);
+        *ppData = NULL;
+    }
+
+    return false;
+}
@@ -0,0 +1,157 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A recording split into segments of a fixed duration, each a pair of
+ * files: <prefix>NNNN.bin holds the audio and <prefix>NNNN.idx is its
+ * index.  There are a fixed number of slots, NNNN, and segment n goes
+ * in slot n modulo that number, so the recording rotates, the oldest
+ * segment giving way to the newest; a corrupt file loses one segment,
+ * not the lot.
+ *
+ * An index starts with a header giving the segment number, the run
+ * (one per time recording is started, so that segments left from an
+ * earlier one can be told apart) and the size of the audio blocks.  A
+ * 16 byte entry follows for each write, giving the byte offset in the
+ * segment, the URTP sequence number and timestamp of the first block
+ * written and the number of blocks, so that a point in hours of audio
+ * can be found from the index files alone.
+ *
+ * The files for the next segment are opened ahead of time, by
+ * prepare(), so that moving on to it costs no more than closing the
+ * last one; opening them empties them, so with the slots all used the
+ * oldest segment goes a segment early.  Only stdio is used, so this
+ * works on any file system (or on a host).
+ */
+
+#ifndef _SEGMENT_H_
+#define _SEGMENT_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Marks an index file
+#define SEGMENT_INDEX_MAGIC 0x55534547
+
+// The version of the index layout
+#define SEGMENT_INDEX_VERSION 1
+
+// The size of the index header and of each entry
+#define SEGMENT_INDEX_HEADER_SIZE 16
+#define SEGMENT_INDEX_ENTRY_SIZE 16
+
+// The longest file name prefix
+#define SEGMENT_MAX_PREFIX_LENGTH 32
+
+// The size of a segment file name, prefix, slot and extension
+#define SEGMENT_FILE_NAME_SIZE (SEGMENT_MAX_PREFIX_LENGTH + 10)
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// The header of an index file
+typedef struct {
+    uint32_t segment;
+    uint32_t run;
+    int blockSize;
+} SegmentHeader;
+
+// An entry in an index file
+typedef struct {
+    uint32_t offset;
+    int sequenceNumber;
+    int numBlocks;
+    uint64_t timestampUs;
+} SegmentEntry;
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Make the name of the audio (isIndex false) or index file of a slot
+void segmentFileName(char * pName, const char * pPrefix, int slot, bool isIndex);
+
+// Read the header of an index file, returning false if there is none
+bool segmentReadHeader(FILE * pFile, SegmentHeader * pHeader);
+
+// Read the next entry of an index file, returning false if there
+// are no more
+bool segmentReadEntry(FILE * pFile, SegmentEntry * pEntry);
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+class SegmentWriter {
+public:
+    SegmentWriter();
+
+    // Start recording blocks of blockSize bytes into numSlots slots
+    // of files named from pPrefix, moving on to a new segment every
+    // segmentSeconds; the segment numbering and the run follow on
+    // from whatever is there already
+    bool open(const char * pPrefix, int numSlots, int segmentSeconds, int blockSize);
+
+    // Close the segment being written
+    void close();
+
+    // True if recording
+    bool isOpen();
+
+    // Write size bytes of audio, whole blocks, the first of which has
+    // the given URTP sequence number and timestamp, moving on to the
+    // next segment first if this one is long enough
+    bool write(const char * pBuf, int size, int sequenceNumber, uint64_t timestampUs);
+
+    // Open the files of the next segment, if that isn't done already;
+    // call this between writes
+    void prepare();
+
+    // Get the segment being written
+    uint32_t getSegment();
+
+    // Get the run
+    uint32_t getRun();
+
+    // Get the number of times that moving on to the next segment
+    // had to open its files because prepare() hadn't been called
+    unsigned int getNumUnpreparedSwitches();
+
+protected:
+    // Open the files of a segment
+    bool openSegment(uint32_t segment, FILE ** ppData, FILE ** ppIndex);
+
+    char _prefix[SEGMENT_MAX_PREFIX_LENGTH + 1];
+    int _numSlots;
+    uint64_t _segmentUs;
+    int _blockSize;
+    uint32_t _run;
+    uint32_t _segment;
+    FILE * _pData;
+    FILE * _pIndex;
+    uint32_t _offset;
+    bool _started;
+    uint64_t _firstTimestampUs;
+    FILE * _pNextData;
+    FILE * _pNextIndex;
+    unsigned int _numUnpreparedSwitches;
+};
+
+#endif // _SEGMENT_H_
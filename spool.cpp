@@ -0,0 +1,176 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "spool.h"
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Constructor
+Spool::Spool()
+{
+    _pFile = NULL;
+    _datagramSize = 0;
+    _bufferNumDatagrams = 0;
+    _pWriteBuffer = NULL;
+    _numWriteBuffered = 0;
+    _pReadBuffer = NULL;
+    _numReadBuffered = 0;
+    _readIndex = 0;
+    _readOffset = 0;
+    _writeOffset = 0;
+}
+
+// Open the spool file
+bool Spool::open(const char * pFileName, int datagramSize,
+                 char * pWriteBuffer, char * pReadBuffer, int bufferNumDatagrams)
+{
+    close();
+
+    _pFile = fopen(pFileName, "wb+");
+    if (_pFile != NULL) {
+        _datagramSize = datagramSize;
+        _bufferNumDatagrams = bufferNumDatagrams;
+        _pWriteBuffer = pWriteBuffer;
+        _pReadBuffer = pReadBuffer;
+    }
+
+    return (_pFile != NULL);
+}
+
+// Close the spool file
+void Spool::close()
+{
+    if (_pFile != NULL) {
+        fclose(_pFile);
+        _pFile = NULL;
+    }
+    _numWriteBuffered = 0;
+    _numReadBuffered = 0;
+    _readIndex = 0;
+    _readOffset = 0;
+    _writeOffset = 0;
+}
+
+// Check if the spool is open
+bool Spool::isOpen()
+{
+    return (_pFile != NULL);
+}
+
+// Add a datagram to the spool
+bool Spool::write(const char * pDatagram)
+{
+    bool success = false;
+
+    if (_pFile != NULL) {
+        if ((_numWriteBuffered < _bufferNumDatagrams) || flushWrites()) {
+            memcpy(_pWriteBuffer + _numWriteBuffered * _datagramSize, pDatagram, _datagramSize);
+            _numWriteBuffered++;
+            success = true;
+        }
+    }
+
+    return success;
+}
+
+// Get the oldest datagram
+const char * Spool::peek()
+{
+    const char * pDatagram = NULL;
+    int numDatagrams;
+
+    if (_pFile != NULL) {
+        if (_readIndex >= _numReadBuffered) {
+            _readIndex = 0;
+            _numReadBuffered = 0;
+            // Nothing left in the file means that the oldest
+            // datagrams are still in the write buffer
+            if ((_readOffset >= _writeOffset) && (_numWriteBuffered > 0)) {
+                flushWrites();
+            }
+            if (_readOffset < _writeOffset) {
+                numDatagrams = (_writeOffset - _readOffset) / _datagramSize;
+                if (numDatagrams > _bufferNumDatagrams) {
+                    numDatagrams = _bufferNumDatagrams;
+                }
+                if (fseek(_pFile, _readOffset, SEEK_SET) == 0) {
+                    _numReadBuffered = fread(_pReadBuffer, _datagramSize, numDatagrams, _pFile);
+                    _readOffset += _numReadBuffered * _datagramSize;
+                }
+            }
+            if ((_numReadBuffered == 0) && (_readOffset >= _writeOffset)) {
+                // All gone: start again from the beginning of the file
+                _readOffset = 0;
+                _writeOffset = 0;
+            }
+        }
+
+        if (_readIndex < _numReadBuffered) {
+            pDatagram = _pReadBuffer + _readIndex * _datagramSize;
+        }
+    }
+
+    return pDatagram;
+}
+
+// Remove the oldest datagram
+void Spool::consume()
+{
+    if (_readIndex < _numReadBuffered) {
+        _readIndex++;
+    }
+}
+
+// Get the number of datagrams waiting
+unsigned int Spool::getNumDatagrams()
+{
+    unsigned int numDatagrams = _numWriteBuffered + _numReadBuffered - _readIndex;
+
+    if ((_datagramSize > 0) && (_writeOffset > _readOffset)) {
+        numDatagrams += (_writeOffset - _readOffset) / _datagramSize;
+    }
+
+    return numDatagrams;
+}
+
+/* ----------------------------------------------------------------
+ * PROTECTED FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Write out the write buffer
+bool Spool::flushWrites()
+{
+    int numWritten = 0;
+
+    if (_numWriteBuffered > 0) {
+        if (fseek(_pFile, _writeOffset, SEEK_SET) == 0) {
+            numWritten = fwrite(_pWriteBuffer, _datagramSize, _numWriteBuffered, _pFile);
+            _writeOffset += numWritten * _datagramSize;
+        }
+        // Keep anything that didn't make it for next time
+        if ((numWritten > 0) && (numWritten < _numWriteBuffered)) {
+            memmove(_pWriteBuffer, _pWriteBuffer + numWritten * _datagramSize,
+                    (_numWriteBuffered - numWritten) * _datagramSize);
+        }
+        _numWriteBuffered -= numWritten;
+    }
+
+    return (_numWriteBuffered < _bufferNumDatagrams);
+}
@@ -0,0 +1,81 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A first-in first-out spool of fixed-size datagrams in a file, used to
+ * hold on to coded audio while the network is down so that it can be
+ * sent later.
+ *
+ * Writes and reads are batched through RAM buffers since the SD card is
+ * only quick when given large blocks.  Once everything in the file has
+ * been read back the file is reused from the start.  Only stdio is
+ * used, so this works on any file system (or on a host).
+ */
+
+#ifndef _SPOOL_H_
+#define _SPOOL_H_
+
+#include <stdio.h>
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+class Spool {
+public:
+    Spool();
+
+    // Open the spool file, emptying it.  pWriteBuffer and pReadBuffer
+    // must each be bufferNumDatagrams * datagramSize bytes long.
+    bool open(const char * pFileName, int datagramSize,
+              char * pWriteBuffer, char * pReadBuffer, int bufferNumDatagrams);
+
+    // Close the spool file; anything not yet read is lost
+    void close();
+
+    // True if the spool file is open
+    bool isOpen();
+
+    // Add a datagram to the end of the spool
+    bool write(const char * pDatagram);
+
+    // Return the oldest datagram in the spool, or NULL if it is empty;
+    // the datagram stays in the spool until consume() is called
+    const char * peek();
+
+    // Remove the datagram returned by peek()
+    void consume();
+
+    // Get the number of datagrams in the spool
+    unsigned int getNumDatagrams();
+
+protected:
+    // Write out the write buffer
+    bool flushWrites();
+
+    FILE * _pFile;
+    int _datagramSize;
+    int _bufferNumDatagrams;
+    char * _pWriteBuffer;
+    int _numWriteBuffered;
+    char * _pReadBuffer;
+    int _numReadBuffered;
+    int _readIndex;
+    // The file holds the datagrams from _readOffset up to _writeOffset
+    long _readOffset;
+    long _writeOffset;
+};
+
+#endif // _SPOOL_H_
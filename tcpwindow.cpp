@@ -0,0 +1,84 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "lwip/api.h"
+#include "lwip/tcp.h"
+#include "tcpwindow.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// struct lwip_socket below is a copy of the start of a structure
+// private to mbed's lwIP glue, as it is in features/FEATURE_LWIP/
+// lwip-interface/lwip_stack.c of mbed OS 5.3 to 5.8; from 5.9 the
+// glue was rewritten.  If mbed-os is moved on, check the structure
+// against it before changing these, or cwnd and the rest will be
+// read from the wrong place without a word
+#define TCP_WINDOW_MBED_OS_MAJOR 5
+#define TCP_WINDOW_MBED_OS_MINOR_MIN 3
+#define TCP_WINDOW_MBED_OS_MINOR_MAX 8
+
+#if !defined(MBED_MAJOR_VERSION) || (MBED_MAJOR_VERSION != TCP_WINDOW_MBED_OS_MAJOR) || \
+    (MBED_MINOR_VERSION < TCP_WINDOW_MBED_OS_MINOR_MIN) || (MBED_MINOR_VERSION > TCP_WINDOW_MBED_OS_MINOR_MAX)
+#  error struct lwip_socket in tcpwindow.cpp has not been checked against this version of mbed OS
+#endif
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// The start of the socket structure in mbed's lwip_stack.c, which
+// is what a socket handle points to; only conn is needed
+struct lwip_socket {
+    bool in_use;
+    struct netconn *conn;
+};
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Read the state of the connection
+bool TcpWindowSocket::getWindow(TcpWindow * pWindow)
+{
+    struct lwip_socket * pSocket = (struct lwip_socket *) _socket;
+    struct tcp_pcb * pPcb = NULL;
+    int window;
+
+    if ((pSocket != NULL) && pSocket->in_use && (pSocket->conn != NULL) &&
+        (NETCONNTYPE_GROUP(pSocket->conn->type) == NETCONN_TCP)) {
+        pPcb = pSocket->conn->pcb.tcp;
+    }
+
+    if ((pPcb != NULL) && (pPcb->state == ESTABLISHED)) {
+        pWindow->cwnd = pPcb->cwnd;
+        pWindow->sndWnd = pPcb->snd_wnd;
+        pWindow->inFlight = (int) (pPcb->snd_nxt - pPcb->lastack);
+        window = pWindow->cwnd;
+        if (pWindow->sndWnd < window) {
+            window = pWindow->sndWnd;
+        }
+        pWindow->effWnd = window - pWindow->inFlight;
+        if (pWindow->effWnd < 0) {
+            pWindow->effWnd = 0;
+        }
+        pWindow->sndBuf = pPcb->snd_buf;
+        pWindow->queueLen = pPcb->snd_queuelen;
+    }
+
+    return (pPcb != NULL) && (pPcb->state == ESTABLISHED);
+}
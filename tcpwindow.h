@@ -0,0 +1,60 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A TCP socket that can report lwIP's view of the connection's send
+ * side: the congestion window, the window the far end has offered,
+ * how much of those is still free and how much is queued.
+ *
+ * mbed's socket API doesn't give access to any of this so the socket
+ * handle is followed through to lwIP's PCB; this depends on the layout
+ * of the socket structure in mbed's lwip_stack.c and on lwIP 2.  The
+ * values are read without taking the lwIP core lock, so they are a
+ * snapshot that may already be out of date, which is fine for steering
+ * the send rate.
+ */
+
+#ifndef _TCPWINDOW_H_
+#define _TCPWINDOW_H_
+
+#include "mbed.h"
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// The state of the send side of a TCP connection, in bytes
+// except for queueLen, which is in lwIP segments
+typedef struct {
+    int cwnd;       // The congestion window
+    int sndWnd;     // The window offered by the far end
+    int inFlight;   // Sent but not yet acknowledged
+    int effWnd;     // What can be sent now: the lesser window less inFlight
+    int sndBuf;     // Free space in the send buffer
+    int queueLen;   // Segments queued, sent or not
+} TcpWindow;
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+class TcpWindowSocket : public TCPSocket {
+public:
+    // Read the state of the connection; returns false
+    // if the socket isn't open or isn't connected
+    bool getWindow(TcpWindow * pWindow);
+};
+
+#endif // _TCPWINDOW_H_
@@ -0,0 +1,223 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "capture.h"
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// The share of a range one thread decodes
+typedef struct {
+    const char * pRecords;
+    uint64_t firstRecord;
+    uint64_t numRecords;
+    int32_t * pSamples;
+    CaptureCallback pCallback;
+    void * pContext;
+} Share;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Decode a share, straight into memory or a chunk at a time
+// through the callback
+static void * decodeShare(void * pParam)
+{
+    Share * pShare = (Share *) pParam;
+    int32_t chunk[CAPTURE_CHUNK_RECORDS * CAPTURE_RECORD_SAMPLES];
+    const char * pRecord = pShare->pRecords;
+    uint64_t done = 0;
+    int count;
+
+    while (done < pShare->numRecords) {
+        count = CAPTURE_CHUNK_RECORDS;
+        if (pShare->numRecords - done < (uint64_t) count) {
+            count = (int) (pShare->numRecords - done);
+        }
+        if (pShare->pCallback == NULL) {
+            for (int x = 0; x < count; x++) {
+                unicamDecode(pRecord, pShare->pSamples + (done + x) * CAPTURE_RECORD_SAMPLES);
+                pRecord += CAPTURE_RECORD_SIZE;
+            }
+        } else {
+            for (int x = 0; x < count; x++) {
+                unicamDecode(pRecord, chunk + x * CAPTURE_RECORD_SAMPLES);
+                pRecord += CAPTURE_RECORD_SIZE;
+            }
+            pShare->pCallback(pShare->firstRecord + done, count, chunk, pShare->pContext);
+        }
+        done += count;
+    }
+
+    return NULL;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Constructor
+CaptureReader::CaptureReader()
+{
+    _fd = -1;
+    _pBase = NULL;
+    _size = 0;
+}
+
+// Destructor
+CaptureReader::~CaptureReader()
+{
+    close();
+}
+
+// Map a capture
+bool CaptureReader::open(const char * pFileName)
+{
+    struct stat status;
+    void * pMap;
+
+    close();
+
+    _fd = ::open(pFileName, O_RDONLY);
+    if (_fd < 0) {
+        return false;
+    }
+    if ((fstat(_fd, &status) != 0) || (status.st_size < CAPTURE_RECORD_SIZE)) {
+        close();
+        return false;
+    }
+    pMap = mmap(NULL, (size_t) status.st_size, PROT_READ, MAP_SHARED, _fd, 0);
+    if (pMap == MAP_FAILED) {
+        close();
+        return false;
+    }
+    // Read ahead hard: records are gone through in order
+    madvise(pMap, (size_t) status.st_size, MADV_SEQUENTIAL);
+    _pBase = (const char *) pMap;
+    _size = (uint64_t) status.st_size;
+
+    return true;
+}
+
+// Unmap it
+void CaptureReader::close()
+{
+    if (_pBase != NULL) {
+        munmap((void *) _pBase, (size_t) _size);
+        _pBase = NULL;
+    }
+    _size = 0;
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+// Get the number of whole records
+uint64_t CaptureReader::getNumRecords()
+{
+    return _size / CAPTURE_RECORD_SIZE;
+}
+
+// Get the number of bytes left over
+int CaptureReader::getNumTrailingBytes()
+{
+    return (int) (_size % CAPTURE_RECORD_SIZE);
+}
+
+// Get a record
+const char * CaptureReader::getRecord(uint64_t index)
+{
+    if (index >= getNumRecords()) {
+        return NULL;
+    }
+
+    return _pBase + index * CAPTURE_RECORD_SIZE;
+}
+
+// Decode a range into memory
+bool CaptureReader::decode(uint64_t firstRecord, uint64_t numRecords, int32_t * pSamples, int numThreads)
+{
+    return run(firstRecord, numRecords, numThreads, pSamples, NULL, NULL);
+}
+
+// Decode a range through a callback
+bool CaptureReader::process(uint64_t firstRecord, uint64_t numRecords, int numThreads,
+                            CaptureCallback pCallback, void ** ppContexts)
+{
+    return (pCallback != NULL) && run(firstRecord, numRecords, numThreads, NULL, pCallback, ppContexts);
+}
+
+/* ----------------------------------------------------------------
+ * PROTECTED FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Share a range out between threads and run them; the first share is
+// done on this thread
+bool CaptureReader::run(uint64_t firstRecord, uint64_t numRecords, int numThreads, int32_t * pSamples,
+                        CaptureCallback pCallback, void ** ppContexts)
+{
+    Share shares[CAPTURE_MAX_NUM_THREADS];
+    pthread_t threads[CAPTURE_MAX_NUM_THREADS];
+    bool started[CAPTURE_MAX_NUM_THREADS];
+    uint64_t start = firstRecord;
+    uint64_t each;
+    bool success = true;
+
+    if ((_pBase == NULL) || (numThreads < 1) || (numThreads > CAPTURE_MAX_NUM_THREADS) ||
+        (firstRecord > getNumRecords()) || (numRecords > getNumRecords() - firstRecord)) {
+        return false;
+    }
+    if ((uint64_t) numThreads > numRecords) {
+        numThreads = (numRecords > 0) ? (int) numRecords : 1;
+    }
+
+    each = numRecords / numThreads;
+    for (int x = 0; x < numThreads; x++) {
+        shares[x].pRecords = _pBase + start * CAPTURE_RECORD_SIZE;
+        shares[x].firstRecord = start;
+        // The last share takes whatever doesn't divide evenly
+        shares[x].numRecords = (x < numThreads - 1) ? each : firstRecord + numRecords - start;
+        shares[x].pSamples = (pSamples != NULL) ? pSamples + (start - firstRecord) * CAPTURE_RECORD_SAMPLES : NULL;
+        shares[x].pCallback = pCallback;
+        shares[x].pContext = (ppContexts != NULL) ? ppContexts[x] : NULL;
+        start += shares[x].numRecords;
+    }
+
+    for (int x = 1; x < numThreads; x++) {
+        started[x] = (pthread_create(&threads[x], NULL, decodeShare, &shares[x]) == 0);
+        if (!started[x]) {
+            // Do it here instead
+            decodeShare(&shares[x]);
+        }
+    }
+    decodeShare(&shares[0]);
+    for (int x = 1; x < numThreads; x++) {
+        if (started[x] && (pthread_join(threads[x], NULL) != 0)) {
+            success = false;
+        }
+    }
+
+    return success;
+}
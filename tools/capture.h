@@ -0,0 +1,110 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Reading of a capture in the LOCAL_FILE format (the URTP bodies of
+ * the stream, one after the other, as written to the SD card or got
+ * out by raw_extract or seg_seek), for use on a Linux host.
+ *
+ * The capture is mapped into memory rather than read, so records are
+ * handed out as pointers into the mapping, without a copy, and a
+ * multi-gigabyte capture costs no more than the pages touched.  A
+ * range of records can be decoded to samples on several threads at
+ * once, each thread taking a contiguous share of the range, either
+ * into memory or, where the samples of the whole range would not fit,
+ * through a callback that sees them a chunk at a time.  Records are
+ * decoded as in unicam.h.
+ */
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stdint.h>
+#include "unicam.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The number of samples in a record
+#define CAPTURE_RECORD_SAMPLES UNICAM_BODY_SAMPLES
+
+// The size of a record, URTP_BODY_SIZE
+#define CAPTURE_RECORD_SIZE UNICAM_BODY_SIZE
+
+// The most threads a decode may use
+#define CAPTURE_MAX_NUM_THREADS 64
+
+// The number of records a callback is given at a time
+#define CAPTURE_CHUNK_RECORDS 256
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// A callback for CaptureReader::process(), called with the samples of
+// numRecords records from firstRecord on; pContext is the one given
+// for the thread doing the work, so needs no locking
+typedef void (*CaptureCallback)(uint64_t firstRecord, int numRecords,
+                                const int32_t * pSamples, void * pContext);
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+class CaptureReader {
+public:
+    CaptureReader();
+    ~CaptureReader();
+
+    // Map a capture
+    bool open(const char * pFileName);
+
+    // Unmap it
+    void close();
+
+    // Get the number of whole records in the capture
+    uint64_t getNumRecords();
+
+    // Get the number of bytes at the end that don't make up a
+    // whole record (e.g. the last write was cut short)
+    int getNumTrailingBytes();
+
+    // Get a record, pointing into the mapping, or NULL if there is
+    // no such record
+    const char * getRecord(uint64_t index);
+
+    // Decode numRecords records from firstRecord on into pSamples,
+    // which must have room for numRecords * CAPTURE_RECORD_SAMPLES
+    // samples, using numThreads threads
+    bool decode(uint64_t firstRecord, uint64_t numRecords, int32_t * pSamples, int numThreads);
+
+    // Decode numRecords records from firstRecord on using numThreads
+    // threads, calling pCallback with the samples of each chunk; thread
+    // x gives its callbacks ppContexts[x]
+    bool process(uint64_t firstRecord, uint64_t numRecords, int numThreads,
+                 CaptureCallback pCallback, void ** ppContexts);
+
+protected:
+    // Share a range out between threads and run them
+    bool run(uint64_t firstRecord, uint64_t numRecords, int numThreads, int32_t * pSamples,
+             CaptureCallback pCallback, void ** ppContexts);
+
+    int _fd;
+    const char * _pBase;
+    uint64_t _size;
+};
+
+#endif // _CAPTURE_H_
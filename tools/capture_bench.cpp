@@ -0,0 +1,280 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Measures how fast a capture in the LOCAL_FILE format can be gone
+ * through with CaptureReader (see capture.h), for use on a Linux host.
+ *
+ * Each pass first walks the records in place, then decodes all of them
+ * on 1, 2, 4... up to -t threads, the samples going to a callback that
+ * keeps the peak and the sum of squares; the rate is given in Gbytes
+ * of capture per second.  The first pass may be limited by the disk,
+ * later ones run from the page cache.  The totals must come out the
+ * same however many threads are used, and are checked.
+ *
+ * With -w, a capture of so many Mbytes of made-up UNICAM records is
+ * written first, so that a multi-gigabyte capture can be had without
+ * hardware.
+ *
+ * Usage: capture_bench [-t threads] [-p passes] [-w Mbytes] file
+ *   -t  the most threads to decode on (default the number of CPUs)
+ *   -p  the number of passes (default 3)
+ *   -w  write a capture of this many Mbytes first
+ *  e.g. capture_bench -w 4096 /tmp/capture.bin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <vector>
+#include "capture.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Defaults
+#define DEFAULT_NUM_PASSES 3
+
+// The number of records written in one go with -w
+#define WRITE_CHUNK_RECORDS 4096
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// What a thread works out from the samples it decodes
+typedef struct {
+    uint64_t numSamples;
+    uint64_t sumOfSquares;
+    int32_t peak;
+} Totals;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Time now in microseconds
+static int64_t nowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Gbytes per second
+static double gBytesPerSecond(uint64_t numBytes, int64_t durationUs)
+{
+    return (durationUs > 0) ? (double) numBytes / durationUs / 1000 : 0;
+}
+
+// Callback adding a chunk of samples to a thread's totals
+static void addToTotals(uint64_t firstRecord, int numRecords, const int32_t * pSamples, void * pContext)
+{
+    Totals * pTotals = (Totals *) pContext;
+    int numSamples = numRecords * CAPTURE_RECORD_SAMPLES;
+    int32_t magnitude;
+
+    (void) firstRecord;
+    for (int x = 0; x < numSamples; x++) {
+        magnitude = (pSamples[x] < 0) ? -pSamples[x] : pSamples[x];
+        if (magnitude > pTotals->peak) {
+            pTotals->peak = magnitude;
+        }
+        pTotals->sumOfSquares += (uint64_t) ((int64_t) pSamples[x] * pSamples[x]);
+    }
+    pTotals->numSamples += numSamples;
+}
+
+// Write a capture of made-up records: a sawtooth whose UNICAM
+// shift wanders up and down, so that every shift gets decoded
+static bool writeCapture(const char * pFileName, uint64_t numBytes)
+{
+    FILE * pFile;
+    std::vector<char> buffer(WRITE_CHUNK_RECORDS * CAPTURE_RECORD_SIZE);
+    uint64_t numRecords = numBytes / CAPTURE_RECORD_SIZE;
+    uint64_t record = 0;
+    unsigned int count;
+    char * pCoded;
+    int block;
+    bool success = true;
+
+    pFile = fopen(pFileName, "wb");
+    if (pFile == NULL) {
+        perror("Unable to open capture");
+        return false;
+    }
+    while (success && (record < numRecords)) {
+        count = WRITE_CHUNK_RECORDS;
+        if (numRecords - record < count) {
+            count = (unsigned int) (numRecords - record);
+        }
+        pCoded = &buffer[0];
+        for (unsigned int x = 0; x < count; x++) {
+            block = (int) ((record + x) % 13);
+            for (int y = 0; y < CAPTURE_RECORD_SAMPLES; y += UNICAM_BLOCK_SAMPLES * 2) {
+                for (int z = 0; z < UNICAM_BLOCK_SAMPLES * 2; z++) {
+                    *pCoded = (char) (int8_t) ((z * 8) - 128 + y);
+                    pCoded++;
+                }
+                *pCoded = (char) ((block << 4) | (12 - block));
+                pCoded++;
+            }
+        }
+        success = (fwrite(&buffer[0], CAPTURE_RECORD_SIZE, count, pFile) == count);
+        record += count;
+    }
+    if (fclose(pFile) != 0) {
+        success = false;
+    }
+    if (success) {
+        printf("Wrote %llu record(s), %llu byte(s), to %s.\n", (unsigned long long) numRecords,
+               (unsigned long long) (numRecords * CAPTURE_RECORD_SIZE), pFileName);
+    } else {
+        printf("Unable to write %s.\n", pFileName);
+    }
+
+    return success;
+}
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Entry point
+int main(int argc, char * argv[])
+{
+    int maxNumThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int numPasses = DEFAULT_NUM_PASSES;
+    uint64_t writeBytes = 0;
+    CaptureReader reader;
+    uint64_t numRecords;
+    uint64_t numBytes;
+    uint64_t sum;
+    const char * pRecord;
+    Totals totals[CAPTURE_MAX_NUM_THREADS];
+    void * pContexts[CAPTURE_MAX_NUM_THREADS];
+    Totals result;
+    Totals first;
+    bool haveFirst = false;
+    int64_t startUs;
+    int64_t durationUs;
+    int opt;
+    int retValue = 0;
+
+    while ((opt = getopt(argc, argv, "t:p:w:")) != -1) {
+        switch (opt) {
+            case 't':
+                maxNumThreads = atoi(optarg);
+                break;
+            case 'p':
+                numPasses = atoi(optarg);
+                break;
+            case 'w':
+                writeBytes = (uint64_t) atoi(optarg) << 20;
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+    if (maxNumThreads < 1) {
+        maxNumThreads = 1;
+    }
+    if (maxNumThreads > CAPTURE_MAX_NUM_THREADS) {
+        maxNumThreads = CAPTURE_MAX_NUM_THREADS;
+    }
+    if (optind != argc - 1) {
+        printf("Usage: %s [-t threads] [-p passes] [-w Mbytes] file\n", argv[0]);
+        return -1;
+    }
+
+    if ((writeBytes > 0) && !writeCapture(argv[optind], writeBytes)) {
+        return -1;
+    }
+    if (!reader.open(argv[optind])) {
+        printf("Unable to map %s.\n", argv[optind]);
+        return -1;
+    }
+    numRecords = reader.getNumRecords();
+    numBytes = numRecords * CAPTURE_RECORD_SIZE;
+    printf("%s: %llu record(s) (%.1f hour(s) of audio)", argv[optind], (unsigned long long) numRecords,
+           numRecords * CAPTURE_RECORD_SAMPLES / 16000.0 / 3600);
+    if (reader.getNumTrailingBytes() > 0) {
+        printf(", %d byte(s) at the end ignored", reader.getNumTrailingBytes());
+    }
+    printf(".\n");
+
+    for (int x = 0; x < CAPTURE_MAX_NUM_THREADS; x++) {
+        pContexts[x] = &totals[x];
+    }
+
+    for (int pass = 0; pass < numPasses; pass++) {
+        // Walk the records in place, touching every byte
+        startUs = nowUs();
+        sum = 0;
+        for (uint64_t x = 0; x < numRecords; x++) {
+            pRecord = reader.getRecord(x);
+            for (int y = 0; y < CAPTURE_RECORD_SIZE; y++) {
+                sum += (uint8_t) pRecord[y];
+            }
+        }
+        durationUs = nowUs() - startUs;
+        printf("Pass %d: walk %.2f Gbytes/s (byte sum %llu)", pass + 1,
+               gBytesPerSecond(numBytes, durationUs), (unsigned long long) sum);
+
+        // Decode on more and more threads
+        for (int numThreads = 1; numThreads <= maxNumThreads;
+             numThreads = (numThreads * 2 > maxNumThreads) && (numThreads < maxNumThreads) ?
+                          maxNumThreads : numThreads * 2) {
+            memset(totals, 0, sizeof(totals));
+            startUs = nowUs();
+            if (!reader.process(0, numRecords, numThreads, addToTotals, pContexts)) {
+                printf("\nDecode on %d thread(s) failed.\n", numThreads);
+                return -1;
+            }
+            durationUs = nowUs() - startUs;
+            memset(&result, 0, sizeof(result));
+            for (int x = 0; x < numThreads; x++) {
+                result.numSamples += totals[x].numSamples;
+                result.sumOfSquares += totals[x].sumOfSquares;
+                if (totals[x].peak > result.peak) {
+                    result.peak = totals[x].peak;
+                }
+            }
+            printf(", decode x%d %.2f Gbytes/s", numThreads, gBytesPerSecond(numBytes, durationUs));
+            if (!haveFirst) {
+                first = result;
+                haveFirst = true;
+            } else if ((result.numSamples != first.numSamples) ||
+                       (result.sumOfSquares != first.sumOfSquares) || (result.peak != first.peak)) {
+                printf(" (totals DIFFER)");
+                retValue = -1;
+            }
+        }
+        printf(".\n");
+    }
+
+    if (haveFirst) {
+        printf("%llu sample(s), peak %d, sum of squares %llu.\n", (unsigned long long) first.numSamples,
+               first.peak, (unsigned long long) first.sumOfSquares);
+    }
+
+    return retValue;
+}
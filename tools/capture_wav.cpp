@@ -0,0 +1,184 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Turns a capture in the LOCAL_FILE format into a Broadcast WAV file,
+ * as LOCAL_FILE_WAV writes on the board, for use on a Linux host.
+ *
+ * The WAV file is written with the same WavWriter and in the same size
+ * of write as the board, the header being brought up to date only
+ * every -u seconds of audio, and the time each write takes is
+ * reported along with the sustained throughput, against the rate the
+ * audio arrives at.  Write to a mounted SD card, with -s so that each
+ * write goes to the card rather than the page cache, to see whether
+ * the card can keep up.
+ *
+ * Usage: capture_wav [-u seconds] [-b blocks] [-s] capture wavfile
+ *   -u  how often to bring the header up to date (default 10 seconds,
+ *       as LOCAL_FILE_WAV_UPDATE_SECONDS)
+ *   -b  the number of blocks of audio in each write (default 16,
+ *       as on the board)
+ *   -s  sync each write to the card
+ *  e.g. capture_wav -s audio.bin /media/sd/audio.wav
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <vector>
+#include "capture.h"
+#include "wav.h"
+#include "clocksync.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Defaults
+#define DEFAULT_UPDATE_SECONDS 10
+#define DEFAULT_NUM_BLOCKS 16
+
+// The sampling frequency and block duration, as on the board
+#define SAMPLING_FREQUENCY 16000
+#define BLOCK_DURATION_MS 20
+
+// The histogram of write times: 100 us bins, up to a second
+#define LATENCY_BIN_US 100
+#define LATENCY_NUM_BINS 10000
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Time now in microseconds
+static int64_t nowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Entry point
+int main(int argc, char * argv[])
+{
+    int updateSeconds = DEFAULT_UPDATE_SECONDS;
+    int numBlocks = DEFAULT_NUM_BLOCKS;
+    bool sync = false;
+    CaptureReader reader;
+    WavWriter writer;
+    FILE * pSync = NULL;
+    std::vector<int32_t> samples;
+    std::vector<char> pcm;
+    std::vector<uint32_t> bins(LATENCY_NUM_BINS);
+    LatencyHistogram latency;
+    uint64_t numRecords;
+    uint64_t record = 0;
+    int count;
+    int64_t startUs;
+    int64_t writeUs = 0;
+    int64_t durationUs;
+    bool success = true;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "u:b:s")) != -1) {
+        switch (opt) {
+            case 'u':
+                updateSeconds = atoi(optarg);
+                break;
+            case 'b':
+                numBlocks = atoi(optarg);
+                break;
+            case 's':
+                sync = true;
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+    if ((optind != argc - 2) || (numBlocks < 1)) {
+        printf("Usage: %s [-u seconds] [-b blocks] [-s] capture wavfile\n", argv[0]);
+        return -1;
+    }
+
+    if (!reader.open(argv[optind])) {
+        printf("Unable to map %s.\n", argv[optind]);
+        return -1;
+    }
+    if (!writer.open(argv[optind + 1], SAMPLING_FREQUENCY, 24, 1,
+                     (uint32_t) updateSeconds * SAMPLING_FREQUENCY * 3, "capture_wav")) {
+        printf("Unable to open %s.\n", argv[optind + 1]);
+        return -1;
+    }
+    if (sync) {
+        // A second handle, only for fsync(), as WavWriter keeps its own
+        pSync = fopen(argv[optind + 1], "rb");
+    }
+
+    numRecords = reader.getNumRecords();
+    samples.resize(numBlocks * CAPTURE_RECORD_SAMPLES);
+    pcm.resize(numBlocks * CAPTURE_RECORD_SAMPLES * 3);
+    latency.init(&bins[0], LATENCY_NUM_BINS, LATENCY_BIN_US);
+    while (success && (record < numRecords)) {
+        count = numBlocks;
+        if (numRecords - record < (uint64_t) count) {
+            count = (int) (numRecords - record);
+        }
+        reader.decode(record, count, &samples[0], 1);
+        wavPack24(&samples[0], count * CAPTURE_RECORD_SAMPLES, &pcm[0]);
+        startUs = nowUs();
+        success = writer.write(&pcm[0], count * CAPTURE_RECORD_SAMPLES * 3,
+                               record * BLOCK_DURATION_MS * 1000, (int) (record & 0xFFFF));
+        if (pSync != NULL) {
+            fflush(NULL);
+            fsync(fileno(pSync));
+        }
+        durationUs = nowUs() - startUs;
+        latency.add((int) durationUs);
+        writeUs += durationUs;
+        record += count;
+    }
+    if (!writer.close()) {
+        success = false;
+    }
+    if (pSync != NULL) {
+        fsync(fileno(pSync));
+        fclose(pSync);
+    }
+
+    printf("Wrote %u byte(s) of audio (%.1f second(s)) to %s in %d write(s) of %d byte(s), the header"
+           " %d time(s)%s.\n", writer.getNumBytes(), (double) record * BLOCK_DURATION_MS / 1000,
+           argv[optind + 1], latency.getCount(), numBlocks * CAPTURE_RECORD_SAMPLES * 3,
+           writer.getNumHeaderWrites(), success ? "" : ", FAILED");
+    if (latency.getCount() > 0) {
+        printf("Write time: 50%% %d us, 99%% %d us, worst %d us, against %d ms to fill a write.\n",
+               latency.getPercentileUs(50), latency.getPercentileUs(99), latency.getMaxUs(),
+               numBlocks * BLOCK_DURATION_MS);
+    }
+    if (writeUs > 0) {
+        printf("Throughput %.1f kbyte(s)/s sustained, %d kbyte(s)/s needed.\n",
+               (double) writer.getNumBytes() * 1000 / writeUs, SAMPLING_FREQUENCY * 3 / 1000);
+    }
+
+    return success ? 0 : -1;
+}
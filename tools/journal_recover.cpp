@@ -0,0 +1,312 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Gets back a LOCAL_FILE recording from its journal (see journal.h)
+ * after the power went before it was closed, for use on a Linux host.
+ *
+ * The last commit in the journal is printed and, with -o, the audio
+ * it covers, in whole blocks, is copied out of the recording file to
+ * a capture in the LOCAL_FILE format.
+ *
+ * With -b, a recording of so many Mbytes of made-up blocks is first
+ * written over the recording file, as LOCAL_FILE_JOURNAL_SECONDS has
+ * the board do it, twice: once without commits and once with, timing
+ * both so that what committing costs can be seen.  The second is left
+ * unclosed, as if the power had gone, and is then got back as above.
+ * Do this on a mounted SD card, with -s so that each write and commit
+ * goes to the card rather than the page cache, for real numbers.
+ *
+ * Usage: journal_recover [-o capture] [-b Mbytes] [-w bytes] [-c seconds] [-s]
+ *                        journal recording
+ *   -o  copy the committed audio to this file
+ *   -b  first write a recording of this many Mbytes, timing it
+ *   -w  the size of each write with -b (default 16500, as the board)
+ *   -c  how often to commit with -b (default 5 seconds of audio)
+ *   -s  sync each write and commit to the card with -b
+ *  e.g. journal_recover -o audio.bin /media/sd/audio.jnl /media/sd/audio.bin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <vector>
+#include "journal.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Defaults
+#define DEFAULT_WRITE_SIZE 16500
+#define DEFAULT_COMMIT_SECONDS 5
+
+// The block size and duration, as on the board
+#define BLOCK_SIZE 330
+#define BLOCK_DURATION_MS 20
+
+// The number of bytes copied out in one go
+#define COPY_CHUNK_SIZE (1024 * 1024)
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// How a timed recording went
+typedef struct {
+    uint64_t numBytes;
+    int64_t writeUs;
+    int64_t commitUs;
+    int commitMaxUs;
+    unsigned int numCommits;
+} Timing;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Time now in microseconds
+static int64_t nowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Kbytes per second
+static int kBytesPerSecond(uint64_t numBytes, int64_t durationUs)
+{
+    return (durationUs > 0) ? (int) (numBytes * 1000 / durationUs) : 0;
+}
+
+// Write numBytes of made-up blocks over a recording file, allocated
+// first and untimed, committing every commitBytes to pJournal unless
+// it is NULL; the journal is left open
+static bool record(const char * pFileName, uint64_t numBytes, int writeSize, Journal * pJournal,
+                   const char * pJournalName, uint64_t commitBytes, bool sync, Timing * pTiming)
+{
+    FILE * pFile;
+    FILE * pJournalSync = NULL;
+    std::vector<char> buffer(writeSize);
+    uint64_t offset = 0;
+    uint64_t lastOffset = 0;
+    int count;
+    int64_t startUs;
+    int duration;
+    bool success;
+
+    memset(pTiming, 0, sizeof(*pTiming));
+    for (int x = 0; x < writeSize; x++) {
+        buffer[x] = (char) (x * 7);
+    }
+
+    // Allocate it, as openPreallocated() does on the board
+    pFile = fopen(pFileName, "rb+");
+    if (pFile == NULL) {
+        pFile = fopen(pFileName, "wb+");
+    }
+    success = (pFile != NULL) && (fseeko(pFile, 0, SEEK_END) == 0);
+    if (success && ((uint64_t) ftello(pFile) < numBytes)) {
+        success = (fseeko(pFile, numBytes - 1, SEEK_SET) == 0) && (fputc(0, pFile) != EOF) &&
+                  (fflush(pFile) == 0) && (fsync(fileno(pFile)) == 0);
+    }
+    success = success && (fseeko(pFile, 0, SEEK_SET) == 0);
+    if (success) {
+        // As on the board, nothing is held back in stdio
+        setvbuf(pFile, NULL, _IONBF, 0);
+    }
+    if (success && (pJournal != NULL)) {
+        success = pJournal->open(pJournalName, BLOCK_SIZE);
+        if (success && sync) {
+            // A second handle, only for fdatasync(), as Journal keeps its own
+            pJournalSync = fopen(pJournalName, "rb");
+        }
+    }
+
+    while (success && (offset < numBytes)) {
+        count = (numBytes - offset < (uint64_t) writeSize) ? (int) (numBytes - offset) : writeSize;
+        startUs = nowUs();
+        success = (fwrite(&buffer[0], 1, count, pFile) == (size_t) count);
+        if (success && sync) {
+            success = (fdatasync(fileno(pFile)) == 0);
+        }
+        pTiming->writeUs += nowUs() - startUs;
+        lastOffset = offset;
+        offset += count;
+        if (success && (pJournal != NULL) && (offset - pJournal->getNumBytes() >= commitBytes)) {
+            startUs = nowUs();
+            success = pJournal->commit(offset, lastOffset, (int) ((lastOffset / BLOCK_SIZE) & 0xFFFF),
+                                       lastOffset / BLOCK_SIZE * BLOCK_DURATION_MS * 1000);
+            if (success && (pJournalSync != NULL)) {
+                success = (fdatasync(fileno(pJournalSync)) == 0);
+            }
+            duration = (int) (nowUs() - startUs);
+            pTiming->commitUs += duration;
+            if (duration > pTiming->commitMaxUs) {
+                pTiming->commitMaxUs = duration;
+            }
+            pTiming->numCommits++;
+        }
+    }
+    pTiming->numBytes = offset;
+
+    if (pJournalSync != NULL) {
+        fclose(pJournalSync);
+    }
+    if ((pFile != NULL) && (fclose(pFile) != 0)) {
+        success = false;
+    }
+    if (!success) {
+        printf("Unable to write a recording to %s.\n", pFileName);
+    }
+
+    return success;
+}
+
+// Copy numBytes from the start of one file to another
+static bool copy(const char * pFromName, const char * pToName, uint64_t numBytes)
+{
+    FILE * pFrom = fopen(pFromName, "rb");
+    FILE * pTo = fopen(pToName, "wb");
+    std::vector<char> buffer(COPY_CHUNK_SIZE);
+    uint64_t done = 0;
+    size_t count;
+    bool success = (pFrom != NULL) && (pTo != NULL);
+
+    while (success && (done < numBytes)) {
+        count = (numBytes - done < COPY_CHUNK_SIZE) ? (size_t) (numBytes - done) : COPY_CHUNK_SIZE;
+        success = (fread(&buffer[0], 1, count, pFrom) == count) &&
+                  (fwrite(&buffer[0], 1, count, pTo) == count);
+        done += count;
+    }
+    if (pFrom != NULL) {
+        fclose(pFrom);
+    }
+    if ((pTo != NULL) && (fclose(pTo) != 0)) {
+        success = false;
+    }
+
+    return success;
+}
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Entry point
+int main(int argc, char * argv[])
+{
+    const char * pOutName = NULL;
+    uint64_t benchBytes = 0;
+    int writeSize = DEFAULT_WRITE_SIZE;
+    int commitSeconds = DEFAULT_COMMIT_SECONDS;
+    bool sync = false;
+    const char * pJournalName;
+    const char * pRecordingName;
+    Journal journal;
+    Timing without;
+    Timing with;
+    FILE * pFile;
+    JournalCommit commit;
+    uint64_t numBytes;
+    uint64_t firstBlock;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:b:w:c:s")) != -1) {
+        switch (opt) {
+            case 'o':
+                pOutName = optarg;
+                break;
+            case 'b':
+                benchBytes = (uint64_t) atoi(optarg) << 20;
+                break;
+            case 'w':
+                writeSize = atoi(optarg);
+                break;
+            case 'c':
+                commitSeconds = atoi(optarg);
+                break;
+            case 's':
+                sync = true;
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+    if ((optind != argc - 2) || (writeSize < 1) || (commitSeconds < 1)) {
+        printf("Usage: %s [-o capture] [-b Mbytes] [-w bytes] [-c seconds] [-s] journal recording\n", argv[0]);
+        return -1;
+    }
+    pJournalName = argv[optind];
+    pRecordingName = argv[optind + 1];
+
+    if (benchBytes > 0) {
+        if (!record(pRecordingName, benchBytes, writeSize, NULL, NULL, 0, sync, &without) ||
+            !record(pRecordingName, benchBytes, writeSize, &journal, pJournalName,
+                    (uint64_t) commitSeconds * (1000 / BLOCK_DURATION_MS) * BLOCK_SIZE, sync, &with)) {
+            return -1;
+        }
+        printf("Wrote %llu byte(s) in writes of %d byte(s)%s: without commits %d kbyte(s)/s; with %u"
+               " commit(s), one every %d second(s) of audio, %d kbyte(s)/s, a commit taking %d us on"
+               " average, worst %d us, %.1f%% of the time.\n", (unsigned long long) with.numBytes,
+               writeSize, sync ? ", syncing each" : "", kBytesPerSecond(without.numBytes, without.writeUs),
+               with.numCommits, commitSeconds, kBytesPerSecond(with.numBytes, with.writeUs + with.commitUs),
+               (with.numCommits > 0) ? (int) (with.commitUs / with.numCommits) : 0, with.commitMaxUs,
+               (with.writeUs + with.commitUs > 0) ?
+               (double) with.commitUs * 100 / (with.writeUs + with.commitUs) : 0);
+        printf("Leaving the recording unclosed, as if the power had gone.\n");
+    }
+
+    pFile = fopen(pJournalName, "rb");
+    if (pFile == NULL) {
+        printf("Unable to open %s.\n", pJournalName);
+        return -1;
+    }
+    if (!journalRead(pFile, &commit)) {
+        printf("No commits found in %s.\n", pJournalName);
+        fclose(pFile);
+        return -1;
+    }
+    fclose(pFile);
+
+    numBytes = (commit.blockSize > 0) ? commit.numBytes - commit.numBytes % commit.blockSize : 0;
+    printf("Run %u, commit %u: %llu byte(s) of audio, %llu block(s) of %d byte(s) (%.1f second(s)), %s.\n",
+           commit.run, commit.commit, (unsigned long long) commit.numBytes,
+           (unsigned long long) (numBytes / (commit.blockSize > 0 ? commit.blockSize : 1)),
+           commit.blockSize, (double) numBytes / (commit.blockSize > 0 ? commit.blockSize : 1) *
+           BLOCK_DURATION_MS / 1000, commit.closed ? "closed cleanly" : "NOT closed, the power may have gone");
+    if ((commit.commit > 0) && (commit.blockSize > 0)) {
+        firstBlock = commit.offset / commit.blockSize;
+        printf("The block at byte %llu has sequence number %d and timestamp %llu us, so the recording"
+               " starts at sequence number %d.\n", (unsigned long long) commit.offset, commit.sequenceNumber,
+               (unsigned long long) commit.timestampUs, (int) ((commit.sequenceNumber - firstBlock) & 0xFFFF));
+    }
+
+    if (pOutName != NULL) {
+        if (!copy(pRecordingName, pOutName, numBytes)) {
+            printf("Unable to copy %llu byte(s) from %s to %s.\n", (unsigned long long) numBytes,
+                   pRecordingName, pOutName);
+            return -1;
+        }
+        printf("Copied %llu byte(s) to %s.\n", (unsigned long long) numBytes, pOutName);
+    }
+
+    return 0;
+}
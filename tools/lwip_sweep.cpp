@@ -0,0 +1,671 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A sweep of the lwIP buffer settings in mbed_app.json (TCP_MSS,
+ * TCP_WND, TCP_SND_BUF, PBUF_POOL_SIZE and MEMP_NUM_TCP_SEG) against
+ * simulated links, for use on a Linux host.
+ *
+ * The lwIP settings are fixed when mbed OS is built, so rather than
+ * running on the board each combination is run through a model of the
+ * board's send path: the send task writes a URTP datagram every block
+ * period with tcpSend(), lwIP's send buffer and segment queue limits
+ * decide when a write is taken, and a Reno-style sender (slow start,
+ * fast retransmit, retransmission timeout with go-back) pushes
+ * segments over a link of the given round trip time, bandwidth and
+ * random loss.  For each combination this reports the throughput, the
+ * share of the stream delivered, percentiles of the time a send takes
+ * and an estimate of the RAM the settings cost.
+ *
+ * For each link the cheapest combination that delivers the stream with
+ * 99th percentile sends inside a block period is recommended.  Given
+ * -j and -o, a copy of mbed_app.json with the recommended settings is
+ * written for each link, to be built with:
+ *
+ *   mbed compile --app-config <dir>/mbed_app_<link>.json
+ *
+ * Usage: lwip_sweep [-d seconds] [-s size] [-l name:rttms:bits/s:loss%]
+ *                   [-j mbed_app.json -o dir] [-v]
+ *   -d  how long to simulate each combination for (default 60 seconds)
+ *   -s  URTP datagram size (default 344)
+ *   -l  a link to use instead of the built-in ones; may be repeated
+ *   -j  the mbed_app.json to base the per-link profiles on
+ *   -o  the directory to write the per-link profiles to
+ *   -v  print every combination, not just the best few
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Defaults
+#define DEFAULT_DATAGRAM_SIZE 344
+#define DEFAULT_DURATION_SECONDS 60
+
+// As on the board
+#define BLOCK_DURATION_MS 20
+#define MAX_NUM_DATAGRAMS 200
+
+// lwIP's header overheads: IP + TCP headers, and the link
+// header plus padding that each pool buffer leaves room for
+#define TCP_IP_HEADER_SIZE 40
+#define LINK_HEADER_SIZE 16
+
+// lwIP's own sizes on a 32-bit target, for the RAM estimate
+#define SIZEOF_PBUF 16
+#define SIZEOF_TCP_SEG 20
+
+// lwIP's defaults for the initial congestion window and for
+// the number of pbufs that may be queued for sending
+#define INITIAL_CWND(mss) (std::min(4 * (mss), std::max(2 * (mss), 4380)))
+#define TCP_SND_QUEUELEN(sndBuf, mss) ((4 * (sndBuf) + ((mss) - 1)) / (mss))
+
+// The slowest retransmission timeout lwIP will back off to
+#define MAX_RTO_MS 60000
+
+// How much the modem will queue before dropping
+#define MODEM_BUFFER_BYTES 65536
+
+// The number of best combinations printed per link
+#define NUM_BEST 5
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// A simulated link
+typedef struct {
+    std::string name;
+    int rttMs;
+    int bitsPerSecond;
+    double lossPercent;
+} Link;
+
+// One combination of lwIP settings
+typedef struct {
+    int mss;
+    int wnd;
+    int sndBuf;
+    int pbufPoolSize;
+    int numTcpSeg;
+} Settings;
+
+// What a combination achieved on a link
+typedef struct {
+    Settings settings;
+    int ramBytes;
+    int throughputBitsPerSecond;
+    double deliveredPercent;
+    int sendMsP50;
+    int sendMsP90;
+    int sendMsP99;
+    int sendMsMax;
+    unsigned int numRetransmits;
+    unsigned int numTimeouts;
+} Result;
+
+// A segment on its way over the link
+typedef struct {
+    double arrivalMs;
+    uint32_t seq;
+    int len;
+} Packet;
+
+// An ACK on its way back
+typedef struct {
+    double arrivalMs;
+    uint32_t ack;
+} Ack;
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// The built-in links, roughly an office LAN and the cellular
+// radio technologies the board's modems support
+static const Link gBuiltInLinks[] = {{"ethernet", 2, 10000000, 0},
+                                     {"lte", 60, 2000000, 0.2},
+                                     {"catm1", 200, 375000, 1},
+                                     {"3g", 120, 384000, 0.5}};
+
+// The random number state, fixed so that runs can be compared
+static uint32_t gRandom = 1;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// A repeatable random number between 0 and 1
+static double random01()
+{
+    gRandom = gRandom * 1103515245 + 12345;
+    return (double) ((gRandom >> 8) & 0xFFFFFF) / 0x1000000;
+}
+
+// Estimate the RAM that a combination of settings costs: the
+// receive pool, the segment pool and, at worst, a full send
+// buffer with a pbuf for each queued write
+static int ramBytes(const Settings * pSettings)
+{
+    int poolBufSize = (pSettings->mss + TCP_IP_HEADER_SIZE + LINK_HEADER_SIZE + 3) & ~3;
+
+    return pSettings->pbufPoolSize * (poolBufSize + SIZEOF_PBUF) +
+           pSettings->numTcpSeg * SIZEOF_TCP_SEG +
+           pSettings->sndBuf +
+           TCP_SND_QUEUELEN(pSettings->sndBuf, pSettings->mss) *
+           (SIZEOF_PBUF + TCP_IP_HEADER_SIZE + LINK_HEADER_SIZE);
+}
+
+// Get a percentile of a set of values
+static int percentile(std::vector<int> & values, int percent)
+{
+    size_t x;
+
+    if (values.empty()) {
+        return 0;
+    }
+    x = values.size() * percent / 100;
+    if (x >= values.size()) {
+        x = values.size() - 1;
+    }
+    std::nth_element(values.begin(), values.begin() + x, values.end());
+
+    return values[x];
+}
+
+// Put a segment onto the link, unless the modem's queue is full,
+// and decide whether it will be lost on the way
+static void transmit(const Link * pLink, int nowMs, uint32_t seq, int len,
+                     double * pLinkFreeMs, std::deque<Packet> * pToServer)
+{
+    double msPerByte = 8000.0 / pLink->bitsPerSecond;
+    Packet packet;
+
+    // The modem queue drains at the link rate
+    if ((*pLinkFreeMs - nowMs) / msPerByte + len <= MODEM_BUFFER_BYTES) {
+        *pLinkFreeMs = std::max(*pLinkFreeMs, (double) nowMs) + (len + TCP_IP_HEADER_SIZE) * msPerByte;
+        packet.seq = seq;
+        packet.len = len;
+        packet.arrivalMs = *pLinkFreeMs + pLink->rttMs / 2.0;
+        if (random01() * 100 >= pLink->lossPercent) {
+            pToServer->push_back(packet);
+        }
+    }
+}
+
+// Run one combination of settings over a link
+static void simulate(const Link * pLink, const Settings * pSettings, int datagramSize,
+                     int durationSeconds, Result * pResult)
+{
+    int mss = pSettings->mss;
+    int queueLenLimit = std::min(TCP_SND_QUEUELEN(pSettings->sndBuf, mss), pSettings->numTcpSeg);
+    double linkFreeMs = 0;
+    std::deque<Packet> toServer;
+    std::deque<Ack> toBoard;
+    std::deque<uint32_t> writeEnds;
+    std::deque<double> datagramTimes;
+    std::vector<int> sendMs;
+    // Sender state, in bytes from the start of the stream
+    uint32_t lastAck = 0;
+    uint32_t sndNxt = 0;
+    uint32_t written = 0;
+    int cwnd = INITIAL_CWND(mss);
+    int ssthresh = pSettings->sndBuf;
+    int dupAcks = 0;
+    bool inRecovery = false;
+    uint32_t recover = 0;
+    int rtoMs = 3000;
+    int srttMs = -1;
+    double rtoStartMs = -1;
+    double rttTimedSentMs = -1;
+    uint32_t rttTimedSeq = 0;
+    // Server state
+    uint32_t rcvNxt = 0;
+    std::vector<bool> gotByte;
+    // The send task
+    double nextBlockMs = 0;
+    double writeStartMs = -1;
+    unsigned int numProduced = 0;
+    unsigned int numRetransmits = 0;
+    unsigned int numTimeouts = 0;
+    int endMs = durationSeconds * 1000;
+    uint32_t window;
+    uint32_t inFlight;
+    int len;
+    Packet packet;
+    Ack ack;
+
+    gotByte.resize((size_t) (endMs / BLOCK_DURATION_MS + 1) * datagramSize + mss * 2);
+
+    for (int nowMs = 0; nowMs < endMs; nowMs++) {
+        // The codec produces a datagram every block period; the store
+        // holds MAX_NUM_DATAGRAMS, after which the oldest are lost
+        while (nowMs >= nextBlockMs) {
+            datagramTimes.push_back(nextBlockMs);
+            numProduced++;
+            if (datagramTimes.size() > MAX_NUM_DATAGRAMS) {
+                datagramTimes.pop_front();
+                writeStartMs = -1;
+            }
+            nextBlockMs += BLOCK_DURATION_MS;
+        }
+
+        // The send task writes the oldest datagram once lwIP has room
+        while (!datagramTimes.empty()) {
+            if (writeStartMs < 0) {
+                writeStartMs = nowMs;
+            }
+            if ((written - lastAck + datagramSize > (uint32_t) pSettings->sndBuf) ||
+                ((int) writeEnds.size() >= queueLenLimit)) {
+                break;
+            }
+            written += datagramSize;
+            writeEnds.push_back(written);
+            sendMs.push_back(nowMs - (int) writeStartMs);
+            writeStartMs = -1;
+            datagramTimes.pop_front();
+        }
+
+        // ACKs arriving back at the board
+        while (!toBoard.empty() && (toBoard.front().arrivalMs <= nowMs)) {
+            ack = toBoard.front();
+            toBoard.pop_front();
+            if (ack.ack > lastAck) {
+                if ((rttTimedSentMs >= 0) && (ack.ack > rttTimedSeq)) {
+                    len = nowMs - (int) rttTimedSentMs;
+                    srttMs = (srttMs < 0) ? len : (srttMs * 7 + len) / 8;
+                    // lwIP's timers tick every 500 ms
+                    rtoMs = ((srttMs * 2 + 999) / 500) * 500;
+                    rttTimedSentMs = -1;
+                }
+                if (inRecovery) {
+                    if (ack.ack >= recover) {
+                        inRecovery = false;
+                        cwnd = ssthresh;
+                    }
+                } else if (cwnd < ssthresh) {
+                    cwnd += mss;
+                } else {
+                    cwnd += std::max(1, mss * mss / cwnd);
+                }
+                lastAck = ack.ack;
+                if (sndNxt < lastAck) {
+                    sndNxt = lastAck;
+                }
+                while (!writeEnds.empty() && (writeEnds.front() <= lastAck)) {
+                    writeEnds.pop_front();
+                }
+                dupAcks = 0;
+                rtoStartMs = (sndNxt > lastAck) ? nowMs : -1;
+            } else if ((ack.ack == lastAck) && (sndNxt > lastAck)) {
+                dupAcks++;
+                if ((dupAcks == 3) && !inRecovery) {
+                    // Fast retransmit
+                    inFlight = sndNxt - lastAck;
+                    ssthresh = std::max((int) inFlight / 2, 2 * mss);
+                    cwnd = ssthresh + 3 * mss;
+                    inRecovery = true;
+                    recover = sndNxt;
+                    len = std::min((uint32_t) mss, written - lastAck);
+                    transmit(pLink, nowMs, lastAck, len, &linkFreeMs, &toServer);
+                    numRetransmits++;
+                    rttTimedSentMs = -1;
+                } else if (inRecovery) {
+                    cwnd += mss;
+                }
+            }
+        }
+
+        // Retransmission timeout: lwIP goes back to the oldest
+        // unacknowledged byte and starts again from one segment
+        if ((rtoStartMs >= 0) && (nowMs - rtoStartMs >= rtoMs)) {
+            inFlight = sndNxt - lastAck;
+            ssthresh = std::max((int) inFlight / 2, 2 * mss);
+            cwnd = mss;
+            sndNxt = lastAck;
+            inRecovery = false;
+            dupAcks = 0;
+            rtoMs = std::min(rtoMs * 2, MAX_RTO_MS);
+            rtoStartMs = nowMs;
+            rttTimedSentMs = -1;
+            numTimeouts++;
+        }
+
+        // Send what the window allows; with TCP_NODELAY set a part
+        // segment goes straight away
+        window = (uint32_t) cwnd;
+        while ((sndNxt < written) && (sndNxt - lastAck < window)) {
+            len = (int) std::min(std::min((uint32_t) mss, written - sndNxt), window - (sndNxt - lastAck));
+            if (len <= 0) {
+                break;
+            }
+            transmit(pLink, nowMs, sndNxt, len, &linkFreeMs, &toServer);
+            if (sndNxt < recover) {
+                numRetransmits++;
+            } else if (rttTimedSentMs < 0) {
+                rttTimedSentMs = nowMs;
+                rttTimedSeq = sndNxt;
+            }
+            sndNxt += len;
+            recover = std::max(recover, sndNxt);
+            if (rtoStartMs < 0) {
+                rtoStartMs = nowMs;
+            }
+        }
+
+        // Segments arriving at the server, which ACKs every one
+        while (!toServer.empty() && (toServer.front().arrivalMs <= nowMs)) {
+            packet = toServer.front();
+            toServer.pop_front();
+            for (int x = 0; x < packet.len; x++) {
+                if (packet.seq + x < gotByte.size()) {
+                    gotByte[packet.seq + x] = true;
+                }
+            }
+            while ((rcvNxt < gotByte.size()) && gotByte[rcvNxt]) {
+                rcvNxt++;
+            }
+            ack.ack = rcvNxt;
+            ack.arrivalMs = packet.arrivalMs + pLink->rttMs / 2.0;
+            toBoard.push_back(ack);
+        }
+    }
+
+    pResult->settings = *pSettings;
+    pResult->ramBytes = ramBytes(pSettings);
+    pResult->throughputBitsPerSecond = (int) ((uint64_t) rcvNxt * 8 / durationSeconds);
+    // Anything not at the server by the end counts as not delivered
+    pResult->deliveredPercent = numProduced > 0 ? 100.0 * (rcvNxt / datagramSize) / numProduced : 0;
+    pResult->sendMsP50 = percentile(sendMs, 50);
+    pResult->sendMsP90 = percentile(sendMs, 90);
+    pResult->sendMsP99 = percentile(sendMs, 99);
+    pResult->sendMsMax = percentile(sendMs, 100);
+    pResult->numRetransmits = numRetransmits;
+    pResult->numTimeouts = numTimeouts;
+}
+
+// True if a result is good enough to stream on: all but the last
+// second or so delivered and sends keeping up with the codec
+static bool goodEnough(const Result * pResult, int durationSeconds)
+{
+    return (pResult->deliveredPercent >= 100.0 - 100.0 / durationSeconds) &&
+           (pResult->sendMsP99 <= BLOCK_DURATION_MS);
+}
+
+// Order results best first: good enough before not, then the least
+// RAM; if not good enough, the most delivered then the quickest sends
+static bool better(const Result & a, const Result & b, int durationSeconds)
+{
+    bool aGood = goodEnough(&a, durationSeconds);
+    bool bGood = goodEnough(&b, durationSeconds);
+
+    if (aGood != bGood) {
+        return aGood;
+    }
+    if (aGood) {
+        if (a.ramBytes != b.ramBytes) {
+            return a.ramBytes < b.ramBytes;
+        }
+        if (a.sendMsP99 != b.sendMsP99) {
+            return a.sendMsP99 < b.sendMsP99;
+        }
+        return a.settings.wnd < b.settings.wnd;
+    }
+    if (a.deliveredPercent != b.deliveredPercent) {
+        return a.deliveredPercent > b.deliveredPercent;
+    }
+
+    return a.sendMsP99 < b.sendMsP99;
+}
+
+// Comparison object for sorting results
+struct Better {
+    int durationSeconds;
+    bool operator()(const Result & a, const Result & b) const {
+        return better(a, b, durationSeconds);
+    }
+};
+
+// Print a result
+static void printResult(const Result * pResult, int durationSeconds)
+{
+    printf("  %c MSS %4d WND %5d SND_BUF %5d POOL %2d SEG %3d: %7d bits/s, %6.2f%% delivered,"
+           " send ms p50 %4d p90 %4d p99 %4d max %5d, %3u rexmit %2u RTO, RAM ~%6d\n",
+           goodEnough(pResult, durationSeconds) ? '*' : ' ',
+           pResult->settings.mss, pResult->settings.wnd, pResult->settings.sndBuf,
+           pResult->settings.pbufPoolSize, pResult->settings.numTcpSeg,
+           pResult->throughputBitsPerSecond, pResult->deliveredPercent,
+           pResult->sendMsP50, pResult->sendMsP90, pResult->sendMsP99, pResult->sendMsMax,
+           pResult->numRetransmits, pResult->numTimeouts, pResult->ramBytes);
+}
+
+// Replace the value of NAME= in a list of macros
+static bool setMacro(std::string & text, const char * pName, const std::string & value)
+{
+    std::string key = std::string("\"") + pName + "=";
+    size_t start = text.find(key);
+    size_t end;
+
+    if (start == std::string::npos) {
+        return false;
+    }
+    start += key.size();
+    end = text.find('"', start);
+    if (end == std::string::npos) {
+        return false;
+    }
+    text.replace(start, end - start, value);
+
+    return true;
+}
+
+// Write a copy of mbed_app.json with the recommended settings for a link
+static bool writeProfile(const char * pTemplate, const char * pDir, const Link * pLink,
+                         const Settings * pSettings)
+{
+    FILE * pFile;
+    std::string text;
+    std::string fileName;
+    char buf[256];
+    size_t size;
+    size_t pos;
+    bool success;
+
+    pFile = fopen(pTemplate, "r");
+    if (pFile == NULL) {
+        perror(pTemplate);
+        return false;
+    }
+    while ((size = fread(buf, 1, sizeof (buf), pFile)) > 0) {
+        text.append(buf, size);
+    }
+    fclose(pFile);
+
+    snprintf(buf, sizeof (buf), "%d", pSettings->mss);
+    success = setMacro(text, "TCP_MSS", buf);
+    snprintf(buf, sizeof (buf), "%d", pSettings->wnd);
+    success = setMacro(text, "TCP_WND", buf) && success;
+    snprintf(buf, sizeof (buf), "%d", pSettings->sndBuf);
+    success = setMacro(text, "TCP_SND_BUF", buf) && success;
+    snprintf(buf, sizeof (buf), "%d", pSettings->pbufPoolSize);
+    success = setMacro(text, "PBUF_POOL_SIZE", buf) && success;
+    snprintf(buf, sizeof (buf), "%d", pSettings->numTcpSeg);
+    success = setMacro(text, "MEMP_NUM_TCP_SEG", buf) && success;
+    if (!success) {
+        printf("%s doesn't have all of the lwIP settings in its macros.\n", pTemplate);
+        return false;
+    }
+    // Name the profile so that the board can say which it was built with
+    snprintf(buf, sizeof (buf), "\\\"%s\\\"", pLink->name.c_str());
+    if (!setMacro(text, "LWIP_PROFILE", buf)) {
+        pos = text.find("\"MEMP_NUM_TCP_SEG=");
+        pos = text.find('"', pos + 1);
+        snprintf(buf, sizeof (buf), ", \"LWIP_PROFILE=\\\"%s\\\"\"", pLink->name.c_str());
+        text.insert(pos + 1, buf);
+    }
+
+    fileName = std::string(pDir) + "/mbed_app_" + pLink->name + ".json";
+    pFile = fopen(fileName.c_str(), "w");
+    if (pFile == NULL) {
+        perror(fileName.c_str());
+        return false;
+    }
+    fwrite(text.data(), 1, text.size(), pFile);
+    fclose(pFile);
+    printf("  written to %s\n", fileName.c_str());
+
+    return true;
+}
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Entry point
+int main(int argc, char * argv[])
+{
+    int durationSeconds = DEFAULT_DURATION_SECONDS;
+    int datagramSize = DEFAULT_DATAGRAM_SIZE;
+    const char * pTemplate = NULL;
+    const char * pDir = NULL;
+    bool verbose = false;
+    std::vector<Link> links;
+    std::vector<Settings> combinations;
+    std::vector<Result> results;
+    const int mssValues[] = {536, 1376};
+    const int sndBufMultiples[] = {2, 3, 4, 6, 8};
+    const int wndMultiples[] = {2, 4, 6};
+    const int poolValues[] = {4, 6, 8};
+    Settings settings;
+    Result result;
+    Better order;
+    Link link;
+    char name[64];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:s:l:j:o:v")) != -1) {
+        switch (opt) {
+            case 'd':
+                durationSeconds = atoi(optarg);
+                break;
+            case 's':
+                datagramSize = atoi(optarg);
+                break;
+            case 'l':
+                if (sscanf(optarg, "%63[^:]:%d:%d:%lf", name, &link.rttMs,
+                           &link.bitsPerSecond, &link.lossPercent) != 4) {
+                    printf("A link is name:rttms:bits/s:loss%%, e.g. catm1:200:375000:1.\n");
+                    return -1;
+                }
+                link.name = name;
+                links.push_back(link);
+                break;
+            case 'j':
+                pTemplate = optarg;
+                break;
+            case 'o':
+                pDir = optarg;
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                printf("Usage: %s [-d seconds] [-s size] [-l name:rttms:bits/s:loss%%] [-j mbed_app.json -o dir] [-v]\n",
+                       argv[0]);
+                return -1;
+        }
+    }
+
+    if ((durationSeconds <= 0) || (datagramSize <= 0)) {
+        printf("Duration and datagram size must be positive.\n");
+        return -1;
+    }
+    if ((pTemplate == NULL) != (pDir == NULL)) {
+        printf("-j and -o go together.\n");
+        return -1;
+    }
+    if (links.empty()) {
+        links.assign(gBuiltInLinks, gBuiltInLinks + sizeof (gBuiltInLinks) / sizeof (gBuiltInLinks[0]));
+    }
+
+    // The combinations to try; lwIP won't build unless the segment
+    // pool can hold the send queue, and warns if the receive window
+    // is bigger than the receive pool, so those are left out
+    for (unsigned int a = 0; a < sizeof (mssValues) / sizeof (mssValues[0]); a++) {
+        for (unsigned int b = 0; b < sizeof (sndBufMultiples) / sizeof (sndBufMultiples[0]); b++) {
+            for (unsigned int c = 0; c < sizeof (wndMultiples) / sizeof (wndMultiples[0]); c++) {
+                for (unsigned int d = 0; d < sizeof (poolValues) / sizeof (poolValues[0]); d++) {
+                    settings.mss = mssValues[a];
+                    settings.sndBuf = settings.mss * sndBufMultiples[b];
+                    settings.wnd = settings.mss * wndMultiples[c];
+                    settings.pbufPoolSize = poolValues[d];
+                    settings.numTcpSeg = std::max(16, TCP_SND_QUEUELEN(settings.sndBuf, settings.mss));
+                    if (settings.wnd <= settings.pbufPoolSize * settings.mss) {
+                        combinations.push_back(settings);
+                    }
+                }
+            }
+        }
+    }
+
+    printf("%d combination(s) of lwIP settings, %d second(s) of %d byte datagrams every %d ms"
+           " (%d bits/s) on each link.\n", (int) combinations.size(), durationSeconds,
+           datagramSize, BLOCK_DURATION_MS, datagramSize * 8 * 1000 / BLOCK_DURATION_MS);
+    printf("* marks a combination that delivers the stream with 99th percentile sends inside %d ms.\n",
+           BLOCK_DURATION_MS);
+
+    order.durationSeconds = durationSeconds;
+    for (unsigned int x = 0; x < links.size(); x++) {
+        printf("\nLink \"%s\": RTT %d ms, %d bits/s, %.1f%% loss:\n", links[x].name.c_str(),
+               links[x].rttMs, links[x].bitsPerSecond, links[x].lossPercent);
+        results.clear();
+        for (unsigned int y = 0; y < combinations.size(); y++) {
+            gRandom = 1;
+            simulate(&links[x], &combinations[y], datagramSize, durationSeconds, &result);
+            results.push_back(result);
+            if (verbose) {
+                printResult(&result, durationSeconds);
+            }
+        }
+        std::sort(results.begin(), results.end(), order);
+        if (verbose) {
+            printf(" best:\n");
+        }
+        for (unsigned int y = 0; (y < results.size()) && (y < NUM_BEST); y++) {
+            printResult(&results[y], durationSeconds);
+        }
+        if (!goodEnough(&results[0], durationSeconds)) {
+            printf("  nothing keeps up with the stream on this link, the closest is recommended.\n");
+        }
+        printf("  recommended: TCP_MSS=%d TCP_WND=%d TCP_SND_BUF=%d PBUF_POOL_SIZE=%d MEMP_NUM_TCP_SEG=%d\n",
+               results[0].settings.mss, results[0].settings.wnd, results[0].settings.sndBuf,
+               results[0].settings.pbufPoolSize, results[0].settings.numTcpSeg);
+        if (pTemplate != NULL) {
+            writeProfile(pTemplate, pDir, &links[x], &results[0].settings);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,300 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Gets the recordings made with LOCAL_FILE_RAW (see rawlog.h) out of
+ * an image of the SD card, for use on a Linux host.  Take the image
+ * with e.g.:
+ *
+ *   dd if=/dev/sdX of=card.img bs=1M
+ *
+ * or, to save time, only the last part of the card that holds the
+ * region.  The recordings are listed and each is written to a file of
+ * its own (prefix0.bin, prefix1.bin...) holding the audio, as
+ * LOCAL_FILE does.
+ *
+ * With -w, a recording of so many seconds of dummy audio is added to
+ * the image (which is made if need be) using the same buffer sizes as
+ * the board, and the time each write takes is reported, so that the
+ * writer and this tool can be tried out without hardware.
+ *
+ * Usage: raw_extract [-r Mbytes] [-p prefix] [-w seconds] image
+ *   -r  the size of the region at the end of the image (default
+ *       1024 Mbytes, as RAW_LOG_REGION_SIZE, or all of a smaller image)
+ *   -p  the prefix of the files to write (default "recording")
+ *   -w  add a recording of this many seconds of dummy audio
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <vector>
+#include "rawlog.h"
+#include "clocksync.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Defaults
+#define DEFAULT_REGION_MBYTES 1024
+#define DEFAULT_PREFIX "recording"
+
+// The audio in a URTP datagram, and the block duration, as on the board
+#define URTP_BODY_SIZE 330
+#define BLOCK_DURATION_MS 20
+
+// The number of datagrams' worth of audio in each write, as on the board
+#define FILE_BUFFER_NUM_DATAGRAMS 50
+
+// The histogram of write times: 100 us bins, up to a second
+#define LATENCY_BIN_US 100
+#define LATENCY_NUM_BINS 10000
+
+// The amount copied out in one go
+#define COPY_SIZE (64 * 1024)
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+// A region at the end of an image file
+class FileRegion : public RawLogStore {
+public:
+    FileRegion() : _pFile(NULL), _start(0), _size(0) {}
+
+    // Set up as the last size bytes of pFile, or all of it if it is
+    // smaller; if the file is smaller still than minSize it is
+    // made that big
+    bool init(FILE * pFile, uint64_t size, uint64_t minSize)
+    {
+        off_t end;
+        uint64_t fileSize;
+
+        _pFile = pFile;
+        if ((fseeko(_pFile, 0, SEEK_END) != 0) || ((end = ftello(_pFile)) < 0)) {
+            return false;
+        }
+        fileSize = (uint64_t) end;
+        if (fileSize < minSize) {
+            if ((fseeko(_pFile, minSize - 1, SEEK_SET) != 0) || (fputc(0, _pFile) == EOF)) {
+                return false;
+            }
+            fileSize = minSize;
+        }
+        _size = (size < fileSize) ? size : fileSize;
+        _size -= _size % RAW_LOG_SECTOR_SIZE;
+        _start = fileSize - _size;
+        return true;
+    }
+
+    bool read(void * pBuf, uint64_t address, uint32_t size)
+    {
+        return (fseeko(_pFile, _start + address, SEEK_SET) == 0) &&
+               (fread(pBuf, 1, size, _pFile) == size);
+    }
+
+    bool program(const void * pBuf, uint64_t address, uint32_t size)
+    {
+        return (fseeko(_pFile, _start + address, SEEK_SET) == 0) &&
+               (fwrite(pBuf, 1, size, _pFile) == size);
+    }
+
+    bool erase(uint64_t address, uint64_t size)
+    {
+        // An SD card may read erased sectors as 0 or as 0xFF; either
+        // will do, since nothing relies on what erased sectors hold
+        (void) address;
+        (void) size;
+        return true;
+    }
+
+    uint64_t getSize()
+    {
+        return _size;
+    }
+
+protected:
+    FILE * _pFile;
+    uint64_t _start;
+    uint64_t _size;
+};
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Time now in microseconds
+static int64_t nowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Add a recording of dummy audio
+static bool addRecording(FileRegion * pRegion, int seconds)
+{
+    RawLog rawLog;
+    std::vector<char> buffer(URTP_BODY_SIZE * FILE_BUFFER_NUM_DATAGRAMS);
+    int numWrites = seconds * 1000 / (FILE_BUFFER_NUM_DATAGRAMS * BLOCK_DURATION_MS);
+    std::vector<uint32_t> bins(LATENCY_NUM_BINS);
+    LatencyHistogram latency;
+    int64_t startUs;
+    bool success;
+
+    if (!rawLog.open(pRegion, URTP_BODY_SIZE)) {
+        printf("Unable to start a recording (is the index full, or the region too small?).\n");
+        return false;
+    }
+    latency.init(&bins[0], LATENCY_NUM_BINS, LATENCY_BIN_US);
+    success = true;
+    for (int x = 0; success && (x < numWrites); x++) {
+        for (unsigned int y = 0; y < buffer.size(); y++) {
+            buffer[y] = (char) (x + y);
+        }
+        startUs = nowUs();
+        success = rawLog.write(&buffer[0], (int) buffer.size());
+        latency.add((int) (nowUs() - startUs));
+        rawLog.eraseAhead();
+    }
+    if (!rawLog.close()) {
+        success = false;
+    }
+    fflush(NULL);
+
+    printf("Added a recording of %u byte(s) in %d write(s) of %d byte(s)%s.\n",
+           rawLog.getNumBytes(), latency.getCount(), (int) buffer.size(), success ? "" : ", FAILED");
+    if (latency.getCount() > 0) {
+        printf("Write time: 50%% %d us, 99%% %d us, worst %d us; %u write(s) had to wait for an erase.\n",
+               latency.getPercentileUs(50), latency.getPercentileUs(99), latency.getMaxUs(),
+               rawLog.getNumEraseStalls());
+    }
+
+    return success;
+}
+
+// Copy a recording out to a file
+static bool extract(FileRegion * pRegion, const RawLogRecording * pRecording, const char * pFileName)
+{
+    FILE * pFile;
+    std::vector<char> buffer(COPY_SIZE);
+    uint64_t address = (uint64_t) pRecording->startSector * RAW_LOG_SECTOR_SIZE;
+    uint32_t remaining = pRecording->numBytes;
+    uint32_t count;
+    bool success = true;
+
+    pFile = fopen(pFileName, "wb");
+    if (pFile == NULL) {
+        perror("Unable to open output file");
+        return false;
+    }
+    while (success && (remaining > 0)) {
+        count = (remaining < COPY_SIZE) ? remaining : COPY_SIZE;
+        success = pRegion->read(&buffer[0], address, count) &&
+                  (fwrite(&buffer[0], 1, count, pFile) == count);
+        address += count;
+        remaining -= count;
+    }
+    fclose(pFile);
+
+    return success;
+}
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Entry point
+int main(int argc, char * argv[])
+{
+    uint64_t regionSize = (uint64_t) DEFAULT_REGION_MBYTES << 20;
+    const char * pPrefix = DEFAULT_PREFIX;
+    int writeSeconds = 0;
+    FILE * pImage;
+    FileRegion region;
+    RawLogRecording recordings[RAW_LOG_MAX_NUM_RECORDINGS];
+    int numRecordings;
+    char fileName[256];
+    int opt;
+    int retValue = 0;
+
+    while ((opt = getopt(argc, argv, "r:p:w:")) != -1) {
+        switch (opt) {
+            case 'r':
+                regionSize = (uint64_t) atoi(optarg) << 20;
+                break;
+            case 'p':
+                pPrefix = optarg;
+                break;
+            case 'w':
+                writeSeconds = atoi(optarg);
+                break;
+            default:
+                printf("Usage: %s [-r Mbytes] [-p prefix] [-w seconds] image\n", argv[0]);
+                return -1;
+        }
+    }
+    if ((optind >= argc) || (regionSize < 2 * RAW_LOG_SECTOR_SIZE)) {
+        printf("Usage: %s [-r Mbytes] [-p prefix] [-w seconds] image\n", argv[0]);
+        return -1;
+    }
+
+    pImage = fopen(argv[optind], (writeSeconds > 0) ? "rb+" : "rb");
+    if ((pImage == NULL) && (writeSeconds > 0)) {
+        pImage = fopen(argv[optind], "wb+");
+    }
+    if ((pImage == NULL) ||
+        !region.init(pImage, regionSize, (writeSeconds > 0) ? regionSize : 0)) {
+        perror("Unable to open image");
+        return -1;
+    }
+    printf("Region of %llu byte(s) at the end of %s.\n", (unsigned long long) region.getSize(), argv[optind]);
+
+    if ((writeSeconds > 0) && !addRecording(&region, writeSeconds)) {
+        retValue = -1;
+    }
+
+    numRecordings = rawLogReadIndex(&region, recordings, RAW_LOG_MAX_NUM_RECORDINGS);
+    if (numRecordings < 0) {
+        printf("No index found: is the region size right?\n");
+        fclose(pImage);
+        return -1;
+    }
+    printf("%d recording(s):\n", numRecordings);
+    for (int x = 0; x < numRecordings; x++) {
+        snprintf(fileName, sizeof(fileName), "%s%d.bin", pPrefix, x);
+        printf("  %d: sector %u, %u byte(s) (%u block(s) of %d), %s", x, recordings[x].startSector,
+               recordings[x].numBytes, (recordings[x].blockSize > 0) ?
+               recordings[x].numBytes / recordings[x].blockSize : 0,
+               recordings[x].blockSize, recordings[x].closed ? "closed" : "not closed, length unknown");
+        if (recordings[x].closed) {
+            if (extract(&region, &recordings[x], fileName)) {
+                printf(", written to %s", fileName);
+            } else {
+                printf(", unable to write %s", fileName);
+                retValue = -1;
+            }
+        }
+        printf(".\n");
+    }
+
+    fclose(pImage);
+    return retValue;
+}
@@ -0,0 +1,287 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The SD benchmark of SD_BENCHMARK (see sdbench.h) for use on a Linux
+ * host, with the same cases and the same table of results.
+ *
+ * The file system cases write a file in a directory: the host's file
+ * system stands in for FAT, or give the mount point of a card to time
+ * the card's own FAT.  The raw cases write to the end of an image file
+ * standing in for the block device (made if need be), or give the
+ * card's device (e.g. /dev/sdX, which will be written over) to time
+ * the card itself.  Without -s most writes only reach the page cache,
+ * which times the code rather than the card.  There is no SPI clock to
+ * vary on a host.
+ *
+ * Usage: sd_bench [-d dir] [-i image] [-r Mbytes] [-n kbytes] [-b sizes]
+ *                 [-o offsets] [-a bytes/s] [-s]
+ *   -d  the directory for the file system cases (default .)
+ *   -i  the image or device for the raw cases (default none: no raw cases)
+ *   -r  the size of the region at the end of the image (default 64 Mbytes)
+ *   -n  the number of kbytes written in each case (default 1024)
+ *   -b  the write sizes, separated by commas (default as SD_BENCHMARK)
+ *   -o  the starting offsets, separated by commas (default as SD_BENCHMARK)
+ *   -a  the rate the audio arrives at (default 16500 bytes/s, LOCAL_FILE)
+ *   -s  sync each write to the device
+ *  e.g. sd_bench -s -d /media/sd -b 4096,16500,32768
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "sdbench.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Defaults, as SD_BENCHMARK on the board
+#define DEFAULT_BLOCK_SIZES "512,2048,4096,8192,16500,16384,32768"
+#define DEFAULT_OFFSETS "0,330,512"
+#define DEFAULT_REGION_MBYTES 64
+#define DEFAULT_KBYTES 1024
+#define DEFAULT_BYTES_PER_SECOND 16500
+
+// The name of the file written by the file system cases
+#define BENCH_FILE_NAME "sd_bench.bin"
+
+// The histogram of write times: 100 us bins, up to two seconds
+#define LATENCY_BIN_US 100
+#define LATENCY_NUM_BINS 20000
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+// A region at the end of an image file or device
+class FileStore : public RawLogStore {
+public:
+    FileStore() : _pFile(NULL), _start(0), _size(0), _sync(false) {}
+
+    // Set up as the last size bytes of pFile, making it that
+    // big if it is smaller
+    bool init(FILE * pFile, uint64_t size, bool sync)
+    {
+        off_t end;
+
+        _pFile = pFile;
+        _sync = sync;
+        if ((fseeko(_pFile, 0, SEEK_END) != 0) || ((end = ftello(_pFile)) < 0)) {
+            return false;
+        }
+        if ((uint64_t) end < size) {
+            if ((fseeko(_pFile, size - 1, SEEK_SET) != 0) || (fputc(0, _pFile) == EOF)) {
+                return false;
+            }
+            end = (off_t) size;
+        }
+        _size = size - size % RAW_LOG_SECTOR_SIZE;
+        _start = (uint64_t) end - _size;
+        return true;
+    }
+
+    bool read(void * pBuf, uint64_t address, uint32_t size)
+    {
+        return (fseeko(_pFile, _start + address, SEEK_SET) == 0) &&
+               (fread(pBuf, 1, size, _pFile) == size);
+    }
+
+    bool program(const void * pBuf, uint64_t address, uint32_t size)
+    {
+        bool success = (fseeko(_pFile, _start + address, SEEK_SET) == 0) &&
+                       (fwrite(pBuf, 1, size, _pFile) == size);
+
+        if (success && _sync) {
+            success = (fflush(_pFile) == 0) && (fdatasync(fileno(_pFile)) == 0);
+        }
+        return success;
+    }
+
+    bool erase(uint64_t address, uint64_t size)
+    {
+        // Nothing to do for a file; a card takes care of
+        // erasing for itself when written to through the host
+        (void) address;
+        (void) size;
+        return true;
+    }
+
+    uint64_t getSize()
+    {
+        return _size;
+    }
+
+protected:
+    FILE * _pFile;
+    uint64_t _start;
+    uint64_t _size;
+    bool _sync;
+};
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Time now in microseconds
+static int64_t nowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Push a file write past the page cache
+static void syncFile(FILE * pFile)
+{
+    fflush(pFile);
+    fdatasync(fileno(pFile));
+}
+
+// Read a list of numbers separated by commas
+static std::vector<int> parseList(const char * pList)
+{
+    std::vector<int> list;
+    std::string copy(pList);
+    char * pSave = NULL;
+
+    for (char * pItem = strtok_r(&copy[0], ",", &pSave); pItem != NULL; pItem = strtok_r(NULL, ",", &pSave)) {
+        list.push_back(atoi(pItem));
+    }
+
+    return list;
+}
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Entry point
+int main(int argc, char * argv[])
+{
+    std::string dir = ".";
+    const char * pImageName = NULL;
+    uint64_t regionSize = (uint64_t) DEFAULT_REGION_MBYTES << 20;
+    uint32_t totalBytes = DEFAULT_KBYTES * 1024;
+    std::vector<int> blockSizes = parseList(DEFAULT_BLOCK_SIZES);
+    std::vector<int> offsets = parseList(DEFAULT_OFFSETS);
+    int neededBytesPerSecond = DEFAULT_BYTES_PER_SECOND;
+    bool sync = false;
+    std::string fileName;
+    FILE * pImage = NULL;
+    FileStore store;
+    SdBench bench;
+    SdBenchResult result;
+    std::vector<uint32_t> bins(LATENCY_NUM_BINS);
+    std::vector<char> buffer;
+    int maxBlockSize = 0;
+    int smallest[2] = {-1, -1};
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:i:r:n:b:o:a:s")) != -1) {
+        switch (opt) {
+            case 'd':
+                dir = optarg;
+                break;
+            case 'i':
+                pImageName = optarg;
+                break;
+            case 'r':
+                regionSize = (uint64_t) atoi(optarg) << 20;
+                break;
+            case 'n':
+                totalBytes = (uint32_t) atoi(optarg) * 1024;
+                break;
+            case 'b':
+                blockSizes = parseList(optarg);
+                break;
+            case 'o':
+                offsets = parseList(optarg);
+                break;
+            case 'a':
+                neededBytesPerSecond = atoi(optarg);
+                break;
+            case 's':
+                sync = true;
+                break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    }
+    if ((optind != argc) || blockSizes.empty() || offsets.empty()) {
+        printf("Usage: %s [-d dir] [-i image] [-r Mbytes] [-n kbytes] [-b sizes] [-o offsets]"
+               " [-a bytes/s] [-s]\n", argv[0]);
+        return -1;
+    }
+
+    for (unsigned int x = 0; x < blockSizes.size(); x++) {
+        if (blockSizes[x] > maxBlockSize) {
+            maxBlockSize = blockSizes[x];
+        }
+    }
+    buffer.resize(maxBlockSize + RAW_LOG_SECTOR_SIZE);
+    bench.init(nowUs, &bins[0], LATENCY_NUM_BINS, LATENCY_BIN_US, &buffer[0], (int) buffer.size(),
+               sync ? syncFile : NULL);
+    fileName = dir + "/" + BENCH_FILE_NAME;
+
+    if (pImageName != NULL) {
+        pImage = fopen(pImageName, "rb+");
+        if (pImage == NULL) {
+            pImage = fopen(pImageName, "wb+");
+        }
+        if ((pImage == NULL) || !store.init(pImage, regionSize, sync)) {
+            perror("Unable to open image");
+            return -1;
+        }
+    }
+
+    printf("Writing %u byte(s) in each case%s, audio arriving at %d byte(s)/s:\n", totalBytes,
+           sync ? ", syncing each write" : "", neededBytesPerSecond);
+    sdBenchPrintHeading();
+    for (unsigned int b = 0; b < blockSizes.size(); b++) {
+        for (unsigned int o = 0; o < offsets.size(); o++) {
+            bench.runFat(fileName.c_str(), blockSizes[b], offsets[o], totalBytes, &result);
+            sdBenchPrintResult(&result, neededBytesPerSecond);
+            if (sdBenchKeptUp(&result, neededBytesPerSecond) &&
+                ((smallest[0] < 0) || (blockSizes[b] < smallest[0]))) {
+                smallest[0] = blockSizes[b];
+            }
+            // Raw writes are only ever sector aligned
+            if ((pImage != NULL) && (offsets[o] % RAW_LOG_SECTOR_SIZE == 0)) {
+                bench.runRaw(&store, blockSizes[b], offsets[o], totalBytes, &result);
+                sdBenchPrintResult(&result, neededBytesPerSecond);
+                if (sdBenchKeptUp(&result, neededBytesPerSecond) &&
+                    ((smallest[1] < 0) || (blockSizes[b] < smallest[1]))) {
+                    smallest[1] = blockSizes[b];
+                }
+            }
+        }
+    }
+    printf("Smallest write that kept up every time: FAT %d byte(s), raw %d byte(s) (-1 if none did).\n",
+           smallest[0], smallest[1]);
+
+    if (pImage != NULL) {
+        fclose(pImage);
+    }
+
+    return 0;
+}
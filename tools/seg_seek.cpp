@@ -0,0 +1,342 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Finds a point in a recording made with LOCAL_FILE_SEGMENT_SECONDS
+ * (see segment.h), for use on a Linux host with the SD card mounted.
+ * Only the index files are read to find it, so this is as quick for
+ * hours of audio as for minutes.
+ *
+ * Without -t the segments of the run are listed.  With -t the segment
+ * and byte offset of the audio that many seconds into the run is
+ * given and, with -o, -d seconds of audio from there (across segments
+ * if need be) are written to a file, as LOCAL_FILE would hold them.
+ *
+ * With -w, a recording of so many seconds of dummy audio is made first
+ * using the same segment writer as the board, in -S second segments,
+ * so that this can be tried out without hardware.
+ *
+ * Usage: seg_seek [-n slots] [-r run] [-t seconds] [-d seconds]
+ *                 [-o file] [-w seconds] [-S seconds] prefix
+ *   -n  the number of slots (default 120, as LOCAL_FILE_NUM_SEGMENTS)
+ *   -r  the run to look at (default the newest)
+ *   -t  the point to find, in seconds from the start of the run
+ *   -d  how many seconds of audio to write with -o (default 10)
+ *   -o  the file to write the audio to
+ *   -w  make a recording of this many seconds of dummy audio first
+ *   -S  the segment length for -w (default 60 seconds)
+ *  e.g. seg_seek -t 3600 -d 30 -o hour.bin /media/sd/audio
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <vector>
+#include <algorithm>
+#include "segment.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Defaults
+#define DEFAULT_NUM_SLOTS 120
+#define DEFAULT_DURATION_SECONDS 10
+#define DEFAULT_SEGMENT_SECONDS 60
+
+// The audio in a URTP datagram, and the block duration, as on the board
+#define URTP_BODY_SIZE 330
+#define BLOCK_DURATION_MS 20
+
+// The number of datagrams' worth of audio in each write, as on the board
+#define FILE_BUFFER_NUM_DATAGRAMS 50
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// A segment and its index
+typedef struct {
+    SegmentHeader header;
+    int slot;
+    std::vector<SegmentEntry> entries;
+} Segment;
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// For sorting segments into order
+static bool segmentLess(const Segment & a, const Segment & b)
+{
+    return a.header.segment < b.header.segment;
+}
+
+// Make a recording of dummy audio, as the board's file write task would
+static bool makeRecording(const char * pPrefix, int numSlots, int seconds, int segmentSeconds)
+{
+    SegmentWriter writer;
+    std::vector<char> buffer(URTP_BODY_SIZE * FILE_BUFFER_NUM_DATAGRAMS);
+    int numWrites = seconds * 1000 / (FILE_BUFFER_NUM_DATAGRAMS * BLOCK_DURATION_MS);
+    int sequenceNumber = 0;
+    uint64_t timestampUs = 0;
+    bool success;
+
+    if (!writer.open(pPrefix, numSlots, segmentSeconds, URTP_BODY_SIZE)) {
+        printf("Unable to start a recording at %s.\n", pPrefix);
+        return false;
+    }
+    success = true;
+    for (int x = 0; success && (x < numWrites); x++) {
+        for (unsigned int y = 0; y < buffer.size(); y++) {
+            buffer[y] = (char) (x + y);
+        }
+        success = writer.write(&buffer[0], (int) buffer.size(), sequenceNumber, timestampUs);
+        sequenceNumber = (sequenceNumber + FILE_BUFFER_NUM_DATAGRAMS) & 0xFFFF;
+        timestampUs += FILE_BUFFER_NUM_DATAGRAMS * BLOCK_DURATION_MS * 1000;
+        writer.prepare();
+    }
+    writer.close();
+    printf("Made run %u, up to segment %u%s.\n", writer.getRun(), writer.getSegment(),
+           success ? "" : ", FAILED");
+
+    return success;
+}
+
+// Read the indexes of all the segments in a run (or of the newest run
+// if run is negative) in order, returning the run
+static int readRun(const char * pPrefix, int numSlots, int run, std::vector<Segment> & segments)
+{
+    char name[SEGMENT_FILE_NAME_SIZE];
+    FILE * pFile;
+    Segment segment;
+    SegmentEntry entry;
+    std::vector<Segment> all;
+    int newest = -1;
+
+    for (int x = 0; x < numSlots; x++) {
+        segmentFileName(name, pPrefix, x, true);
+        pFile = fopen(name, "rb");
+        if (pFile != NULL) {
+            if (segmentReadHeader(pFile, &segment.header)) {
+                segment.slot = x;
+                segment.entries.clear();
+                while (segmentReadEntry(pFile, &entry)) {
+                    segment.entries.push_back(entry);
+                }
+                all.push_back(segment);
+                if ((int) segment.header.run > newest) {
+                    newest = (int) segment.header.run;
+                }
+            }
+            fclose(pFile);
+        }
+    }
+
+    if (run < 0) {
+        run = newest;
+    }
+    for (unsigned int x = 0; x < all.size(); x++) {
+        if ((int) all[x].header.run == run) {
+            segments.push_back(all[x]);
+        }
+    }
+    std::sort(segments.begin(), segments.end(), segmentLess);
+
+    return run;
+}
+
+// Copy numBytes of audio, from offset in segment x on, to pOut
+static bool copyAudio(const char * pPrefix, std::vector<Segment> & segments, unsigned int x,
+                      uint32_t offset, uint64_t numBytes, FILE * pOut)
+{
+    char name[SEGMENT_FILE_NAME_SIZE];
+    FILE * pFile;
+    char buf[4096];
+    size_t count;
+
+    for (; (x < segments.size()) && (numBytes > 0); x++) {
+        segmentFileName(name, pPrefix, segments[x].slot, false);
+        pFile = fopen(name, "rb");
+        if ((pFile == NULL) || (fseek(pFile, offset, SEEK_SET) != 0)) {
+            printf("Unable to read %s.\n", name);
+            if (pFile != NULL) {
+                fclose(pFile);
+            }
+            return false;
+        }
+        while ((numBytes > 0) &&
+               ((count = fread(buf, 1, (numBytes < sizeof(buf)) ? numBytes : sizeof(buf), pFile)) > 0)) {
+            fwrite(buf, 1, count, pOut);
+            numBytes -= count;
+        }
+        fclose(pFile);
+        offset = 0;
+    }
+
+    return true;
+}
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Entry point
+int main(int argc, char * argv[])
+{
+    int numSlots = DEFAULT_NUM_SLOTS;
+    int run = -1;
+    double pointSeconds = -1;
+    double durationSeconds = DEFAULT_DURATION_SECONDS;
+    const char * pOutFileName = NULL;
+    int writeSeconds = 0;
+    int segmentSeconds = DEFAULT_SEGMENT_SECONDS;
+    const char * pPrefix;
+    std::vector<Segment> segments;
+    const SegmentEntry * pEntry;
+    const SegmentEntry * pLast;
+    uint64_t startUs;
+    uint64_t pointUs;
+    unsigned int found = 0;
+    int foundEntry = -1;
+    bool isLater = false;
+    int blockSize;
+    uint32_t offset;
+    FILE * pOut;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:t:d:o:w:S:")) != -1) {
+        switch (opt) {
+            case 'n':
+                numSlots = atoi(optarg);
+                break;
+            case 'r':
+                run = atoi(optarg);
+                break;
+            case 't':
+                pointSeconds = atof(optarg);
+                break;
+            case 'd':
+                durationSeconds = atof(optarg);
+                break;
+            case 'o':
+                pOutFileName = optarg;
+                break;
+            case 'w':
+                writeSeconds = atoi(optarg);
+                break;
+            case 'S':
+                segmentSeconds = atoi(optarg);
+                break;
+            default:
+                optind = argc;
+                break;
+        }
+    }
+    if (optind != argc - 1) {
+        printf("Usage: %s [-n slots] [-r run] [-t seconds] [-d seconds] [-o file] [-w seconds] [-S seconds]"
+               " prefix\n", argv[0]);
+        return -1;
+    }
+    pPrefix = argv[optind];
+
+    if ((writeSeconds > 0) && !makeRecording(pPrefix, numSlots, writeSeconds, segmentSeconds)) {
+        return -1;
+    }
+
+    run = readRun(pPrefix, numSlots, run, segments);
+    if (segments.empty()) {
+        printf("No segments found at %s.\n", pPrefix);
+        return -1;
+    }
+
+    // The run starts with the oldest audio that is left
+    startUs = 0;
+    for (unsigned int x = 0; x < segments.size(); x++) {
+        if (!segments[x].entries.empty()) {
+            startUs = segments[x].entries[0].timestampUs;
+            break;
+        }
+    }
+
+    if (pointSeconds < 0) {
+        printf("Run %d, %d segment(s):\n", run, (int) segments.size());
+        for (unsigned int x = 0; x < segments.size(); x++) {
+            printf("  segment %u (slot %d): ", segments[x].header.segment, segments[x].slot);
+            if (segments[x].entries.empty()) {
+                printf("empty.\n");
+                continue;
+            }
+            pEntry = &segments[x].entries.front();
+            pLast = &segments[x].entries.back();
+            printf("%.3f to %.3f seconds, sequence numbers %d to %d, %u byte(s).\n",
+                   (pEntry->timestampUs - startUs) / 1000000.0,
+                   (pLast->timestampUs - startUs) / 1000000.0 +
+                   pLast->numBlocks * BLOCK_DURATION_MS / 1000.0,
+                   pEntry->sequenceNumber, (pLast->sequenceNumber + pLast->numBlocks - 1) & 0xFFFF,
+                   pLast->offset + pLast->numBlocks * segments[x].header.blockSize);
+        }
+        return 0;
+    }
+
+    // Find the last entry that starts at or before the point
+    pointUs = startUs + (uint64_t) (pointSeconds * 1000000);
+    for (unsigned int x = 0; x < segments.size(); x++) {
+        for (unsigned int y = 0; y < segments[x].entries.size(); y++) {
+            if (segments[x].entries[y].timestampUs <= pointUs) {
+                found = x;
+                foundEntry = (int) y;
+            } else {
+                isLater = true;
+            }
+        }
+    }
+    if (foundEntry < 0) {
+        printf("The recording that is left starts after that point.\n");
+        return -1;
+    }
+
+    // Then the block within it
+    pEntry = &segments[found].entries[foundEntry];
+    blockSize = segments[found].header.blockSize;
+    offset = pEntry->offset;
+    if (pointUs - pEntry->timestampUs < (uint64_t) pEntry->numBlocks * BLOCK_DURATION_MS * 1000) {
+        offset += (uint32_t) ((pointUs - pEntry->timestampUs) / (BLOCK_DURATION_MS * 1000)) * blockSize;
+    } else if (!isLater) {
+        printf("The recording ends before that point.\n");
+        return -1;
+    } else {
+        // In a gap: go to the end of the entry
+        offset += pEntry->numBlocks * blockSize;
+    }
+    printf("%.3f seconds into run %d is segment %u, byte %u of slot %d.\n", pointSeconds, run,
+           segments[found].header.segment, offset, segments[found].slot);
+
+    if (pOutFileName != NULL) {
+        pOut = fopen(pOutFileName, "wb");
+        if (pOut == NULL) {
+            perror("Unable to open output file");
+            return -1;
+        }
+        copyAudio(pPrefix, segments, found, offset,
+                  (uint64_t) (durationSeconds * 1000 / BLOCK_DURATION_MS) * blockSize, pOut);
+        printf("%ld byte(s) of audio written to %s.\n", ftell(pOut), pOutFileName);
+        fclose(pOut);
+    }
+
+    return 0;
+}
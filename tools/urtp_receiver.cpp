@@ -0,0 +1,832 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A stand-in for the URTP server, for use on a Linux host.  It receives
+ * a URTP stream over UDP (or TCP), can throw away datagrams to simulate
+ * random or bursty loss and, for UDP, can NACK the gaps so that a
+ * sender built with USE_RELIABLE_UDP fills them in.  Any FEC parity
+ * datagrams (see fec.h) are used to rebuild lost datagrams.  When the
+ * stream ends (or on CTRL-C) it prints how much of the stream was
+ * delivered and how it was recovered.
+ *
+ * Time requests from the sender (see clocksync.h) are always answered,
+ * over UDP on the same port even when the stream is over TCP.  Once the
+ * sender has passed on its clock offset, the timestamp of each datagram
+ * gives its one-way latency, from capture to arrival here; the spread
+ * of arrival times gives the jitter, as RFC 3550 defines it.  The
+ * drift of the sender's sample clock, if it passes that on, is reported
+ * too.
+ *
+ * With -R the stream is RTP, as the board sends with RTP_OUTPUT; each
+ * packet is turned back into a URTP datagram (with a timestamp counted
+ * from the first packet, so one-way latency can't be measured) and the
+ * sender reports that arrive on the next port up are answered with
+ * receiver reports, as a standard RTP receiver would.
+ *
+ * Usage: urtp_receiver [-p port] [-t] [-s size] [-l loss%] [-b burst]
+ *                      [-n] [-w ms] [-g ms] [-q] [-R rate]
+ *   -p  port to listen on (default 5065)
+ *   -t  listen for TCP rather than UDP
+ *   -s  URTP datagram size, needed to frame a TCP stream (default 344)
+ *   -l  percentage of datagrams to throw away (UDP only)
+ *   -b  mean length of a run of lost datagrams; 1 (the default) gives
+ *       independent random loss, more gives bursty loss
+ *   -n  send NACKs for missing datagrams
+ *   -w  how long to wait for a late datagram before NACKing it (40 ms)
+ *   -g  how long to keep NACKing before giving up on a datagram (1000 ms)
+ *   -q  no per-second prints
+ *   -R  receive RTP with this clock rate (e.g. 16000) over UDP
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <map>
+#include "datagram.h"
+#include "retransmit.h"
+#include "fec.h"
+#include "clocksync.h"
+#include "rtp.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Defaults
+#define DEFAULT_PORT 5065
+#define DEFAULT_DATAGRAM_SIZE 344
+#define DEFAULT_NACK_WAIT_MS 40
+#define DEFAULT_GIVE_UP_MS 1000
+
+// The interval between NACKs for the same datagram
+#define NACK_REPEAT_MS 100
+
+// The largest datagram we expect
+#define MAX_DATAGRAM_SIZE 2048
+
+// If nothing arrives for this long once a stream has started,
+// the stream is taken to have ended
+#define STREAM_END_MS 5000
+
+// The number of datagrams and parity datagrams the FEC decoder keeps
+#define FEC_HISTORY_SIZE 1024
+#define FEC_PARITY_HISTORY_SIZE 128
+
+// The histogram of one-way latencies: 1 ms bins, up to 10 seconds
+#define LATENCY_BIN_US 1000
+#define LATENCY_NUM_BINS 10000
+
+// With -R, the CNAME to send in receiver reports
+#define RTCP_CNAME "urtp_receiver"
+
+/* ----------------------------------------------------------------
+ * TYPES
+ * -------------------------------------------------------------- */
+
+// What we know of a datagram that hasn't arrived
+typedef struct {
+    int64_t noticedMs;
+    int64_t lastNackMs;
+    int numNacks;
+} Missing;
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// Set by the signal handler
+static volatile bool gStop = false;
+
+// Settings
+static int gDatagramSize = DEFAULT_DATAGRAM_SIZE;
+static double gLoss = 0;
+static double gBurst = 1;
+static bool gNack = false;
+static int gNackWaitMs = DEFAULT_NACK_WAIT_MS;
+static int gGiveUpMs = DEFAULT_GIVE_UP_MS;
+static bool gQuiet = false;
+static int gRtpRate = 0;
+
+// State of the loss simulator: true if in the "bad" state
+static bool gLossBurst = false;
+
+// Where the stream has got to, as extended sequence numbers
+static bool gStreamStarted = false;
+static int64_t gFirstSeq = 0;
+static int64_t gHighestSeq = 0;
+static std::map<int64_t, Missing> gMissing;
+
+// Stats
+static uint64_t gNumReceived = 0;
+static uint64_t gNumDuplicates = 0;
+static uint64_t gNumDropped = 0;
+static uint64_t gNumRecovered = 0;
+static uint64_t gNumGivenUp = 0;
+static uint64_t gNumNacksSent = 0;
+static uint64_t gBytesReceived = 0;
+static uint64_t gBytesThisSecond = 0;
+static uint64_t gNumDroppedParity = 0;
+static uint64_t gNumParity = 0;
+static uint64_t gParityBytes = 0;
+static uint64_t gNumRecoveredByFec = 0;
+// The longest time between two datagrams arriving, e.g. while
+// the sender moves from one path to another
+static int64_t gLastDatagramMs = 0;
+static int64_t gMaxGapMs = 0;
+
+// The sender's clock offset, the one-way latencies and jitter
+// it gives and the time requests that have been answered
+static bool gClockOffsetValid = false;
+static int64_t gClockOffsetUs = 0;
+static uint32_t gLatencyBins[LATENCY_NUM_BINS];
+static LatencyHistogram gLatency;
+static bool gHaveTransit = false;
+static int64_t gLastTransitUs = 0;
+static double gJitterUs = 0;
+static uint64_t gNumTimeRequests = 0;
+static bool gDriftValid = false;
+static int gDriftPpb = 0;
+
+// With -R, what is needed for receiver reports
+static bool gRtpStarted = false;
+static uint32_t gRtpFirstTimestamp = 0;
+static uint32_t gRtpSsrc = 0;
+static uint32_t gRtcpSsrc = 0;
+static int64_t gExpectedPrior = 0;
+static int64_t gReceivedPrior = 0;
+static uint64_t gNumSenderReports = 0;
+static uint64_t gNumReceiverReports = 0;
+
+// The FEC decoder, set up once the datagram size is known
+static bool gFecStarted = false;
+static FecDecoder gFecDecoder;
+static char * gpFecHistory = NULL;
+static uint32_t gFecHistoryInfo[FEC_HISTORY_SIZE];
+static char * gpFecParity = NULL;
+static uint32_t gFecParityInfo[FEC_PARITY_HISTORY_SIZE];
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Signal handler
+static void stop(int sig)
+{
+    (void) sig;
+    gStop = true;
+}
+
+// Time now in milliseconds
+static int64_t nowMs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Time now in microseconds
+static int64_t nowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Answer a time request from the sender, noting the offset it
+// has arrived at; t2Us is when the request arrived
+static void handleTimeRequest(int sock, char * pBuf, int size, int64_t t2Us,
+                              const struct sockaddr_in * pSender)
+{
+    int64_t offsetUs;
+    int driftPpb;
+
+    if (timeRespond(pBuf, size, (uint64_t) t2Us, (uint64_t) nowUs()) > 0) {
+        sendto(sock, pBuf, TIME_DATAGRAM_SIZE, 0, (const struct sockaddr *) pSender, sizeof (*pSender));
+        gNumTimeRequests++;
+        if (timeGetOffset(pBuf, size, &offsetUs)) {
+            gClockOffsetValid = true;
+            gClockOffsetUs = offsetUs;
+        }
+        if (timeGetDrift(pBuf, size, &driftPpb)) {
+            gDriftValid = true;
+            gDriftPpb = driftPpb;
+        }
+    }
+}
+
+// Note the latency and jitter of a URTP datagram that has just arrived
+static void measureLatency(const char * pBuf, int64_t arrivalUs)
+{
+    int64_t transitUs;
+    int64_t d;
+
+    if (gClockOffsetValid) {
+        gLatency.add((int) (arrivalUs - ((int64_t) urtpGetTimestamp(pBuf) + gClockOffsetUs)));
+    }
+
+    // Jitter needs no offset: it is the smoothed change in transit time
+    transitUs = arrivalUs - (int64_t) urtpGetTimestamp(pBuf);
+    if (gHaveTransit) {
+        d = transitUs - gLastTransitUs;
+        if (d < 0) {
+            d = -d;
+        }
+        gJitterUs += ((double) d - gJitterUs) / 16;
+    }
+    gLastTransitUs = transitUs;
+    gHaveTransit = true;
+}
+
+// Decide whether to throw this datagram away.  Bursty loss is a
+// two-state (Gilbert) model: in the bad state everything is lost and
+// the chance of leaving it gives the requested mean burst length,
+// while the chance of entering it gives the requested overall loss.
+static bool simulateLoss()
+{
+    double pLeave;
+    double pEnter;
+    double r = (double) rand() / RAND_MAX;
+
+    if (gLoss <= 0) {
+        return false;
+    }
+    if (gBurst <= 1) {
+        return r < gLoss;
+    }
+
+    pLeave = 1 / gBurst;
+    pEnter = gLoss * pLeave / (1 - gLoss);
+    if (gLossBurst) {
+        if (r < pLeave) {
+            gLossBurst = false;
+        }
+    } else {
+        if (r < pEnter) {
+            gLossBurst = true;
+        }
+    }
+
+    return gLossBurst;
+}
+
+// Account for the arrival of a URTP datagram, or for one
+// that has been rebuilt by the FEC decoder
+static void handleDatagram(const char * pBuf, int size, bool fromFec)
+{
+    int64_t seq;
+    int64_t now = nowMs();
+    std::map<int64_t, Missing>::iterator i;
+    Missing missing;
+
+    if ((size < URTP_SEQUENCE_NUMBER_OFFSET + 2) || ((unsigned char) pBuf[0] != URTP_SYNC_BYTE)) {
+        return;
+    }
+
+    if (fromFec) {
+        gNumRecoveredByFec++;
+    } else {
+        gNumReceived++;
+        gBytesReceived += size;
+        gBytesThisSecond += size;
+        if (gStreamStarted && (now - gLastDatagramMs > gMaxGapMs)) {
+            gMaxGapMs = now - gLastDatagramMs;
+        }
+        gLastDatagramMs = now;
+        if (size >= URTP_TIMESTAMP_OFFSET + 8) {
+            measureLatency(pBuf, nowUs());
+        }
+    }
+
+    if (!gStreamStarted) {
+        gStreamStarted = true;
+        gFirstSeq = urtpGetSequenceNumber(pBuf);
+        gHighestSeq = gFirstSeq;
+        return;
+    }
+
+    seq = gHighestSeq + sequenceNumberDiff(urtpGetSequenceNumber(pBuf), (int) (gHighestSeq & 0xFFFF));
+    if (seq > gHighestSeq) {
+        // Anything we skipped over is now missing
+        missing.noticedMs = now;
+        missing.lastNackMs = 0;
+        missing.numNacks = 0;
+        for (int64_t x = gHighestSeq + 1; x < seq; x++) {
+            gMissing[x] = missing;
+        }
+        gHighestSeq = seq;
+    } else {
+        i = gMissing.find(seq);
+        if (i != gMissing.end()) {
+            if (!fromFec && (i->second.numNacks > 0)) {
+                gNumRecovered++;
+            }
+            gMissing.erase(i);
+        } else if (!fromFec) {
+            gNumDuplicates++;
+        }
+    }
+}
+
+// Callback for the FEC decoder rebuilding a datagram
+static void fecRecovered(const char * pDatagram, void * pContext)
+{
+    handleDatagram(pDatagram, *((int *) pContext), true);
+}
+
+// Handle anything that has arrived over UDP
+static void handleUdp(const char * pBuf, int size)
+{
+    static int datagramSize = 0;
+
+    if ((unsigned char) pBuf[0] == FEC_SYNC_BYTE) {
+        gNumParity++;
+        gParityBytes += size;
+        if (gFecStarted) {
+            gFecDecoder.receivedParity(pBuf, size);
+        }
+    } else {
+        handleDatagram(pBuf, size, false);
+        if (!gFecStarted && ((unsigned char) pBuf[0] == URTP_SYNC_BYTE)) {
+            // All URTP datagrams are the same size, so the
+            // decoder can be set up from the first one
+            datagramSize = size;
+            gpFecHistory = new char[FEC_HISTORY_SIZE * datagramSize];
+            gpFecParity = new char[FEC_PARITY_HISTORY_SIZE * FEC_PARITY_DATAGRAM_SIZE(datagramSize)];
+            gFecDecoder.init(gpFecHistory, gFecHistoryInfo, FEC_HISTORY_SIZE,
+                             gpFecParity, gFecParityInfo, FEC_PARITY_HISTORY_SIZE,
+                             datagramSize, fecRecovered, &datagramSize);
+            gFecStarted = true;
+        }
+        if (gFecStarted && (size == datagramSize)) {
+            gFecDecoder.receivedDatagram(pBuf);
+        }
+    }
+}
+
+// Send NACKs for whatever is overdue and give up on the hopeless
+static void serviceMissing(int sock, const struct sockaddr_in * pSender)
+{
+    int64_t now = nowMs();
+    int sequenceNumbers[NACK_MAX_SEQUENCE_NUMBERS];
+    int numSequenceNumbers = 0;
+    char nack[NACK_MAX_SIZE];
+    int size;
+    std::map<int64_t, Missing>::iterator i = gMissing.begin();
+
+    while (i != gMissing.end()) {
+        if (now - i->second.noticedMs > gGiveUpMs) {
+            gNumGivenUp++;
+            gMissing.erase(i++);
+            continue;
+        }
+        if (gNack && (pSender != NULL) &&
+            (now - i->second.noticedMs >= gNackWaitMs) &&
+            (now - i->second.lastNackMs >= NACK_REPEAT_MS)) {
+            sequenceNumbers[numSequenceNumbers] = (int) (i->first & 0xFFFF);
+            numSequenceNumbers++;
+            i->second.lastNackMs = now;
+            i->second.numNacks++;
+            if (numSequenceNumbers >= NACK_MAX_SEQUENCE_NUMBERS) {
+                size = nackEncode(nack, sequenceNumbers, numSequenceNumbers);
+                sendto(sock, nack, size, 0, (const struct sockaddr *) pSender, sizeof (*pSender));
+                gNumNacksSent++;
+                numSequenceNumbers = 0;
+            }
+        }
+        i++;
+    }
+
+    if (numSequenceNumbers > 0) {
+        size = nackEncode(nack, sequenceNumbers, numSequenceNumbers);
+        sendto(sock, nack, size, 0, (const struct sockaddr *) pSender, sizeof (*pSender));
+        gNumNacksSent++;
+    }
+}
+
+// Print the outcome
+static void printSummary()
+{
+    uint64_t sent;
+    uint64_t lost;
+
+    if (!gStreamStarted) {
+        printf("No stream received.\n");
+        return;
+    }
+
+    // Anything still outstanding is as good as lost
+    gNumGivenUp += gMissing.size();
+    gMissing.clear();
+
+    sent = gHighestSeq - gFirstSeq + 1;
+    lost = gNumGivenUp;
+    printf("Stream summary:\n");
+    printf("  datagrams in stream:       %llu\n", (unsigned long long) sent);
+    printf("  datagrams received:        %llu (%llu duplicate(s), %llu more thrown away)\n",
+           (unsigned long long) gNumReceived, (unsigned long long) gNumDuplicates,
+           (unsigned long long) gNumDropped);
+    printf("  NACKs sent:                %llu\n", (unsigned long long) gNumNacksSent);
+    printf("  recovered after a NACK:    %llu\n", (unsigned long long) gNumRecovered);
+    if (gNumParity > 0) {
+        printf("  FEC parity received:       %llu (%llu thrown away), %.1f%% extra bandwidth\n",
+               (unsigned long long) gNumParity, (unsigned long long) gNumDroppedParity,
+               gBytesReceived > 0 ? 100.0 * gParityBytes / gBytesReceived : 0.0);
+        printf("  rebuilt by FEC:            %llu (%.1f%% of those thrown away)\n",
+               (unsigned long long) gNumRecoveredByFec,
+               gNumDropped > 0 ? 100.0 * gNumRecoveredByFec / gNumDropped : 0.0);
+    }
+    printf("  never delivered:           %llu\n", (unsigned long long) lost);
+    printf("  delivered:                 %.3f%%\n", 100.0 * (sent - lost) / sent);
+    printf("  bytes received:            %llu\n", (unsigned long long) gBytesReceived);
+    printf("  worst arrival gap:         %d ms\n", (int) gMaxGapMs);
+    printf("  time requests answered:    %llu\n", (unsigned long long) gNumTimeRequests);
+    if (gLatency.getCount() > 0) {
+        printf("  one-way latency:           50%% %.1f ms, 90%% %.1f ms, 99%% %.1f ms, worst %.1f ms"
+               " (clock offset %lld us)\n",
+               gLatency.getPercentileUs(50) / 1000.0, gLatency.getPercentileUs(90) / 1000.0,
+               gLatency.getPercentileUs(99) / 1000.0, gLatency.getMaxUs() / 1000.0,
+               (long long) gClockOffsetUs);
+    } else {
+        printf("  one-way latency:           unknown, the sender has not passed on its clock offset\n");
+    }
+    printf("  jitter:                    %.1f ms\n", gJitterUs / 1000);
+    if (gDriftValid) {
+        printf("  sample clock drift:        %.3f ppm, as reported by the sender\n", gDriftPpb / 1000.0);
+    }
+    if (gRtpRate > 0) {
+        printf("  RTP SSRC:                  0x%08x, %llu sender report(s), %llu receiver report(s) sent\n",
+               gRtpSsrc, (unsigned long long) gNumSenderReports, (unsigned long long) gNumReceiverReports);
+    }
+}
+
+// Turn an RTP packet into a URTP datagram in pUrtp, which must be
+// at least size - RTP_HEADER_SIZE + URTP_HEADER_SIZE long,
+// returning its size or -1 if it isn't RTP
+static int rtpToUrtp(const char * pBuf, int size, char * pUrtp)
+{
+    int headerSize;
+    uint32_t timestamp;
+
+    if ((size < RTP_HEADER_SIZE) || (((unsigned char) pBuf[0] >> 6) != RTP_VERSION)) {
+        return -1;
+    }
+    // Skip any contributing sources
+    headerSize = RTP_HEADER_SIZE + (pBuf[0] & 0x0F) * 4;
+    if (size < headerSize) {
+        return -1;
+    }
+
+    timestamp = datagramGetUint32(pBuf + 4);
+    if (!gRtpStarted) {
+        gRtpStarted = true;
+        gRtpFirstTimestamp = timestamp;
+        gRtpSsrc = datagramGetUint32(pBuf + 8);
+    }
+    pUrtp[0] = (char) URTP_SYNC_BYTE;
+    pUrtp[1] = 0;
+    datagramSetUint16(pUrtp + URTP_SEQUENCE_NUMBER_OFFSET, datagramGetUint16(pBuf + 2));
+    datagramSetUint64(pUrtp + URTP_TIMESTAMP_OFFSET,
+                      (uint64_t) (timestamp - gRtpFirstTimestamp) * 1000000 / gRtpRate);
+    datagramSetUint16(pUrtp + URTP_HEADER_SIZE - 2, size - headerSize);
+    memcpy(pUrtp + URTP_HEADER_SIZE, pBuf + headerSize, size - headerSize);
+
+    return size - headerSize + URTP_HEADER_SIZE;
+}
+
+// Answer an RTCP sender report with a receiver report
+// about the stream; arrivalUs is when it arrived
+static void handleRtcp(int sock, const char * pBuf, int size, int64_t arrivalUs,
+                       const struct sockaddr_in * pSender)
+{
+    uint32_t ntpMiddle;
+    uint32_t ssrc;
+    RtpReportBlock block;
+    char report[RTCP_MAX_SIZE];
+    int64_t expected;
+    int64_t received;
+    int64_t expectedInterval;
+    int64_t lostInterval;
+
+    if (!rtcpGetSenderReport(pBuf, size, &ntpMiddle, &ssrc)) {
+        return;
+    }
+    gNumSenderReports++;
+    if (!gStreamStarted) {
+        return;
+    }
+
+    // As RFC 3550 appendix A.3 works them out
+    expected = gHighestSeq - gFirstSeq + 1;
+    received = (int64_t) (gNumReceived - gNumDuplicates);
+    expectedInterval = expected - gExpectedPrior;
+    lostInterval = expectedInterval - (received - gReceivedPrior);
+    gExpectedPrior = expected;
+    gReceivedPrior = received;
+
+    block.ssrc = ssrc;
+    block.fractionLost = 0;
+    if ((expectedInterval > 0) && (lostInterval > 0)) {
+        block.fractionLost = (int) ((lostInterval << 8) / expectedInterval);
+    }
+    block.cumulativeLost = (int) (expected - received);
+    block.highestSeq = (uint32_t) gHighestSeq;
+    block.jitter = (uint32_t) (gJitterUs * gRtpRate / 1000000);
+    block.lsr = ntpMiddle;
+    block.dlsr = (uint32_t) ((nowUs() - arrivalUs) * 65536 / 1000000);
+
+    size = rtcpMakeReceiverReport(report, gRtcpSsrc, RTCP_CNAME, &block);
+    if (sendto(sock, report, size, 0, (const struct sockaddr *) pSender, sizeof (*pSender)) == size) {
+        gNumReceiverReports++;
+    }
+}
+
+// Receive over UDP
+static int runUdp(int port)
+{
+    int sock;
+    struct sockaddr_in addr;
+    struct sockaddr_in sender;
+    struct sockaddr_in from;
+    socklen_t fromLen;
+    bool haveSender = false;
+    char buf[MAX_DATAGRAM_SIZE];
+    char urtp[MAX_DATAGRAM_SIZE + URTP_HEADER_SIZE];
+    int rtcpSock = -1;
+    struct pollfd pfd[2];
+    int numPfd = 1;
+    int size;
+    int64_t lastArrivalMs = 0;
+    int64_t lastPrintMs = nowMs();
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if ((sock < 0) || (bind(sock, (struct sockaddr *) &addr, sizeof (addr)) != 0)) {
+        perror("Unable to bind UDP socket");
+        return -1;
+    }
+    pfd[0].fd = sock;
+    pfd[0].events = POLLIN;
+    if (gRtpRate > 0) {
+        // RTCP comes to the next port up
+        rtcpSock = socket(AF_INET, SOCK_DGRAM, 0);
+        addr.sin_port = htons(port + 1);
+        if ((rtcpSock < 0) || (bind(rtcpSock, (struct sockaddr *) &addr, sizeof (addr)) != 0)) {
+            perror("Unable to bind RTCP socket");
+            close(sock);
+            return -1;
+        }
+        gRtcpSsrc = ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+        pfd[1].fd = rtcpSock;
+        pfd[1].events = POLLIN;
+        numPfd = 2;
+        printf("Listening for RTP over UDP on port %d, RTCP on port %d.\n", port, port + 1);
+    } else {
+        printf("Listening for URTP over UDP on port %d.\n", port);
+    }
+
+    while (!gStop) {
+        if ((poll(pfd, numPfd, 10) > 0) && (numPfd > 1) && (pfd[1].revents & POLLIN)) {
+            fromLen = sizeof (from);
+            size = recvfrom(rtcpSock, buf, sizeof (buf), 0, (struct sockaddr *) &from, &fromLen);
+            if (size > 0) {
+                handleRtcp(rtcpSock, buf, size, nowUs(), &from);
+            }
+        }
+        if (pfd[0].revents & POLLIN) {
+            fromLen = sizeof (from);
+            size = recvfrom(sock, buf, sizeof (buf), 0, (struct sockaddr *) &from, &fromLen);
+            if ((size > 0) && ((unsigned char) buf[0] == TIME_SYNC_BYTE)) {
+                // Time requests may come from a socket of their own,
+                // so they don't say where NACKs should go
+                handleTimeRequest(sock, buf, size, nowUs(), &from);
+            } else if (size > 0) {
+                sender = from;
+                haveSender = true;
+                lastArrivalMs = nowMs();
+                if (simulateLoss()) {
+                    if ((unsigned char) buf[0] == FEC_SYNC_BYTE) {
+                        gNumDroppedParity++;
+                    } else {
+                        gNumDropped++;
+                    }
+                } else if (gRtpRate > 0) {
+                    size = rtpToUrtp(buf, size, urtp);
+                    if (size > 0) {
+                        handleUdp(urtp, size);
+                    }
+                } else {
+                    handleUdp(buf, size);
+                }
+            }
+        }
+        serviceMissing(sock, haveSender ? &sender : NULL);
+        if (nowMs() - lastPrintMs >= 1000) {
+            lastPrintMs += 1000;
+            if (!gQuiet && gStreamStarted) {
+                printf("%llu bits/s, %d datagram(s) outstanding.\n",
+                       (unsigned long long) gBytesThisSecond << 3, (int) gMissing.size());
+            }
+            gBytesThisSecond = 0;
+        }
+        if (gStreamStarted && (nowMs() - lastArrivalMs > STREAM_END_MS)) {
+            printf("Stream has ended.\n");
+            break;
+        }
+    }
+
+    if (rtcpSock >= 0) {
+        close(rtcpSock);
+    }
+    close(sock);
+    return 0;
+}
+
+// Receive over TCP
+static int runTcp(int port)
+{
+    int listener;
+    int sock;
+    int timeSock;
+    int one = 1;
+    struct sockaddr_in addr;
+    struct sockaddr_in from;
+    socklen_t fromLen;
+    char buf[MAX_DATAGRAM_SIZE];
+    char timeBuf[MAX_DATAGRAM_SIZE];
+    struct pollfd pfd[2];
+    int count = 0;
+    int size = 1;
+    int64_t lastPrintMs;
+
+    if (gDatagramSize > (int) sizeof (buf)) {
+        printf("Datagram size must be no more than %d.\n", (int) sizeof (buf));
+        return -1;
+    }
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+    memset(&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if ((listener < 0) || (bind(listener, (struct sockaddr *) &addr, sizeof (addr)) != 0) ||
+        (listen(listener, 1) != 0)) {
+        perror("Unable to listen on TCP socket");
+        return -1;
+    }
+    printf("Listening for URTP over TCP on port %d.\n", port);
+
+    // Time requests come over UDP on the same port
+    timeSock = socket(AF_INET, SOCK_DGRAM, 0);
+    if ((timeSock < 0) || (bind(timeSock, (struct sockaddr *) &addr, sizeof (addr)) != 0)) {
+        perror("Unable to bind UDP socket for time requests");
+        close(listener);
+        return -1;
+    }
+
+    sock = accept(listener, NULL, NULL);
+    if (sock < 0) {
+        close(timeSock);
+        close(listener);
+        return -1;
+    }
+    pfd[0].fd = sock;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = timeSock;
+    pfd[1].events = POLLIN;
+    lastPrintMs = nowMs();
+    while (!gStop && (size > 0)) {
+        if (poll(pfd, 2, 10) > 0) {
+            if (pfd[1].revents & POLLIN) {
+                fromLen = sizeof (from);
+                size = recvfrom(timeSock, timeBuf, sizeof (timeBuf), 0, (struct sockaddr *) &from, &fromLen);
+                if (size > 0) {
+                    handleTimeRequest(timeSock, timeBuf, size, nowUs(), &from);
+                }
+                size = 1;
+            }
+            if (pfd[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+                size = recv(sock, buf + count, gDatagramSize - count, 0);
+                if (size > 0) {
+                    count += size;
+                    if (count == gDatagramSize) {
+                        handleDatagram(buf, count, false);
+                        count = 0;
+                    }
+                }
+            }
+        }
+        if (!gQuiet && (nowMs() - lastPrintMs >= 1000)) {
+            lastPrintMs += 1000;
+            printf("%llu bits/s.\n", (unsigned long long) gBytesThisSecond << 3);
+            gBytesThisSecond = 0;
+        }
+    }
+
+    close(sock);
+    close(timeSock);
+    close(listener);
+    return 0;
+}
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Entry point
+int main(int argc, char * argv[])
+{
+    int port = DEFAULT_PORT;
+    bool useTcp = false;
+    int opt;
+    int retValue;
+
+    while ((opt = getopt(argc, argv, "p:ts:l:b:nw:g:qR:")) != -1) {
+        switch (opt) {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 't':
+                useTcp = true;
+                break;
+            case 's':
+                gDatagramSize = atoi(optarg);
+                break;
+            case 'l':
+                gLoss = atof(optarg) / 100;
+                break;
+            case 'b':
+                gBurst = atof(optarg);
+                break;
+            case 'n':
+                gNack = true;
+                break;
+            case 'w':
+                gNackWaitMs = atoi(optarg);
+                break;
+            case 'g':
+                gGiveUpMs = atoi(optarg);
+                break;
+            case 'q':
+                gQuiet = true;
+                break;
+            case 'R':
+                gRtpRate = atoi(optarg);
+                break;
+            default:
+                printf("Usage: %s [-p port] [-t] [-s size] [-l loss%%] [-b burst] [-n] [-w ms] [-g ms] [-q] [-R rate]\n",
+                       argv[0]);
+                return -1;
+        }
+    }
+
+    if ((gLoss < 0) || (gLoss >= 1) || (gDatagramSize <= 0)) {
+        printf("Loss must be at least 0%% and less than 100%%, size must be positive.\n");
+        return -1;
+    }
+    if ((gRtpRate < 0) || ((gRtpRate > 0) && useTcp)) {
+        printf("RTP needs a positive clock rate and is received over UDP.\n");
+        return -1;
+    }
+
+    signal(SIGINT, stop);
+    srand(time(NULL));
+    gLatency.init(gLatencyBins, LATENCY_NUM_BINS, LATENCY_BIN_US);
+
+    if (useTcp) {
+        retValue = runTcp(port);
+    } else {
+        retValue = runUdp(port);
+    }
+    printSummary();
+
+    return retValue;
+}
@@ -0,0 +1,743 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A stand-in for the board's send path, for use on a Linux host.  It
+ * produces dummy URTP datagrams at the codec's block rate and sends
+ * them using the same pacer and retransmit window code as the board,
+ * so that those can be exercised against urtp_receiver without any
+ * hardware.  Stalls can be simulated to build up a backlog.
+ *
+ * With -m, datagrams are sent from two or more local addresses (e.g.
+ * two network interfaces, or 127.0.0.1 and 127.0.0.2 for a test on
+ * one machine) using the same path selection as USE_MULTIPATH; -k
+ * makes sends over the first path fail for a while, to show how
+ * quickly the stream moves to the next.
+ *
+ * With -c, the clock used for the datagram timestamps is lined up with
+ * the receiver's as CLOCK_SYNC does on the board, so that the receiver
+ * can measure one-way latency.  -D makes the sample clock run fast (or,
+ * if negative, slow) by so many parts per million; the drift is
+ * measured from the block times and, with -c, passed on to the receiver
+ * as MEASURE_SAMPLE_CLOCK_DRIFT does.
+ *
+ * With -R the datagrams go out as RTP, as RTP_OUTPUT does, with sender
+ * reports to the next port up; the receiver reports that come back
+ * give the loss, jitter and round trip that the receiver sees.
+ *
+ * Usage: urtp_source [-a address] [-p port] [-d seconds] [-s size] [-t]
+ *                    [-n] [-f N:P] [-r bits/s] [-B bytes] [-x ms:seconds]
+ *                    [-m local,local...] [-k seconds:ms] [-c] [-D ppm]
+ *                    [-R]
+ *   -a  address of the server (default 127.0.0.1)
+ *   -p  port of the server (default 5065)
+ *   -d  how long to stream for (default 10 seconds)
+ *   -s  URTP datagram size (default 344)
+ *   -t  send over TCP rather than UDP
+ *   -n  service NACKs from the server, as USE_RELIABLE_UDP does
+ *   -f  send P FEC parity datagrams after every N, as USE_FEC does
+ *   -r  pace sends to this rate (default 0, no pacing)
+ *   -B  pacer burst size (default four datagrams)
+ *   -x  stall sending for ms milliseconds every so many seconds
+ *   -m  send over UDP from each of these local addresses, in order
+ *       of preference, failing over from one to the next
+ *   -k  make the first path fail for ms milliseconds, starting
+ *       so many seconds in
+ *   -c  exchange time with the receiver, over UDP, once a second
+ *   -D  make the sample clock drift by this many parts per million
+ *   -R  send RTP rather than URTP, over UDP
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <deque>
+#include <vector>
+#include "datagram.h"
+#include "pacer.h"
+#include "retransmit.h"
+#include "fec.h"
+#include "multipath.h"
+#include "clocksync.h"
+#include "drift.h"
+#include "rtp.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Defaults
+#define DEFAULT_PORT 5065
+#define DEFAULT_DATAGRAM_SIZE 344
+#define DEFAULT_DURATION_SECONDS 10
+
+// The codec's block duration
+#define BLOCK_DURATION_MS 20
+
+// The size of the datagram store, as on the board
+#define MAX_NUM_DATAGRAMS 200
+
+// The number of datagrams kept for retransmission, as on the board
+#define RETRANSMIT_WINDOW_NUM_DATAGRAMS (1000 / BLOCK_DURATION_MS)
+#define RETRANSMIT_MAX_TRIES 3
+
+// How long a path that has failed a send is avoided for, as on the board
+#define MULTIPATH_HOLD_DOWN_MS 2000
+
+// How often the time is exchanged with the receiver, as on the board
+#define CLOCK_SYNC_INTERVAL_MS 1000
+
+// The number of blocks between points for the drift estimate, as on
+// the board, and how long the estimates must run before they are
+// believed; there is little noise here so that can be short
+#define DRIFT_SAMPLE_NUM_BLOCKS (1000 / BLOCK_DURATION_MS)
+#define DRIFT_MIN_SPAN_MS 10000
+
+// With -R, the RTP payload type, how often a sender report
+// is sent and the CNAME to send, as on the board
+#define RTP_PAYLOAD_TYPE 96
+#define RTCP_INTERVAL_MS 5000
+#define RTCP_CNAME "urtp_source"
+
+// The sample rate, the RTP clock rate
+#define SAMPLING_FREQUENCY 16000
+
+// The seconds from the NTP epoch (1900) to the Unix one (1970)
+#define NTP_UNIX_OFFSET_SECONDS 2208988800ULL
+
+/* ----------------------------------------------------------------
+ * VARIABLES
+ * -------------------------------------------------------------- */
+
+// Timing origin
+static struct timespec gStart;
+
+// With -m, a socket for each path and the choice between them
+static int gPathSock[MULTIPATH_MAX_NUM_PATHS];
+static int gNumPaths = 0;
+static PathSelector gPathSelector;
+static uint64_t gNumSentOnPath[MULTIPATH_MAX_NUM_PATHS];
+static uint64_t gNumFailovers = 0;
+static int gMaxFailoverUs = 0;
+
+// With -k, when the first path fails and for how long
+static uint64_t gKillStartUs = 0;
+static uint64_t gKillDurationUs = 0;
+
+// With -R, the RTP framing
+static bool gRtp = false;
+static RtpSender gRtpSender;
+static char gRtpBuf[2048];
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Microseconds since start
+static uint64_t nowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) (ts.tv_sec - gStart.tv_sec) * 1000000 + (ts.tv_nsec - gStart.tv_nsec) / 1000;
+}
+
+// The wall clock in microseconds since the NTP epoch
+static uint64_t ntpNowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((uint64_t) ts.tv_sec + NTP_UNIX_OFFSET_SECONDS) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Make a dummy URTP datagram
+static void makeDatagram(std::vector<char> & datagram, int sequenceNumber, uint64_t timestampUs)
+{
+    datagram[0] = (char) URTP_SYNC_BYTE;
+    datagram[1] = 0;
+    datagramSetUint16(&datagram[URTP_SEQUENCE_NUMBER_OFFSET], sequenceNumber);
+    datagramSetUint64(&datagram[URTP_TIMESTAMP_OFFSET], timestampUs);
+    datagramSetUint16(&datagram[URTP_HEADER_SIZE - 2], (int) datagram.size() - URTP_HEADER_SIZE);
+    for (unsigned int x = URTP_HEADER_SIZE; x < datagram.size(); x++) {
+        datagram[x] = (char) (sequenceNumber + x);
+    }
+}
+
+// Send over sock or, with -m, over the preferred path; if a send
+// over a path fails it is made again at once over the next one
+static int sendOverPath(int sock, const void * pData, int size, int flags)
+{
+    int retValue = -1;
+    int path;
+    int failedPath = -1;
+    uint64_t failedUs = 0;
+    uint64_t now;
+
+    if (gNumPaths == 0) {
+        return send(sock, pData, size, flags);
+    }
+
+    while ((retValue != size) &&
+           ((path = gPathSelector.getPath((uint32_t) (nowUs() / 1000), failedPath)) >= 0)) {
+        now = nowUs();
+        if ((path == 0) && (now >= gKillStartUs) && (now < gKillStartUs + gKillDurationUs)) {
+            retValue = -1;
+        } else {
+            retValue = send(gPathSock[path], pData, size, flags);
+            if ((retValue < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+                // Just busy, not broken
+                break;
+            }
+        }
+        if (retValue == size) {
+            gPathSelector.sendSucceeded(path);
+            gNumSentOnPath[path]++;
+            if (failedPath >= 0) {
+                gNumFailovers++;
+                if ((int) (nowUs() - failedUs) > gMaxFailoverUs) {
+                    gMaxFailoverUs = (int) (nowUs() - failedUs);
+                }
+            }
+        } else {
+            gPathSelector.sendFailed(path, (uint32_t) (now / 1000));
+            if (failedPath >= 0) {
+                break;
+            }
+            failedPath = path;
+            failedUs = now;
+        }
+    }
+
+    return retValue;
+}
+
+// Send a URTP datagram or parity datagram, as RTP with -R,
+// returning size if it was sent
+static int sendOn(int sock, const void * pData, int size, int flags)
+{
+    int rtpSize;
+
+    if (!gRtp) {
+        return sendOverPath(sock, pData, size, flags);
+    }
+
+    rtpSize = gRtpSender.wrap(gRtpBuf, (const char *) pData, size);
+    if ((rtpSize < 0) || (sendOverPath(sock, gRtpBuf, rtpSize, flags) != rtpSize)) {
+        return -1;
+    }
+    gRtpSender.sent(rtpSize);
+
+    return size;
+}
+
+// Open a UDP socket from each local address in a comma-separated
+// list, all connected to the server
+static bool openPaths(char * pLocals, const struct sockaddr_in * pServer)
+{
+    struct sockaddr_in local;
+    char * pLocal;
+
+    for (pLocal = strtok(pLocals, ","); pLocal != NULL; pLocal = strtok(NULL, ",")) {
+        if (gNumPaths >= MULTIPATH_MAX_NUM_PATHS) {
+            printf("At most %d paths can be used.\n", MULTIPATH_MAX_NUM_PATHS);
+            return false;
+        }
+        memset(&local, 0, sizeof (local));
+        local.sin_family = AF_INET;
+        if (inet_pton(AF_INET, pLocal, &local.sin_addr) != 1) {
+            printf("Bad local address \"%s\".\n", pLocal);
+            return false;
+        }
+        gPathSock[gNumPaths] = socket(AF_INET, SOCK_DGRAM, 0);
+        if ((gPathSock[gNumPaths] < 0) ||
+            (bind(gPathSock[gNumPaths], (struct sockaddr *) &local, sizeof (local)) != 0) ||
+            (connect(gPathSock[gNumPaths], (struct sockaddr *) pServer, sizeof (*pServer)) != 0)) {
+            perror("Unable to open path");
+            return false;
+        }
+        gNumSentOnPath[gNumPaths] = 0;
+        gNumPaths++;
+    }
+
+    gPathSelector.init(gNumPaths, MULTIPATH_HOLD_DOWN_MS);
+    for (int x = 0; x < gNumPaths; x++) {
+        gPathSelector.setUp(x, true);
+    }
+
+    return true;
+}
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Entry point
+int main(int argc, char * argv[])
+{
+    const char * pAddress = "127.0.0.1";
+    int port = DEFAULT_PORT;
+    int durationSeconds = DEFAULT_DURATION_SECONDS;
+    int datagramSize = DEFAULT_DATAGRAM_SIZE;
+    bool useTcp = false;
+    bool reliable = false;
+    int pacerRate = 0;
+    int pacerBurst = -1;
+    int stallMs = 0;
+    int stallEverySeconds = 0;
+    int fecGroupSize = 0;
+    int fecNumParity = 0;
+    char * pLocals = NULL;
+    int killStartSeconds = 0;
+    int killMs = 0;
+    bool clockSync = false;
+    int timeSock = -1;
+    ClockSync sync;
+    char timeBuf[TIME_DATAGRAM_SIZE];
+    uint64_t lastTimeRequestUs = 0;
+    bool timeRequested = false;
+    double driftPpm = 0;
+    double blockUs;
+    uint64_t numBlocks = 0;
+    int64_t nominalUs;
+    DriftEstimator sampleClockDrift;
+    DriftEstimator serverClockDrift;
+    int rtcpSock = -1;
+    struct sockaddr_in rtcpServer;
+    char rtcpBuf[RTCP_MAX_SIZE];
+    uint64_t lastSenderReportUs = 0;
+    RtpReportBlock reportBlock;
+    int rttUs = -1;
+    int numReports = 0;
+    std::vector<char> fecStorage;
+    FecEncoder fecEncoder;
+    uint64_t numParity = 0;
+    int opt;
+    int sock;
+    struct sockaddr_in server;
+    std::deque<std::vector<char> > queue;
+    std::vector<char> datagram;
+    std::vector<char> retransmitStorage;
+    std::vector<uint32_t> retransmitSlotInfo;
+    RetransmitWindow retransmitWindow;
+    Pacer pacer;
+    char nack[NACK_MAX_SIZE];
+    int sequenceNumbers[NACK_MAX_SEQUENCE_NUMBERS];
+    int numSequenceNumbers;
+    const char * pRetransmit;
+    struct pollfd pfd[MULTIPATH_MAX_NUM_PATHS];
+    int numPfd = 1;
+    int sequenceNumber = 0;
+    uint64_t nextBlockUs = 0;
+    uint64_t endUs;
+    uint64_t now;
+    uint64_t lastPrintUs = 0;
+    uint64_t bytesThisSecond = 0;
+    uint64_t bytesSent = 0;
+    uint64_t numSent = 0;
+    uint64_t numOverflows = 0;
+    uint64_t numRetransmits = 0;
+    uint64_t numNacks = 0;
+    uint64_t queueDelaySum = 0;
+    int queueDelayMax = 0;
+    int queueDelay;
+    int peakBytesPerBlock = 0;
+    int bytesThisBlock = 0;
+    uint64_t thisBlockStartUs = 0;
+    int waitUs;
+    int size;
+
+    while ((opt = getopt(argc, argv, "a:p:d:s:tnf:r:B:x:m:k:cD:R")) != -1) {
+        switch (opt) {
+            case 'a':
+                pAddress = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'd':
+                durationSeconds = atoi(optarg);
+                break;
+            case 's':
+                datagramSize = atoi(optarg);
+                break;
+            case 't':
+                useTcp = true;
+                break;
+            case 'n':
+                reliable = true;
+                break;
+            case 'f':
+                if (sscanf(optarg, "%d:%d", &fecGroupSize, &fecNumParity) != 2) {
+                    fecGroupSize = 0;
+                }
+                break;
+            case 'r':
+                pacerRate = atoi(optarg);
+                break;
+            case 'B':
+                pacerBurst = atoi(optarg);
+                break;
+            case 'x':
+                if (sscanf(optarg, "%d:%d", &stallMs, &stallEverySeconds) != 2) {
+                    stallMs = 0;
+                }
+                break;
+            case 'm':
+                pLocals = optarg;
+                break;
+            case 'k':
+                if (sscanf(optarg, "%d:%d", &killStartSeconds, &killMs) != 2) {
+                    killMs = 0;
+                }
+                break;
+            case 'c':
+                clockSync = true;
+                break;
+            case 'D':
+                driftPpm = atof(optarg);
+                break;
+            case 'R':
+                gRtp = true;
+                break;
+            default:
+                printf("Usage: %s [-a address] [-p port] [-d seconds] [-s size] [-t] [-n] [-f N:P] [-r bits/s] [-B bytes] [-x ms:seconds]"
+                       " [-m local,local...] [-k seconds:ms] [-c] [-D ppm] [-R]\n",
+                       argv[0]);
+                return -1;
+        }
+    }
+
+    if (datagramSize <= URTP_HEADER_SIZE) {
+        printf("Datagram size must be more than %d.\n", URTP_HEADER_SIZE);
+        return -1;
+    }
+    if ((reliable || (fecGroupSize > 0)) && useTcp) {
+        printf("NACKs and FEC only make sense over UDP.\n");
+        return -1;
+    }
+    if ((fecGroupSize > 0) && ((fecNumParity <= 0) || (fecGroupSize > FEC_MAX_GROUP_SIZE))) {
+        printf("FEC needs at least one parity datagram and a group of at most %d.\n", FEC_MAX_GROUP_SIZE);
+        return -1;
+    }
+    if ((pLocals != NULL) && useTcp) {
+        printf("Multiple paths only make sense over UDP.\n");
+        return -1;
+    }
+    if (gRtp && (useTcp || (fecGroupSize > 0))) {
+        printf("RTP is sent over UDP and without FEC.\n");
+        return -1;
+    }
+    if (pacerBurst < 0) {
+        pacerBurst = datagramSize * 4;
+    }
+
+    memset(&server, 0, sizeof (server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(port);
+    if (inet_pton(AF_INET, pAddress, &server.sin_addr) != 1) {
+        printf("Bad address \"%s\".\n", pAddress);
+        return -1;
+    }
+    sock = socket(AF_INET, useTcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if ((sock < 0) || (connect(sock, (struct sockaddr *) &server, sizeof (server)) != 0)) {
+        perror("Unable to connect");
+        return -1;
+    }
+    if (useTcp) {
+        int one = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+    }
+    if ((pLocals != NULL) && !openPaths(pLocals, &server)) {
+        return -1;
+    }
+    if (clockSync) {
+        // Time always goes over UDP, whatever carries the stream
+        timeSock = socket(AF_INET, SOCK_DGRAM, 0);
+        if ((timeSock < 0) || (connect(timeSock, (struct sockaddr *) &server, sizeof (server)) != 0)) {
+            perror("Unable to open socket for time requests");
+            return -1;
+        }
+    }
+    if (gRtp) {
+        // RTCP goes to the next port up
+        rtcpServer = server;
+        rtcpServer.sin_port = htons(port + 1);
+        rtcpSock = socket(AF_INET, SOCK_DGRAM, 0);
+        if ((rtcpSock < 0) || (connect(rtcpSock, (struct sockaddr *) &rtcpServer, sizeof (rtcpServer)) != 0)) {
+            perror("Unable to open socket for RTCP");
+            return -1;
+        }
+        srand((unsigned int) time(NULL));
+        gRtpSender.init(((uint32_t) rand() << 16) ^ (uint32_t) rand(), (uint32_t) rand(),
+                        RTP_PAYLOAD_TYPE, SAMPLING_FREQUENCY, RTCP_CNAME);
+    }
+    gKillStartUs = (uint64_t) killStartSeconds * 1000000;
+    gKillDurationUs = (uint64_t) killMs * 1000;
+
+    datagram.resize(datagramSize);
+    retransmitStorage.resize(datagramSize * RETRANSMIT_WINDOW_NUM_DATAGRAMS);
+    retransmitSlotInfo.resize(RETRANSMIT_WINDOW_NUM_DATAGRAMS);
+    retransmitWindow.init(&retransmitStorage[0], RETRANSMIT_WINDOW_NUM_DATAGRAMS, datagramSize,
+                          &retransmitSlotInfo[0], RETRANSMIT_MAX_TRIES);
+    if (fecGroupSize > 0) {
+        fecStorage.resize(FEC_PARITY_DATAGRAM_SIZE(datagramSize) * fecNumParity);
+        fecEncoder.init(&fecStorage[0], fecGroupSize, fecNumParity, datagramSize);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &gStart);
+    pacer.init(pacerRate, pacerBurst, 0);
+    // A fast sample clock fills a block in less time
+    blockUs = BLOCK_DURATION_MS * 1000 / (1 + driftPpm / 1000000);
+    sampleClockDrift.init((int64_t) DRIFT_MIN_SPAN_MS * 1000);
+    serverClockDrift.init((int64_t) DRIFT_MIN_SPAN_MS * 1000);
+    endUs = (uint64_t) durationSeconds * 1000000;
+    pfd[0].fd = sock;
+    pfd[0].events = POLLIN;
+    for (int x = 0; x < gNumPaths; x++) {
+        pfd[x].fd = gPathSock[x];
+        pfd[x].events = POLLIN;
+    }
+    if (gNumPaths > 0) {
+        numPfd = gNumPaths;
+    }
+
+    printf("Sending %d byte %s datagrams over %s to %s:%d for %d second(s)", datagramSize,
+           gRtp ? "RTP-framed" : "URTP", useTcp ? "TCP" : "UDP", pAddress, port, durationSeconds);
+    if (pacerRate > 0) {
+        printf(", paced at %d bits/s (burst %d bytes)", pacerRate, pacerBurst);
+    }
+    if (gNumPaths > 0) {
+        printf(", over %d path(s)", gNumPaths);
+        if (gKillDurationUs > 0) {
+            printf(", the first failing for %d ms after %d second(s)", killMs, killStartSeconds);
+        }
+    }
+    printf(".\n");
+
+    while ((now = nowUs()) < endUs) {
+        // Produce a datagram every block period, as the codec would
+        while (now >= nextBlockUs) {
+            makeDatagram(datagram, sequenceNumber, nextBlockUs);
+            sequenceNumber = (sequenceNumber + 1) & 0xFFFF;
+            if (queue.size() >= MAX_NUM_DATAGRAMS) {
+                queue.pop_front();
+                numOverflows++;
+            }
+            queue.push_back(datagram);
+            // Time the blocks as the board times its DMA events
+            if ((numBlocks > 0) && (numBlocks % DRIFT_SAMPLE_NUM_BLOCKS == 0)) {
+                nominalUs = (int64_t) numBlocks * BLOCK_DURATION_MS * 1000;
+                sampleClockDrift.add(nominalUs, (int64_t) nextBlockUs - nominalUs);
+            }
+            numBlocks++;
+            nextBlockUs = (uint64_t) (numBlocks * blockUs);
+        }
+
+        // Simulate a stall if required
+        if ((stallMs > 0) && (stallEverySeconds > 0) &&
+            ((now % ((uint64_t) stallEverySeconds * 1000000)) < (uint64_t) stallMs * 1000)) {
+            usleep(1000);
+            continue;
+        }
+
+        // Send what we can
+        while (!queue.empty()) {
+            waitUs = pacer.getWaitUs(datagramSize, nowUs());
+            if (waitUs > 0) {
+                break;
+            }
+            queueDelay = (int) ((nowUs() - datagramGetUint64(&queue.front()[URTP_TIMESTAMP_OFFSET])) / 1000);
+            if (useTcp) {
+                size = send(sock, &queue.front()[0], datagramSize, 0);
+            } else {
+                size = sendOn(sock, &queue.front()[0], datagramSize, MSG_DONTWAIT);
+            }
+            if (size != datagramSize) {
+                break;
+            }
+            pacer.consume(size, nowUs());
+            if (reliable) {
+                retransmitWindow.store(&queue.front()[0]);
+            }
+            if (fecGroupSize > 0) {
+                fecEncoder.add(&queue.front()[0]);
+                if (fecEncoder.isReady()) {
+                    for (int x = 0; x < fecEncoder.getNumParity(); x++) {
+                        if (sendOn(sock, fecEncoder.getParity(x), fecEncoder.getParitySize(), MSG_DONTWAIT) ==
+                            fecEncoder.getParitySize()) {
+                            pacer.consume(fecEncoder.getParitySize(), nowUs());
+                            bytesSent += fecEncoder.getParitySize();
+                            bytesThisSecond += fecEncoder.getParitySize();
+                            numParity++;
+                        }
+                    }
+                    fecEncoder.clear();
+                }
+            }
+            queueDelaySum += queueDelay;
+            if (queueDelay > queueDelayMax) {
+                queueDelayMax = queueDelay;
+            }
+            // Burstiness: the most bytes sent in any one block period
+            now = nowUs();
+            if (now - thisBlockStartUs >= BLOCK_DURATION_MS * 1000) {
+                thisBlockStartUs = now;
+                bytesThisBlock = 0;
+            }
+            bytesThisBlock += size;
+            if (bytesThisBlock > peakBytesPerBlock) {
+                peakBytesPerBlock = bytesThisBlock;
+            }
+            bytesSent += size;
+            bytesThisSecond += size;
+            numSent++;
+            queue.pop_front();
+        }
+
+        // Service NACKs, which come back over whichever path the
+        // receiver last heard from
+        for (int p = 0; reliable && (p < numPfd); p++) {
+            while ((size = recv(pfd[p].fd, nack, sizeof (nack), MSG_DONTWAIT)) > 0) {
+                numSequenceNumbers = nackDecode(nack, size, sequenceNumbers);
+                if (numSequenceNumbers > 0) {
+                    numNacks++;
+                }
+                for (int x = 0; x < numSequenceNumbers; x++) {
+                    pRetransmit = retransmitWindow.getForRetransmit(sequenceNumbers[x]);
+                    if ((pRetransmit != NULL) &&
+                        (sendOn(sock, pRetransmit, datagramSize, MSG_DONTWAIT) == datagramSize)) {
+                        pacer.consume(datagramSize, nowUs());
+                        bytesSent += datagramSize;
+                        bytesThisSecond += datagramSize;
+                        numRetransmits++;
+                    }
+                }
+            }
+        }
+
+        // Exchange time with the receiver
+        if (clockSync) {
+            while ((size = recv(timeSock, timeBuf, sizeof (timeBuf), MSG_DONTWAIT)) > 0) {
+                if (sync.handleResponse(timeBuf, size, nowUs())) {
+                    serverClockDrift.add(nowUs(), sync.getOffsetUs());
+                }
+            }
+            if (!timeRequested || (now - lastTimeRequestUs >= CLOCK_SYNC_INTERVAL_MS * 1000)) {
+                timeRequested = true;
+                lastTimeRequestUs = now;
+                size = sync.makeRequest(timeBuf, nowUs());
+                if (sampleClockDrift.isValid() && serverClockDrift.isValid()) {
+                    timeSetDrift(timeBuf, -sampleClockDrift.getPpb() - serverClockDrift.getPpb());
+                }
+                send(timeSock, timeBuf, size, MSG_DONTWAIT);
+            }
+        }
+
+        // Send a sender report now and again and read the receiver's
+        if (gRtp) {
+            while ((size = recv(rtcpSock, rtcpBuf, sizeof (rtcpBuf), MSG_DONTWAIT)) > 0) {
+                if (gRtpSender.handleReport(rtcpBuf, size, ntpNowUs(), &reportBlock, &rttUs)) {
+                    numReports++;
+                }
+            }
+            if (now - lastSenderReportUs >= RTCP_INTERVAL_MS * 1000) {
+                size = gRtpSender.makeSenderReport(rtcpBuf, ntpNowUs(), nowUs());
+                if (size > 0) {
+                    lastSenderReportUs = now;
+                    send(rtcpSock, rtcpBuf, size, MSG_DONTWAIT);
+                }
+            }
+        }
+
+        if (now - lastPrintUs >= 1000000) {
+            lastPrintUs += 1000000;
+            printf("%llu bits/s, %d datagram(s) queued.\n",
+                   (unsigned long long) bytesThisSecond << 3, (int) queue.size());
+            bytesThisSecond = 0;
+        }
+
+        poll(pfd, reliable ? numPfd : 0, 1);
+    }
+
+    printf("Summary:\n");
+    printf("  datagrams sent:            %llu (%llu sent again after a NACK, %llu NACK(s))\n",
+           (unsigned long long) numSent, (unsigned long long) numRetransmits,
+           (unsigned long long) numNacks);
+    printf("  datagrams lost to overflow: %llu\n", (unsigned long long) numOverflows);
+    if (fecGroupSize > 0) {
+        printf("  FEC parity datagrams sent: %llu\n", (unsigned long long) numParity);
+    }
+    printf("  average throughput:        %llu bits/s\n",
+           (unsigned long long) (bytesSent * 8 / (durationSeconds > 0 ? durationSeconds : 1)));
+    if (numSent > 0) {
+        printf("  queueing delay:            average %d ms, worst %d ms\n",
+               (int) (queueDelaySum / numSent), queueDelayMax);
+    }
+    printf("  peak bytes in one block:   %d (%d datagram(s))\n",
+           peakBytesPerBlock, peakBytesPerBlock / datagramSize);
+    for (int x = 0; x < gNumPaths; x++) {
+        printf("  sent over path %d:          %llu\n", x, (unsigned long long) gNumSentOnPath[x]);
+    }
+    if (gNumPaths > 0) {
+        printf("  failovers:                 %llu (worst %d us), %d path switch(es)\n",
+               (unsigned long long) gNumFailovers, gMaxFailoverUs, gPathSelector.getNumSwitches());
+    }
+
+    if (clockSync) {
+        if (sync.isValid()) {
+            printf("  clock offset:              %lld us (round trip %d us), from %u exchange(s)\n",
+                   (long long) sync.getOffsetUs(), sync.getDelayUs(), sync.getNumExchanges());
+        } else {
+            printf("  clock offset:              unknown, no time responses\n");
+        }
+        close(timeSock);
+    }
+    if (gRtp) {
+        printf("  RTP packets sent:          %u (%u byte(s) of audio)\n",
+               gRtpSender.getNumPackets(), gRtpSender.getNumOctets());
+        if (numReports > 0) {
+            printf("  RTCP receiver reports:     %d, last %d%% lost (%d in all), jitter %u sample(s)",
+                   numReports, reportBlock.fractionLost * 100 / 256, reportBlock.cumulativeLost,
+                   reportBlock.jitter);
+            if (rttUs >= 0) {
+                printf(", round trip %d us", rttUs);
+            }
+            printf("\n");
+        } else {
+            printf("  RTCP receiver reports:     none\n");
+        }
+        close(rtcpSock);
+    }
+    if (sampleClockDrift.isValid()) {
+        printf("  sample clock drift:        %.3f ppm (simulated %.3f ppm)\n",
+               -sampleClockDrift.getPpb() / 1000.0, driftPpm);
+    }
+
+    for (int x = 0; x < gNumPaths; x++) {
+        close(gPathSock[x]);
+    }
+    close(sock);
+    return 0;
+}
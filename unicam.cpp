@@ -0,0 +1,42 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "unicam.h"
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Decode a URTP body
+void unicamDecode(const char * pBody, int32_t * pSamples)
+{
+    const int8_t * pCoded = (const int8_t *) pBody;
+    int shift[2];
+
+    for (int x = 0; x < UNICAM_BODY_SAMPLES; x += UNICAM_BLOCK_SAMPLES * 2) {
+        shift[0] = ((uint8_t) pCoded[UNICAM_BLOCK_SAMPLES * 2]) >> 4;
+        shift[1] = ((uint8_t) pCoded[UNICAM_BLOCK_SAMPLES * 2]) & 0x0F;
+        for (int y = 0; y < 2; y++) {
+            for (int z = 0; z < UNICAM_BLOCK_SAMPLES; z++) {
+                // Multiply rather than shift: the sample may be negative
+                *pSamples = (int32_t) *pCoded * (1 << shift[y]);
+                pSamples++;
+                pCoded++;
+            }
+        }
+        pCoded++;
+    }
+}
@@ -0,0 +1,54 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Decoding of the UNICAM coded body of a URTP datagram back to
+ * samples, as the server does.  The urtp library codes the body as
+ * UNICAM blocks of 16 samples, each sample an 8 bit signed value to be
+ * shifted left by a 4 bit shift for its UNICAM block.  The UNICAM
+ * blocks go in pairs: the 16 samples of the first, the 16 samples of
+ * the second, then a byte holding the shift of the first in the upper
+ * nibble and that of the second in the lower nibble.  A decoded sample
+ * fits in 24 bits.
+ *
+ * Nothing here depends on mbed so that the host tools can use it too.
+ */
+
+#ifndef _UNICAM_H_
+#define _UNICAM_H_
+
+#include <stdint.h>
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The number of samples in a UNICAM block
+#define UNICAM_BLOCK_SAMPLES 16
+
+// The number of samples in a URTP body, one block period's worth
+#define UNICAM_BODY_SAMPLES 320
+
+// The size of a URTP body, URTP_BODY_SIZE
+#define UNICAM_BODY_SIZE (UNICAM_BODY_SAMPLES + UNICAM_BODY_SAMPLES / UNICAM_BLOCK_SAMPLES / 2)
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Decode a URTP body into UNICAM_BODY_SAMPLES samples
+void unicamDecode(const char * pBody, int32_t * pSamples);
+
+#endif // _UNICAM_H_
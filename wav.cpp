@@ -0,0 +1,254 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include "wav.h"
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// Offsets of the chunks in the header
+#define RIFF_OFFSET 0
+#define BEXT_OFFSET 12
+#define FMT_OFFSET (BEXT_OFFSET + 8 + WAV_BEXT_SIZE)
+#define FMT_SIZE 16
+#define JUNK_OFFSET (FMT_OFFSET + 8 + FMT_SIZE)
+#define DATA_OFFSET (WAV_HEADER_SIZE - 8)
+
+// Offsets of the fields of the bext chunk, from its start
+#define BEXT_DESCRIPTION_OFFSET 0
+#define BEXT_DESCRIPTION_SIZE 256
+#define BEXT_ORIGINATOR_OFFSET 256
+#define BEXT_ORIGINATION_DATE_OFFSET 320
+#define BEXT_ORIGINATION_TIME_OFFSET 330
+#define BEXT_TIME_REFERENCE_OFFSET 338
+#define BEXT_VERSION_OFFSET 346
+
+// The WAVE format code for PCM
+#define WAVE_FORMAT_PCM 1
+
+/* ----------------------------------------------------------------
+ * STATIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Set a little-endian 16 bit value
+static void setLe16(char * pBuf, int value)
+{
+    pBuf[0] = (char) value;
+    pBuf[1] = (char) (value >> 8);
+}
+
+// Set a little-endian 32 bit value
+static void setLe32(char * pBuf, uint32_t value)
+{
+    setLe16(pBuf, (int) (value & 0xFFFF));
+    setLe16(pBuf + 2, (int) (value >> 16));
+}
+
+// Start a chunk, returning a pointer to its body
+static char * setChunk(char * pBuf, const char * pId, uint32_t size)
+{
+    memcpy(pBuf, pId, 4);
+    setLe32(pBuf + 4, size);
+
+    return pBuf + 8;
+}
+
+/* ----------------------------------------------------------------
+ * PUBLIC FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Pack samples as 24 bit PCM
+void wavPack24(const int32_t * pSamples, int numSamples, char * pPcm)
+{
+    for (int x = 0; x < numSamples; x++) {
+        *pPcm++ = (char) pSamples[x];
+        *pPcm++ = (char) (pSamples[x] >> 8);
+        *pPcm++ = (char) (pSamples[x] >> 16);
+    }
+}
+
+// Constructor
+WavWriter::WavWriter()
+{
+    _pFile = NULL;
+    _sampleRate = 0;
+    _bitsPerSample = 0;
+    _numChannels = 0;
+    _updateBytes = 0;
+    _originator[0] = 0;
+    _started = false;
+    _firstTimestampUs = 0;
+    _firstSequenceNumber = 0;
+    _numBytes = 0;
+    _numBytesAtUpdate = 0;
+    _numHeaderWrites = 0;
+}
+
+// Start a file
+bool WavWriter::open(const char * pFileName, int sampleRate, int bitsPerSample, int numChannels,
+                     uint32_t updateBytes, const char * pOriginator)
+{
+    close();
+
+    _sampleRate = sampleRate;
+    _bitsPerSample = bitsPerSample;
+    _numChannels = numChannels;
+    _updateBytes = updateBytes;
+    // Not necessarily terminated: the bext field needn't be
+    strncpy(_originator, (pOriginator != NULL) ? pOriginator : "", sizeof(_originator));
+    _started = false;
+    _firstTimestampUs = 0;
+    _firstSequenceNumber = 0;
+    _numBytes = 0;
+    _numBytesAtUpdate = 0;
+    _numHeaderWrites = 0;
+
+    _pFile = fopen(pFileName, "wb+");
+    if ((_pFile != NULL) && !writeHeader(false)) {
+        fclose(_pFile);
+        _pFile = NULL;
+    }
+
+    return (_pFile != NULL);
+}
+
+// Write the header a last time and close the file
+bool WavWriter::close()
+{
+    bool success = true;
+
+    if (_pFile != NULL) {
+        // A chunk must be an even number of bytes long
+        if ((_numBytes & 1) && (fputc(0, _pFile) == EOF)) {
+            success = false;
+        }
+        if (!writeHeader(false)) {
+            success = false;
+        }
+        if (fclose(_pFile) != 0) {
+            success = false;
+        }
+        _pFile = NULL;
+    }
+
+    return success;
+}
+
+// True if a file is open
+bool WavWriter::isOpen()
+{
+    return (_pFile != NULL);
+}
+
+// Write some audio
+bool WavWriter::write(const char * pBuf, int size, uint64_t timestampUs, int sequenceNumber)
+{
+    size_t count;
+    bool success;
+
+    if ((_pFile == NULL) || (size <= 0) || ((uint32_t) size > WAV_MAX_DATA_SIZE - _numBytes)) {
+        return false;
+    }
+
+    if (!_started) {
+        _started = true;
+        _firstTimestampUs = timestampUs;
+        _firstSequenceNumber = sequenceNumber;
+    }
+
+    count = fwrite(pBuf, 1, size, _pFile);
+    _numBytes += count;
+    success = (count == (size_t) size);
+
+    // Only now and then does the header catch up
+    if ((_updateBytes > 0) && (_numBytes - _numBytesAtUpdate >= _updateBytes) && !writeHeader(true)) {
+        success = false;
+    }
+
+    return success;
+}
+
+// Get the number of bytes of audio written
+uint32_t WavWriter::getNumBytes()
+{
+    return _numBytes;
+}
+
+// Get the number of times the header has been written
+unsigned int WavWriter::getNumHeaderWrites()
+{
+    return _numHeaderWrites;
+}
+
+/* ----------------------------------------------------------------
+ * PROTECTED FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Write the header
+bool WavWriter::writeHeader(bool seekBack)
+{
+    char * pBody;
+    int blockAlign = _numChannels * ((_bitsPerSample + 7) / 8);
+    uint64_t timeReference = _firstTimestampUs * _sampleRate / 1000000;
+    time_t now = time(NULL);
+    struct tm * pTm = gmtime(&now);
+    char text[BEXT_DESCRIPTION_SIZE];
+    bool success;
+
+    memset(_header, 0, WAV_HEADER_SIZE);
+    pBody = setChunk(_header + RIFF_OFFSET, "RIFF", WAV_HEADER_SIZE - 8 + _numBytes + (_numBytes & 1));
+    memcpy(pBody, "WAVE", 4);
+
+    pBody = setChunk(_header + BEXT_OFFSET, "bext", WAV_BEXT_SIZE);
+    if (_started) {
+        snprintf(text, sizeof(text), "First sample captured at %lu.%06lu s, URTP sequence number %d.",
+                 (unsigned long) (_firstTimestampUs / 1000000), (unsigned long) (_firstTimestampUs % 1000000),
+                 _firstSequenceNumber);
+        memcpy(pBody + BEXT_DESCRIPTION_OFFSET, text, strlen(text));
+    }
+    memcpy(pBody + BEXT_ORIGINATOR_OFFSET, _originator, sizeof(_originator));
+    if (pTm != NULL) {
+        snprintf(text, sizeof(text), "%04d-%02d-%02d%02d:%02d:%02d", pTm->tm_year + 1900, pTm->tm_mon + 1,
+                 pTm->tm_mday, pTm->tm_hour, pTm->tm_min, pTm->tm_sec);
+        memcpy(pBody + BEXT_ORIGINATION_DATE_OFFSET, text, 18);
+    }
+    setLe32(pBody + BEXT_TIME_REFERENCE_OFFSET, (uint32_t) timeReference);
+    setLe32(pBody + BEXT_TIME_REFERENCE_OFFSET + 4, (uint32_t) (timeReference >> 32));
+    setLe16(pBody + BEXT_VERSION_OFFSET, 1);
+
+    pBody = setChunk(_header + FMT_OFFSET, "fmt ", FMT_SIZE);
+    setLe16(pBody, WAVE_FORMAT_PCM);
+    setLe16(pBody + 2, _numChannels);
+    setLe32(pBody + 4, (uint32_t) _sampleRate);
+    setLe32(pBody + 8, (uint32_t) (_sampleRate * blockAlign));
+    setLe16(pBody + 12, blockAlign);
+    setLe16(pBody + 14, _bitsPerSample);
+
+    setChunk(_header + JUNK_OFFSET, "JUNK", DATA_OFFSET - JUNK_OFFSET - 8);
+    setChunk(_header + DATA_OFFSET, "data", _numBytes);
+
+    success = (fseek(_pFile, 0, SEEK_SET) == 0) &&
+              (fwrite(_header, 1, WAV_HEADER_SIZE, _pFile) == WAV_HEADER_SIZE) &&
+              (!seekBack || (fseek(_pFile, 0, SEEK_END) == 0));
+    _numBytesAtUpdate = _numBytes;
+    _numHeaderWrites++;
+
+    return success;
+}
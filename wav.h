@@ -0,0 +1,121 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Writing of PCM audio as a Broadcast WAV file (EBU Tech 3285), so
+ * that a recording can be played or edited with standard tools.
+ *
+ * The header is a fixed WAV_HEADER_SIZE bytes: the RIFF header, a bext
+ * chunk, the fmt chunk, a JUNK chunk to pad it out and the header of
+ * the data chunk, so the audio starts on a sector boundary and writes
+ * of whole sectors stay whole sectors on the card.  The bext chunk
+ * carries the capture timestamp of the first sample: its time
+ * reference is that timestamp in samples and its description gives it
+ * in full, with the URTP sequence number.
+ *
+ * A WAV header holds the length of the audio, which isn't known until
+ * the end, so the header is written when the file is opened and then
+ * written again in place only every so many bytes of audio and on
+ * close; between times writes are of audio alone.  A file that isn't
+ * closed is still readable, up to the last update.
+ *
+ * Only stdio is used, so this works on any file system (or on a host).
+ */
+
+#ifndef _WAV_H_
+#define _WAV_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* ----------------------------------------------------------------
+ * COMPILE-TIME MACROS
+ * -------------------------------------------------------------- */
+
+// The size of the header, a whole number of sectors
+#define WAV_HEADER_SIZE 1024
+
+// The size of a bext chunk without coding history
+#define WAV_BEXT_SIZE 602
+
+// The size of the originator field of the bext chunk
+#define WAV_BEXT_ORIGINATOR_SIZE 32
+
+// The most audio a RIFF file can hold after the header
+#define WAV_MAX_DATA_SIZE (0xFFFFFFFFUL - WAV_HEADER_SIZE)
+
+/* ----------------------------------------------------------------
+ * FUNCTIONS
+ * -------------------------------------------------------------- */
+
+// Pack numSamples samples into 24 bit little-endian PCM at pPcm,
+// which must have room for numSamples * 3 bytes
+void wavPack24(const int32_t * pSamples, int numSamples, char * pPcm);
+
+/* ----------------------------------------------------------------
+ * CLASSES
+ * -------------------------------------------------------------- */
+
+class WavWriter {
+public:
+    WavWriter();
+
+    // Start a file of numChannels channels of bitsPerSample bit
+    // samples at sampleRate, the header being written again after
+    // every updateBytes of audio (0 for only on close); pOriginator
+    // goes in the bext chunk
+    bool open(const char * pFileName, int sampleRate, int bitsPerSample, int numChannels,
+              uint32_t updateBytes, const char * pOriginator);
+
+    // Write the header a last time and close the file
+    bool close();
+
+    // True if a file is open
+    bool isOpen();
+
+    // Write size bytes of audio, the first sample of which has the
+    // given capture timestamp and URTP sequence number (only those of
+    // the first write are kept)
+    bool write(const char * pBuf, int size, uint64_t timestampUs, int sequenceNumber);
+
+    // Get the number of bytes of audio written
+    uint32_t getNumBytes();
+
+    // Get the number of times the header has been written
+    unsigned int getNumHeaderWrites();
+
+protected:
+    // Write the header at the start of the file, coming back
+    // to the end if seekBack
+    bool writeHeader(bool seekBack);
+
+    // The header is put together here rather than on the
+    // stack of whichever task is writing
+    char _header[WAV_HEADER_SIZE];
+    FILE * _pFile;
+    int _sampleRate;
+    int _bitsPerSample;
+    int _numChannels;
+    uint32_t _updateBytes;
+    char _originator[WAV_BEXT_ORIGINATOR_SIZE];
+    bool _started;
+    uint64_t _firstTimestampUs;
+    int _firstSequenceNumber;
+    uint32_t _numBytes;
+    uint32_t _numBytesAtUpdate;
+    unsigned int _numHeaderWrites;
+};
+
+#endif // _WAV_H_